@@ -19,6 +19,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "can.h"
+#include "dma.h"
 #include "spi.h"
 #include "tim.h"
 #include "gpio.h"
@@ -27,6 +28,10 @@
 /* USER CODE BEGIN Includes */
 #include "seven_seg.h"
 #include "buttons.h"
+#include "can_std.h"
+#include "can_codec.h"
+#include "can_sched.h"
+#include "can_stats.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -49,10 +54,6 @@
 /* USER CODE BEGIN PV */
 Seven_Seg *seven_seg;
 uint8_t num;
-
-CAN_TxHeaderTypeDef   TxHeader;
-uint8_t               TxData[8];
-uint32_t              TxMailbox;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -63,26 +64,11 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
-void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) {
-  HAL_GPIO_WritePin(DEBUG_INDICATOR_1_GPIO_Port, DEBUG_INDICATOR_1_Pin, GPIO_PIN_SET);
-}
-
-
 void Button_0_Handler(GPIO_PinState state) {
   if (state == GPIO_PIN_RESET) {
       Seven_Seg_Write_Integer(seven_seg, ++num);
-        TxHeader.IDE = CAN_ID_STD;
-        TxHeader.StdId = 0x5a5;
-        TxHeader.RTR = CAN_RTR_DATA;
-        TxHeader.DLC = 2;
-
-        TxData[0] = 50;
-        TxData[1] = 0xAA;
-        if (HAL_CAN_AddTxMessage(&hcan1, &TxHeader, TxData, &TxMailbox) != HAL_OK) {
-          HAL_GPIO_WritePin(DEBUG_INDICATOR_0_GPIO_Port, DEBUG_INDICATOR_0_Pin, GPIO_PIN_SET);
-        }
 
-        HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_9);
+      HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_9);
 
   }
 }
@@ -92,6 +78,15 @@ void Button_1_Handler(GPIO_PinState state) {
       __NOP();
   }
 }
+
+uint8_t Dash_Status_Producer(uint8_t *data, void *context) {
+  CAN_Msg_Dash_Status_Set_Button_Count_Raw(data, num);
+  return 1;
+}
+
+void Motor_Status_Handler(const CAN_Std_Frame *frame, void *context) {
+  HAL_GPIO_TogglePin(DEBUG_INDICATOR_1_GPIO_Port, DEBUG_INDICATOR_1_Pin);
+}
 /* USER CODE END 0 */
 
 /**
@@ -123,14 +118,26 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_TIM3_Init();
   MX_SPI1_Init();
   MX_CAN1_Init();
+  MX_TIM7_Init();
   /* USER CODE BEGIN 2 */
+  CAN_Std_RX_Register(CAN_MSG_Motor_Status, Motor_Status_Handler, NULL);
+  CAN_Std_RX_Init(&hcan1);
+  CAN_Std_TX_Init(&hcan1);
   HAL_CAN_Start(&hcan1);
   HAL_GPIO_WritePin(CAN1_STBY_GPIO_Port, CAN1_STBY_Pin, GPIO_PIN_RESET);
 
-  Shift_Reg *shift_reg = Shift_Reg_SPI_SW_NSS_Init(&hspi1, DEBUG_CS_GPIO_Port, DEBUG_CS_Pin);
+  CAN_Sched_Init(&htim7);
+  if (CAN_SCHED_REGISTER_MSG(Dash_Status, Dash_Status_Producer, NULL) == NULL) {
+      HAL_GPIO_WritePin(DEBUG_INDICATOR_0_GPIO_Port, DEBUG_INDICATOR_0_Pin, GPIO_PIN_SET);
+  }
+  CAN_Stats_Init(&hcan1, CAN_MSG_Dash_Diag, CAN_MSG_Dash_Diag_PERIOD);
+  CAN_Sched_Start();
+
+  Shift_Reg *shift_reg = Shift_Reg_SPI_DMA_Init(&hspi1, DEBUG_CS_GPIO_Port, DEBUG_CS_Pin, 2);
 
   seven_seg = Seven_Seg_Init(shift_reg);
   num = 0;
@@ -162,7 +169,7 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
-      __NOP();
+      CAN_Std_RX_Dispatch(8);
   }
   /* USER CODE END 3 */
 }
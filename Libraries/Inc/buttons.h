@@ -13,9 +13,13 @@
  *        purpose of debouncing.
  *      - In your NVIC, ensure that 'TIMx global interrupt' is enabled
  *		  - This timer should not be used for other purposes
+ *      - The timer ticks every 1 ms, only while a button is settling, or
+ *        all the time if there are button ports
  *    2. INIT:
  *      - Ensure you initialize your buttons according to Usage
  *    3. EXTI:
+ *      - Button ports are polled, and need none of this; set their pins as
+ *        GPIO inputs
  *      - Set the buttons you want to handle as EXTI pins
  *      - ensure that the EXTI triggers on both the rising
  *        and falling edge
@@ -44,22 +48,72 @@
  *         Debug_Button_1_Handler);
  *     Init_Button( ... );
  *     Init_Button( ... );
+ *
+ *     // a switch which chatters more than the others gets a longer time
+ *     Button *ignition = Init_Button( ... );
+ *     Button_Set_Debounce(ignition, 120);
+ *
+ *     // or poll a whole port of switches, with no EXTI lines
+ *     void Dash_Switches_Handler(uint16_t changed, uint16_t state) {
+ *        if (changed & GPIO_PIN_3) { ... (state & GPIO_PIN_3) ... }
+ *      }
+ *     Init_Button_Port(GPIOE, 0x00FF, 5, Dash_Switches_Handler);  // 20 ms debounce
+ *
  *    Init_Button_Finish();
  *    // ...
  *
+ * Principle of Operation:
+ *    Each button is debounced on its own. An edge marks only that button
+ *    as settling, and starts a shared 1 ms tick if it is not already
+ *    running. Each tick, a settling button's integrator counts up while
+ *    the pin differs from the button's state, and down while it matches.
+ *    Reaching the button's debounce time changes the state and calls the
+ *    callback; decaying to zero means it bounced back. Once no button is
+ *    settling, the tick stops.
+ *
+ *    So a clean press is reported after exactly the button's debounce
+ *    time, whatever the other buttons are doing, and a switch which
+ *    chatters only delays itself.
+ *
+ *    A button port is instead scanned every scan_time, reading the port
+ *    once. Each pin has a two bit vertical counter, held as two masks
+ *    (bit 0 of every pin's count, and bit 1), so all 16 pins count at once
+ *    in a few bitwise operations, however many switches there are:
+ *
+ *      delta   = (IDR ^ state) & pins      // pins differing from their state
+ *      count1  = (count1 ^ count0) & delta // count up, reset where equal
+ *      count0  = ~count0 & delta
+ *      changed = delta & ~(count0 | count1)  // wrapped: 4 scans differing
+ *      state  ^= changed
+ *
  */
 #include "stm32f4xx.h"
 
 /* Definitions */
 typedef void (*button_callback_t)(GPIO_PinState state);
+typedef void (*button_port_callback_t)(uint16_t changed, uint16_t state);
 
 typedef struct {
   GPIO_TypeDef *Port;
   uint16_t Pin;
   button_callback_t callback;
-  GPIO_PinState last_state;
+  GPIO_PinState last_state;         // the debounced state
+  uint16_t debounce_ticks;          // ticks the pin must differ to change state
+  uint16_t integrator;              // ticks (net) the pin has differed
+  volatile uint8_t settling;        // 1 from an edge until the integrator settles
 } Button;
 
+typedef struct {
+  GPIO_TypeDef *Port;
+  uint16_t pins;                    // mask of the pins debounced
+  button_port_callback_t callback;
+  uint16_t state;                   // the debounced state of each pin
+  uint16_t count0;                  // bit 0 of each pin's vertical counter
+  uint16_t count1;                  // bit 1 of each pin's vertical counter
+  uint8_t scan_ticks;               // ticks between scans
+  uint8_t ticks;                    // ticks since the last scan
+} Button_Port;
+
 
 /* Functions */
 
@@ -67,7 +121,8 @@ typedef struct {
  * Initializes button registration, allows for individual buttons to be initialized
  *
  * @param htim pointer to the timer handler used for debouncing
- * @param debounce_time wait time for button pattern to settle, in ms
+ * @param debounce_time the debounce time of each button, unless set with
+ *                      Button_Set_Debounce, in ms
  *
  * @error returns HAL_StatusTypeDef
  *
@@ -90,7 +145,40 @@ HAL_StatusTypeDef Init_Button_Begin();
 Button *Init_Button(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState init_state, button_callback_t cb);
 
 /**
- * Finishes initialization of buttons.
+ * Initializes a port of polled buttons, debounced together without EXTI.
+ * Every scan_time the port is read once, and a pin changes state after
+ * four scans in a row differ from it, so the debounce time is
+ * 4 * scan_time.
+ *
+ * @param port       the GPIO port of the buttons
+ * @param pins       the mask of the pins to debounce (GPIO_PIN_x | ...);
+ *                   they should not also be EXTI buttons
+ * @param scan_time  the time between scans, in ms (1 to 255)
+ * @param cb         called with the mask of the pins which changed, and
+ *                   the debounced state of every pin in the mask
+ *
+ * @error returns NULL
+ *
+ * @retval a reference to the button port if there was no errors, NULL otherwise
+ */
+Button_Port *Init_Button_Port(GPIO_TypeDef *port, uint16_t pins, uint8_t scan_time, button_port_callback_t cb);
+
+/**
+ * Sets the debounce time of a button, for a switch which bounces more or
+ * less than the others.
+ *
+ * @param button         the button returned by Init_Button
+ * @param debounce_time  the time the pin must hold a new state, in ms
+ *
+ * @error returns HAL_ERROR if the time is under 1 ms
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Button_Set_Debounce(Button *button, uint16_t debounce_time);
+
+/**
+ * Finishes initialization of buttons. Starts scanning the button ports,
+ * if there are any.
  *
  * @error returns HAL_StatusTypeDef
  *
@@ -100,7 +188,7 @@ HAL_StatusTypeDef Init_Button_Finish();
 
 /**
  * Given an EXTI pin trigger, if the pin is associated with a registered button,
- * reset the button timer.
+ * mark the button as settling, and start the button timer if it is stopped.
  *
  * Intended to be called from HAL_GPIO_EXTI_Callback
  *
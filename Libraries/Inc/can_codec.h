@@ -0,0 +1,256 @@
+/*
+ * can_codec.h
+ *
+ * Pack/unpack functions and a receive dispatch table generated from the
+ * message catalog in can_msgs.h.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. PAYLOADS:
+ *      - Every function reads or writes a full 8-byte payload, so data must
+ *        always point to 8 bytes (e.g. CAN_Std_Frame.data), even if the
+ *        message DLC is shorter
+ *    2. IDS:
+ *      - Two messages with the same ID fail to compile ("duplicate case value")
+ *    3. DISPATCH:
+ *      - A CAN_Codec_RX_Table is referenced by the receive path, not copied,
+ *        so declare it static
+ *
+ * Principle of Operation:
+ *    Every signal has its bit position, length, byte order and type known at
+ *    compile time. Each accessor loads the payload as one 64-bit word (byte
+ *    swapped for big endian signals), then shifts and masks it by constants.
+ *    All of the functions are forced inline, so after constant folding a
+ *    getter is a load plus a bitfield extract (UBFX/SBFX), and a setter is a
+ *    bitfield insert (BFI), with no branches or loops.
+ *
+ *    For every message <M> in CAN_MSG_LIST, this generates:
+ *      CAN_MSG_<M>                     the message ID
+ *      CAN_MSG_<M>_DLC                 the message length, in bytes
+ *      CAN_MSG_<M>_PERIOD              the transmit period, in ms
+ *      CAN_Msg_<M>                     a struct of the raw signal values
+ *      CAN_Msg_<M>_Pack(data, msg)     writes every signal into a payload
+ *      CAN_Msg_<M>_Unpack(data, msg)   reads every signal from a payload
+ *
+ *    and for every signal <S> of <M>:
+ *      CAN_Msg_<M>_Get_<S>_Raw(data)         the raw value
+ *      CAN_Msg_<M>_Set_<S>_Raw(data, raw)
+ *      CAN_Msg_<M>_Get_<S>(data)             the physical value (float)
+ *      CAN_Msg_<M>_Set_<S>(data, value)
+ *
+ *    The receive dispatch table, CAN_Codec_RX_Table, has one handler member
+ *    per message, named after it. CAN_Codec_RX_Register registers each
+ *    message with a handler through CAN_Std_RX_Register, behind a generated
+ *    CAN_Std_Handler which unpacks the frame into CAN_Msg_<M>, so
+ *    CAN_Std_RX_Dispatch goes from the frame's filter match straight to the
+ *    unpacked message, with no ID comparison.
+ *
+ * Usage:
+ *
+ *      #import "can_codec.h"
+ *
+ *      // ...
+ *
+ *      // decode straight out of a received frame
+ *      if (frame.id == CAN_MSG_Motor_Status) {
+ *          int16_t rpm = CAN_Msg_Motor_Status_Get_Motor_Speed_Raw(frame.data);
+ *          float torque = CAN_Msg_Motor_Status_Get_Motor_Torque(frame.data);
+ *      }
+ *
+ *      // encode a frame
+ *      uint8_t data[8] = { 0 };
+ *      CAN_Msg_Dash_Status_Set_Button_Count_Raw(data, 5);
+ *      CAN_Std_TX_Send(CAN_MSG_Dash_Status, data, CAN_MSG_Dash_Status_DLC);
+ *
+ *      // or receive through the dispatch table
+ *      void Motor_Status_Handler(const CAN_Msg_Motor_Status *msg, void *context) {
+ *          rpm = msg->Motor_Speed;
+ *      }
+ *
+ *      static const CAN_Codec_RX_Table rx_table = {
+ *          .Motor_Status = Motor_Status_Handler,
+ *          .Steer_Angle  = Steer_Angle_Handler,
+ *          .context      = &dash,
+ *      };
+ *      CAN_Codec_RX_Register(&rx_table);
+ *      CAN_Std_RX_Init(&hcan1);
+ *
+ *      // ...
+ *
+ *      while (1) {
+ *          CAN_Std_RX_Dispatch(8);
+ *      }
+ */
+
+#ifndef INC_CAN_CODEC_H_
+#define INC_CAN_CODEC_H_
+
+#include "can_msgs.h"
+#include <string.h>
+
+/* Generic accessors; every argument but data is expected to be a constant */
+
+/**
+ * @retval the position of the signal LSB within the (byte order adjusted) payload word
+ */
+__STATIC_FORCEINLINE uint32_t CAN_Codec_Shift(uint32_t start, uint32_t length, uint32_t order) {
+  if (order == CAN_MSG_LE) {
+      return start;
+  }
+  return (7 - start / 8) * 8 + start % 8 - (length - 1);
+}
+
+__STATIC_FORCEINLINE uint64_t CAN_Codec_Load(const uint8_t *data, uint32_t order) {
+  uint64_t word;
+  memcpy(&word, data, sizeof(word));
+  return (order == CAN_MSG_LE) ? word : __builtin_bswap64(word);
+}
+
+__STATIC_FORCEINLINE void CAN_Codec_Store(uint8_t *data, uint64_t word, uint32_t order) {
+  word = (order == CAN_MSG_LE) ? word : __builtin_bswap64(word);
+  memcpy(data, &word, sizeof(word));
+}
+
+__STATIC_FORCEINLINE uint32_t CAN_Codec_Get(const uint8_t *data, uint32_t start, uint32_t length,
+                                            uint32_t order, uint32_t is_signed) {
+  uint64_t word = CAN_Codec_Load(data, order);
+  uint32_t raw = (uint32_t)(word >> CAN_Codec_Shift(start, length, order));
+
+  // move the signal to the top of the word, then shift it back down,
+  // which masks (unsigned) or sign-extends (signed) it
+  raw <<= 32 - length;
+  if (is_signed) {
+      return (uint32_t)((int32_t)raw >> (32 - length));
+  }
+  return raw >> (32 - length);
+}
+
+__STATIC_FORCEINLINE void CAN_Codec_Set(uint8_t *data, uint32_t start, uint32_t length,
+                                        uint32_t order, uint32_t raw) {
+  uint32_t shift = CAN_Codec_Shift(start, length, order);
+  uint64_t mask = ((length < 32) ? ((1ULL << length) - 1) : 0xFFFFFFFFULL) << shift;
+
+  uint64_t word = CAN_Codec_Load(data, order);
+  word = (word & ~mask) | (((uint64_t)raw << shift) & mask);
+  CAN_Codec_Store(data, word, order);
+}
+
+__STATIC_FORCEINLINE int32_t CAN_Codec_Round(float value) {
+  return (int32_t)(value + ((value < 0.0f) ? -0.5f : 0.5f));
+}
+
+/* Code generation */
+
+#define CAN_CODEC_IS_SIGNED(type) (((type)-1) < 0)
+
+// message ID, length and period constants
+#define CAN_CODEC_ID(name, id, dlc, period)     CAN_MSG_##name = (id),
+#define CAN_CODEC_DLC(name, id, dlc, period)    CAN_MSG_##name##_DLC = (dlc),
+#define CAN_CODEC_PERIOD(name, id, dlc, period) CAN_MSG_##name##_PERIOD = (period),
+
+typedef enum { CAN_MSG_LIST(CAN_CODEC_ID) } CAN_Msg_ID;
+enum { CAN_MSG_LIST(CAN_CODEC_DLC) };
+enum { CAN_MSG_LIST(CAN_CODEC_PERIOD) };
+
+// a duplicate ID is a duplicate case label, which is a compile error
+#define CAN_CODEC_CASE(name, id, dlc, period)   case (id):
+static inline void CAN_Codec_Check_Unique_IDs(uint32_t id) {
+  switch (id) {
+    CAN_MSG_LIST(CAN_CODEC_CASE)
+    default:
+      break;
+  }
+}
+
+// per-signal accessors
+#define CAN_CODEC_SIGNAL(msg, sig, start, length, order, type, scale, offset)                   \
+  __STATIC_FORCEINLINE type CAN_Msg_##msg##_Get_##sig##_Raw(const uint8_t *data) {               \
+    return (type)CAN_Codec_Get(data, start, length, order, CAN_CODEC_IS_SIGNED(type));           \
+  }                                                                                              \
+  __STATIC_FORCEINLINE void CAN_Msg_##msg##_Set_##sig##_Raw(uint8_t *data, type raw) {           \
+    CAN_Codec_Set(data, start, length, order, (uint32_t)raw);                                    \
+  }                                                                                              \
+  __STATIC_FORCEINLINE float CAN_Msg_##msg##_Get_##sig(const uint8_t *data) {                    \
+    return (float)CAN_Msg_##msg##_Get_##sig##_Raw(data) * (scale) + (offset);                    \
+  }                                                                                              \
+  __STATIC_FORCEINLINE void CAN_Msg_##msg##_Set_##sig(uint8_t *data, float value) {              \
+    CAN_Msg_##msg##_Set_##sig##_Raw(data, (type)CAN_Codec_Round((value - (offset)) / (scale)));  \
+  }
+
+#define CAN_CODEC_FIELD(msg, sig, start, length, order, type, scale, offset) type sig;
+#define CAN_CODEC_PACK(msg, sig, start, length, order, type, scale, offset)   \
+    CAN_Msg_##msg##_Set_##sig##_Raw(data, m->sig);
+#define CAN_CODEC_UNPACK(msg, sig, start, length, order, type, scale, offset) \
+    m->sig = CAN_Msg_##msg##_Get_##sig##_Raw(data);
+
+// per-message struct and whole-message pack/unpack
+#define CAN_CODEC_MESSAGE(name, id, dlc, period)                                      \
+  CAN_SIGNALS_##name(CAN_CODEC_SIGNAL, name)                                          \
+  typedef struct { CAN_SIGNALS_##name(CAN_CODEC_FIELD, name) } CAN_Msg_##name;        \
+  __STATIC_FORCEINLINE void CAN_Msg_##name##_Pack(uint8_t *data, const CAN_Msg_##name *m) { \
+    memset(data, 0, 8);                                                               \
+    CAN_SIGNALS_##name(CAN_CODEC_PACK, name)                                          \
+  }                                                                                   \
+  __STATIC_FORCEINLINE void CAN_Msg_##name##_Unpack(const uint8_t *data, CAN_Msg_##name *m) { \
+    CAN_SIGNALS_##name(CAN_CODEC_UNPACK, name)                                        \
+  }
+
+CAN_MSG_LIST(CAN_CODEC_MESSAGE)
+
+/* Receive dispatch */
+
+#ifdef HAL_CAN_MODULE_ENABLED
+
+// per-message receive handler, given the unpacked message
+#define CAN_CODEC_HANDLER_TYPE(name, id, dlc, period) \
+  typedef void (*CAN_Msg_##name##_Handler)(const CAN_Msg_##name *msg, void *context);
+CAN_MSG_LIST(CAN_CODEC_HANDLER_TYPE)
+
+// one handler per catalog message, NULL for the messages not received
+#define CAN_CODEC_HANDLER_FIELD(name, id, dlc, period) CAN_Msg_##name##_Handler name;
+typedef struct {
+  CAN_MSG_LIST(CAN_CODEC_HANDLER_FIELD)
+  void *context;                // passed to every handler
+} CAN_Codec_RX_Table;
+
+// CAN_Std_Handler of each message: unpacks the frame and calls the table's handler
+#define CAN_CODEC_RX_HANDLER(name, id, msg_dlc, period)                              \
+  static inline void CAN_Codec_RX_##name(const CAN_Std_Frame *frame, void *context) { \
+    const CAN_Codec_RX_Table *table = (const CAN_Codec_RX_Table *)context;          \
+    CAN_Msg_##name msg;                                                             \
+    if (frame->dlc < (msg_dlc)) {                                                   \
+        return;                                                                     \
+    }                                                                               \
+    CAN_Msg_##name##_Unpack(frame->data, &msg);                                     \
+    table->name(&msg, table->context);                                              \
+  }
+CAN_MSG_LIST(CAN_CODEC_RX_HANDLER)
+
+#define CAN_CODEC_RX_REGISTER(name, id, dlc, period)                                  \
+  if (table->name != NULL &&                                                        \
+      CAN_Std_RX_Register((id), CAN_Codec_RX_##name, (void *)table) != HAL_OK) {    \
+      return HAL_ERROR;                                                             \
+  }
+
+/**
+ * Registers every message with a handler in the table with
+ * CAN_Std_RX_Register, so CAN_Std_RX_Dispatch unpacks each received frame
+ * and calls its message's handler. Frames shorter than the message DLC are
+ * ignored. Must be called before CAN_Std_RX_Init.
+ *
+ * @param table  the handlers, which must outlive the receive path (e.g. static const)
+ *
+ * @error returns HAL_ERROR on the first message which fails to register
+ *
+ * @retval the status of the operation
+ */
+static inline HAL_StatusTypeDef CAN_Codec_RX_Register(const CAN_Codec_RX_Table *table) {
+  CAN_MSG_LIST(CAN_CODEC_RX_REGISTER)
+  return HAL_OK;
+}
+
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
+
+#endif /* INC_CAN_CODEC_H_ */
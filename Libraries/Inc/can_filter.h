@@ -0,0 +1,181 @@
+/*
+ * can_filter.h
+ *
+ * bxCAN hardware filter bank allocator for the Caltech Racing CAN standard.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. INIT:
+ *      - Every module must subscribe to its IDs before CAN_Std_RX_Init is
+ *        called, which allocates and applies the filters
+ *      - If nothing subscribes, a single accept-all filter is used
+ *    2. IDS:
+ *      - Only standard (11-bit) data frames are accepted
+ *
+ * Principle of Operation:
+ *    The bxCAN peripheral has 28 filter banks shared by CAN1 and CAN2.
+ *    CAN1 can use at most CAN_FILTER_NUM_BANKS of them. Each bank is either:
+ *      - a list of exact IDs     (16-bit: 4 IDs,   32-bit: 2 IDs)
+ *      - a list of ID/mask pairs (16-bit: 2 pairs, 32-bit: 1 pair)
+ *
+ *    The 16-bit scale holds the full 11-bit standard ID, plus the RTR and IDE
+ *    bits, so for standard IDs it is always at least as exact as the 32-bit
+ *    scale while holding twice the filters. Only the 16-bit scale is used.
+ *
+ *    Subscriptions are collected into a 2048-bit map of the standard ID space.
+ *    Each run of consecutive subscribed IDs is split into aligned power-of-two
+ *    blocks, each of which is exactly one ID/mask pair (a block of one is an
+ *    exact ID). IDs below CAN_FILTER_FIFO1_FIRST_ID (the high priority ones)
+ *    are routed to FIFO0, the rest to FIFO1.
+ *
+ *    Exact IDs are packed four to a list bank, pairs two to a mask bank. If that
+ *    needs more banks than are available, the two filters of the same FIFO
+ *    whose merged mask adds the fewest extra IDs are combined, until it fits.
+ *    Exact subscriptions therefore never false-accept unless the banks run out.
+ *
+ *    The allocation itself does not touch the hardware (only CAN_Filter_Apply
+ *    does), so it is checked on the host by Tools/tests/test_can_filter.c.
+ *
+ * Usage:
+ *
+ *      #import "can_filter.h"
+ *
+ *      // ...
+ *
+ *      CAN_Filter_Subscribe(CAN_ID_TACH);
+ *      CAN_Filter_Subscribe(CAN_ID_STEER);
+ *      CAN_Filter_Subscribe_Range(CAN_ID_AMS, CAN_ID_AMS + 0xF);
+ *
+ *      CAN_Std_RX_Init(&hcan1);  // allocates and applies the filters
+ *
+ *      CAN_Filter_Report report;
+ *      CAN_Filter_Get_Report(&report);
+ */
+
+#ifndef INC_CAN_FILTER_H_
+#define INC_CAN_FILTER_H_
+
+#include "stm32f4xx_hal.h"
+
+/* Definitions */
+
+// number of banks usable by CAN1; the last bank is left for CAN2
+#define CAN_FILTER_NUM_BANKS 27
+
+// IDs at or above this are received into FIFO1, below into FIFO0
+#define CAN_FILTER_FIFO1_FIRST_ID 0x400
+
+// maximum number of ID/mask pairs before merging (per FIFO)
+#define CAN_FILTER_MAX_ELEMENTS 128
+
+#define CAN_FILTER_NUM_FIFOS 2
+
+typedef enum {
+  CAN_Filter_List_Mode,         // four exact 16-bit IDs
+  CAN_Filter_Mask_Mode,         // two 16-bit ID/mask pairs
+} CAN_Filter_Mode;
+
+typedef struct {
+  uint16_t id;                  // standard identifier
+  uint16_t mask;                // bits of id which must match (0x7FF = exact)
+} CAN_Filter_Element;
+
+typedef struct {
+  CAN_Filter_Mode mode;
+  uint8_t fifo;                 // 0 or 1
+  uint8_t first_match_index;    // FilterMatchIndex reported for elements[0]
+  CAN_Filter_Element elements[4]; // list mode uses 4, mask mode uses 2
+} CAN_Filter_Bank;
+
+typedef struct {
+  uint16_t subscribed_ids;      // IDs modules subscribed to
+  uint16_t accepted_ids;        // IDs the filters let through
+  uint16_t false_accepts;       // IDs let through which nobody subscribed to
+  uint16_t false_accept_permille; // false_accepts / accepted_ids, in 1/1000
+  uint8_t  banks_used;          // number of filter banks configured
+  uint8_t  merges;              // number of filters merged to fit the banks
+} CAN_Filter_Report;
+
+/* Functions */
+
+/**
+ * Removes all subscriptions and allocated banks.
+ */
+void CAN_Filter_Reset(void);
+
+/**
+ * Subscribes to a single standard ID.
+ *
+ * @param id  the standard identifier to receive
+ *
+ * @error returns HAL_ERROR if the ID is not a standard ID
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Filter_Subscribe(uint16_t id);
+
+/**
+ * Subscribes to an inclusive range of standard IDs.
+ *
+ * @param first  the first identifier to receive
+ * @param last   the last identifier to receive
+ *
+ * @error returns HAL_ERROR if the range is invalid
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Filter_Subscribe_Range(uint16_t first, uint16_t last);
+
+/**
+ * Packs the subscriptions into filter banks. Does not access the hardware.
+ *
+ * @error returns HAL_ERROR if the subscriptions split into more than
+ *        CAN_FILTER_MAX_ELEMENTS blocks in a FIFO
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Filter_Allocate(void);
+
+/**
+ * @param num_banks  set to the number of allocated banks
+ *
+ * @retval the allocated banks, in hardware bank order
+ */
+const CAN_Filter_Bank *CAN_Filter_Get_Banks(uint8_t *num_banks);
+
+/**
+ * Checks whether the allocated banks accept a standard ID.
+ *
+ * @param id    the standard identifier
+ * @param fifo  set to the FIFO the ID is received into, if accepted (may be NULL)
+ *
+ * @retval 1 if the ID is accepted, 0 otherwise
+ */
+uint8_t CAN_Filter_Accepts(uint16_t id, uint8_t *fifo);
+
+/**
+ * Computes how well the allocated banks match the subscriptions.
+ *
+ * @param report  the structure to fill in
+ */
+void CAN_Filter_Get_Report(CAN_Filter_Report *report);
+
+#ifdef HAL_CAN_MODULE_ENABLED
+/**
+ * Allocates the banks and writes them into the bxCAN filter registers.
+ * With no subscriptions, configures a single accept-all filter into FIFO0.
+ *
+ * Called from CAN_Std_RX_Init.
+ *
+ * @param hcan  the CAN handler whose filters to configure
+ *
+ * @error returns HAL_StatusTypeDef
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Filter_Apply(CAN_HandleTypeDef *hcan);
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
+
+#endif /* INC_CAN_FILTER_H_ */
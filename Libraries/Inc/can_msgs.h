@@ -0,0 +1,115 @@
+/*
+ * can_msgs.h
+ *
+ * Caltech Racing CAN message catalog.
+ *
+ * Declares every message on the car network, and the signals packed into
+ * each one. Nothing here generates code by itself; see can_codec.h for the
+ * pack/unpack functions and receive dispatch table generated from these lists.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * GENERATED by Tools/dbc_to_can_msgs.py from Tools/can_msgs.dbc; do not edit.
+ *
+ * Adding a message:
+ *    1. Add the message to Tools/can_msgs.dbc, with an ID inside the range of
+ *       the sending node (see CAN_ID in can_std.h), and a GenMsgCycleTime
+ *    2. Run python3 Tools/dbc_to_can_msgs.py
+ *
+ * Signal columns:
+ *    start   - DBC start bit. For little endian (Intel) signals, the LSB.
+ *              For big endian (Motorola) signals, the MSB, numbered with
+ *              bit 7 as the MSB of byte 0 (DBC "sawtooth" numbering)
+ *    length  - number of bits, 1 to 32
+ *    order   - CAN_MSG_LE (Intel) or CAN_MSG_BE (Motorola)
+ *    type    - C type of the raw value; signed types are sign-extended
+ *    scale   - physical = raw * scale + offset
+ *    offset
+ */
+
+#ifndef INC_CAN_MSGS_H_
+#define INC_CAN_MSGS_H_
+
+#include "can_std.h"
+
+#define CAN_MSG_LE 0
+#define CAN_MSG_BE 1
+
+/*      name,             id,                   dlc, period (ms) */
+#define CAN_MSG_LIST(MSG) \
+  MSG(AMS_Status,         CAN_ID_AMS + 0x0,     8,   100)  \
+  MSG(AMS_Cells,          CAN_ID_AMS + 0x1,     8,   1000) \
+  MSG(Charger_Status,     CAN_ID_CHARGER + 0x0, 5,   1000) \
+  MSG(Charger_Command,    CAN_ID_CHARGER + 0x1, 5,   1000) \
+  MSG(Motor_Status,       CAN_ID_MOTOR + 0x0,   7,   10)   \
+  MSG(Motor_Command,      CAN_ID_MOTOR + 0x1,   3,   10)   \
+  MSG(Dash_Status,        CAN_ID_DASH + 0x0,    3,   100)  \
+  MSG(Pedal_Status,       CAN_ID_PEDAL + 0x0,   5,   10)   \
+  MSG(Tach_Speeds,        CAN_ID_TACH + 0x0,    8,   10)   \
+  MSG(Steer_Angle,        CAN_ID_STEER + 0x0,   4,   10)   \
+  MSG(Dash_Diag,          CAN_ID_DIAG + 0x0,    8,   10)
+
+/*      message,          signal,             start, length, order,      type,     scale,   offset */
+#define CAN_SIGNALS_AMS_Status(SIG, M) \
+  SIG(M,                  Pack_Voltage,       0,     16,     CAN_MSG_LE, uint16_t, 0.01f,   0.0f)   \
+  SIG(M,                  Pack_Current,       16,    16,     CAN_MSG_LE, int16_t,  0.1f,    0.0f)   \
+  SIG(M,                  State_Of_Charge,    32,    8,      CAN_MSG_LE, uint8_t,  0.5f,    0.0f)   \
+  SIG(M,                  Max_Cell_Temp,      40,    8,      CAN_MSG_LE, int8_t,   1.0f,    0.0f)   \
+  SIG(M,                  Fault_Flags,        48,    16,     CAN_MSG_LE, uint16_t, 1.0f,    0.0f)
+
+#define CAN_SIGNALS_AMS_Cells(SIG, M) \
+  SIG(M,                  Min_Cell_Voltage,   0,     16,     CAN_MSG_LE, uint16_t, 0.001f,  0.0f)   \
+  SIG(M,                  Max_Cell_Voltage,   16,    16,     CAN_MSG_LE, uint16_t, 0.001f,  0.0f)   \
+  SIG(M,                  Min_Cell_Temp,      32,    8,      CAN_MSG_LE, int8_t,   1.0f,    0.0f)   \
+  SIG(M,                  Balancing,          40,    1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Charger_Status(SIG, M) \
+  SIG(M,                  Output_Voltage,     0,     16,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Output_Current,     16,    16,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Status_Flags,       32,    8,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Charger_Command(SIG, M) \
+  SIG(M,                  Max_Voltage,        0,     16,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Max_Current,        16,    16,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Enable,             32,    1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Motor_Status(SIG, M) \
+  SIG(M,                  Motor_Speed,        0,     16,     CAN_MSG_LE, int16_t,  1.0f,    0.0f)   \
+  SIG(M,                  Motor_Torque,       16,    16,     CAN_MSG_LE, int16_t,  0.1f,    0.0f)   \
+  SIG(M,                  DC_Bus_Voltage,     32,    16,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Motor_Temp,         48,    8,      CAN_MSG_LE, uint8_t,  1.0f,    -40.0f)
+
+#define CAN_SIGNALS_Motor_Command(SIG, M) \
+  SIG(M,                  Torque_Request,     0,     16,     CAN_MSG_LE, int16_t,  0.1f,    0.0f)   \
+  SIG(M,                  Direction,          16,    1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)   \
+  SIG(M,                  Enable,             17,    1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Dash_Status(SIG, M) \
+  SIG(M,                  Buttons,            0,     8,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)   \
+  SIG(M,                  Drive_Mode,         8,     4,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)   \
+  SIG(M,                  Button_Count,       16,    8,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Pedal_Status(SIG, M) \
+  SIG(M,                  Throttle,           0,     10,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Brake_Pressure,     16,    16,     CAN_MSG_LE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Implausible,        32,    1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Tach_Speeds(SIG, M) \
+  SIG(M,                  Wheel_Speed_FL,     7,     16,     CAN_MSG_BE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Wheel_Speed_FR,     23,    16,     CAN_MSG_BE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Wheel_Speed_RL,     39,    16,     CAN_MSG_BE, uint16_t, 0.1f,    0.0f)   \
+  SIG(M,                  Wheel_Speed_RR,     55,    16,     CAN_MSG_BE, uint16_t, 0.1f,    0.0f)
+
+#define CAN_SIGNALS_Steer_Angle(SIG, M) \
+  SIG(M,                  Angle,              7,     16,     CAN_MSG_BE, int16_t,  0.1f,    0.0f)   \
+  SIG(M,                  Rate,               23,    16,     CAN_MSG_BE, int16_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Dash_Diag(SIG, M) \
+  SIG(M,                  Described_ID,       0,     11,     CAN_MSG_LE, uint16_t, 1.0f,    0.0f)   \
+  SIG(M,                  Frame_Type,         11,    5,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)   \
+  SIG(M,                  Word_0,             16,    16,     CAN_MSG_LE, uint16_t, 1.0f,    0.0f)   \
+  SIG(M,                  Word_1,             32,    16,     CAN_MSG_LE, uint16_t, 1.0f,    0.0f)   \
+  SIG(M,                  Word_2,             48,    16,     CAN_MSG_LE, uint16_t, 1.0f,    0.0f)
+
+#endif /* INC_CAN_MSGS_H_ */
@@ -0,0 +1,201 @@
+/*
+ * can_sched.h
+ *
+ * Cyclic CAN transmit scheduler.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. TIMERS:
+ *      - In your IOC file, activate a timer to be used for the sole
+ *        purpose of the scheduler (a basic timer such as TIM7 is enough)
+ *      - In your NVIC, ensure that 'TIMx global interrupt' is enabled
+ *    2. INIT:
+ *      - Call CAN_Sched_Init, register every message, then call
+ *        CAN_Sched_Start, after CAN_Std_TX_Init
+ *      - Messages cannot be registered once the scheduler is started
+ *    3. PRODUCERS:
+ *      - Producers are called from the timer interrupt, so they must be short
+ *        and only read state the main loop updates atomically
+ *    4. SETTINGS
+ *      - Ensure that USE_HAL_TIM_REGISTER_CALLBACKS is set to 1U in
+ *        stm32f4xx_hal_conf.h (see buttons.h)
+ *
+ * Principle of Operation:
+ *    The timer interrupts every CAN_SCHED_TICK_MS. Each message counts down
+ *    the ticks until it is due; when it is, its producer fills in the payload
+ *    and the frame is queued with CAN_Std_TX_Send.
+ *
+ *    If every message with the same period started on the same tick, they
+ *    would all be queued at once, filling the three TX mailboxes and delaying
+ *    high priority frames behind them. Instead, CAN_Sched_Start gives each
+ *    message a phase offset, spreading them over the ticks:
+ *      - the load of every tick over the hyperperiod (the least common
+ *        multiple of all periods, capped at CAN_SCHED_MAX_HYPERPERIOD ticks)
+ *        is tracked
+ *      - messages are placed shortest period first (the least freedom)
+ *      - each message gets the offset whose busiest tick is least busy, with
+ *        ties broken by the lowest total load, then the earliest offset
+ *
+ *    Jitter is measured where it shows on the bus: every time a mailbox
+ *    completes, CAN_Std_TX_Mailbox_Callback reports the frame's ID and DWT
+ *    cycle count to CAN_Sched_Record_TX, and the time since the message's
+ *    previous transmission is compared with its nominal period. The largest
+ *    deviation is kept as the message's jitter, so it includes the time
+ *    frames wait in the TX queue and behind full mailboxes, not only the
+ *    timer interrupt's latency. The interval across a period that was
+ *    skipped or dropped is not measured, as it spans two periods.
+ *
+ * Usage:
+ *
+ *      #import "can_sched.h"
+ *
+ *      // ...
+ *
+ *      uint8_t Dash_Status_Producer(uint8_t *data, void *context) {
+ *          CAN_Msg_Dash_Status_Set_Button_Count_Raw(data, num);
+ *          return 1;  // send (0 skips this period)
+ *      }
+ *
+ *      // ...
+ *
+ *      CAN_Std_TX_Init(&hcan1);
+ *      CAN_Sched_Init(&htim7);
+ *      CAN_SCHED_REGISTER_MSG(Dash_Status, Dash_Status_Producer, NULL);
+ *      CAN_Sched_Register(CAN_ID_DASH + 0xF, 2, 1000, Heartbeat_Producer, NULL);
+ *      CAN_Sched_Start();
+ */
+
+#ifndef INC_CAN_SCHED_H_
+#define INC_CAN_SCHED_H_
+
+#include "stm32f4xx_hal.h"
+
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+#if defined(HAL_TIM_MODULE_ENABLED) && defined(HAL_CAN_MODULE_ENABLED)
+
+/* Definitions */
+
+// maximum number of periodic messages
+#define CAN_SCHED_MAX_MESSAGES 32
+
+// timer interrupt period; message periods are in ms, and rounded to this
+#define CAN_SCHED_TICK_MS 1
+
+// longest hyperperiod considered when assigning phase offsets, in ticks
+#define CAN_SCHED_MAX_HYPERPERIOD 1000
+
+/**
+ * Fills in the payload of a periodic message, called from the timer interrupt.
+ *
+ * @param data     the 8 byte payload, zeroed before the call
+ * @param context  the context pointer given when the message was registered
+ *
+ * @retval 1 to send the frame, 0 to skip this period
+ */
+typedef uint8_t (*CAN_Sched_Producer)(uint8_t *data, void *context);
+
+typedef struct {
+  uint32_t sent;          // frames queued for transmission
+  uint32_t skipped;       // periods the producer chose not to send
+  uint32_t dropped;       // frames CAN_Std_TX_Send rejected (queue full)
+  uint32_t max_jitter;    // largest |actual - nominal| time between transmissions, in us
+  uint16_t offset;        // assigned phase offset, in ticks
+} CAN_Sched_Stats;
+
+typedef struct {
+  uint16_t id;
+  uint8_t dlc;
+  uint16_t period;        // in ticks
+  uint16_t countdown;     // ticks until the message is next due
+  CAN_Sched_Producer producer;
+  void *context;
+  uint32_t last_sent;     // cycle count of the last transmission, 0 if none
+  uint32_t transmitted;   // frames reported by CAN_Sched_Record_TX
+  uint32_t gap_before;    // transmitted count of the first frame after a skipped
+                          // or dropped period, whose interval is not measured
+  CAN_Sched_Stats stats;
+} CAN_Sched_Message;
+
+/**
+ * Registers a message from the catalog (see can_codec.h), with its
+ * catalog DLC and period.
+ *
+ * @param name      the message name in CAN_MSG_LIST
+ * @param producer  the CAN_Sched_Producer filling in the payload
+ * @param context   passed to producer (may be NULL)
+ */
+#define CAN_SCHED_REGISTER_MSG(name, producer, context) \
+  CAN_Sched_Register(CAN_MSG_##name, CAN_MSG_##name##_DLC, CAN_MSG_##name##_PERIOD, producer, context)
+
+/* Functions */
+
+/**
+ * Initializes the scheduler timer, and removes all registered messages.
+ *
+ * @param htim  pointer to the timer handler used by the scheduler
+ *
+ * @error returns HAL_StatusTypeDef
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Sched_Init(TIM_HandleTypeDef *htim);
+
+/**
+ * Registers a periodic message. Must be called before CAN_Sched_Start.
+ *
+ * @param id         the standard identifier to send
+ * @param dlc        the number of data bytes
+ * @param period_ms  the transmit period, in ms
+ * @param producer   the function filling in the payload
+ * @param context    passed to producer (may be NULL)
+ *
+ * @error returns NULL if the scheduler is started, full, or the
+ *        arguments are invalid
+ *
+ * @retval the registered message, whose stats can be read
+ */
+CAN_Sched_Message *CAN_Sched_Register(uint16_t id, uint8_t dlc, uint16_t period_ms,
+                                      CAN_Sched_Producer producer, void *context);
+
+/**
+ * Assigns the phase offsets and starts the timer.
+ *
+ * @error returns HAL_StatusTypeDef
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Sched_Start(void);
+
+/**
+ * Stops the timer. CAN_Sched_Start resumes with new phase offsets.
+ *
+ * @error returns HAL_StatusTypeDef
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Sched_Stop(void);
+
+/**
+ * Copies the statistics of a message.
+ *
+ * @param message  the message returned by CAN_Sched_Register
+ * @param stats    the structure to copy the statistics into
+ */
+void CAN_Sched_Get_Stats(const CAN_Sched_Message *message, CAN_Sched_Stats *stats);
+
+/**
+ * Records a transmitted frame, measuring the jitter of the scheduled message
+ * with its ID (if any). Called from CAN_Std_TX_Mailbox_Callback, with
+ * interrupts masked.
+ *
+ * @param id      the standard identifier
+ * @param cycles  the DWT cycle count when the mailbox completed
+ */
+void CAN_Sched_Record_TX(uint16_t id, uint32_t cycles);
+
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && defined(HAL_CAN_MODULE_ENABLED)
+#endif // #if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+#endif /* INC_CAN_SCHED_H_ */
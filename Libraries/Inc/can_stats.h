@@ -0,0 +1,197 @@
+/*
+ * can_stats.h
+ *
+ * CAN bus load, latency and error counter statistics.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. NVIC:
+ *      - In your IOC file, ensure that 'CAN1 SCE interrupt' is enabled,
+ *        otherwise error passive and bus-off events are never seen
+ *    2. INIT:
+ *      - Call CAN_Stats_Init after CAN_Sched_Init, and before CAN_Sched_Start
+ *        (the statistics are published through the scheduler, see can_sched.h)
+ *      - Every node must publish on its own diagnostic ID, since two nodes
+ *        sending different data with the same ID corrupt each other's frames.
+ *        Take the next free ID in the CAN_ID_DIAG range, and declare it in
+ *        Tools/can_msgs.dbc like Dash_Diag, so the generator checks it is unique
+ *      - Enable 'Automatic Bus-Off Management' in your IOC file, otherwise
+ *        the node never leaves bus-off, and only one event is ever counted
+ *    3. CALLBACKS:
+ *      - ensure that CAN_Stats_Error_Callback is called in
+ *        HAL_CAN_ErrorCallback, before CAN_Std_Error_Callback
+ *      (done in hal.c; frames are recorded by can_std.c)
+ *    4. COVERAGE:
+ *      - Only frames this node sends, or which pass its filters, are counted,
+ *        so the bus load is the load of those frames. To see the whole bus,
+ *        leave a node subscribed to nothing (it then accepts every frame)
+ *
+ * Principle of Operation:
+ *    Every received and transmitted frame is recorded from the CAN interrupts:
+ *      - its ID gets a slot (up to CAN_STATS_MAX_IDS), which counts RX and TX
+ *        frames, and for TX, the time from CAN_Std_TX_Send until the frame was
+ *        on the bus, as a histogram of CAN_STATS_LATENCY_BINS bins
+ *      - its worst-case length on the wire (with stuff bits and interframe
+ *        space, 55 + 10 * DLC bits) is added to the bit count
+ *
+ *    The bus load is the bit count over the bits the bus could carry in the
+ *    same time, at the bit rate read back from the bxCAN timing register.
+ *
+ *    The error status interrupts (error warning, error passive, bus-off) are
+ *    counted on each transition into the state. The transmit and receive
+ *    error counters (TEC/REC) are read from the ESR register, keeping their
+ *    maximum.
+ *
+ *    Every period_ms, one diagnostic frame is published, cycling through a
+ *    bus summary, then a count frame and a histogram frame for each ID.
+ *    The per-ID values in each frame are since that ID was last published.
+ *
+ * Diagnostic frames (8 bytes, little endian):
+ *    bytes 0-1: bits 0-10  the ID the frame describes (0 for the summary)
+ *               bits 11-15 the frame type (CAN_Stats_Frame_Type)
+ *
+ *    CAN_Stats_Summary:
+ *      bytes 2-3: bus load since the previous summary, in 0.1 %
+ *      byte 4:    TEC
+ *      byte 5:    REC
+ *      byte 6:    error passive events (saturates at 255)
+ *      byte 7:    bus-off events (saturates at 255)
+ *    CAN_Stats_Counts:
+ *      bytes 2-3: received frames
+ *      bytes 4-5: transmitted frames
+ *      bytes 6-7: worst transmit latency, in us (saturates at 65535)
+ *    CAN_Stats_Histogram:
+ *      bytes 2-7: the latency bins as 6-bit counts (saturating at 63),
+ *                 bin 0 in bits 0-5 of byte 2
+ *
+ * Usage:
+ *
+ *      #import "can_stats.h"
+ *      #import "can_codec.h"
+ *
+ *      // ...
+ *
+ *      CAN_Sched_Init(&htim7);
+ *      CAN_Stats_Init(&hcan1, CAN_MSG_Dash_Diag, CAN_MSG_Dash_Diag_PERIOD);
+ *      CAN_Sched_Start();
+ *
+ *      // ...
+ *
+ *      CAN_Stats_Bus bus;
+ *      CAN_Stats_Get_Bus(&bus);
+ *      if (bus.load_permille > 700) {
+ *          // find the busiest ID with CAN_Stats_Get_ID
+ *      }
+ */
+
+#ifndef INC_CAN_STATS_H_
+#define INC_CAN_STATS_H_
+
+#include "stm32f4xx_hal.h"
+
+#ifdef HAL_CAN_MODULE_ENABLED
+
+/* Definitions */
+
+// maximum number of distinct IDs tracked; frames of further IDs only count
+// towards the bus load
+#define CAN_STATS_MAX_IDS 64
+
+// transmit latency histogram bins: bin 0 is below 64 us, each next bin is
+// twice as wide, and the last bin holds everything from 4096 us up
+#define CAN_STATS_LATENCY_BINS 8
+#define CAN_STATS_LATENCY_BIN0_US 64
+
+typedef enum {
+  CAN_Stats_Summary,
+  CAN_Stats_Counts,
+  CAN_Stats_Histogram,
+} CAN_Stats_Frame_Type;
+
+typedef struct {
+  uint32_t bits;            // worst-case bits of every frame counted
+  uint16_t load_permille;   // bus load over the last summary period, in 0.1 %
+  uint8_t  tec;             // transmit error counter, as of the last update
+  uint8_t  rec;             // receive error counter, as of the last update
+  uint8_t  max_tec;
+  uint8_t  max_rec;
+  uint32_t error_warning;   // transitions into error warning (a counter >= 96)
+  uint32_t error_passive;   // transitions into error passive (a counter >= 128)
+  uint32_t bus_off;         // transitions into bus-off (TEC > 255)
+  uint32_t untracked;       // frames whose ID did not fit in the table
+} CAN_Stats_Bus;
+
+typedef struct {
+  uint16_t id;
+  uint32_t rx;              // frames received
+  uint32_t tx;              // frames transmitted
+  uint32_t max_latency;     // worst transmit latency, in us
+  uint32_t latency[CAN_STATS_LATENCY_BINS]; // transmit latency histogram
+} CAN_Stats_ID;
+
+/* Functions */
+
+/**
+ * Clears the statistics, activates the error status interrupts, and
+ * registers the diagnostic frame with the scheduler.
+ *
+ * @param hcan       the CAN handler to monitor
+ * @param diag_id    the standard ID to publish on, unique to this node
+ * @param period_ms  the time between diagnostic frames
+ *
+ * @error returns HAL_ERROR if the scheduler rejects the diagnostic frame
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Stats_Init(CAN_HandleTypeDef *hcan, uint16_t diag_id, uint16_t period_ms);
+
+/**
+ * Records a received frame. Called from CAN_Std_RX_FIFO_Callback.
+ *
+ * @param id   the standard identifier
+ * @param dlc  the number of data bytes
+ */
+void CAN_Stats_Record_RX(uint16_t id, uint8_t dlc);
+
+/**
+ * Records a transmitted frame. Called from CAN_Std_TX_Mailbox_Callback.
+ *
+ * @param id          the standard identifier
+ * @param dlc         the number of data bytes
+ * @param latency_us  the time from CAN_Std_TX_Send to transmission, in us
+ */
+void CAN_Stats_Record_TX(uint16_t id, uint8_t dlc, uint32_t latency_us);
+
+/**
+ * Counts error state transitions and updates the error counters.
+ *
+ * Intended to be called from HAL_CAN_ErrorCallback.
+ *
+ * @param hcan  the CAN handler which reported an error
+ */
+void CAN_Stats_Error_Callback(CAN_HandleTypeDef *hcan);
+
+/**
+ * Copies the bus statistics.
+ *
+ * @param bus  the structure to copy the statistics into
+ */
+void CAN_Stats_Get_Bus(CAN_Stats_Bus *bus);
+
+/**
+ * Copies the statistics of an ID.
+ *
+ * @param id     the standard identifier
+ * @param stats  the structure to copy the statistics into
+ *
+ * @error returns HAL_ERROR if the ID has not been seen
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Stats_Get_ID(uint16_t id, CAN_Stats_ID *stats);
+
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
+
+#endif /* INC_CAN_STATS_H_ */
@@ -3,12 +3,118 @@
  *
  *  Created on: May 20, 2024
  *      Author: Caltech Racing
+ *
+ * Caltech Racing CAN standard and receive/transmit library.
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. NVIC:
+ *      - In your IOC file, ensure that 'CAN1 TX interrupts', 'CAN1 RX0 interrupts',
+ *        'CAN1 RX1 interrupt' and 'CAN1 SCE interrupt' are enabled
+ *      - RX0 and RX1 may have different preemption priorities (e.g. RX0
+ *        raised for the high priority IDs can_filter.h sends to FIFO0);
+ *        both fill the receive ring, one frame at a time with interrupts
+ *        masked
+ *    2. INIT:
+ *      - Call CAN_Std_RX_Init and CAN_Std_TX_Init after MX_CAN1_Init,
+ *        and before HAL_CAN_Start
+ *      - Subscribe to received IDs, or register their handlers, before
+ *        CAN_Std_RX_Init (see can_filter.h)
+ *      - Enable 'Automatic Retransmission' in your IOC file, otherwise a frame
+ *        which loses arbitration is dropped by the hardware
+ *    3. CALLBACKS:
+ *      - ensure that CAN_Std_RX_FIFO_Callback is called in
+ *        HAL_CAN_RxFifo0MsgPendingCallback and HAL_CAN_RxFifo1MsgPendingCallback
+ *      - ensure that CAN_Std_TX_Mailbox_Callback is called in
+ *        HAL_CAN_TxMailboxxCompleteCallback and HAL_CAN_TxMailboxxAbortCallback
+ *      - ensure that CAN_Std_Error_Callback is called in HAL_CAN_ErrorCallback
+ *      (all done in hal.c)
+ *
+ * Principle of Operation:
+ *    The bxCAN peripheral only has two receive FIFOs, each three messages deep.
+ *    At 500 kbit/s a busy bus fills these in well under a millisecond, so
+ *    frames must be moved out of the FIFOs from the interrupt, not the main loop.
+ *
+ *    On every FIFO message pending interrupt, the whole FIFO is drained into a
+ *    single-producer/single-consumer ring buffer of CAN_STD_RX_RING_SIZE frames.
+ *    There are two such interrupts, RX0 and RX1, and both write head, so each
+ *    frame is reserved and committed with interrupts masked (a few dozen
+ *    cycles); that makes them a single producer whatever their priorities.
+ *    The main loop is the only consumer (writes tail), so reading needs no
+ *    interrupt disabling.
+ *
+ *    If the ring is full, the frame is still released from the hardware FIFO
+ *    (otherwise the FIFO would overrun), but is dropped and counted.
+ *
+ *    Received frames can be routed to handlers with CAN_Std_RX_Dispatch, in
+ *    constant time regardless of the number of handlers. The bxCAN reports,
+ *    for every frame, the index of the filter element which accepted it.
+ *    Once the filters are allocated, each element matching exactly one ID is
+ *    mapped straight to that ID's handler, so most frames need one table
+ *    lookup and no ID comparison. Frames accepted by a mask element (an ID
+ *    range) fall back to a second table indexed by the 11-bit ID itself.
+ *
+ *    Outgoing frames are queued in a binary min-heap of CAN_STD_TX_QUEUE_SIZE
+ *    frames, keyed by CAN ID (lower ID = higher priority, as in bus arbitration).
+ *    Frames with the same ID leave in the order they were sent. Whenever a
+ *    hardware mailbox frees up, the highest priority queued frame is moved into it.
+ *
+ *    If all three mailboxes are full and a frame is queued with a higher
+ *    priority than one of the mailboxes, the lowest priority mailbox is aborted,
+ *    and its frame is put back into the queue. This way a CAN_ID_LOW_PRIO
+ *    frame never blocks a CAN_ID_HIGH_PRIO frame inside this node.
+ *
+ * Usage:
+ *
+ *      #import "can_std.h"
+ *
+ *      // ...
+ *
+ *      MX_CAN1_Init();
+ *      CAN_Filter_Subscribe(CAN_ID_DASH);
+ *      CAN_Std_RX_Init(&hcan1);
+ *      CAN_Std_TX_Init(&hcan1);
+ *      HAL_CAN_Start(&hcan1);
+ *
+ *      // ...
+ *
+ *      uint8_t data[2] = { 50, 0xAA };
+ *      CAN_Std_TX_Send(CAN_ID_DASH, data, 2);
+ *
+ *      // ...
+ *
+ *      CAN_Std_Frame frames[8];
+ *      while (1) {
+ *          uint16_t num_frames = CAN_Std_RX_Read(frames, 8);
+ *          for (uint16_t i = 0; i < num_frames; i++) {
+ *              // handle frames[i]
+ *          }
+ *      }
+ *
+ *      // or, instead of CAN_Std_RX_Read, with a handler per ID
+ *
+ *      void Steer_Handler(const CAN_Std_Frame *frame, void *context) {
+ *          // handle frame
+ *      }
+ *
+ *      static const CAN_Std_Handler_Entry handlers[] = {
+ *          { CAN_ID_STEER, Steer_Handler, NULL },
+ *          { CAN_ID_TACH,  Tach_Handler,  &wheel_speeds },
+ *      };
+ *      CAN_Std_RX_Register_All(handlers, 2);
+ *      CAN_Std_RX_Init(&hcan1);
+ *
+ *      // ...
+ *
+ *      while (1) {
+ *          CAN_Std_RX_Dispatch(8);
+ *      }
  */
 
 #ifndef INC_CAN_H_
 #define INC_CAN_H_
 
 #include "stm32f4xx_hal.h"
+#include "can_filter.h"
 
 typedef enum {
 
@@ -23,9 +129,222 @@ typedef enum {
   CAN_ID_TACH           = 0x400,    /* Wheel Speed Sensor */
   CAN_ID_STEER          = 0x410,    /* Steering Angle Sensor */
 
+  CAN_ID_DIAG           = 0x7E0,    /* CAN_Stats diagnostics, one ID per node */
+
   CAN_ID_LOW_PRIO       = 0x7FF     /* Testing/Debugging */
 
 } CAN_ID;
 
+#ifdef HAL_CAN_MODULE_ENABLED
+
+/* Definitions */
+
+// number of frames in the receive ring, must be a power of two
+#define CAN_STD_RX_RING_SIZE 64
+
+typedef struct {
+  uint32_t id;            // standard or extended identifier
+  uint8_t  ide;           // CAN_ID_STD or CAN_ID_EXT
+  uint8_t  rtr;           // CAN_RTR_DATA or CAN_RTR_REMOTE
+  uint8_t  dlc;           // number of data bytes
+  uint8_t  fifo;          // CAN_RX_FIFO0 or CAN_RX_FIFO1
+  uint8_t  filter_match;  // index of the filter element which accepted the frame
+  uint16_t timestamp;     // bxCAN timestamp (only valid in time triggered mode)
+  uint8_t  data[8];       // payload
+} CAN_Std_Frame;
+
+typedef struct {
+  uint32_t received;      // frames stored in the ring
+  uint32_t overflows;     // frames dropped because the ring was full
+  uint32_t fifo_overruns; // frames lost in hardware before the ISR could run
+  uint16_t high_water;    // maximum number of frames ever waiting in the ring
+  uint32_t unhandled;     // frames dispatched with no handler registered for their ID
+} CAN_Std_RX_Stats;
+
+// maximum number of receive handlers, must be below 255
+#define CAN_STD_MAX_HANDLERS 64
+
+/**
+ * Receive handler, called from CAN_Std_RX_Dispatch in the main loop.
+ *
+ * @param frame    the received frame, only valid until the handler returns
+ * @param context  the context pointer given when the handler was registered
+ */
+typedef void (*CAN_Std_Handler)(const CAN_Std_Frame *frame, void *context);
+
+typedef struct {
+  uint16_t id;            // standard identifier to handle
+  CAN_Std_Handler handler;
+  void *context;          // passed to handler
+} CAN_Std_Handler_Entry;
+
+// number of frames in the transmit queue, excluding the three hardware mailboxes
+#define CAN_STD_TX_QUEUE_SIZE 32
+
+typedef struct {
+  uint32_t queued;        // frames accepted by CAN_Std_TX_Send
+  uint32_t sent;          // frames successfully transmitted
+  uint32_t dropped;       // frames rejected because the queue was full
+  uint32_t preempted;     // mailboxes aborted to make room for a higher priority frame
+  uint16_t depth;         // number of frames currently waiting in software
+  uint16_t high_water;    // maximum number of frames ever waiting in software
+  uint32_t max_latency;   // worst-case time from CAN_Std_TX_Send to transmission, in us
+} CAN_Std_TX_Stats;
+
+/* Functions */
+
+/**
+ * Initializes the interrupt-driven receive path.
+ *
+ * Configures the hardware filters from the subscriptions (see can_filter.h),
+ * and activates the FIFO0 and FIFO1 message pending and overrun notifications.
+ *
+ * @param hcan  the CAN handler to receive from
+ *
+ * @error returns HAL_StatusTypeDef
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Std_RX_Init(CAN_HandleTypeDef *hcan);
+
+/**
+ * Drains the given hardware FIFO into the receive ring.
+ *
+ * Intended to be called from HAL_CAN_RxFifo0MsgPendingCallback
+ * and HAL_CAN_RxFifo1MsgPendingCallback.
+ *
+ * @param hcan  the CAN handler whose FIFO has pending messages
+ * @param fifo  CAN_RX_FIFO0 or CAN_RX_FIFO1
+ */
+void CAN_Std_RX_FIFO_Callback(CAN_HandleTypeDef *hcan, uint32_t fifo);
+
+/**
+ * Records hardware receive errors (FIFO overruns), and requeues frames
+ * whose transmission failed.
+ *
+ * Intended to be called from HAL_CAN_ErrorCallback.
+ *
+ * @param hcan  the CAN handler which reported an error
+ */
+void CAN_Std_Error_Callback(CAN_HandleTypeDef *hcan);
+
+/**
+ * Removes up to max_frames received frames from the ring.
+ *
+ * Must only be called from the main loop (the single consumer).
+ *
+ * @param frames      array to copy the frames into
+ * @param max_frames  the number of frames frames can hold
+ *
+ * @retval the number of frames copied into frames
+ */
+uint16_t CAN_Std_RX_Read(CAN_Std_Frame *frames, uint16_t max_frames);
+
+/**
+ * Registers the handler for a standard ID, and subscribes to the ID (see
+ * can_filter.h). Must be called before CAN_Std_RX_Init.
+ *
+ * @param id       the standard identifier to handle
+ * @param handler  the function to call for every frame with this ID
+ * @param context  passed to handler (may be NULL)
+ *
+ * @error returns HAL_ERROR if the ID is not a standard ID, already has a
+ *        handler, or CAN_STD_MAX_HANDLERS handlers are already registered
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Std_RX_Register(uint16_t id, CAN_Std_Handler handler, void *context);
+
+/**
+ * Registers a table of handlers, as CAN_Std_RX_Register.
+ * Must be called before CAN_Std_RX_Init.
+ *
+ * @param entries      the handlers to register
+ * @param num_entries  the number of entries
+ *
+ * @error returns HAL_ERROR on the first entry which fails to register
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Std_RX_Register_All(const CAN_Std_Handler_Entry *entries, uint16_t num_entries);
+
+/**
+ * Removes up to max_frames received frames from the ring, calling the
+ * registered handler of each. Frames without a handler are counted in
+ * CAN_Std_RX_Stats.unhandled and discarded.
+ *
+ * Must only be called from the main loop (the single consumer), and
+ * not mixed with CAN_Std_RX_Read.
+ *
+ * @param max_frames  the maximum number of frames to handle
+ *
+ * @retval the number of frames removed from the ring
+ */
+uint16_t CAN_Std_RX_Dispatch(uint16_t max_frames);
+
+/**
+ * @retval the number of frames waiting in the receive ring
+ */
+uint16_t CAN_Std_RX_Available(void);
+
+/**
+ * Copies the receive statistics.
+ *
+ * @param stats  the structure to copy the statistics into
+ */
+void CAN_Std_RX_Get_Stats(CAN_Std_RX_Stats *stats);
+
+/**
+ * Initializes the transmit queue.
+ *
+ * Activates the TX mailbox empty notification, and enables the DWT cycle
+ * counter for latency measurement.
+ *
+ * @param hcan  the CAN handler to transmit on
+ *
+ * @error returns HAL_StatusTypeDef
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Std_TX_Init(CAN_HandleTypeDef *hcan);
+
+/**
+ * Queues a standard data frame for transmission.
+ *
+ * @param id    the standard identifier to send with (e.g. CAN_ID_DASH + 1)
+ * @param data  the payload, copied into the queue
+ * @param dlc   the number of bytes in data (at most 8)
+ *
+ * @error returns HAL_ERROR if the queue is full or the arguments are invalid
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef CAN_Std_TX_Send(uint32_t id, const uint8_t *data, uint8_t dlc);
+
+/**
+ * Releases a hardware mailbox, and refills the mailboxes from the queue.
+ *
+ * Intended to be called from HAL_CAN_TxMailboxxCompleteCallback (sent = 1)
+ * and HAL_CAN_TxMailboxxAbortCallback (sent = 0).
+ *
+ * @param hcan     the CAN handler whose mailbox was released
+ * @param mailbox  the index of the mailbox (0, 1 or 2)
+ * @param sent     1 if the frame was transmitted, 0 if it should be requeued
+ */
+void CAN_Std_TX_Mailbox_Callback(CAN_HandleTypeDef *hcan, uint8_t mailbox, uint8_t sent);
+
+/**
+ * @retval the number of frames waiting in software for a mailbox
+ */
+uint16_t CAN_Std_TX_Pending(void);
+
+/**
+ * Copies the transmit statistics.
+ *
+ * @param stats  the structure to copy the statistics into
+ */
+void CAN_Std_TX_Get_Stats(CAN_Std_TX_Stats *stats);
+
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
 
 #endif /* INC_CAN_H_ */
@@ -35,6 +35,9 @@
  *      // write "3.5" to the display
  *      Seven_Seg_Write_Decimal(seven_seg, 3.5);
  *
+ *      // write "1.2." (1.2 thousand) for 1234.5, given in tenths
+ *      Seven_Seg_Write_Fixed(seven_seg, 12345, 1);
+ *
  *      // write "Hi." to the display
  *      Seven_Seg_Write_Chars(seven_seg, "Hi", 0, 1);
  *
@@ -69,6 +72,15 @@
 
 #include "shift_reg.h"
 
+// the number of seven segment handlers which can be initialized (set it,
+// if at all, in the compiler flags, as for the sizes in shift_reg.h)
+#ifndef SEVEN_SEG_MAX_HANDLERS
+#define SEVEN_SEG_MAX_HANDLERS 2
+#endif
+
+// the most decimal places Seven_Seg_Write_Fixed accepts
+#define SEVEN_SEG_MAX_DECIMALS 6
+
 typedef struct {
   Shift_Reg *shift_reg;
 } Seven_Seg;
@@ -79,7 +91,8 @@ typedef struct {
  * @param shift_reg   reference to the shift register handler associated
  *                    with the seven segment
  *
- * @retval a reference to the seven segment handler
+ * @retval a reference to the seven segment handler, or NULL if the shift
+ *         register is NULL, or SEVEN_SEG_MAX_HANDLERS are already initialized
  */
 Seven_Seg *Seven_Seg_Init(Shift_Reg *shift_reg);
 
@@ -101,10 +114,12 @@ HAL_StatusTypeDef Seven_Seg_Write_Raw(Seven_Seg *seven_seg, uint8_t left_raw, ui
  *
  * E.g. 0xA9 will write "A9" to the display.
  *
+ * Both digits come from one lookup in a precomputed table.
+ *
  * @param seven_seg  the seven seg handler
  * @param hex        the hex value to display
- * @param left_dp    0 if the left  decimal point should be on, 1 otherwise
- * @param right_dp   0 if the right decimal point should be on, 1 otherwise
+ * @param left_dp    1 if the left  decimal point should be on, 0 otherwise
+ * @param right_dp   1 if the right decimal point should be on, 0 otherwise
  *
  * @error   return HAL_StatusTypeDef error
  *
@@ -118,7 +133,10 @@ HAL_StatusTypeDef Seven_Seg_Write_Hex(Seven_Seg *seven_seg, uint8_t hex, uint8_t
  * E.g. 95 will write "95" to the display.
  * E.g. -9 will write "-9" to the display.
  *
- * Assumes -10 < val < 100
+ * Values outside -10 < val < 100 write "--".
+ *
+ * Both digits come from one lookup in a precomputed table, so this is
+ * cheap enough to call from a high-rate CAN handler.
  *
  * @param seven_seg  the seven seg handler
  * @param val        the integer value to display
@@ -130,17 +148,45 @@ HAL_StatusTypeDef Seven_Seg_Write_Hex(Seven_Seg *seven_seg, uint8_t hex, uint8_t
 HAL_StatusTypeDef Seven_Seg_Write_Integer(Seven_Seg *seven_seg, int8_t val);
 
 /**
- * Writes a float/decimal value to the display
+ * Writes a fixed point value, value / 10^decimals, to the display,
+ * rounded half away from zero to the most significant figures that fit.
+ * The decimal points give the scale:
  *
- * E.g. 3.5 will write "3.5" to the display.
- * E.g. 59  will write "59." to the display.
- * E.g. -5  will write "-5." to the display.
+ *      "d.d"    0.0 to 9.9            E.g. 3.46 writes "3.5"
+ *      "dd"     10 to 99              E.g. 59.5 writes "60"
+ *      "d.d."   0.1 to 9.9 thousand   E.g. 1234 writes "1.2."
+ *      "dd."    10 to 99 thousand     E.g. 56789 writes "57."
+ *      "-.d"    -0.9 to -0.1          E.g. -0.5 writes "-.5"
+ *      "-d"     -9 to -1              E.g. -5 writes "-5"
+ *
+ * Values which round beyond these (-9.5 or below, 99.5 thousand or above)
+ * write "--".
+ *
+ * Uses integer arithmetic only, so it is cheap enough to call from a CAN
+ * handler with a raw scaled signal.
+ *
+ * @param seven_seg  the seven seg handler
+ * @param value      the value, scaled by 10^decimals
+ * @param decimals   the decimal places in value, up to SEVEN_SEG_MAX_DECIMALS
+ *
+ * @error   returns HAL_ERROR if decimals is out of range, otherwise
+ *          return HAL_StatusTypeDef error
  *
- * Only two sig figs are possible for positive numbers,
- * and only one sig fig is possible for negative numbers.
- * Remaining sig figs are truncated (not rounded).
+ * @retval  the HAL_StatusTypeDef status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Write_Fixed(Seven_Seg *seven_seg, int32_t value, uint8_t decimals);
+
+/**
+ * Writes a float/decimal value to the display, as Seven_Seg_Write_Fixed.
+ *
+ * E.g. 3.5 will write "3.5" to the display.
+ * E.g. 59  will write "59" to the display.
+ * E.g. -5  will write "-5" to the display.
  *
- * Assumes -10.0 < val < 100.0
+ * From -9.5 to 99.5, the range shown without a thousands point, the float
+ * is rounded straight to tenths or units, with no integer division. Larger
+ * values are converted to thousandths and written as Seven_Seg_Write_Fixed.
+ * Prefer Seven_Seg_Write_Fixed where the value is already an integer.
  *
  * @param seven_seg  the seven seg handler
  * @param val        the decimal value to display
@@ -163,8 +209,8 @@ HAL_StatusTypeDef Seven_Seg_Write_Decimal(Seven_Seg *seven_seg, float val);
  *
  * @param seven_seg  the seven seg handler
  * @param text       the two characters to display
- * @param left_dp    0 if the left  decimal point should be on, 1 otherwise
- * @param right_dp   0 if the right decimal point should be on, 1 otherwise
+ * @param left_dp    1 if the left  decimal point should be on, 0 otherwise
+ * @param right_dp   1 if the right decimal point should be on, 0 otherwise
  *
  * @error   return HAL_StatusTypeDef error
  *
@@ -191,4 +237,69 @@ HAL_StatusTypeDef Seven_Seg_Write_Chars(Seven_Seg *seven_seg, char text[2], uint
  */
 HAL_StatusTypeDef Seven_Seg_Write_Text(Seven_Seg *seven_seg, char text[2]);
 
+/*
+ * Renderers: each fills the two bytes the matching Write function would
+ * give to Shift_Reg_Write, without writing them. For callers which
+ * precompute what they show, or place it in a longer chain (see
+ * seven_seg_marquee.h and seven_seg_array.h).
+ */
+
+/**
+ * Renders a hexidecimal value, as Seven_Seg_Write_Hex.
+ *
+ * @param hex        the hex value to render
+ * @param left_dp    1 if the left  decimal point should be on, 0 otherwise
+ * @param right_dp   1 if the right decimal point should be on, 0 otherwise
+ * @param data       filled with the two bytes, in the order given to
+ *                   Shift_Reg_Write
+ */
+void Seven_Seg_Render_Hex(uint8_t hex, uint8_t left_dp, uint8_t right_dp, uint8_t data[2]);
+
+/**
+ * Renders an integer value, as Seven_Seg_Write_Integer.
+ *
+ * @param val        the integer value to render
+ * @param data       filled with the two bytes, in the order given to
+ *                   Shift_Reg_Write
+ */
+void Seven_Seg_Render_Integer(int8_t val, uint8_t data[2]);
+
+/**
+ * Renders a fixed point value, as Seven_Seg_Write_Fixed.
+ *
+ * @param value      the value, scaled by 10^decimals
+ * @param decimals   the decimal places in value, up to SEVEN_SEG_MAX_DECIMALS
+ * @param data       filled with the two bytes, in the order given to
+ *                   Shift_Reg_Write
+ *
+ * @error   returns HAL_ERROR if decimals is out of range, leaving data as
+ *          it was
+ *
+ * @retval  the HAL_StatusTypeDef status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Render_Fixed(int32_t value, uint8_t decimals, uint8_t data[2]);
+
+/**
+ * Renders a float value, as Seven_Seg_Write_Decimal.
+ *
+ * @param val        the decimal value to render
+ * @param data       filled with the two bytes, in the order given to
+ *                   Shift_Reg_Write
+ */
+void Seven_Seg_Render_Decimal(float val, uint8_t data[2]);
+
+/**
+ * Renders two characters, as Seven_Seg_Write_Chars would write them,
+ * without writing them.
+ *
+ * Characters outside printable ASCII render blank.
+ *
+ * @param text       the two characters to render
+ * @param left_dp    1 if the left  decimal point should be on, 0 otherwise
+ * @param right_dp   1 if the right decimal point should be on, 0 otherwise
+ * @param data       filled with the two bytes, in the order given to
+ *                   Shift_Reg_Write
+ */
+void Seven_Seg_Render_Chars(const char text[2], uint8_t left_dp, uint8_t right_dp, uint8_t data[2]);
+
 #endif /* INC_SEVEN_SEG_H_ */
@@ -0,0 +1,222 @@
+/*
+ * seven_seg_array.h
+ *
+ * Several two digit seven segment modules (see seven_seg.h) cascaded on
+ * one 74HC595 chain, drawn as logical slots and sent in one write.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. INIT:
+ *      - Create the shift register and a frame over the whole chain first
+ *        (see shift_reg_frame.h); other outputs on the chain (e.g. LEDs)
+ *        can share the frame through their own owners
+ *      - The array adds an owner for the bytes of its modules, so Init
+ *        returns NULL if another owner already has any of them
+ *      - Handlers come from a static pool of SEVEN_SEG_ARRAY_MAX_HANDLERS;
+ *        Seven_Seg_Array_Init returns NULL once it is used up
+ *    2. SLOTS:
+ *      - Slots are numbered in reading order, slot 0 being the leftmost
+ *        module, whatever their order on the chain
+ *      - A slot's offset is the byte of the chain (data[offset] given to
+ *        Shift_Reg_Write) of its right digit; its left digit is the byte
+ *        after, as for Seven_Seg_Write_Raw
+ *    3. FLUSHING:
+ *      - Nothing is sent until Seven_Seg_Array_Flush (or
+ *        Shift_Reg_Frame_Flush on the frame) is called; call it from the
+ *        main loop, so every module changed since goes out in one write
+ *      - Do not use a Seven_Seg handler on the same chain
+ *
+ * Principle of Operation:
+ *    Each write renders with the same tables as seven_seg.h into the
+ *    array's own copy of its bytes, then hands them to the frame as its
+ *    owner in one short critical section. Writing to one module only
+ *    replaces that module's bytes, so the others, and anything else on the
+ *    chain, keep what they show.
+ *
+ *    The frame only sends the chain when something changed, so updating
+ *    four modules from four CAN handlers costs one transfer, and
+ *    rewriting a module with what it shows costs none.
+ *
+ *    Text and numbers can span several slots, e.g. four digits over two
+ *    modules, with decimal points where a '.' or the decimal places fall.
+ *
+ * Usage:
+ *
+ *      #import "seven_seg_array.h"
+ *
+ *      // ...
+ *
+ *      // three modules on six registers; the leftmost module is last on
+ *      // the chain
+ *      Shift_Reg *shift_reg = Shift_Reg_SPI_DMA_Init(&hspi1, STCP_GPIO_Port, STCP_Pin, 6);
+ *      Shift_Reg_Frame *frame = Shift_Reg_Frame_Init(shift_reg, 6);
+ *      uint8_t offsets[3] = { 4, 2, 0 };
+ *      Seven_Seg_Array *dash = Seven_Seg_Array_Init(frame, offsets, 3);
+ *
+ *      // ...
+ *
+ *      // in CAN handlers
+ *      Seven_Seg_Array_Write_Integer(dash, 0, gear);
+ *      Seven_Seg_Array_Write_Number(dash, 1, 2, lap_time_ds, 1);  // " 8", "3.4"
+ *
+ *      // ...
+ *
+ *      // main loop
+ *      while (1) {
+ *          CAN_Std_RX_Dispatch(8);
+ *          Seven_Seg_Array_Flush(dash);
+ *      }
+ */
+
+#ifndef INC_SEVEN_SEG_ARRAY_H_
+#define INC_SEVEN_SEG_ARRAY_H_
+
+#include "seven_seg.h"
+#include "shift_reg_frame.h"
+
+/* Definitions */
+
+// the most modules in one array
+#define SEVEN_SEG_ARRAY_MAX_SLOTS 8
+
+// the number of array handlers which can be initialized (set it, if at
+// all, in the compiler flags, as for the sizes in shift_reg.h)
+#ifndef SEVEN_SEG_ARRAY_MAX_HANDLERS
+#define SEVEN_SEG_ARRAY_MAX_HANDLERS 1
+#endif
+
+typedef struct {
+  Shift_Reg_Frame *frame;
+  int8_t owner;                               // the array's owner of the frame
+  uint8_t num_slots;
+  uint8_t offsets[SEVEN_SEG_ARRAY_MAX_SLOTS]; // chain byte of each slot's right digit
+  uint8_t values[SHIFT_REG_MAX_REGS];         // the modules' bytes, as rendered
+} Seven_Seg_Array;
+
+/* Functions */
+
+/**
+ * Creates an array of modules over a frame, every module blank.
+ *
+ * @param frame      the frame over the chain
+ * @param offsets    num_slots chain bytes, of the right digit of each slot
+ *                   in reading order
+ * @param num_slots  the number of modules, up to SEVEN_SEG_ARRAY_MAX_SLOTS
+ *
+ * @retval the array handler, or NULL if a parameter is out of range, two
+ *         modules overlap, their bytes are owned already, or
+ *         SEVEN_SEG_ARRAY_MAX_HANDLERS are already initialized
+ */
+Seven_Seg_Array *Seven_Seg_Array_Init(Shift_Reg_Frame *frame, const uint8_t *offsets, uint8_t num_slots);
+
+/**
+ * Writes raw binary to one module, as Seven_Seg_Write_Raw.
+ *
+ * @param array      the array handler
+ * @param slot       the module
+ * @param left_raw   the raw binary of the left digit
+ * @param right_raw  the raw binary of the right digit
+ *
+ * @error returns HAL_ERROR if the slot is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Write_Raw(Seven_Seg_Array *array, uint8_t slot, uint8_t left_raw, uint8_t right_raw);
+
+/**
+ * Writes a hexidecimal value to one module, as Seven_Seg_Write_Hex.
+ *
+ * @param array      the array handler
+ * @param slot       the module
+ * @param hex        the hex value to display
+ * @param left_dp    1 if the left  decimal point should be on, 0 otherwise
+ * @param right_dp   1 if the right decimal point should be on, 0 otherwise
+ *
+ * @error returns HAL_ERROR if the slot is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Write_Hex(Seven_Seg_Array *array, uint8_t slot, uint8_t hex, uint8_t left_dp, uint8_t right_dp);
+
+/**
+ * Writes an integer to one module, as Seven_Seg_Write_Integer.
+ *
+ * @param array      the array handler
+ * @param slot       the module
+ * @param val        the integer value to display
+ *
+ * @error returns HAL_ERROR if the slot is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Write_Integer(Seven_Seg_Array *array, uint8_t slot, int8_t val);
+
+/**
+ * Writes a fixed point value to one module, as Seven_Seg_Write_Fixed.
+ *
+ * @param array      the array handler
+ * @param slot       the module
+ * @param value      the value, scaled by 10^decimals
+ * @param decimals   the decimal places in value, up to SEVEN_SEG_MAX_DECIMALS
+ *
+ * @error returns HAL_ERROR if the slot or decimals is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Write_Fixed(Seven_Seg_Array *array, uint8_t slot, int32_t value, uint8_t decimals);
+
+/**
+ * Writes text across consecutive modules, left aligned and padded with
+ * blanks. A '.' lights the decimal point of the character before it.
+ *
+ * E.g. "LAP 3." over 3 modules writes "LA", "P ", "3.".
+ *
+ * @param array       the array handler
+ * @param first_slot  the leftmost module
+ * @param num_slots   the number of modules
+ * @param text        the null terminated text
+ *
+ * @error returns HAL_ERROR if the modules are out of range, or the text
+ *        does not fit; nothing is written
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Write_Text(Seven_Seg_Array *array, uint8_t first_slot, uint8_t num_slots, const char *text);
+
+/**
+ * Writes a number across consecutive modules, right aligned and padded
+ * with blanks, with a decimal point before the last `decimals` digits.
+ *
+ * E.g. 1234 with 1 decimal over 2 modules writes "12", "3.4".
+ * E.g. -5 with 2 decimals over 2 modules writes "-0.", "05".
+ *
+ * Numbers with more digits (and sign) than fit write "-" on every digit.
+ *
+ * @param array       the array handler
+ * @param first_slot  the leftmost module
+ * @param num_slots   the number of modules
+ * @param value       the value, scaled by 10^decimals
+ * @param decimals    the digits after the decimal point
+ *
+ * @error returns HAL_ERROR if the modules are out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Write_Number(Seven_Seg_Array *array, uint8_t first_slot, uint8_t num_slots,
+                                               int32_t value, uint8_t decimals);
+
+/**
+ * Sends every module changed since the last flush, in one write of the
+ * chain. The same as Shift_Reg_Frame_Flush on the frame.
+ *
+ * @param array      the array handler
+ *
+ * @error returns the Shift_Reg_Frame_Flush error
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Array_Flush(Seven_Seg_Array *array);
+
+#endif /* INC_SEVEN_SEG_ARRAY_H_ */
@@ -0,0 +1,174 @@
+/*
+ * seven_seg_marquee.h
+ *
+ * Scrolls text longer than two characters across the seven segment
+ * display (see seven_seg.h), with priorities so that e.g. a fault message
+ * interrupts a lap time.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. TIMERS:
+ *      - In your IOC file, activate a timer to be used for the sole
+ *        purpose of scrolling (a basic timer, TIM6/TIM7, is enough)
+ *      - In your NVIC, ensure that 'TIMx global interrupt' is enabled
+ *      - Ensure that USE_HAL_TIM_REGISTER_CALLBACKS is set to 1U in
+ *        stm32f4xx_hal_conf.h (see buttons.h)
+ *    2. SHIFT REGISTER:
+ *      - Frames are written from the timer interrupt, so use a
+ *        non-blocking mode (SPI_DMA, SPI_TIM_Latch or GPIO_IT, see
+ *        shift_reg.h) for the display's shift register
+ *      - Do not write to the seven segment yourself while a message is
+ *        showing; the next frame overwrites it
+ *    3. TEXT:
+ *      - At most SEVEN_SEG_MARQUEE_MAX_LENGTH characters per message
+ *      - A '.' lights the decimal point of the character before it, and
+ *        takes no frame of its own
+ *      - See seven_seg.h for how characters appear
+ *    4. POOL:
+ *      - Handlers come from a static pool of
+ *        SEVEN_SEG_MARQUEE_MAX_HANDLERS; Seven_Seg_Marquee_Init returns
+ *        NULL once it is used up
+ *
+ * Principle of Operation:
+ *    Each message is rendered once, when it is shown, into the frames of
+ *    a two character window sliding over the text, padded with a blank at
+ *    each end so the text scrolls in and out. Each frame is the two bytes
+ *    written to the shift register, so a scroll step is one raw write from
+ *    the timer interrupt, with no character lookups.
+ *
+ *    There is one message slot per priority, 0 being the lowest. The
+ *    highest priority slot holding a message is the one shown. Showing a
+ *    message of higher priority preempts the one scrolling; once it is
+ *    cleared, or it ends if it does not repeat, the preempted message
+ *    resumes from the frame it was on. When no message is left, the
+ *    display is blanked and the timer stopped.
+ *
+ *    The timer ticks at 10 kHz; the auto-reload is set from the step of
+ *    the message shown.
+ *
+ * Usage:
+ *
+ *      #import "seven_seg_marquee.h"
+ *
+ *      // ...
+ *
+ *      Seven_Seg *seven_seg = Seven_Seg_Init(shift_reg);
+ *      Seven_Seg_Marquee *marquee = Seven_Seg_Marquee_Init(seven_seg, &htim7);
+ *
+ *      // ...
+ *
+ *      // scroll the lap time, 300 ms per step, until replaced
+ *      Seven_Seg_Marquee_Show(marquee, 0, "LAP 1.23.4", 300, 1);
+ *
+ *      // interrupt it with a fault until the fault clears
+ *      Seven_Seg_Marquee_Show(marquee, 2, "BMS FAULT", 250, 1);
+ *
+ *      // ...
+ *
+ *      // the lap time resumes
+ *      Seven_Seg_Marquee_Clear(marquee, 2);
+ */
+
+#ifndef INC_SEVEN_SEG_MARQUEE_H_
+#define INC_SEVEN_SEG_MARQUEE_H_
+
+#include "seven_seg.h"
+
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+/* Definitions */
+
+// These size Seven_Seg_Marquee, so every file must see the same values:
+// set them, if at all, in the compiler flags (see shift_reg.h, INIT)
+
+// the most characters in a message, not counting decimal points
+#ifndef SEVEN_SEG_MARQUEE_MAX_LENGTH
+#define SEVEN_SEG_MARQUEE_MAX_LENGTH 32
+#endif
+
+// the number of priorities, and so of messages held at once
+#ifndef SEVEN_SEG_MARQUEE_PRIORITIES
+#define SEVEN_SEG_MARQUEE_PRIORITIES 3
+#endif
+
+// the number of marquee handlers which can be initialized
+#ifndef SEVEN_SEG_MARQUEE_MAX_HANDLERS
+#define SEVEN_SEG_MARQUEE_MAX_HANDLERS 1
+#endif
+
+// the longest step, in ms, at the 10 kHz timer tick
+#define SEVEN_SEG_MARQUEE_MAX_STEP_MS 6553
+
+typedef struct {
+  // two bytes per frame, in the order given to Shift_Reg_Write
+  uint8_t frames[SEVEN_SEG_MARQUEE_MAX_LENGTH + 1][2];
+  uint8_t num_frames;                 // 0 if the slot is empty
+  uint8_t frame;                      // the frame being shown
+  uint8_t repeat;
+  uint16_t step_ms;
+} Seven_Seg_Message;
+
+typedef struct {
+  Seven_Seg *seven_seg;
+  TIM_HandleTypeDef *htim;
+  Seven_Seg_Message messages[SEVEN_SEG_MARQUEE_PRIORITIES];
+  int8_t active;                      // priority being shown, -1 if none
+} Seven_Seg_Marquee;
+
+/* Functions */
+
+/**
+ * Sets up a marquee over a seven segment display. Configures the timer,
+ * but does not start it until a message is shown.
+ *
+ * @param seven_seg  the seven segment handler
+ * @param htim       the timer handler used solely for scrolling
+ *
+ * @retval the marquee handler, or NULL if the seven segment is NULL, the
+ *         timer could not be initialized, or
+ *         SEVEN_SEG_MARQUEE_MAX_HANDLERS are already initialized
+ */
+Seven_Seg_Marquee *Seven_Seg_Marquee_Init(Seven_Seg *seven_seg, TIM_HandleTypeDef *htim);
+
+/**
+ * Shows a message at a priority, replacing any message of that priority.
+ * It is shown at once, from its first frame, unless a message of higher
+ * priority is showing.
+ *
+ * Safe to call from an interrupt.
+ *
+ * @param marquee   the marquee handler
+ * @param priority  0 (lowest) to SEVEN_SEG_MARQUEE_PRIORITIES - 1
+ * @param text      the null terminated text to scroll
+ * @param step_ms   the time each frame is shown, 1 to
+ *                  SEVEN_SEG_MARQUEE_MAX_STEP_MS
+ * @param repeat    1 to scroll until cleared, 0 to scroll once
+ *
+ * @error returns HAL_ERROR if the priority or step is out of range, or the
+ *        text is too long
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Marquee_Show(Seven_Seg_Marquee *marquee, uint8_t priority,
+                                         const char *text, uint16_t step_ms, uint8_t repeat);
+
+/**
+ * Clears the message of a priority. If it was showing, the message of the
+ * next highest priority resumes, or the display is blanked.
+ *
+ * Safe to call from an interrupt.
+ *
+ * @param marquee   the marquee handler
+ * @param priority  0 (lowest) to SEVEN_SEG_MARQUEE_PRIORITIES - 1
+ *
+ * @error returns HAL_ERROR if the priority is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Seven_Seg_Marquee_Clear(Seven_Seg_Marquee *marquee, uint8_t priority);
+
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+#endif /* INC_SEVEN_SEG_MARQUEE_H_ */
@@ -9,18 +9,52 @@
  *        to the 74HC595
  *      - In your NVIC, ensure that 'SPIx global interrupt' is enabled
  *      - Under 'Hardware NSS Signal', select 'Disable'
+ *      - For SPI_DMA and SPI_TIM_Latch, add a 'SPIx_TX' DMA request (Memory
+ *        To Peripheral, Normal mode, Byte width), and ensure that its
+ *        'DMAx streamy global interrupt' is enabled in the NVIC
  *      - Under 'Frame Format', select 'Motorola'
  *      - Under 'Data Size', select '8 Bits'
  *      - Under 'Clock Phase', select '1 Edge'
  *      - Under 'CRC Calculation', select 'Disabled'
+ *      - Several shift registers may share a bus; they must each have their
+ *        own STCP pin (or timer channel)
+ *      - For 74HC165 inputs, set the mode to 'Full-Duplex Master', add a
+ *        'SPIx_RX' DMA request (Peripheral To Memory, Normal mode, Byte
+ *        width) with its interrupt enabled, and keep the bit rate within
+ *        the 74HC165's (at 3.3 V, up to about 9 Mbit/s)
  *    2. TIMERS (if you are using GPIO_IT):
  *      - In your IOC file, activate a timer to be used for the sole
  *        purpose of handling the shift register.
  *      - In your NVIC, ensure that 'TIMx global interrupt' is enabled
  *      - This timer should not be used for other purposes
- *    3. INIT:
+ *      - Ensure that USE_HAL_TIM_REGISTER_CALLBACKS is set to 1U in
+ *        stm32f4xx_hal_conf.h (see buttons.h)
+ *    3. TIMERS (if you are using SPI_TIM_Latch):
+ *      - In your IOC file, set the pin connected to STCP to a channel
+ *        (TIMx_CHy) of a timer used for the sole purpose of the latch,
+ *        and set that channel to 'PWM Generation CHy'
+ *      - Also wire SCK to the timer's TIMx_ETR pin, and set that pin to
+ *        TIMx_ETR; the timer counts the shift clock. Only TIM1 to TIM5 and
+ *        TIM8 have an ETR input
+ *      - SCK must idle low ('Clock Polarity' 'Low'), and the bit rate be
+ *        at most twice the timer clock; init returns NULL otherwise
+ *      - In your NVIC, ensure that the timer's global (or capture compare)
+ *        interrupt is enabled; it ends each write, freeing the SPI bus for
+ *        the next
+ *    4. INIT:
  *      - Ensure you initialize  according to Usage
- *    4. SETTINGS
+ *      - At most SHIFT_REG_MAX_HANDLERS shift registers, on at most
+ *        SHIFT_REG_MAX_BUSES SPI buses, can be initialized; further inits
+ *        return NULL. If you need more, raise them in the project's
+ *        compiler flags (e.g. -DSHIFT_REG_MAX_HANDLERS=8, under
+ *        C/C++ Build > Settings > MCU GCC Compiler > Preprocessor),
+ *        never with a #define before including this file
+ *      - The same goes for SHIFT_REG_MAX_REGS, which sizes the buffers in
+ *        Shift_Reg and in the structs of shift_reg_frame.h, shift_reg_bcm.h
+ *        and seven_seg_array.h. A source file which saw another value
+ *        would disagree with shift_reg.c about where their fields are, and
+ *        neither the compiler nor the linker can catch it
+ *    5. SETTINGS
  *      - Ensure that USE_HAL_SPI_REGISTER_CALLBACKS is set to 1U in
  *        stm32f4xx_hal_conf.h; set using:
  *        STM32CubeMX Project Manager > Advanced Settings > Register Callback
@@ -60,7 +94,10 @@
  *    the STCP, completing the operation, and should be used if possible.
  *    If not, STCP can be controlled by software ("software" slave select).
  *
- *    Currently, hardware slave select is not available.
+ *    Hardware slave select is not available: on the STM32F4, the NSS output
+ *    stays low for as long as the SPI bus is enabled, so it never pulses
+ *    STCP between writes. Instead, SPI_TIM_Latch generates the STCP pulse
+ *    with a timer output (see below).
  *
  *    Your SPIx bus should be connected to the 74HC595 as:
  *
@@ -73,7 +110,80 @@
  *
  *    Your options for initializing are therefore:
  *    `Shift_Reg_GPIO_Init` -> GPIO/manual control
+ *    `Shift_Reg_GPIO_IT_Init` -> GPIO/manual control, paced by a timer
  *    `Shift_Reg_SPI_SW_NSS_Init` -> SPI control with software slave select
+ *    `Shift_Reg_SPI_DMA_Init` -> SPI control with software slave select,
+ *                                sent by DMA
+ *    `Shift_Reg_SPI_TIM_Latch_Init` -> SPI control sent by DMA, with STCP
+ *                                      latched by a timer output
+ *
+ *    SPI_SW_NSS takes an interrupt for every byte. At high SPI clocks, this
+ *    keeps the CPU in the SPI interrupt for most of the transfer, delaying
+ *    other interrupts (such as CAN). SPI_DMA instead sends the whole cascade
+ *    in one DMA transfer, with a single interrupt at the end, which latches
+ *    STCP. Use it for long cascades, e.g. LED bars of 16+ registers.
+ *
+ *    SPI_SW_NSS and SPI_DMA latch STCP from the transfer complete interrupt,
+ *    so the latch is late by the interrupt latency, which varies with the
+ *    other interrupts. SPI_TIM_Latch instead connects STCP to a timer
+ *    channel in PWM mode, and clocks the timer from SCK itself, through
+ *    its ETR pin (external clock mode 2). Each write clears the counter,
+ *    pulling STCP low, and the output rises when the counter reaches the
+ *    number of bits written, on the last SHCP edge, a few timer clocks
+ *    (the input synchronization) after it. Gaps between DMA bytes only
+ *    delay the edges, so the latch can never come before the last bit is
+ *    in, and needs no CPU at all. Above a quarter of the timer clock, the
+ *    ETR prescaler counts every 2, 4 or 8 bits; it also sees the other
+ *    transfers on the bus, but every transfer is whole bytes, so the
+ *    counts stay in step with the bytes.
+ *
+ *    GPIO writes the pins through their BSRR registers, with the set/reset
+ *    words precomputed at init. If SHCP and DATA share a port, SHCP low and
+ *    the data bit are one store, so a bit is two stores. Bytes are unrolled.
+ *    For long cables or slow edges, Shift_Reg_GPIO_Set_Max_Bit_Rate caps the
+ *    rate, timing each SHCP phase with the DWT cycle counter.
+ *    Shift_Reg_GPIO_Benchmark (built with SHIFT_REG_GPIO_BENCHMARK) times
+ *    these paths against the old three HAL_GPIO_WritePin calls a bit.
+ *
+ *    GPIO blocks until every bit is out. GPIO_IT instead shifts out one bit
+ *    on each timer interrupt: SHCP low, DATA set to the bit, SHCP high.
+ *    One tick after the last bit, STCP is latched and the timer stopped.
+ *    Shift_Reg_Write returns as soon as the timer is started.
+ *
+ *    The non-blocking modes (every mode but GPIO) own a double buffer, so
+ *    Shift_Reg_Write copies the data and the caller's array may be reused
+ *    straight away. If the previous write is still being sent, the data
+ *    replaces any write already waiting, and is sent as soon as the
+ *    previous write is latched. Writes never block or return HAL_BUSY, and
+ *    however fast they come, the last one is always sent: intermediate
+ *    writes are dropped ("latest wins").
+ *
+ *    Any number of SPI shift registers may share one SPI bus (SCK and MOSI),
+ *    each latched by its own STCP pin or timer channel; the other cascades
+ *    shift in the same bits, but only the one whose STCP rises shows them.
+ *    Each bus has a queue: a write is sent straight away if the bus is
+ *    idle, and otherwise waits in the queue (at most once per shift
+ *    register, latest wins). Each transfer complete interrupt latches its
+ *    shift register, then starts the next queued one, so the transfers go
+ *    out back to back. An SPI_TIM_Latch shift register holds the bus until
+ *    its latch pulse is over, as the next transfer would otherwise shift
+ *    its data along before it is latched.
+ *
+ *    74HC165 parallel-in shift registers can be read on the same bus, with
+ *    their QH output on MISO. SH/LD is pulsed low before each transfer,
+ *    which loads the inputs, and they are shifted in while the outputs
+ *    are shifted out, in a single full-duplex DMA transfer. Writes shorter
+ *    than the input cascade are led by zero bytes, which shift out past
+ *    the end of the 74HC595 cascade. At the end of the transfer, the
+ *    received bytes are compared with the previous ones, and the input
+ *    change callback is given a mask of the inputs which changed.
+ *    Shift_Reg_Scan_Inputs reads them without a new write, by sending the
+ *    last write again. This reads 8 inputs per 74HC165 with one interrupt
+ *    per scan, whereas EXTI can only tell apart 16 pins (see buttons.h).
+ *
+ *    Every mode calls the write complete callback (if registered) once the
+ *    data is latched: from the timer or SPI interrupt in the non-blocking
+ *    modes, and before Shift_Reg_Write returns in GPIO mode.
  *
  *  Usage:
  *
@@ -91,6 +201,24 @@
  *
  *      // ...
  *
+ *      // optionally, be told when the outputs are updated
+ *      void Shift_Reg_Done(Shift_Reg *shift_reg) {
+ *          // ...
+ *      }
+ *      Shift_Reg_Register_Complete_Callback(shift_reg, Shift_Reg_Done);
+ *
+ *      // ...
+ *
+ *      // optionally, read 74HC165 inputs during each write (SPI_DMA only)
+ *      void Switches_Changed(Shift_Reg *shift_reg, const uint8_t *changed) {
+ *          // ...
+ *      }
+ *      Shift_Reg_SPI_DMA_Attach_Input(shift_reg, PL_GPIO_Port, PL_Pin, 4);
+ *      Shift_Reg_Register_Input_Callback(shift_reg, Switches_Changed);
+ *
+ *      // e.g. every 10 ms
+ *      Shift_Reg_Scan_Inputs(shift_reg);
+ *
  *  Created on: Mar 19, 2024
  *      Authors: Gavin Hua
  *         David Melisso
@@ -107,21 +235,36 @@
   #include "stm32f4xx_hal.h"
   #include "stm32f4xx_hal_spi.h"
 #endif // End of HAL_SPI_MODULE_ENABLED check
-#include <stdlib.h>
+
+// the longest cascade a non-blocking shift register can write; like the
+// pool sizes below, only ever set it in the compiler flags (see INIT)
+#ifndef SHIFT_REG_MAX_REGS
+#define SHIFT_REG_MAX_REGS 32
+#endif
+
+// the number of shift register handlers (of every mode) and SPI buses
+// which can be initialized; the handlers are allocated statically
+#ifndef SHIFT_REG_MAX_HANDLERS
+#define SHIFT_REG_MAX_HANDLERS 4
+#endif
+#ifndef SHIFT_REG_MAX_BUSES
+#define SHIFT_REG_MAX_BUSES 2
+#endif
 
 
 typedef enum {
-  Shift_Reg_SPI_HW_NSS_Mode,    // SPI with Hardware Slave Select
+  Shift_Reg_SPI_TIM_Latch_Mode, // SPI sent by DMA, with STCP pulsed by a timer
   Shift_Reg_SPI_SW_NSS_Mode,    // SPI with Software Slave Select
+  Shift_Reg_SPI_DMA_Mode,       // SPI with Software Slave Select, sent by DMA
   Shift_Reg_GPIO_Mode,          // Manual GPIO mode, blocking (no interrupts)
   Shift_Reg_GPIO_IT_Mode,       // Manual GPIO mode, non-blocking (with interrupts)
 } Shift_Reg_Mode;
 
-typedef struct {
+typedef struct Shift_Reg {
   /**
    * Mode, select from:
-   * SPI with hardware slave select,
    * SPI with software slave select,
+   * SPI with a timer latch,
    * GPIO (manual mode)
    */
   Shift_Reg_Mode Mode;
@@ -138,6 +281,15 @@ typedef struct {
   GPIO_TypeDef *DATA_Port;    // Register data input GPIO Port
   uint16_t     DATA_Pin;      // Register data input GPIO Pin
 
+  /**
+   * Precomputed BSRR words (GPIO modes)
+   */
+  uint32_t SHCP_Set;          // sets SHCP high
+  uint32_t SHCP_Reset;        // sets SHCP low
+  uint32_t DATA_BSRR[2];      // writes a 0/1 to DATA (and SHCP low if Shared_Port)
+  uint8_t  Shared_Port;       // 1 if SHCP and DATA are on the same port
+  uint32_t half_bit_cycles;   // minimum SHCP low/high time in GPIO mode, 0 for none
+
   /**
    * Memory for holding data between cycles
    */
@@ -149,15 +301,75 @@ typedef struct {
 
   TIM_HandleTypeDef  *htim;           // timer for timing GPIO outputs
 
+  struct Shift_Reg *next;             // next shift register on the same bus
+                                      // (or the next GPIO_IT shift register)
+
+  /**
+   * Double buffer (non-blocking modes only): one buffer is being sent,
+   * the other holds the latest write waiting for it
+   */
+  uint8_t tx_buffers[2][SHIFT_REG_MAX_REGS];
+  uint8_t tx_buffer_size;             // number of registers in the cascade
+  uint8_t tx_index;                   // the buffer being (or last) sent
+  volatile uint8_t pending_length;    // bytes waiting in the other buffer, 0 if none
+
+  /**
+   * Called once written data is latched (may be NULL)
+   */
+  void (*Write_Complete_Callback)(struct Shift_Reg *shift_reg);
+
   #ifdef HAL_SPI_MODULE_ENABLED
   /**
    * SPI handler
    */
   SPI_HandleTypeDef *hspi;
 
+  /**
+   * Bus arbitration (SPI modes only)
+   */
+  struct Shift_Reg_Bus *bus;          // the bus shared with other shift registers
+  struct Shift_Reg *queue_next;       // next shift register waiting for the bus
+  volatile uint8_t queued;            // 1 if waiting for the bus
+
+  /**
+   * Latch timer channel (SPI_TIM_Latch only; the timer is htim)
+   */
+  uint32_t latch_channel;
+  uint8_t  latch_bits_per_count;      // SCK edges per timer count (the ETR prescaler)
+
+  /**
+   * 74HC165 input chain, read during every transfer (SPI_DMA only)
+   */
+  GPIO_TypeDef *PL_Port;              // parallel load (SH/LD) GPIO Port
+  uint16_t     PL_Pin;                // parallel load (SH/LD) GPIO Pin
+  uint8_t in_num_regs;                // number of 74HC165, 0 if none attached
+  uint8_t in_buffer[SHIFT_REG_MAX_REGS];  // received by DMA
+  uint8_t in_states[SHIFT_REG_MAX_REGS];  // the inputs, as of the last transfer
+  uint8_t tx_length;                  // bytes in the write being (or last) sent
+
+  /**
+   * Called when inputs change (may be NULL)
+   */
+  void (*Input_Change_Callback)(struct Shift_Reg *shift_reg, const uint8_t *changed);
+
   #endif // End of HAL_SPI_MODULE_ENABLED check
 } Shift_Reg;
 
+#ifdef HAL_SPI_MODULE_ENABLED
+/**
+ * The shift registers on one SPI bus, and the writes waiting for it.
+ * Taken from a pool of SHIFT_REG_MAX_BUSES by the first SPI init on the bus.
+ */
+typedef struct Shift_Reg_Bus {
+  SPI_HandleTypeDef *hspi;
+  Shift_Reg *devices;                 // every shift register on the bus
+  Shift_Reg *volatile active;         // being sent (until latched), NULL if idle
+  Shift_Reg *queue_head;              // waiting to be sent, oldest first
+  Shift_Reg *queue_tail;
+  struct Shift_Reg_Bus *next;
+} Shift_Reg_Bus;
+#endif // End of HAL_SPI_MODULE_ENABLED check
+
 /**
  * Initializes shift register using GPIO. Does not use interrupts,
  * so this is blocking.
@@ -175,12 +387,97 @@ typedef struct {
  * @param data_pin    the GPIO pin corresponding with the data pin of the
  *                    74HC595
  *
- * @retval the Shift_Reg handler configured to the given pins
+ * @retval the Shift_Reg handler configured to the given pins, or NULL if
+ *         SHIFT_REG_MAX_HANDLERS are already initialized
  */
 Shift_Reg *Shift_Reg_GPIO_Init(GPIO_TypeDef *shcp_port, uint16_t shcp_pin,
           GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
           GPIO_TypeDef *data_port, uint16_t data_pin);
 
+/**
+ * Caps the bit rate of a GPIO mode shift register, e.g. for long cables
+ * whose edges are too slow for the full GPIO speed. Initializes the DWT
+ * cycle counter.
+ *
+ * @param shift_reg   a reference to a GPIO mode shift register
+ * @param bit_rate_hz the maximum bit rate, or 0 to remove the cap
+ *
+ * @error   returns HAL_ERROR if the shift register is not in GPIO mode
+ *
+ * @retval  the HAL_StatusTypeDef status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_GPIO_Set_Max_Bit_Rate(Shift_Reg *shift_reg, uint32_t bit_rate_hz);
+
+#ifdef SHIFT_REG_GPIO_BENCHMARK
+/**
+ * Cycles and bit rates of the blocking GPIO write paths, measured on the
+ * target by Shift_Reg_GPIO_Benchmark.
+ */
+typedef struct {
+  uint32_t bits;                // bits shifted out by each path
+  uint32_t hal_cycles;          // three HAL_GPIO_WritePin calls a bit (the
+                                // write before the precomputed BSRR words)
+  uint32_t fast_cycles;         // the BSRR stores, unrolled (no cap)
+  uint32_t capped_cycles;       // the BSRR stores, at the capped rate
+  float hal_bits_per_us;
+  float fast_bits_per_us;
+  float capped_bits_per_us;
+} Shift_Reg_GPIO_Benchmark_Result;
+
+/**
+ * Times the blocking GPIO write paths with the DWT cycle counter, each
+ * shifting out SHIFT_REG_MAX_REGS bytes with interrupts disabled. STCP is
+ * not pulsed, so the outputs do not change, but the cascade is left full
+ * of the test pattern: write the real data again afterwards.
+ *
+ * Only built if SHIFT_REG_GPIO_BENCHMARK is defined (in the compiler flags).
+ *
+ * @param shift_reg       a reference to a GPIO mode shift register
+ * @param capped_rate_hz  the bit rate for the capped path, e.g. 1000000
+ * @param result          filled with the measurements
+ *
+ * @error   returns HAL_ERROR if the shift register is not in GPIO mode, or
+ *          capped_rate_hz is 0
+ *
+ * @retval  the HAL_StatusTypeDef status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_GPIO_Benchmark(Shift_Reg *shift_reg, uint32_t capped_rate_hz,
+                                           Shift_Reg_GPIO_Benchmark_Result *result);
+#endif // #ifdef SHIFT_REG_GPIO_BENCHMARK
+
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+/**
+ * Initializes shift register using GPIO, paced by a timer. Each timer
+ * interrupt shifts out one bit, so this is non-blocking.
+ *
+ * @param htim          the timer handler used solely by this shift register
+ * @param bit_period_us the time between bits, in us
+ * @param shcp_port     the GPIO port corresponding with the SHCP pin of the
+ *                      74HC595
+ * @param shcp_pin      the GPIO pin corresponding with the SHCP pin of the
+ *                      74HC595
+ * @param stcp_port     the GPIO port corresponding with the STCP pin of the
+ *                      74HC595
+ * @param stcp_pin      the GPIO pin corresponding with the STCP pin of the
+ *                      74HC595
+ * @param data_port     the GPIO port corresponding with the data pin of the
+ *                      74HC595
+ * @param data_pin      the GPIO pin corresponding with the data pin of the
+ *                      74HC595
+ * @param num_regs      the number of 74HC595 in the cascade (the most bytes
+ *                      that can be written at once), up to SHIFT_REG_MAX_REGS
+ *
+ * @retval the Shift_Reg handler configured to the given timer and pins,
+ *         or NULL if the timer could not be initialized, or
+ *         SHIFT_REG_MAX_HANDLERS are already initialized
+ */
+Shift_Reg *Shift_Reg_GPIO_IT_Init(TIM_HandleTypeDef *htim, uint16_t bit_period_us,
+          GPIO_TypeDef *shcp_port, uint16_t shcp_pin,
+          GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
+          GPIO_TypeDef *data_port, uint16_t data_pin,
+          uint8_t num_regs);
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
 #ifdef HAL_SPI_MODULE_ENABLED
 
 #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
@@ -198,29 +495,140 @@ Shift_Reg *Shift_Reg_GPIO_Init(GPIO_TypeDef *shcp_port, uint16_t shcp_pin,
  * @param stcp_pin    the GPIO pin corresponding with the STCP pin of the
  *                    74HC595
  *
- * @retval the Shift_Reg handler configured to the given SPI bus and NSS pin
+ * @retval the Shift_Reg handler configured to the given SPI bus and NSS pin,
+ *         or NULL if the SPI bus is misconfigured, or there is no handler
+ *         or bus left (see SHIFT_REG_MAX_HANDLERS)
  */
 Shift_Reg *Shift_Reg_SPI_SW_NSS_Init(SPI_HandleTypeDef *hspi,
                               GPIO_TypeDef *stcp_port, uint16_t stcp_pin);
 
-#endif // #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
-
+/**
+ * Initializes shift register using SPI with DMA, with software slave
+ * select pin.
+ *
+ * Wired as for Shift_Reg_SPI_SW_NSS_Init, but every write is sent in a
+ * single DMA transfer, and STCP is latched when the transfer completes.
+ *
+ * @param hspi        the spi handler corresponding to the SPI bus connected
+ *                    to the 74HC595, with a TX DMA stream linked
+ * @param stcp_port   the GPIO port corresponding with the STCP pin of the
+ *                    74HC595
+ * @param stcp_pin    the GPIO pin corresponding with the STCP pin of the
+ *                    74HC595
+ * @param num_regs    the number of 74HC595 in the cascade (the most bytes
+ *                    that can be written at once), up to SHIFT_REG_MAX_REGS
+ *
+ * @retval the Shift_Reg handler configured to the given SPI bus and NSS pin,
+ *         or NULL if the SPI bus has no TX DMA stream, or there is no
+ *         handler or bus left (see SHIFT_REG_MAX_HANDLERS)
+ */
+Shift_Reg *Shift_Reg_SPI_DMA_Init(SPI_HandleTypeDef *hspi,
+                              GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
+                              uint8_t num_regs);
 
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
 /**
- * Initializes shift register using SPI, with hardware slave select pin.
+ * Initializes shift register using SPI with DMA, with STCP latched by a
+ * timer output.
  *
- * This is the most preferred method of interfacing with the 74HC595 chip.
- * Use this method if your SPI bus is connected as:
- * MOSI -> DATA
- * SCK  -> SHCP
- * NSS  -> STCP
+ * Use this if your SPI bus is connected as:
+ * MOSI     -> DATA
+ * SCK      -> SHCP, and the timer's TIMx_ETR
+ * TIMx_CHy -> STCP
+ *
+ * The timer is reconfigured (clocked from ETR, PWM mode 2 on the channel)
+ * for the latch.
  *
  * @param hspi        the spi handler corresponding to the SPI bus connected
- *                    to the 74HC595
+ *                    to the 74HC595, with a TX DMA stream linked
+ * @param htim        the timer handler whose channel is connected to STCP
+ * @param channel     the timer channel connected to STCP (TIM_CHANNEL_y)
+ * @param num_regs    the number of 74HC595 in the cascade (the most bytes
+ *                    that can be written at once), up to SHIFT_REG_MAX_REGS
+ *
+ * @retval the Shift_Reg handler configured to the given SPI bus and timer,
+ *         or NULL if the SPI bus has no TX DMA stream or idles SCK high,
+ *         the timer has no ETR input, SCK is too fast for it to count, the
+ *         timer could not be configured, or there is no handler or bus
+ *         left (see SHIFT_REG_MAX_HANDLERS)
+ */
+Shift_Reg *Shift_Reg_SPI_TIM_Latch_Init(SPI_HandleTypeDef *hspi, TIM_HandleTypeDef *htim,
+                              uint32_t channel, uint8_t num_regs);
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+/**
+ * Attaches a cascade of 74HC165 input shift registers to an SPI_DMA shift
+ * register on the same bus. Every write of the shift register then also
+ * reads the inputs, in the same full-duplex DMA transfer.
+ *
+ * Wired as:
+ * SCK      -> CLK (every 74HC165)
+ * MISO     <- QH  (of the first 74HC165)
+ * GPIO pin -> SH/LD (every 74HC165)
+ * with CLK INH low, and SER of the last 74HC165 low.
+ *
+ * @param shift_reg   an SPI_DMA shift register
+ * @param pl_port     the GPIO port corresponding with the SH/LD pin of the
+ *                    74HC165
+ * @param pl_pin      the GPIO pin corresponding with the SH/LD pin of the
+ *                    74HC165
+ * @param num_regs    the number of 74HC165 in the cascade, up to
+ *                    SHIFT_REG_MAX_REGS
+ *
+ * @error   returns HAL_ERROR if the shift register is not in SPI_DMA mode,
+ *          the SPI bus is not full duplex or has no RX DMA stream, or
+ *          num_regs is out of range
  *
- * @retval the Shift_Reg handler configured to the given SPI bus
+ * @retval  the HAL_StatusTypeDef status of the operation
  */
-// Shift_Reg *Shift_Reg_SPI_HW_NSS_Init(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef Shift_Reg_SPI_DMA_Attach_Input(Shift_Reg *shift_reg,
+                              GPIO_TypeDef *pl_port, uint16_t pl_pin,
+                              uint8_t num_regs);
+
+/**
+ * Reads the inputs, by writing the outputs again (or, if a write is
+ * waiting, with that write). Non-blocking; the inputs are updated, and
+ * the input change callback called, at the end of the transfer.
+ *
+ * @param shift_reg   a shift register with inputs attached
+ *
+ * @error   returns HAL_ERROR if no inputs are attached, or the error
+ *          starting the transfer
+ *
+ * @retval  the HAL_StatusTypeDef status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_Scan_Inputs(Shift_Reg *shift_reg);
+
+/**
+ * Copies the inputs as of the last transfer. Input n is bit (n % 8) of
+ * byte (n / 8), byte 0 being the 74HC165 connected to MISO, and bit 7 its
+ * input H (D7).
+ *
+ * @param shift_reg   a shift register with inputs attached
+ * @param states      the array to copy the inputs into, one byte per 74HC165
+ *
+ * @error   returns HAL_ERROR if no inputs are attached
+ *
+ * @retval  the HAL_StatusTypeDef status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_Read_Inputs(Shift_Reg *shift_reg, uint8_t *states);
+
+/**
+ * Registers a function to be called, from the transfer complete
+ * interrupt, when any input changes.
+ *
+ * @param shift_reg   a shift register with inputs attached
+ * @param callback    the function to call, given a mask of the inputs which
+ *                    changed (laid out as for Shift_Reg_Read_Inputs), or
+ *                    NULL for none
+ */
+void Shift_Reg_Register_Input_Callback(Shift_Reg *shift_reg,
+                              void (*callback)(Shift_Reg *shift_reg, const uint8_t *changed));
+
+#endif // #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
+
+
+
 
 
 
@@ -229,15 +637,30 @@ Shift_Reg *Shift_Reg_SPI_SW_NSS_Init(SPI_HandleTypeDef *hspi,
 /**
  * Writes a value to a cascade of 74HC595 chips.
  *
+ * In the non-blocking modes, the data is copied, and sent once the
+ * previous write is latched, replacing any other write still waiting.
+ *
  * @param shift_reg   a reference to the shift register instance
  * @param data        array of bytes to store in the shift registers
  * @param data_length the number of bytes in data
  *
- * @error   return HAL_StatusTypeDef error
+ * @error   return HAL_StatusTypeDef error; HAL_ERROR if data_length is
+ *          longer than the cascade (non-blocking modes)
  *
  * @retval  the HAL_StatusTypeDef status of the operation
  */
 HAL_StatusTypeDef Shift_Reg_Write(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length);
 
+/**
+ * Registers a function to be called once written data is latched onto
+ * the outputs. In the GPIO_IT and SPI modes, it is called from an interrupt.
+ * In SPI_TIM_Latch mode, it is called from the latch timer interrupt, once
+ * STCP has risen.
+ *
+ * @param shift_reg   a reference to the shift register instance
+ * @param callback    the function to call, or NULL for none
+ */
+void Shift_Reg_Register_Complete_Callback(Shift_Reg *shift_reg, void (*callback)(Shift_Reg *shift_reg));
+
 
 #endif /* INC_SHIFT_REG_H_ */
@@ -0,0 +1,179 @@
+/*
+ * shift_reg_bcm.h
+ *
+ * Brightness control for LEDs on a cascade of 74HC595 shift registers,
+ * by binary code modulation (BCM).
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. TIMERS:
+ *      - In your IOC file, activate a timer to be used for the sole
+ *        purpose of the refresh (a basic timer, TIM6/TIM7, is enough)
+ *      - In your NVIC, ensure that 'TIMx global interrupt' is enabled
+ *      - Ensure that USE_HAL_TIM_REGISTER_CALLBACKS is set to 1U in
+ *        stm32f4xx_hal_conf.h (see buttons.h)
+ *    2. SHIFT REGISTER:
+ *      - Use an SPI_DMA or SPI_TIM_Latch shift register (see shift_reg.h),
+ *        on a SPI bus of its own. Other writes on the bus delay the planes
+ *        and show as flicker
+ *      - Prefer SPI_TIM_Latch: SPI_DMA latches from the transfer complete
+ *        interrupt, whose latency adds to the error of every plane (see
+ *        Principle of Operation)
+ *      - Do not call Shift_Reg_Write on the shift register yourself while
+ *        the refresh is running
+ *    3. TIMING:
+ *      - The shortest plane lasts 1 / (refresh_hz * (2^bits - 1)), and
+ *        must be longer than a write of the cascade (8 bits per register
+ *        at the SPI bit rate, plus the interrupt latency), otherwise planes
+ *        are dropped. E.g. 8 bits at 100 Hz gives 39 us, enough for 32
+ *        registers at 9 Mbit/s
+ *      - Use a refresh_hz of at least 100, so the LEDs do not flicker
+ *    4. POOL:
+ *      - Handlers come from a static pool of SHIFT_REG_BCM_MAX_HANDLERS;
+ *        Shift_Reg_BCM_Init returns NULL once it is used up
+ *
+ * Principle of Operation:
+ *    A level of `bits` bits is shown by showing each of its bits in turn,
+ *    bit k for 2^k time units: over a period of 2^bits - 1 units, an output
+ *    of level L is on for exactly L units.
+ *
+ *    The outputs are kept as `bits` bit planes, plane k being the image
+ *    (one byte per register, as for Shift_Reg_Write) of bit k of every
+ *    level. Setting a level updates the planes, so the refresh itself only
+ *    sends precomputed planes.
+ *
+ *    The timer interrupts once per plane, with its auto-reload preloaded
+ *    with the length of the next plane. Each interrupt writes the plane
+ *    to the shift register by DMA, which latches it at the end of the
+ *    transfer. The timer keeps counting through the interrupts, so the
+ *    planes start on time, but each is latched a little after its start:
+ *    the latency of the timer interrupt, the transfer, and (SPI_DMA only)
+ *    the latency of the transfer complete interrupt which raises STCP. A
+ *    plane is shown for its length plus the difference between its delay
+ *    and the next plane's, so the interrupt latencies (e.g. from CAN
+ *    interrupts) show as error on the shortest planes. SPI_TIM_Latch
+ *    raises STCP from the timer, a fixed number of SCK edges after the
+ *    transfer starts, leaving only the timer interrupt's latency.
+ *
+ *    A refresh is `bits` interrupts, each a few dozen instructions, against
+ *    2^bits - 1 for PWM from a timer interrupt, or one per output per
+ *    level for software PWM.
+ *
+ * Usage:
+ *
+ *      #import "shift_reg_bcm.h"
+ *
+ *      // ...
+ *
+ *      Shift_Reg *shift_reg = Shift_Reg_SPI_DMA_Init(&hspi1, STCP_GPIO_Port, STCP_Pin, 4);
+ *      Shift_Reg_BCM *bcm = Shift_Reg_BCM_Init(shift_reg, &htim6, 4, 6, 200);
+ *      Shift_Reg_BCM_Start(bcm);
+ *
+ *      // ...
+ *
+ *      // output 3 at half brightness (levels are 0 to 63 with 6 bits)
+ *      Shift_Reg_BCM_Set(bcm, 3, 32);
+ *
+ *      // night mode: every output dimmed
+ *      Shift_Reg_BCM_Set_All(bcm, 8);
+ */
+
+#ifndef INC_SHIFT_REG_BCM_H_
+#define INC_SHIFT_REG_BCM_H_
+
+#include "shift_reg.h"
+
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+/* Definitions */
+
+// the most bits per level (and so bit planes)
+#define SHIFT_REG_BCM_MAX_BITS 8
+
+// the number of BCM handlers which can be initialized (set it, if at all,
+// in the compiler flags, as for the sizes in shift_reg.h)
+#ifndef SHIFT_REG_BCM_MAX_HANDLERS
+#define SHIFT_REG_BCM_MAX_HANDLERS 1
+#endif
+
+typedef struct {
+  Shift_Reg *shift_reg;
+  TIM_HandleTypeDef *htim;
+  uint8_t num_regs;
+  uint8_t bits;                       // bits per level
+  uint16_t unit_ticks;                // timer ticks of the shortest plane
+
+  uint8_t planes[SHIFT_REG_BCM_MAX_BITS][SHIFT_REG_MAX_REGS];
+  volatile uint8_t plane;             // the plane being shown
+} Shift_Reg_BCM;
+
+/* Functions */
+
+/**
+ * Sets up BCM over a shift register, with every output off. Configures
+ * the timer, but does not start it.
+ *
+ * @param shift_reg   the shift register the LEDs are on
+ * @param htim        the timer handler used solely for the refresh
+ * @param num_regs    the number of 74HC595 in the cascade, up to
+ *                    SHIFT_REG_MAX_REGS
+ * @param bits        the bits per level (1 to SHIFT_REG_BCM_MAX_BITS),
+ *                    for 2^bits levels
+ * @param refresh_hz  the number of times per second every plane is shown
+ *
+ * @retval the BCM handler, or NULL if a parameter is out of range, the
+ *         timer is too slow for the shortest plane or could not be
+ *         initialized, or SHIFT_REG_BCM_MAX_HANDLERS are already initialized
+ */
+Shift_Reg_BCM *Shift_Reg_BCM_Init(Shift_Reg *shift_reg, TIM_HandleTypeDef *htim,
+                                  uint8_t num_regs, uint8_t bits, uint16_t refresh_hz);
+
+/**
+ * Starts the refresh.
+ *
+ * @param bcm  the BCM handler
+ *
+ * @retval the status of starting the timer
+ */
+HAL_StatusTypeDef Shift_Reg_BCM_Start(Shift_Reg_BCM *bcm);
+
+/**
+ * Stops the refresh. The outputs keep the last plane shown.
+ *
+ * @param bcm  the BCM handler
+ *
+ * @retval the status of stopping the timer
+ */
+HAL_StatusTypeDef Shift_Reg_BCM_Stop(Shift_Reg_BCM *bcm);
+
+/**
+ * Sets the level of an output, shown from the next plane on.
+ *
+ * @param bcm     the BCM handler
+ * @param output  the output, bit (output % 8) of register byte (output / 8)
+ * @param level   0 (off) to 2^bits - 1 (fully on)
+ *
+ * @error returns HAL_ERROR if the output is outside the cascade, or the
+ *        level is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_BCM_Set(Shift_Reg_BCM *bcm, uint16_t output, uint8_t level);
+
+/**
+ * Sets every output to the same level.
+ *
+ * @param bcm     the BCM handler
+ * @param level   0 (off) to 2^bits - 1 (fully on)
+ *
+ * @error returns HAL_ERROR if the level is out of range
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_BCM_Set_All(Shift_Reg_BCM *bcm, uint8_t level);
+
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+#endif /* INC_SHIFT_REG_BCM_H_ */
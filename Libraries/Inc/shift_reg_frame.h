@@ -0,0 +1,191 @@
+/*
+ * shift_reg_frame.h
+ *
+ * Frame buffer for a cascade of 74HC595 shift registers, only sending
+ * what changed.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * IMPORTANT NOTES/TROUBLESHOOTING:
+ *    1. INIT:
+ *      - Initialize the shift register first (see shift_reg.h), then
+ *        create the frame over it
+ *      - Add every owner before the outputs are written
+ *      - Frames come from a static pool of SHIFT_REG_FRAME_MAX_FRAMES;
+ *        Shift_Reg_Frame_Init returns NULL once it is used up
+ *    2. FLUSHING:
+ *      - Nothing is sent until Shift_Reg_Frame_Flush is called. Call it
+ *        from the main loop (e.g. after CAN_Std_RX_Dispatch), so all the
+ *        changes since the last flush go out in one write
+ *      - Do not also call Shift_Reg_Write on the same shift register
+ *    3. OWNERS:
+ *      - Owner masks may not overlap, so two owners can never fight over
+ *        an output. The unmasked functions (Set_Bit, Set_Byte) ignore the
+ *        owners, and should not be mixed with them on the same outputs
+ *
+ * Principle of Operation:
+ *    The frame holds two images of the outputs, one byte per register:
+ *      - the image, which the setters modify
+ *      - the latched image, the last image given to Shift_Reg_Write
+ *
+ *    Shift_Reg_Frame_Flush compares the two, and only writes the image if
+ *    it differs, so setting an output to the value it already has costs
+ *    nothing. With dozens of LEDs set from many CAN handlers, most of which
+ *    repeat the current state, this turns every handler call into at most
+ *    one write per flush.
+ *
+ *    Byte i of the image is data[i] given to Shift_Reg_Write (the first
+ *    byte shifted out), and output bit n is bit (n % 8) of byte (n / 8).
+ *
+ *    An owner is a mask of the outputs one part of the code is responsible
+ *    for, e.g. the warning LEDs or the shift light on a shared chain.
+ *    Shift_Reg_Frame_Write_Owner replaces only the owner's outputs:
+ *      image = (image & ~mask) | (values & mask)
+ *
+ *    Every change is made in a short critical section, so outputs may be
+ *    set from interrupts as well as the main loop.
+ *
+ * Usage:
+ *
+ *      #import "shift_reg_frame.h"
+ *
+ *      // ...
+ *
+ *      Shift_Reg *shift_reg = Shift_Reg_SPI_DMA_Init(&hspi1, STCP_GPIO_Port, STCP_Pin, 4);
+ *      Shift_Reg_Frame *frame = Shift_Reg_Frame_Init(shift_reg, 4);
+ *
+ *      // the shift light owns register 0, the warnings the low half of register 1
+ *      uint8_t shift_light_mask[4] = { 0xFF, 0x00, 0x00, 0x00 };
+ *      uint8_t warnings_mask[4]    = { 0x00, 0x0F, 0x00, 0x00 };
+ *      int8_t shift_light = Shift_Reg_Frame_Add_Owner(frame, shift_light_mask);
+ *      int8_t warnings    = Shift_Reg_Frame_Add_Owner(frame, warnings_mask);
+ *
+ *      // ...
+ *
+ *      // in a CAN handler
+ *      uint8_t lights[4] = { 0xFF >> (8 - num_lit) };
+ *      Shift_Reg_Frame_Write_Owner(frame, shift_light, lights);
+ *
+ *      // single outputs
+ *      Shift_Reg_Frame_Set_Bit(frame, 31, 1);
+ *
+ *      // ...
+ *
+ *      // main loop
+ *      while (1) {
+ *          CAN_Std_RX_Dispatch(8);
+ *          Shift_Reg_Frame_Flush(frame);
+ *      }
+ */
+
+#ifndef INC_SHIFT_REG_FRAME_H_
+#define INC_SHIFT_REG_FRAME_H_
+
+#include "shift_reg.h"
+
+/* Definitions */
+
+// maximum number of owners of one frame
+#define SHIFT_REG_FRAME_MAX_OWNERS 8
+
+// the number of frames which can be initialized (set it, if at all, in
+// the compiler flags, as for the sizes in shift_reg.h)
+#ifndef SHIFT_REG_FRAME_MAX_FRAMES
+#define SHIFT_REG_FRAME_MAX_FRAMES 2
+#endif
+
+typedef struct {
+  Shift_Reg *shift_reg;
+  uint8_t num_regs;
+
+  uint8_t image[SHIFT_REG_MAX_REGS];          // the outputs as set
+  uint8_t latched[SHIFT_REG_MAX_REGS];        // the outputs as last written
+  volatile uint8_t dirty;                     // 1 if image may differ from latched
+
+  uint8_t num_owners;
+  uint8_t owner_masks[SHIFT_REG_FRAME_MAX_OWNERS][SHIFT_REG_MAX_REGS];
+  uint8_t owned[SHIFT_REG_MAX_REGS];          // union of all owner masks
+} Shift_Reg_Frame;
+
+/* Functions */
+
+/**
+ * Creates a frame over a shift register, with every output off. The
+ * outputs are written on the first flush.
+ *
+ * @param shift_reg   the shift register the frame is written to
+ * @param num_regs    the number of 74HC595 in the cascade, up to
+ *                    SHIFT_REG_MAX_REGS
+ *
+ * @retval the frame, or NULL if num_regs is out of range, or
+ *         SHIFT_REG_FRAME_MAX_FRAMES are already initialized
+ */
+Shift_Reg_Frame *Shift_Reg_Frame_Init(Shift_Reg *shift_reg, uint8_t num_regs);
+
+/**
+ * Adds an owner of some of the outputs.
+ *
+ * @param frame  the frame
+ * @param mask   num_regs bytes, with the owner's outputs set
+ *
+ * @error returns -1 if the frame has SHIFT_REG_FRAME_MAX_OWNERS owners, or
+ *        the mask overlaps another owner's
+ *
+ * @retval the owner, to pass to Shift_Reg_Frame_Write_Owner
+ */
+int8_t Shift_Reg_Frame_Add_Owner(Shift_Reg_Frame *frame, const uint8_t *mask);
+
+/**
+ * Replaces the outputs of an owner, leaving the others as they are.
+ *
+ * @param frame   the frame
+ * @param owner   the owner returned by Shift_Reg_Frame_Add_Owner
+ * @param values  num_regs bytes; only the bits in the owner's mask are used
+ *
+ * @error returns HAL_ERROR if the owner does not exist
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_Frame_Write_Owner(Shift_Reg_Frame *frame, int8_t owner, const uint8_t *values);
+
+/**
+ * Sets a single output.
+ *
+ * @param frame  the frame
+ * @param bit    the output, bit (bit % 8) of register byte (bit / 8)
+ * @param value  0 for off, anything else for on
+ *
+ * @error returns HAL_ERROR if the output is outside the cascade
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_Frame_Set_Bit(Shift_Reg_Frame *frame, uint16_t bit, uint8_t value);
+
+/**
+ * Sets all 8 outputs of a register.
+ *
+ * @param frame  the frame
+ * @param index  the register byte
+ * @param value  the outputs
+ *
+ * @error returns HAL_ERROR if the register is outside the cascade
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_Frame_Set_Byte(Shift_Reg_Frame *frame, uint8_t index, uint8_t value);
+
+/**
+ * Writes the image to the shift register, if it changed since it was
+ * last written.
+ *
+ * @param frame  the frame
+ *
+ * @error returns the Shift_Reg_Write error; the frame stays dirty, so
+ *        the next flush retries
+ *
+ * @retval the status of the operation
+ */
+HAL_StatusTypeDef Shift_Reg_Frame_Flush(Shift_Reg_Frame *frame);
+
+#endif /* INC_SHIFT_REG_FRAME_H_ */
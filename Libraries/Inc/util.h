@@ -5,12 +5,306 @@
  *
  *  Created on: May 1, 2024
  *      Author: David Melisso
+ *
+ * Ring buffers:
+ *    Lock-free single-producer/single-consumer (SPSC) ring buffers, for
+ *    handing data from an interrupt to the main loop (or the other way).
+ *
+ *    IMPORTANT NOTES/TROUBLESHOOTING:
+ *      - Exactly one context may push, and exactly one context may pop.
+ *        With more than one producer or consumer, use a critical section
+ *      - The size must be a power of two
+ *
+ *    Principle of Operation:
+ *      The head (written only by the producer) and tail (written only by the
+ *      consumer) run freely and are masked on access, so head - tail is
+ *      always the fill level, and all size slots are usable. A __DMB orders
+ *      the slot contents against the index which publishes them: the
+ *      producer writes a slot before moving head, and the consumer reads a
+ *      slot before moving tail. No interrupts are ever disabled.
+ *
+ *      Batch functions move as many items as fit with a single index update.
+ *      Reserve/Commit and Peek/Release let the producer and consumer work on
+ *      a slot in place, without copying it.
+ *
+ *    Usage (C):
+ *
+ *      // in a header, or at file scope
+ *      UTIL_RING_DECLARE(Event_Ring, Event, 32)
+ *
+ *      static Event_Ring events;   // zero-initialised statics start empty
+ *
+ *      // interrupt
+ *      Event_Ring_Push(&events, &event);
+ *
+ *      // main loop
+ *      Event batch[8];
+ *      uint32_t num_events = Event_Ring_Pop_Batch(&events, batch, 8);
+ *
+ *    Usage (C++):
+ *
+ *      static Util_Ring<Event, 32> events;
+ *      events.Push(event);
+ *      uint32_t num_events = events.Pop_Batch(batch, 8);
  */
 
 #ifndef INC_UTIL_H_
 #define INC_UTIL_H_
 
+#include "stm32f4xx.h"
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Enables the DWT cycle counter, used for timing measurements.
+ * Safe to call more than once.
+ */
+void Util_Cycle_Counter_Init(void);
+
+/**
+ * @retval the current value of the free-running DWT cycle counter
+ */
+static inline uint32_t Util_Get_Cycles(void) {
+  return DWT->CYCCNT;
+}
+
+/**
+ * Converts a cycle count into microseconds at the current core clock.
+ *
+ * @param cycles  the number of core clock cycles
+ *
+ * @retval the number of microseconds
+ */
+static inline uint32_t Util_Cycles_To_Us(uint32_t cycles) {
+  return cycles / (SystemCoreClock / 1000000U);
+}
+
+/**
+ * Gets the frequency a timer counts at before its prescaler. This is twice
+ * the APB clock whenever the APB prescaler is not 1.
+ *
+ * @param instance  the timer peripheral (e.g. TIM3)
+ *
+ * @retval the timer kernel clock, in Hz
+ */
+uint32_t Util_Get_Timer_Clock(TIM_TypeDef *instance);
+
+// compile-time check, in C or C++ (C++ has no _Static_assert before C++23)
+#ifdef __cplusplus
+#define UTIL_STATIC_ASSERT(condition, message) static_assert(condition, message)
+#else
+#define UTIL_STATIC_ASSERT(condition, message) _Static_assert(condition, message)
+#endif
+
+/**
+ * Declares a ring buffer type, name, of size items of type, and its functions:
+ *
+ *   uint32_t name_Count(const name *ring)        items waiting
+ *   uint32_t name_Free(const name *ring)         free slots
+ *   void     name_Reset(name *ring)              empties the ring (not concurrently)
+ *
+ *   producer:
+ *   uint8_t  name_Push(name *ring, const type *item)                   1 if pushed
+ *   uint32_t name_Push_Batch(name *ring, const type *items, uint32_t n) number pushed
+ *   type    *name_Reserve(name *ring)           the next free slot, or NULL if full
+ *   void     name_Commit(name *ring)            publishes the reserved slot
+ *
+ *   consumer:
+ *   uint8_t  name_Pop(name *ring, type *item)                          1 if popped
+ *   uint32_t name_Pop_Batch(name *ring, type *items, uint32_t n)       number popped
+ *   type    *name_Peek(name *ring)              the oldest item, or NULL if empty
+ *   void     name_Release(name *ring)           frees the peeked item
+ */
+#define UTIL_RING_DECLARE(name, type, size)                                           \
+  UTIL_STATIC_ASSERT(((size) & ((size) - 1)) == 0 && (size) > 0,                      \
+                     #name " size must be a power of two");                           \
+                                                                                      \
+  typedef struct {                                                                    \
+    type buffer[size];                                                                \
+    volatile uint32_t head;   /* only written by the producer */                      \
+    volatile uint32_t tail;   /* only written by the consumer */                      \
+  } name;                                                                             \
+                                                                                      \
+  static inline uint32_t name##_Count(const name *ring) {                             \
+    return ring->head - ring->tail;                                                   \
+  }                                                                                   \
+  static inline uint32_t name##_Free(const name *ring) {                              \
+    return (size) - (ring->head - ring->tail);                                        \
+  }                                                                                   \
+  static inline void name##_Reset(name *ring) {                                       \
+    ring->head = 0;                                                                   \
+    ring->tail = 0;                                                                   \
+  }                                                                                   \
+                                                                                      \
+  static inline type *name##_Reserve(name *ring) {                                    \
+    uint32_t head = ring->head;                                                       \
+    if (head - ring->tail >= (size)) {                                                \
+        return NULL;                                                                  \
+    }                                                                                 \
+    return &ring->buffer[head & ((size) - 1)];                                        \
+  }                                                                                   \
+  static inline void name##_Commit(name *ring) {                                      \
+    /* publish the slot before the new head is visible to the consumer */             \
+    __DMB();                                                                          \
+    ring->head = ring->head + 1;                                                      \
+  }                                                                                   \
+  static inline uint8_t name##_Push(name *ring, const type *item) {                   \
+    type *slot = name##_Reserve(ring);                                                \
+    if (slot == NULL) {                                                               \
+        return 0;                                                                     \
+    }                                                                                 \
+    *slot = *item;                                                                    \
+    name##_Commit(ring);                                                              \
+    return 1;                                                                         \
+  }                                                                                   \
+  static inline uint32_t name##_Push_Batch(name *ring, const type *items, uint32_t n) { \
+    uint32_t head = ring->head;                                                       \
+    uint32_t space = (size) - (head - ring->tail);                                    \
+    if (n > space) {                                                                  \
+        n = space;                                                                    \
+    }                                                                                 \
+    /* at most two contiguous runs: up to the end of the buffer, then from 0 */       \
+    uint32_t start = head & ((size) - 1);                                             \
+    uint32_t first = ((size) - start < n) ? (size) - start : n;                       \
+    memcpy(&ring->buffer[start], items, first * sizeof(type));                        \
+    memcpy(&ring->buffer[0], items + first, (n - first) * sizeof(type));              \
+    __DMB();                                                                          \
+    ring->head = head + n;                                                            \
+    return n;                                                                         \
+  }                                                                                   \
+                                                                                      \
+  static inline type *name##_Peek(name *ring) {                                       \
+    uint32_t tail = ring->tail;                                                       \
+    if (tail == ring->head) {                                                         \
+        return NULL;                                                                  \
+    }                                                                                 \
+    /* read the slot after the head which published it */                             \
+    __DMB();                                                                          \
+    return &ring->buffer[tail & ((size) - 1)];                                        \
+  }                                                                                   \
+  static inline void name##_Release(name *ring) {                                     \
+    /* finish reading the slot before handing it back to the producer */              \
+    __DMB();                                                                          \
+    ring->tail = ring->tail + 1;                                                      \
+  }                                                                                   \
+  static inline uint8_t name##_Pop(name *ring, type *item) {                          \
+    type *slot = name##_Peek(ring);                                                   \
+    if (slot == NULL) {                                                               \
+        return 0;                                                                     \
+    }                                                                                 \
+    *item = *slot;                                                                    \
+    name##_Release(ring);                                                             \
+    return 1;                                                                         \
+  }                                                                                   \
+  static inline uint32_t name##_Pop_Batch(name *ring, type *items, uint32_t n) {      \
+    uint32_t tail = ring->tail;                                                       \
+    uint32_t count = ring->head - tail;                                               \
+    if (n > count) {                                                                  \
+        n = count;                                                                    \
+    }                                                                                 \
+    __DMB();                                                                          \
+    uint32_t start = tail & ((size) - 1);                                             \
+    uint32_t first = ((size) - start < n) ? (size) - start : n;                       \
+    memcpy(items, &ring->buffer[start], first * sizeof(type));                        \
+    memcpy(items + first, &ring->buffer[0], (n - first) * sizeof(type));              \
+    __DMB();                                                                          \
+    ring->tail = tail + n;                                                            \
+    return n;                                                                         \
+  }
+
+#ifdef __cplusplus
+}
+
+/**
+ * C++ equivalent of UTIL_RING_DECLARE, with the same functions as methods.
+ */
+template <typename T, uint32_t Size>
+class Util_Ring {
+  static_assert((Size & (Size - 1)) == 0 && Size > 0, "Util_Ring size must be a power of two");
+
+public:
+  uint32_t Count() const { return head - tail; }
+  uint32_t Free() const { return Size - (head - tail); }
+  void Reset() { head = 0; tail = 0; }
+
+  T *Reserve() {
+    uint32_t h = head;
+    if (h - tail >= Size) {
+        return nullptr;
+    }
+    return &buffer[h & (Size - 1)];
+  }
+  void Commit() {
+    __DMB();
+    head = head + 1;
+  }
+  bool Push(const T &item) {
+    T *slot = Reserve();
+    if (slot == nullptr) {
+        return false;
+    }
+    *slot = item;
+    Commit();
+    return true;
+  }
+  uint32_t Push_Batch(const T *items, uint32_t n) {
+    uint32_t h = head;
+    uint32_t space = Size - (h - tail);
+    if (n > space) {
+        n = space;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        buffer[(h + i) & (Size - 1)] = items[i];
+    }
+    __DMB();
+    head = h + n;
+    return n;
+  }
 
+  T *Peek() {
+    uint32_t t = tail;
+    if (t == head) {
+        return nullptr;
+    }
+    __DMB();
+    return &buffer[t & (Size - 1)];
+  }
+  void Release() {
+    __DMB();
+    tail = tail + 1;
+  }
+  bool Pop(T &item) {
+    T *slot = Peek();
+    if (slot == nullptr) {
+        return false;
+    }
+    item = *slot;
+    Release();
+    return true;
+  }
+  uint32_t Pop_Batch(T *items, uint32_t n) {
+    uint32_t t = tail;
+    uint32_t count = head - t;
+    if (n > count) {
+        n = count;
+    }
+    __DMB();
+    for (uint32_t i = 0; i < n; i++) {
+        items[i] = buffer[(t + i) & (Size - 1)];
+    }
+    __DMB();
+    tail = t + n;
+    return n;
+  }
 
+private:
+  T buffer[Size];
+  volatile uint32_t head = 0;   // only written by the producer
+  volatile uint32_t tail = 0;   // only written by the consumer
+};
+#endif // #ifdef __cplusplus
 
 #endif /* INC_UTIL_H_ */
@@ -9,17 +9,31 @@
  *
  * Functionality:
  *  All buttons are expected to be registered in the GPIO_EXTIx state, and should trigger
- * 	on both the rising and falling edge. All EXTI calls will reset the button timer's count,
- * 	and start the timer. When the button timer period elapses, the button pattern is
- * 	expected to have 'settled', so each of the registered button callbacks are called, with
- * 	the current state of the pin.
+ * 	on both the rising and falling edge. An EXTI call marks its button as settling, and
+ * 	starts the button timer if it is not already running; it never restarts it, so other
+ * 	buttons keep their progress. The timer ticks every BUTTON_TICK_MS while any button is
+ * 	settling. On each tick, every settling button's integrator counts up while its pin
+ * 	differs from its debounced state, and down while it matches. Reaching the button's
+ * 	own debounce time accepts the new state and calls the callback; decaying to zero means
+ * 	it bounced back. Either way the button is settled, and once none are the timer stops.
+ * 	A chattering button therefore only delays itself.
+ *
+ *  Button ports are polled instead, and need no EXTI. While any are registered the timer
+ *  runs continuously, and every scan_time each port's IDR is read once. Each pin has a
+ *  two bit vertical counter: bit 0 of every pin's count in count0, bit 1 in count1, so
+ *  all 16 pins count at once in a few bitwise operations. A pin's count advances while it
+ *  differs from its debounced state, and resets when it matches; the pin changes on the
+ *  fourth differing scan in a row.
  */
 
 /* INCLUDES */
 #include "stm32f4xx_hal.h"
 #include "buttons.h"
+#include "util.h"
 
 #define MAX_BUTTONS 16
+#define MAX_BUTTON_PORTS 4
+#define BUTTON_TICK_MS 1
 
 // ensure that timer register callbacks are enabled
 #if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
@@ -30,10 +44,14 @@ TIM_HandleTypeDef *htim_debounce; // timer used for debounce handling
 uint8_t NUM_BUTTONS = 0;          // current number of registered btns
 Button buttons[MAX_BUTTONS];      // array of registered buttons
 uint16_t button_mask;             // pin register mask of used EXTI pins
+uint16_t default_debounce_time;   // debounce time of new buttons, in ms
+uint8_t NUM_BUTTON_PORTS = 0;     // current number of registered ports
+Button_Port button_ports[MAX_BUTTON_PORTS]; // array of registered ports
 
 /* PRIVATE FUNCTIONS */
-static HAL_StatusTypeDef Debounce_Timer_Init(TIM_HandleTypeDef* htim, uint32_t debounce_time);
+static HAL_StatusTypeDef Debounce_Timer_Init(TIM_HandleTypeDef* htim);
 static void Debounce_Button_Pattern(TIM_HandleTypeDef *htim);
+static void Debounce_Button_Ports();
 
 /* FUNCTION IMPLEMENTATIONS */
 
@@ -48,9 +66,10 @@ HAL_StatusTypeDef Init_Button_Begin(TIM_HandleTypeDef* htim, uint32_t debounce_t
   initialized = 1;
 
   button_mask = 0;
+  default_debounce_time = debounce_time;
 
   // setup button debounce timer
-  return Debounce_Timer_Init(htim, debounce_time);
+  return Debounce_Timer_Init(htim);
 }
 
 Button *Init_Button(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState init_state, button_callback_t cb) {
@@ -80,65 +99,160 @@ Button *Init_Button(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState init_state,
 
   // add button to array
   button_mask |= pin;
-  buttons[NUM_BUTTONS] = (Button){ Port: port, Pin: pin, last_state: init_state, callback: cb};
+  buttons[NUM_BUTTONS] = (Button){ Port: port, Pin: pin, last_state: init_state, callback: cb,
+                                   debounce_ticks: default_debounce_time / BUTTON_TICK_MS };
   return &buttons[NUM_BUTTONS++];
 }
 
+HAL_StatusTypeDef Button_Set_Debounce(Button *button, uint16_t debounce_time) {
+  if (debounce_time < BUTTON_TICK_MS) {
+      return HAL_ERROR;
+  }
+  button->debounce_ticks = debounce_time / BUTTON_TICK_MS;
+  return HAL_OK;
+}
+
+
+Button_Port *Init_Button_Port(GPIO_TypeDef *port, uint16_t pins, uint8_t scan_time, button_port_callback_t cb) {
+
+  // ensure we have not initialized too many ports
+  if (NUM_BUTTON_PORTS == MAX_BUTTON_PORTS || pins == 0 || scan_time < BUTTON_TICK_MS) {
+      return NULL;
+  }
+
+  // start from the pins as they are, so nothing is reported until they change
+  button_ports[NUM_BUTTON_PORTS] = (Button_Port){ Port: port, pins: pins, callback: cb,
+                                                  state: port->IDR & pins,
+                                                  scan_ticks: scan_time / BUTTON_TICK_MS };
+  return &button_ports[NUM_BUTTON_PORTS++];
+}
 
 HAL_StatusTypeDef Init_Button_Finish() {
+  // polled ports need the tick all the time
+  if (NUM_BUTTON_PORTS > 0) {
+      return HAL_TIM_Base_Start_IT(htim_debounce);
+  }
   return HAL_OK;
 }
 
 /**
- * Calls button callbacks if the button state has changed.
+ * Scans every button port due, and calls its callback with the pins whose
+ * debounced state changed.
+ * Called on every tick of the button timer.
+ */
+static void Debounce_Button_Ports() {
+  for (uint8_t index = 0; index < NUM_BUTTON_PORTS; index++) {
+      Button_Port *port = &button_ports[index];
+      if (++port->ticks < port->scan_ticks) {
+          continue;
+      }
+      port->ticks = 0;
+
+      // count the pins which differ from their state, and reset the others
+      uint16_t delta = (port->Port->IDR ^ port->state) & port->pins;
+      port->count1 = (port->count1 ^ port->count0) & delta;
+      port->count0 = ~port->count0 & delta;
+
+      // a pin whose count wrapped to 0 has differed for four scans
+      uint16_t changed = delta & ~(port->count0 | port->count1);
+      if (changed != 0) {
+          port->state ^= changed;
+          port->callback(changed, port->state);
+      }
+  }
+}
+
+/**
+ * Scans the button ports, and advances the integrator of every settling
+ * button, calling its callback if its state has changed. Stops the timer
+ * once no button is settling, unless there are ports to scan.
  * Should be called when the button timer elapses.
  *
  * @param htim the timer handler whose period elapsed (should be the button timer)
  */
 static void Debounce_Button_Pattern(TIM_HandleTypeDef *htim) {
-  HAL_TIM_Base_Stop_IT(htim);
+  Debounce_Button_Ports();
+
+  uint8_t settling = 0;
   for (uint8_t button = 0; button < NUM_BUTTONS; button++) {
-      GPIO_PinState new_state = HAL_GPIO_ReadPin(buttons[button].Port, buttons[button].Pin);
-      if(new_state != buttons[button].last_state){
-          buttons[button].callback(new_state);
-          buttons[button].last_state = new_state;
+      Button *b = &buttons[button];
+      uint8_t changed = 0;
+
+      // an edge on this button may arrive between the read and the update
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      if (b->settling) {
+          GPIO_PinState new_state = HAL_GPIO_ReadPin(b->Port, b->Pin);
+          if (new_state != b->last_state) {
+              if (++b->integrator >= b->debounce_ticks) {
+                  b->last_state = new_state;
+                  b->integrator = 0;
+                  b->settling = 0;
+                  changed = 1;
+              }
+          }
+          else if (b->integrator == 0 || --b->integrator == 0) {
+              b->settling = 0;
+          }
+          settling |= b->settling;
+      }
+      __set_PRIMASK(primask);
+
+      if (changed) {
+          b->callback(b->last_state);
       }
   }
+
+  // an edge after the loop has settling set, and restarts the timer once stopped
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (!settling) {
+      for (uint8_t button = 0; button < NUM_BUTTONS; button++) {
+          settling |= buttons[button].settling;
+      }
+      if (!settling && NUM_BUTTON_PORTS == 0) {
+          HAL_TIM_Base_Stop_IT(htim);
+      }
+  }
+  __set_PRIMASK(primask);
   return;
 }
 
 HAL_StatusTypeDef Button_EXTI_Callback(uint16_t GPIO_Pin)
 {
-  HAL_StatusTypeDef status;
+  HAL_StatusTypeDef status = HAL_OK;
   // if pin is associated with a button
   if ( ( GPIO_Pin & button_mask ) != 0) {
-      // reset and start the timer
-      status = HAL_TIM_Base_Stop_IT(htim_debounce);
-      if (status != HAL_OK) {
-          return status;
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      for (uint8_t button = 0; button < NUM_BUTTONS; button++) {
+          if ( ( buttons[button].Pin & GPIO_Pin ) != 0 ) {
+              buttons[button].settling = 1;
+          }
       }
-      __HAL_TIM_SET_COUNTER(htim_debounce, 0);
-      status = HAL_TIM_Base_Start_IT(htim_debounce);
-      if (status != HAL_OK) {
-          return status;
+      // start the tick if it is not already running; never restart it, so
+      // the other buttons settling keep their timing
+      if (htim_debounce->State == HAL_TIM_STATE_READY) {
+          __HAL_TIM_SET_COUNTER(htim_debounce, 0);
+          status = HAL_TIM_Base_Start_IT(htim_debounce);
       }
+      __set_PRIMASK(primask);
   }
-  return HAL_OK;
+  return status;
 }
 
 
 /**
- * Initializes the button debounce timer.
+ * Initializes the button debounce timer, to tick every BUTTON_TICK_MS.
  *
  * @param htim pointer to the timer handler used for debouncing
- * @param debounce_time wait time for button pattern to settle, in ms
  */
-static HAL_StatusTypeDef Debounce_Timer_Init(TIM_HandleTypeDef* htim, uint32_t debounce_time)
+static HAL_StatusTypeDef Debounce_Timer_Init(TIM_HandleTypeDef* htim)
 {
   HAL_StatusTypeDef status;
 
-  htim->Init.Prescaler = HAL_RCC_GetPCLK1Freq()/10000 - 1;
-  htim->Init.Period = 10 * debounce_time - 1;
+  htim->Init.Prescaler = Util_Get_Timer_Clock(htim->Instance)/10000 - 1;
+  htim->Init.Period = 10 * BUTTON_TICK_MS - 1;
 
   htim->Init.CounterMode = TIM_COUNTERMODE_UP;
   htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
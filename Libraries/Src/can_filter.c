@@ -0,0 +1,365 @@
+/*
+ * can_filter.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See can_filter.h for usage and troubleshooting.
+ */
+
+#include "can_filter.h"
+
+#define CAN_FILTER_NUM_IDS   2048
+#define CAN_FILTER_EXACT     0x7FF
+
+// 16-bit filter register layout: STDID[10:0] RTR IDE EXTID[17:15]
+#define CAN_FILTER_16_SHIFT  5
+#define CAN_FILTER_16_RTR    0x10
+#define CAN_FILTER_16_IDE    0x08
+
+/* GLOBAL VARS */
+static uint32_t subscribed[CAN_FILTER_NUM_IDS / 32]; // bitmap of subscribed IDs
+
+static CAN_Filter_Element elements[CAN_FILTER_NUM_FIFOS][CAN_FILTER_MAX_ELEMENTS];
+static uint16_t num_elements[CAN_FILTER_NUM_FIFOS];
+
+static CAN_Filter_Bank banks[CAN_FILTER_NUM_BANKS];
+static uint8_t num_banks = 0;
+static uint8_t num_merges = 0;
+
+/* PRIVATE FUNCTIONS */
+static uint8_t Is_Subscribed(uint16_t id);
+static uint16_t Cover_Size(uint16_t mask);
+static HAL_StatusTypeDef Add_Element(uint8_t fifo, uint16_t id, uint16_t mask);
+static uint8_t Count_Banks(uint8_t fifo, uint8_t *singles_in_mask_banks);
+static void Merge_Cheapest(void);
+static void Build_Banks(uint8_t fifo, uint8_t *match_index);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+void CAN_Filter_Reset(void) {
+  for (uint16_t word = 0; word < CAN_FILTER_NUM_IDS / 32; word++) {
+      subscribed[word] = 0;
+  }
+  num_elements[0] = 0;
+  num_elements[1] = 0;
+  num_banks = 0;
+  num_merges = 0;
+}
+
+HAL_StatusTypeDef CAN_Filter_Subscribe(uint16_t id) {
+  return CAN_Filter_Subscribe_Range(id, id);
+}
+
+HAL_StatusTypeDef CAN_Filter_Subscribe_Range(uint16_t first, uint16_t last) {
+  if (first > last || last >= CAN_FILTER_NUM_IDS) {
+      return HAL_ERROR;
+  }
+
+  for (uint16_t id = first; id <= last; id++) {
+      subscribed[id >> 5] |= 1UL << (id & 0x1F);
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef CAN_Filter_Allocate(void) {
+  num_elements[0] = 0;
+  num_elements[1] = 0;
+  num_banks = 0;
+  num_merges = 0;
+
+  // split each run of subscribed IDs into aligned power-of-two blocks
+  uint16_t id = 0;
+  while (id < CAN_FILTER_NUM_IDS) {
+      if (!Is_Subscribed(id)) {
+          id++;
+          continue;
+      }
+
+      // runs never cross the FIFO boundary
+      uint16_t last = id;
+      while (last + 1 < CAN_FILTER_NUM_IDS && Is_Subscribed(last + 1) &&
+             (last + 1 != CAN_FILTER_FIFO1_FIRST_ID)) {
+          last++;
+      }
+
+      uint8_t fifo = (id >= CAN_FILTER_FIFO1_FIRST_ID) ? 1 : 0;
+      while (id <= last) {
+          uint16_t size = 1;
+          while ((id & (size * 2 - 1)) == 0 && id + size * 2 - 1 <= last) {
+              size *= 2;
+          }
+          if (Add_Element(fifo, id, CAN_FILTER_EXACT & ~(size - 1)) != HAL_OK) {
+              return HAL_ERROR;
+          }
+          id += size;
+      }
+  }
+
+  // nobody subscribed, accept everything
+  if (num_elements[0] == 0 && num_elements[1] == 0) {
+      Add_Element(0, 0, 0);
+  }
+
+  // merge filters until they fit in the hardware
+  uint8_t unused;
+  while (Count_Banks(0, &unused) + Count_Banks(1, &unused) > CAN_FILTER_NUM_BANKS) {
+      Merge_Cheapest();
+  }
+
+  uint8_t match_index = 0;
+  Build_Banks(0, &match_index);
+  match_index = 0;
+  Build_Banks(1, &match_index);
+
+  return HAL_OK;
+}
+
+const CAN_Filter_Bank *CAN_Filter_Get_Banks(uint8_t *count) {
+  *count = num_banks;
+  return banks;
+}
+
+uint8_t CAN_Filter_Accepts(uint16_t id, uint8_t *fifo) {
+  for (uint8_t bank = 0; bank < num_banks; bank++) {
+      uint8_t count = (banks[bank].mode == CAN_Filter_List_Mode) ? 4 : 2;
+      for (uint8_t index = 0; index < count; index++) {
+          const CAN_Filter_Element *element = &banks[bank].elements[index];
+          if ((id & element->mask) == (element->id & element->mask)) {
+              if (fifo != NULL) {
+                  *fifo = banks[bank].fifo;
+              }
+              return 1;
+          }
+      }
+  }
+  return 0;
+}
+
+void CAN_Filter_Get_Report(CAN_Filter_Report *report) {
+  *report = (CAN_Filter_Report){ .banks_used = num_banks, .merges = num_merges };
+
+  for (uint16_t id = 0; id < CAN_FILTER_NUM_IDS; id++) {
+      uint8_t is_subscribed = Is_Subscribed(id);
+      uint8_t is_accepted = CAN_Filter_Accepts(id, NULL);
+
+      report->subscribed_ids += is_subscribed;
+      report->accepted_ids += is_accepted;
+      if (is_accepted && !is_subscribed) {
+          report->false_accepts++;
+      }
+  }
+
+  if (report->accepted_ids > 0) {
+      report->false_accept_permille = (uint32_t)report->false_accepts * 1000 / report->accepted_ids;
+  }
+}
+
+#ifdef HAL_CAN_MODULE_ENABLED
+HAL_StatusTypeDef CAN_Filter_Apply(CAN_HandleTypeDef *hcan) {
+  HAL_StatusTypeDef status;
+
+  status = CAN_Filter_Allocate();
+  if (status != HAL_OK) {
+      return status;
+  }
+
+  for (uint8_t bank = 0; bank < CAN_FILTER_NUM_BANKS; bank++) {
+      CAN_FilterTypeDef filter = {
+          .FilterBank           = bank,
+          .FilterScale          = CAN_FILTERSCALE_16BIT,
+          .FilterMode           = CAN_FILTERMODE_IDLIST,
+          .FilterFIFOAssignment = CAN_FILTER_FIFO0,
+          .FilterActivation     = CAN_FILTER_DISABLE,
+          .SlaveStartFilterBank = CAN_FILTER_NUM_BANKS,
+      };
+
+      if (bank < num_banks) {
+          const CAN_Filter_Element *e = banks[bank].elements;
+          filter.FilterActivation     = CAN_FILTER_ENABLE;
+          filter.FilterFIFOAssignment = (banks[bank].fifo == 0) ? CAN_FILTER_FIFO0 : CAN_FILTER_FIFO1;
+
+          // IDE and RTR are always 0: standard data frames only
+          if (banks[bank].mode == CAN_Filter_List_Mode) {
+              filter.FilterMode       = CAN_FILTERMODE_IDLIST;
+              filter.FilterIdLow      = e[0].id << CAN_FILTER_16_SHIFT;
+              filter.FilterMaskIdLow  = e[1].id << CAN_FILTER_16_SHIFT;
+              filter.FilterIdHigh     = e[2].id << CAN_FILTER_16_SHIFT;
+              filter.FilterMaskIdHigh = e[3].id << CAN_FILTER_16_SHIFT;
+          }
+          else {
+              filter.FilterMode       = CAN_FILTERMODE_IDMASK;
+              filter.FilterIdLow      = e[0].id << CAN_FILTER_16_SHIFT;
+              filter.FilterMaskIdLow  = (e[0].mask << CAN_FILTER_16_SHIFT) | CAN_FILTER_16_RTR | CAN_FILTER_16_IDE;
+              filter.FilterIdHigh     = e[1].id << CAN_FILTER_16_SHIFT;
+              filter.FilterMaskIdHigh = (e[1].mask << CAN_FILTER_16_SHIFT) | CAN_FILTER_16_RTR | CAN_FILTER_16_IDE;
+          }
+      }
+
+      status = HAL_CAN_ConfigFilter(hcan, &filter);
+      if (status != HAL_OK) {
+          return status;
+      }
+  }
+
+  return HAL_OK;
+}
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
+
+static uint8_t Is_Subscribed(uint16_t id) {
+  return (subscribed[id >> 5] >> (id & 0x1F)) & 1;
+}
+
+/**
+ * @retval the number of IDs an element with the given mask accepts
+ */
+static uint16_t Cover_Size(uint16_t mask) {
+  return 1 << (11 - __builtin_popcount(mask & CAN_FILTER_EXACT));
+}
+
+static HAL_StatusTypeDef Add_Element(uint8_t fifo, uint16_t id, uint16_t mask) {
+  if (num_elements[fifo] >= CAN_FILTER_MAX_ELEMENTS) {
+      return HAL_ERROR;
+  }
+  elements[fifo][num_elements[fifo]++] = (CAN_Filter_Element){ .id = id & mask, .mask = mask };
+  return HAL_OK;
+}
+
+/**
+ * Computes the number of banks needed for the elements of a FIFO.
+ *
+ * Exact IDs go four to a list bank, the rest two to a mask bank. When the
+ * last list bank would be mostly empty, its leftover exact IDs may instead
+ * take free mask slots.
+ *
+ * @param fifo                   the FIFO to count
+ * @param singles_in_mask_banks  set to the number of exact IDs to put in mask banks
+ *
+ * @retval the number of banks
+ */
+static uint8_t Count_Banks(uint8_t fifo, uint8_t *singles_in_mask_banks) {
+  uint16_t singles = 0;
+  for (uint16_t index = 0; index < num_elements[fifo]; index++) {
+      singles += (elements[fifo][index].mask == CAN_FILTER_EXACT);
+  }
+  uint16_t masks = num_elements[fifo] - singles;
+  uint16_t leftover = singles % 4;
+
+  uint16_t all_in_list = (singles + 3) / 4 + (masks + 1) / 2;
+  uint16_t leftover_in_mask = singles / 4 + (masks + leftover + 1) / 2;
+
+  if (leftover_in_mask < all_in_list) {
+      *singles_in_mask_banks = leftover;
+      return leftover_in_mask;
+  }
+  *singles_in_mask_banks = 0;
+  return all_in_list;
+}
+
+/**
+ * Merges the pair of elements (in the same FIFO) whose combined mask accepts
+ * the fewest additional IDs, and drops any elements the result covers.
+ */
+static void Merge_Cheapest(void) {
+  uint8_t best_fifo = 0;
+  uint16_t best_a = 0;
+  int32_t best_cost = INT32_MAX;
+  CAN_Filter_Element best = { 0 };
+
+  for (uint8_t fifo = 0; fifo < CAN_FILTER_NUM_FIFOS; fifo++) {
+      CAN_Filter_Element *e = elements[fifo];
+      for (uint16_t a = 0; a < num_elements[fifo]; a++) {
+          for (uint16_t b = a + 1; b < num_elements[fifo]; b++) {
+              uint16_t mask = e[a].mask & e[b].mask & ~(e[a].id ^ e[b].id) & CAN_FILTER_EXACT;
+              int32_t cost = (int32_t)Cover_Size(mask) - Cover_Size(e[a].mask) - Cover_Size(e[b].mask);
+              if (cost < best_cost) {
+                  best_cost = cost;
+                  best_fifo = fifo;
+                  best_a = a;
+                  best = (CAN_Filter_Element){ .id = e[a].id & mask, .mask = mask };
+              }
+          }
+      }
+  }
+
+  if (best_cost == INT32_MAX) {
+      return;
+  }
+
+  CAN_Filter_Element *e = elements[best_fifo];
+  e[best_a] = best;
+  num_merges++;
+
+  // remove every other element that the merged element now covers
+  // (including the second element of the pair)
+  uint16_t index = 0;
+  while (index < num_elements[best_fifo]) {
+      if (index != best_a &&
+          (e[index].mask & best.mask) == best.mask &&
+          (e[index].id & best.mask) == best.id) {
+          e[index] = e[--num_elements[best_fifo]];
+          if (best_a == num_elements[best_fifo]) {
+              best_a = index;
+          }
+          continue;
+      }
+      index++;
+  }
+}
+
+/**
+ * Appends the banks for a FIFO: full list banks, then mask banks.
+ *
+ * @param fifo         the FIFO to build banks for
+ * @param match_index  the next FilterMatchIndex of the FIFO, advanced per bank
+ */
+static void Build_Banks(uint8_t fifo, uint8_t *match_index) {
+  uint8_t singles_in_mask_banks;
+  Count_Banks(fifo, &singles_in_mask_banks);
+
+  // static to keep them off the (small) stack
+  static CAN_Filter_Element singles[CAN_FILTER_MAX_ELEMENTS];
+  static CAN_Filter_Element masks[CAN_FILTER_MAX_ELEMENTS];
+  uint16_t num_singles = 0, num_masks = 0;
+
+  for (uint16_t index = 0; index < num_elements[fifo]; index++) {
+      if (elements[fifo][index].mask == CAN_FILTER_EXACT) {
+          singles[num_singles++] = elements[fifo][index];
+      }
+      else {
+          masks[num_masks++] = elements[fifo][index];
+      }
+  }
+
+  // leftover exact IDs which share mask banks instead of a list bank
+  while (singles_in_mask_banks > 0) {
+      masks[num_masks++] = singles[--num_singles];
+      singles_in_mask_banks--;
+  }
+
+  // list banks, unused slots repeat the first ID
+  for (uint16_t index = 0; index < num_singles; index += 4) {
+      CAN_Filter_Bank *bank = &banks[num_banks++];
+      bank->mode = CAN_Filter_List_Mode;
+      bank->fifo = fifo;
+      bank->first_match_index = *match_index;
+      for (uint8_t slot = 0; slot < 4; slot++) {
+          uint16_t source = (index + slot < num_singles) ? index + slot : index;
+          bank->elements[slot] = singles[source];
+      }
+      *match_index += 4;
+  }
+
+  // mask banks, an unused slot repeats the first pair
+  for (uint16_t index = 0; index < num_masks; index += 2) {
+      CAN_Filter_Bank *bank = &banks[num_banks++];
+      bank->mode = CAN_Filter_Mask_Mode;
+      bank->fifo = fifo;
+      bank->first_match_index = *match_index;
+      bank->elements[0] = masks[index];
+      bank->elements[1] = (index + 1 < num_masks) ? masks[index + 1] : masks[index];
+      bank->elements[2] = bank->elements[1];
+      bank->elements[3] = bank->elements[1];
+      *match_index += 2;
+  }
+}
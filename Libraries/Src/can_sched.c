@@ -0,0 +1,243 @@
+/*
+ * can_sched.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See can_sched.h for usage and troubleshooting.
+ */
+
+#include "can_sched.h"
+#include "can_std.h"
+#include "util.h"
+#include <string.h>
+
+// ensure that timer register callbacks are enabled
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+#if defined(HAL_TIM_MODULE_ENABLED) && defined(HAL_CAN_MODULE_ENABLED)
+
+/* GLOBAL VARS */
+static TIM_HandleTypeDef *htim_sched;
+static CAN_Sched_Message messages[CAN_SCHED_MAX_MESSAGES];
+static uint8_t num_messages = 0;
+static uint8_t started = 0;
+
+/* PRIVATE FUNCTIONS */
+static void Assign_Offsets(void);
+static void Sched_Tick(TIM_HandleTypeDef *htim);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+HAL_StatusTypeDef CAN_Sched_Init(TIM_HandleTypeDef *htim) {
+  HAL_StatusTypeDef status;
+
+  if (started) {
+      CAN_Sched_Stop();
+  }
+  num_messages = 0;
+
+  // count at 1 MHz, overflow every tick
+  htim->Init.Prescaler = Util_Get_Timer_Clock(htim->Instance) / 1000000 - 1;
+  htim->Init.Period = CAN_SCHED_TICK_MS * 1000 - 1;
+  htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+  status = HAL_TIM_Base_Init(htim);
+  if (status != HAL_OK) {
+      return status;
+  }
+
+  status = HAL_TIM_RegisterCallback(htim, HAL_TIM_PERIOD_ELAPSED_CB_ID, Sched_Tick);
+  if (status != HAL_OK) {
+      return status;
+  }
+
+  htim_sched = htim;
+  Util_Cycle_Counter_Init();
+
+  return HAL_OK;
+}
+
+CAN_Sched_Message *CAN_Sched_Register(uint16_t id, uint8_t dlc, uint16_t period_ms,
+                                      CAN_Sched_Producer producer, void *context) {
+  if (started || num_messages >= CAN_SCHED_MAX_MESSAGES || id > CAN_ID_LOW_PRIO ||
+      dlc > 8 || period_ms < CAN_SCHED_TICK_MS || producer == NULL) {
+      return NULL;
+  }
+
+  CAN_Sched_Message *message = &messages[num_messages++];
+  *message = (CAN_Sched_Message){
+      .id = id,
+      .dlc = dlc,
+      .period = (period_ms + CAN_SCHED_TICK_MS / 2) / CAN_SCHED_TICK_MS,
+      .producer = producer,
+      .context = context,
+  };
+  return message;
+}
+
+HAL_StatusTypeDef CAN_Sched_Start(void) {
+  if (htim_sched == NULL) {
+      return HAL_ERROR;
+  }
+  if (started) {
+      return HAL_OK;
+  }
+
+  Assign_Offsets();
+  for (uint8_t index = 0; index < num_messages; index++) {
+      // due on the tick after its offset, so an offset of 0 sends on the first tick
+      messages[index].countdown = messages[index].stats.offset + 1;
+      messages[index].last_sent = 0;
+      messages[index].transmitted = messages[index].stats.sent;
+      messages[index].gap_before = 0;
+  }
+
+  started = 1;
+  __HAL_TIM_SET_COUNTER(htim_sched, 0);
+  return HAL_TIM_Base_Start_IT(htim_sched);
+}
+
+HAL_StatusTypeDef CAN_Sched_Stop(void) {
+  if (htim_sched == NULL) {
+      return HAL_ERROR;
+  }
+  started = 0;
+  return HAL_TIM_Base_Stop_IT(htim_sched);
+}
+
+void CAN_Sched_Get_Stats(const CAN_Sched_Message *message, CAN_Sched_Stats *stats) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *stats = message->stats;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @retval the greatest common divisor of a and b
+ */
+static uint32_t GCD(uint32_t a, uint32_t b) {
+  while (b != 0) {
+      uint32_t t = a % b;
+      a = b;
+      b = t;
+  }
+  return a;
+}
+
+/**
+ * Gives every message the phase offset which least adds to the busiest tick,
+ * placing the shortest periods first.
+ */
+static void Assign_Offsets(void) {
+  // static to keep it off the (small) stack
+  static uint8_t load[CAN_SCHED_MAX_HYPERPERIOD];
+  uint8_t order[CAN_SCHED_MAX_MESSAGES];
+
+  // hyperperiod of all the periods; if it is too long, the offsets are only
+  // balanced within the first CAN_SCHED_MAX_HYPERPERIOD ticks
+  uint32_t hyperperiod = 1;
+  for (uint8_t index = 0; index < num_messages; index++) {
+      uint32_t period = messages[index].period;
+      hyperperiod = hyperperiod / GCD(hyperperiod, period) * period;
+      if (hyperperiod > CAN_SCHED_MAX_HYPERPERIOD) {
+          hyperperiod = CAN_SCHED_MAX_HYPERPERIOD;
+      }
+  }
+  memset(load, 0, sizeof(load));
+
+  // insertion sort by period; stable, so equal periods keep registration order
+  for (uint8_t index = 0; index < num_messages; index++) {
+      uint8_t position = index;
+      while (position > 0 && messages[order[position - 1]].period > messages[index].period) {
+          order[position] = order[position - 1];
+          position--;
+      }
+      order[position] = index;
+  }
+
+  for (uint8_t index = 0; index < num_messages; index++) {
+      CAN_Sched_Message *message = &messages[order[index]];
+      uint32_t candidates = (message->period < hyperperiod) ? message->period : hyperperiod;
+
+      uint16_t best_offset = 0;
+      uint32_t best_peak = UINT32_MAX, best_total = UINT32_MAX;
+      for (uint32_t offset = 0; offset < candidates; offset++) {
+          uint32_t peak = 0, total = 0;
+          for (uint32_t tick = offset; tick < hyperperiod; tick += message->period) {
+              if (load[tick] > peak) {
+                  peak = load[tick];
+              }
+              total += load[tick];
+          }
+          if (peak < best_peak || (peak == best_peak && total < best_total)) {
+              best_offset = offset;
+              best_peak = peak;
+              best_total = total;
+          }
+      }
+
+      for (uint32_t tick = best_offset; tick < hyperperiod; tick += message->period) {
+          load[tick]++;
+      }
+      message->stats.offset = best_offset;
+  }
+}
+
+/**
+ * Sends every message which is due. Called when the scheduler timer elapses.
+ *
+ * @param htim the timer handler whose period elapsed (should be the scheduler timer)
+ */
+static void Sched_Tick(TIM_HandleTypeDef *htim) {
+  for (uint8_t index = 0; index < num_messages; index++) {
+      CAN_Sched_Message *message = &messages[index];
+      if (--message->countdown != 0) {
+          continue;
+      }
+      message->countdown = message->period;
+
+      uint8_t data[8] = { 0 };
+      if (!message->producer(data, message->context)) {
+          message->stats.skipped++;
+          message->gap_before = message->stats.sent + 1;
+          continue;
+      }
+
+      if (CAN_Std_TX_Send(message->id, data, message->dlc) == HAL_OK) {
+          message->stats.sent++;
+      }
+      else {
+          message->stats.dropped++;
+          message->gap_before = message->stats.sent + 1;
+      }
+  }
+}
+
+void CAN_Sched_Record_TX(uint16_t id, uint32_t cycles) {
+  CAN_Sched_Message *message = messages;
+  CAN_Sched_Message *end = messages + num_messages;
+  while (message < end && message->id != id) {
+      message++;
+  }
+  if (message == end) {
+      return;
+  }
+
+  // jitter against the previous transmission, unless a period between
+  // them was skipped or dropped
+  message->transmitted++;
+  if (message->last_sent != 0 && message->transmitted != message->gap_before) {
+      uint32_t nominal = SystemCoreClock / 1000 * CAN_SCHED_TICK_MS * message->period;
+      int32_t error = (int32_t)(cycles - message->last_sent - nominal);
+      uint32_t jitter = Util_Cycles_To_Us((error < 0) ? -error : error);
+      if (jitter > message->stats.max_jitter) {
+          message->stats.max_jitter = jitter;
+      }
+  }
+  message->last_sent = cycles | 1;  // never 0, which means "none"
+}
+
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && defined(HAL_CAN_MODULE_ENABLED)
+#endif // #if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
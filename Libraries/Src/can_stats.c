@@ -0,0 +1,290 @@
+/*
+ * can_stats.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See can_stats.h for usage and troubleshooting.
+ */
+
+#include "can_stats.h"
+#include "can_sched.h"
+#include "can_std.h"
+#include <string.h>
+
+#ifdef HAL_CAN_MODULE_ENABLED
+
+#if CAN_STATS_MAX_IDS >= 255
+#error "CAN_STATS_MAX_IDS must be below 255"
+#endif
+
+#define CAN_STATS_ERROR_FLAGS (CAN_ESR_EWGF | CAN_ESR_EPVF | CAN_ESR_BOFF)
+
+typedef struct {
+  CAN_Stats_ID total;
+  // since the ID was last published
+  uint16_t rx;
+  uint16_t tx;
+  uint16_t max_latency;
+  uint8_t  latency[CAN_STATS_LATENCY_BINS];
+} CAN_Stats_Entry;
+
+/* GLOBAL VARS */
+static CAN_HandleTypeDef *hcan_stats;
+static uint32_t bitrate;
+
+// slot 0 is reserved for "not tracked yet"
+static uint8_t id_slots[CAN_ID_LOW_PRIO + 1];
+static CAN_Stats_Entry entries[CAN_STATS_MAX_IDS + 1];
+static uint8_t num_entries = 0;
+
+static volatile CAN_Stats_Bus bus_stats;
+static uint32_t error_flags;          // CAN_STATS_ERROR_FLAGS as last seen
+
+// publishing state: the next frame, and the bits/time of the last summary
+static uint16_t publish_cursor = 0;
+static uint32_t summary_bits;
+static uint32_t summary_tick;
+
+/* PRIVATE FUNCTIONS */
+static CAN_Stats_Entry *Get_Entry(uint16_t id);
+static void Update_Error_State(void);
+static uint8_t Diagnostic_Producer(uint8_t *data, void *context);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+HAL_StatusTypeDef CAN_Stats_Init(CAN_HandleTypeDef *hcan, uint16_t diag_id, uint16_t period_ms) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memset(id_slots, 0, sizeof(id_slots));
+  num_entries = 0;
+  bus_stats = (CAN_Stats_Bus){ 0 };
+  error_flags = hcan->Instance->ESR & CAN_STATS_ERROR_FLAGS;
+  publish_cursor = 0;
+  summary_bits = 0;
+  summary_tick = HAL_GetTick();
+  hcan_stats = hcan;
+  __set_PRIMASK(primask);
+
+  // bit time = (1 + TS1 + TS2) quanta of (BRP + 1) APB1 clocks
+  uint32_t btr = hcan->Instance->BTR;
+  uint32_t quanta = 3 + ((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos);
+  bitrate = HAL_RCC_GetPCLK1Freq() / ((((btr & CAN_BTR_BRP) >> CAN_BTR_BRP_Pos) + 1) * quanta);
+
+  HAL_StatusTypeDef status = HAL_CAN_ActivateNotification(hcan,
+      CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF | CAN_IT_ERROR);
+  if (status != HAL_OK) {
+      return status;
+  }
+
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1) && defined(HAL_TIM_MODULE_ENABLED)
+  if (CAN_Sched_Register(diag_id, 8, period_ms, Diagnostic_Producer, NULL) == NULL) {
+      return HAL_ERROR;
+  }
+  return HAL_OK;
+#else
+  return HAL_ERROR;
+#endif
+}
+
+void CAN_Stats_Record_RX(uint16_t id, uint8_t dlc) {
+  // worst-case frame length: 47 + 8 * DLC bits, plus up to 8 + 2 * DLC stuff bits
+  bus_stats.bits += 55 + 10 * dlc;
+
+  CAN_Stats_Entry *entry = Get_Entry(id);
+  if (entry == NULL) {
+      return;
+  }
+  entry->total.rx++;
+  entry->rx++;
+}
+
+void CAN_Stats_Record_TX(uint16_t id, uint8_t dlc, uint32_t latency_us) {
+  bus_stats.bits += 55 + 10 * dlc;
+
+  // a frame got out, so the node may have left an error state since it was last checked
+  Update_Error_State();
+
+  CAN_Stats_Entry *entry = Get_Entry(id);
+  if (entry == NULL) {
+      return;
+  }
+  entry->total.tx++;
+  entry->tx++;
+
+  // bin = number of bits in latency / CAN_STATS_LATENCY_BIN0_US, capped at the last bin
+  uint32_t scaled = latency_us / CAN_STATS_LATENCY_BIN0_US;
+  uint32_t bin = 32 - __CLZ(scaled);
+  if (bin >= CAN_STATS_LATENCY_BINS) {
+      bin = CAN_STATS_LATENCY_BINS - 1;
+  }
+  entry->total.latency[bin]++;
+  if (entry->latency[bin] < UINT8_MAX) {
+      entry->latency[bin]++;
+  }
+
+  if (latency_us > entry->total.max_latency) {
+      entry->total.max_latency = latency_us;
+  }
+  if (latency_us > entry->max_latency) {
+      entry->max_latency = (latency_us < UINT16_MAX) ? latency_us : UINT16_MAX;
+  }
+}
+
+void CAN_Stats_Error_Callback(CAN_HandleTypeDef *hcan) {
+  if (hcan != hcan_stats) {
+      return;
+  }
+  Update_Error_State();
+}
+
+void CAN_Stats_Get_Bus(CAN_Stats_Bus *bus) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *bus = bus_stats;
+  __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef CAN_Stats_Get_ID(uint16_t id, CAN_Stats_ID *stats) {
+  if (id > CAN_ID_LOW_PRIO || id_slots[id] == 0) {
+      return HAL_ERROR;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *stats = entries[id_slots[id]].total;
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+/**
+ * @retval the entry of an ID, added if it is new, or NULL if the table is full
+ */
+static CAN_Stats_Entry *Get_Entry(uint16_t id) {
+  id &= CAN_ID_LOW_PRIO;
+  uint8_t slot = id_slots[id];
+  if (slot == 0) {
+      if (num_entries >= CAN_STATS_MAX_IDS) {
+          bus_stats.untracked++;
+          return NULL;
+      }
+      slot = ++num_entries;
+      memset(&entries[slot], 0, sizeof(entries[slot]));
+      entries[slot].total.id = id;
+      id_slots[id] = slot;
+  }
+  return &entries[slot];
+}
+
+/**
+ * Reads the error counters, and counts the error states entered since the last read.
+ */
+static void Update_Error_State(void) {
+  if (hcan_stats == NULL) {
+      return;
+  }
+
+  uint32_t esr = hcan_stats->Instance->ESR;
+  uint32_t entered = esr & CAN_STATS_ERROR_FLAGS & ~error_flags;
+  error_flags = esr & CAN_STATS_ERROR_FLAGS;
+
+  if ((entered & CAN_ESR_EWGF) != 0) {
+      bus_stats.error_warning++;
+  }
+  if ((entered & CAN_ESR_EPVF) != 0) {
+      bus_stats.error_passive++;
+  }
+  if ((entered & CAN_ESR_BOFF) != 0) {
+      bus_stats.bus_off++;
+  }
+
+  bus_stats.tec = (esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos;
+  bus_stats.rec = (esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos;
+  if (bus_stats.tec > bus_stats.max_tec) {
+      bus_stats.max_tec = bus_stats.tec;
+  }
+  if (bus_stats.rec > bus_stats.max_rec) {
+      bus_stats.max_rec = bus_stats.rec;
+  }
+}
+
+static uint8_t Saturate_U8(uint32_t value) {
+  return (value < UINT8_MAX) ? value : UINT8_MAX;
+}
+
+/**
+ * Fills in the next diagnostic frame: the summary, then the counts and
+ * histogram of each ID in turn. Called by the scheduler.
+ */
+static uint8_t Diagnostic_Producer(uint8_t *data, void *context) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (publish_cursor >= 1 + 2 * num_entries) {
+      publish_cursor = 0;
+  }
+
+  uint16_t id = 0;
+  CAN_Stats_Frame_Type type;
+
+  if (publish_cursor == 0) {
+      type = CAN_Stats_Summary;
+      Update_Error_State();
+
+      uint32_t now = HAL_GetTick();
+      uint32_t bits = bus_stats.bits - summary_bits;
+      uint32_t elapsed = now - summary_tick;
+      if (elapsed > 0 && bitrate > 0) {
+          uint64_t load = (uint64_t)bits * 1000000 / ((uint64_t)bitrate * elapsed);
+          bus_stats.load_permille = (load < UINT16_MAX) ? load : UINT16_MAX;
+      }
+      summary_bits = bus_stats.bits;
+      summary_tick = now;
+
+      data[2] = bus_stats.load_permille;
+      data[3] = bus_stats.load_permille >> 8;
+      data[4] = bus_stats.tec;
+      data[5] = bus_stats.rec;
+      data[6] = Saturate_U8(bus_stats.error_passive);
+      data[7] = Saturate_U8(bus_stats.bus_off);
+  }
+  else {
+      CAN_Stats_Entry *entry = &entries[1 + (publish_cursor - 1) / 2];
+      id = entry->total.id;
+
+      if ((publish_cursor & 1) != 0) {
+          type = CAN_Stats_Counts;
+          data[2] = entry->rx;
+          data[3] = entry->rx >> 8;
+          data[4] = entry->tx;
+          data[5] = entry->tx >> 8;
+          data[6] = entry->max_latency;
+          data[7] = entry->max_latency >> 8;
+          entry->rx = 0;
+          entry->tx = 0;
+          entry->max_latency = 0;
+      }
+      else {
+          type = CAN_Stats_Histogram;
+          uint64_t bins = 0;
+          for (uint8_t bin = 0; bin < CAN_STATS_LATENCY_BINS; bin++) {
+              uint64_t count = (entry->latency[bin] < 63) ? entry->latency[bin] : 63;
+              bins |= count << (6 * bin);
+              entry->latency[bin] = 0;
+          }
+          for (uint8_t byte = 0; byte < 6; byte++) {
+              data[2 + byte] = bins >> (8 * byte);
+          }
+      }
+  }
+
+  publish_cursor++;
+  __set_PRIMASK(primask);
+
+  data[0] = id;
+  data[1] = (id >> 8) | (type << 3);
+  return 1;
+}
+
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
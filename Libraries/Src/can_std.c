@@ -3,9 +3,459 @@
  *
  *  Created on: May 20, 2024
  *      Author: Caltech Racing
+ *
+ * See can_std.h for usage and troubleshooting.
  */
 
 
 #include "can_std.h"
+#include "can_stats.h"
+#include "can_sched.h"
+#include "util.h"
+#include <string.h>
+
+#ifdef HAL_CAN_MODULE_ENABLED
+
+#define CAN_STD_NUM_MAILBOXES 3
+
+UTIL_RING_DECLARE(CAN_Std_RX_Ring, CAN_Std_Frame, CAN_STD_RX_RING_SIZE)
+
+/* GLOBAL VARS */
+
+// receive ring; the two FIFO ISRs (CAN1_RX0 and CAN1_RX1) produce, each
+// frame with interrupts masked so one cannot preempt the other, and the
+// main loop consumes
+static CAN_Std_RX_Ring rx_ring;
+
+static volatile CAN_Std_RX_Stats rx_stats;
+
+#if CAN_STD_MAX_HANDLERS >= 255
+#error "CAN_STD_MAX_HANDLERS must be below 255"
+#endif
+
+// filter match slot value meaning the element is not an exact ID
+#define CAN_STD_MATCH_BY_ID 0xFF
+
+// receive handlers; slot 0 is reserved for "no handler"
+static CAN_Std_Handler_Entry rx_handlers[CAN_STD_MAX_HANDLERS + 1];
+static uint8_t rx_num_handlers = 0;
+
+// handler slot of every standard ID, and of every filter match index per FIFO
+// (sized for any 8-bit index, so neither lookup needs a bounds check)
+static uint8_t rx_id_slots[CAN_ID_LOW_PRIO + 1];
+static uint8_t rx_match_slots[CAN_FILTER_NUM_FIFOS][256];
+
+typedef struct {
+  uint32_t id;            // standard identifier, the heap key
+  uint32_t seq;           // send order, breaks ties between equal ids
+  uint32_t enqueued;      // cycle count when the frame was sent
+  uint8_t  dlc;
+  uint8_t  data[8];
+} CAN_Std_TX_Entry;
+
+// transmit min-heap, and the frame occupying each hardware mailbox.
+// Shared between the main loop and the CAN interrupts, so only touched
+// with interrupts masked.
+static CAN_HandleTypeDef *hcan_tx;
+static CAN_Std_TX_Entry tx_heap[CAN_STD_TX_QUEUE_SIZE];
+static uint16_t tx_heap_size = 0;
+static uint32_t tx_seq = 0;
+
+static CAN_Std_TX_Entry tx_mailboxes[CAN_STD_NUM_MAILBOXES];
+static uint8_t tx_mailbox_busy = 0;     // bit n set if mailbox n holds a frame
+static uint8_t tx_mailbox_aborting = 0; // bit n set if mailbox n is being preempted
+
+static volatile CAN_Std_TX_Stats tx_stats;
+
+/* PRIVATE FUNCTIONS */
+static void RX_Build_Match_Slots(void);
+static uint8_t TX_Entry_Before(const CAN_Std_TX_Entry *a, const CAN_Std_TX_Entry *b);
+static void TX_Heap_Push(const CAN_Std_TX_Entry *entry);
+static void TX_Heap_Pop(CAN_Std_TX_Entry *entry);
+static void TX_Refill_Mailboxes(void);
+static void TX_Preempt_Mailbox(void);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+HAL_StatusTypeDef CAN_Std_RX_Init(CAN_HandleTypeDef *hcan) {
+  HAL_StatusTypeDef status;
+
+  CAN_Std_RX_Ring_Reset(&rx_ring);
+  rx_stats = (CAN_Std_RX_Stats){ 0 };
+
+  // configure the hardware filters from the module subscriptions
+  status = CAN_Filter_Apply(hcan);
+  if (status != HAL_OK) {
+      return status;
+  }
+  RX_Build_Match_Slots();
+
+  return HAL_CAN_ActivateNotification(hcan,
+      CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO0_OVERRUN |
+      CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_RX_FIFO1_OVERRUN);
+}
+
+void CAN_Std_RX_FIFO_Callback(CAN_HandleTypeDef *hcan, uint32_t fifo) {
+  CAN_RxHeaderTypeDef header;
+  uint8_t discard[8];
+
+  // drain everything; the FIFO is only three deep
+  while (HAL_CAN_GetRxFifoFillLevel(hcan, fifo) > 0) {
+      // both FIFO interrupts produce, so mask the other (which may have a
+      // higher priority) from the reserve to the commit
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+
+      // write directly into the ring slot
+      CAN_Std_Frame *frame = CAN_Std_RX_Ring_Reserve(&rx_ring);
+
+      // ring full: release the message anyway so the hardware FIFO keeps moving
+      if (frame == NULL) {
+          HAL_CAN_GetRxMessage(hcan, fifo, &header, discard);
+          CAN_Stats_Record_RX(header.StdId, header.DLC);
+          rx_stats.overflows++;
+          __set_PRIMASK(primask);
+          continue;
+      }
+
+      if (HAL_CAN_GetRxMessage(hcan, fifo, &header, frame->data) != HAL_OK) {
+          __set_PRIMASK(primask);
+          break;
+      }
+      frame->ide          = header.IDE;
+      frame->id           = (header.IDE == CAN_ID_STD) ? header.StdId : header.ExtId;
+      frame->rtr          = header.RTR;
+      frame->dlc          = header.DLC;
+      frame->fifo         = fifo;
+      frame->filter_match = header.FilterMatchIndex;
+      frame->timestamp    = header.Timestamp;
+      CAN_Stats_Record_RX(header.StdId, header.DLC);
+      CAN_Std_RX_Ring_Commit(&rx_ring);
+
+      rx_stats.received++;
+      uint32_t count = CAN_Std_RX_Ring_Count(&rx_ring);
+      if (count > rx_stats.high_water) {
+          rx_stats.high_water = count;
+      }
+      __set_PRIMASK(primask);
+  }
+}
+
+void CAN_Std_Error_Callback(CAN_HandleTypeDef *hcan) {
+  uint32_t error = HAL_CAN_GetError(hcan);
+
+  if ((error & (HAL_CAN_ERROR_RX_FOV0 | HAL_CAN_ERROR_RX_FOV1)) != 0) {
+      rx_stats.fifo_overruns++;
+  }
+
+  // a mailbox which completed without success (e.g. aborted after an error)
+  // is reported as an error rather than an abort, so requeue its frame here
+  if ((error & (HAL_CAN_ERROR_TX_ALST0 | HAL_CAN_ERROR_TX_TERR0)) != 0) {
+      CAN_Std_TX_Mailbox_Callback(hcan, 0, 0);
+  }
+  if ((error & (HAL_CAN_ERROR_TX_ALST1 | HAL_CAN_ERROR_TX_TERR1)) != 0) {
+      CAN_Std_TX_Mailbox_Callback(hcan, 1, 0);
+  }
+  if ((error & (HAL_CAN_ERROR_TX_ALST2 | HAL_CAN_ERROR_TX_TERR2)) != 0) {
+      CAN_Std_TX_Mailbox_Callback(hcan, 2, 0);
+  }
+
+  HAL_CAN_ResetError(hcan);
+}
+
+uint16_t CAN_Std_RX_Read(CAN_Std_Frame *frames, uint16_t max_frames) {
+  return CAN_Std_RX_Ring_Pop_Batch(&rx_ring, frames, max_frames);
+}
+
+HAL_StatusTypeDef CAN_Std_RX_Register(uint16_t id, CAN_Std_Handler handler, void *context) {
+  if (id > CAN_ID_LOW_PRIO || handler == NULL || rx_id_slots[id] != 0 ||
+      rx_num_handlers >= CAN_STD_MAX_HANDLERS) {
+      return HAL_ERROR;
+  }
+
+  HAL_StatusTypeDef status = CAN_Filter_Subscribe(id);
+  if (status != HAL_OK) {
+      return status;
+  }
+
+  rx_num_handlers++;
+  rx_handlers[rx_num_handlers] = (CAN_Std_Handler_Entry){ id, handler, context };
+  rx_id_slots[id] = rx_num_handlers;
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef CAN_Std_RX_Register_All(const CAN_Std_Handler_Entry *entries, uint16_t num_entries) {
+  for (uint16_t index = 0; index < num_entries; index++) {
+      HAL_StatusTypeDef status = CAN_Std_RX_Register(entries[index].id, entries[index].handler,
+                                                     entries[index].context);
+      if (status != HAL_OK) {
+          return status;
+      }
+  }
+  return HAL_OK;
+}
+
+uint16_t CAN_Std_RX_Dispatch(uint16_t max_frames) {
+  uint16_t num_frames = 0;
+  const CAN_Std_Frame *frame;
+
+  // handle each frame in place, the producer cannot reuse the slot until it is released
+  while (num_frames < max_frames && (frame = CAN_Std_RX_Ring_Peek(&rx_ring)) != NULL) {
+
+      uint8_t slot = rx_match_slots[frame->fifo & 1][frame->filter_match];
+      if (slot == CAN_STD_MATCH_BY_ID) {
+          slot = (frame->ide == CAN_ID_STD) ? rx_id_slots[frame->id & 0x7FF] : 0;
+      }
+
+      if (slot != 0) {
+          rx_handlers[slot].handler(frame, rx_handlers[slot].context);
+      }
+      else {
+          rx_stats.unhandled++;
+      }
+
+      // hand each slot back as soon as it is handled, handlers may be slow
+      CAN_Std_RX_Ring_Release(&rx_ring);
+      num_frames++;
+  }
+
+  return num_frames;
+}
+
+uint16_t CAN_Std_RX_Available(void) {
+  return CAN_Std_RX_Ring_Count(&rx_ring);
+}
+
+void CAN_Std_RX_Get_Stats(CAN_Std_RX_Stats *stats) {
+  *stats = rx_stats;
+}
+
+HAL_StatusTypeDef CAN_Std_TX_Init(CAN_HandleTypeDef *hcan) {
+  hcan_tx = hcan;
+  tx_heap_size = 0;
+  tx_seq = 0;
+  tx_mailbox_busy = 0;
+  tx_mailbox_aborting = 0;
+  tx_stats = (CAN_Std_TX_Stats){ 0 };
+
+  Util_Cycle_Counter_Init();
+
+  return HAL_CAN_ActivateNotification(hcan, CAN_IT_TX_MAILBOX_EMPTY);
+}
+
+HAL_StatusTypeDef CAN_Std_TX_Send(uint32_t id, const uint8_t *data, uint8_t dlc) {
+  if (hcan_tx == NULL || id > CAN_ID_LOW_PRIO || dlc > 8) {
+      return HAL_ERROR;
+  }
+
+  CAN_Std_TX_Entry entry = { .id = id, .dlc = dlc, .enqueued = Util_Get_Cycles() };
+  memcpy(entry.data, data, dlc);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  // keep room for a frame which is being preempted out of its mailbox
+  if (tx_heap_size + (tx_mailbox_aborting != 0) >= CAN_STD_TX_QUEUE_SIZE) {
+      tx_stats.dropped++;
+      __set_PRIMASK(primask);
+      return HAL_ERROR;
+  }
+
+  entry.seq = tx_seq++;
+  TX_Heap_Push(&entry);
+  tx_stats.queued++;
+  if (tx_heap_size > tx_stats.high_water) {
+      tx_stats.high_water = tx_heap_size;
+  }
+
+  TX_Refill_Mailboxes();
+  TX_Preempt_Mailbox();
+
+  tx_stats.depth = tx_heap_size;
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+void CAN_Std_TX_Mailbox_Callback(CAN_HandleTypeDef *hcan, uint8_t mailbox, uint8_t sent) {
+  if (hcan != hcan_tx || mailbox >= CAN_STD_NUM_MAILBOXES) {
+      return;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint8_t mask = 1 << mailbox;
+  if ((tx_mailbox_busy & mask) != 0) {
+      tx_mailbox_busy &= ~mask;
+      tx_mailbox_aborting &= ~mask;
+
+      if (sent) {
+          uint32_t now = Util_Get_Cycles();
+          uint32_t latency = Util_Cycles_To_Us(now - tx_mailboxes[mailbox].enqueued);
+          if (latency > tx_stats.max_latency) {
+              tx_stats.max_latency = latency;
+          }
+          tx_stats.sent++;
+          CAN_Stats_Record_TX(tx_mailboxes[mailbox].id, tx_mailboxes[mailbox].dlc, latency);
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1) && defined(HAL_TIM_MODULE_ENABLED)
+          CAN_Sched_Record_TX(tx_mailboxes[mailbox].id, now);
+#endif
+      }
+      else if (tx_heap_size < CAN_STD_TX_QUEUE_SIZE) {
+          // put it back; it keeps its sequence number, so it stays ahead of
+          // frames with the same id which were sent after it
+          TX_Heap_Push(&tx_mailboxes[mailbox]);
+      }
+      else {
+          tx_stats.dropped++;
+      }
+  }
+
+  TX_Refill_Mailboxes();
+  TX_Preempt_Mailbox();
+
+  tx_stats.depth = tx_heap_size;
+  __set_PRIMASK(primask);
+}
+
+uint16_t CAN_Std_TX_Pending(void) {
+  return tx_stats.depth;
+}
+
+void CAN_Std_TX_Get_Stats(CAN_Std_TX_Stats *stats) {
+  *stats = tx_stats;
+}
+
+/**
+ * Maps every filter element which matches exactly one ID to the handler of
+ * that ID, and every other element to CAN_STD_MATCH_BY_ID.
+ * Must be called after the filters are allocated.
+ */
+static void RX_Build_Match_Slots(void) {
+  memset(rx_match_slots, CAN_STD_MATCH_BY_ID, sizeof(rx_match_slots));
+
+  uint8_t num_banks;
+  const CAN_Filter_Bank *banks = CAN_Filter_Get_Banks(&num_banks);
+
+  for (uint8_t bank = 0; bank < num_banks; bank++) {
+      uint8_t num_elements = (banks[bank].mode == CAN_Filter_List_Mode) ? 4 : 2;
+      for (uint8_t element = 0; element < num_elements; element++) {
+          const CAN_Filter_Element *e = &banks[bank].elements[element];
+          if (e->mask == 0x7FF) {
+              rx_match_slots[banks[bank].fifo][banks[bank].first_match_index + element] =
+                  rx_id_slots[e->id];
+          }
+      }
+  }
+}
+
+/**
+ * @retval 1 if a should be transmitted before b, 0 otherwise
+ */
+static uint8_t TX_Entry_Before(const CAN_Std_TX_Entry *a, const CAN_Std_TX_Entry *b) {
+  if (a->id != b->id) {
+      return a->id < b->id;
+  }
+  return (int32_t)(a->seq - b->seq) < 0;
+}
+
+/**
+ * Inserts an entry into the heap. Assumes there is room.
+ */
+static void TX_Heap_Push(const CAN_Std_TX_Entry *entry) {
+  uint16_t index = tx_heap_size++;
+
+  // sift up
+  while (index > 0) {
+      uint16_t parent = (index - 1) / 2;
+      if (!TX_Entry_Before(entry, &tx_heap[parent])) {
+          break;
+      }
+      tx_heap[index] = tx_heap[parent];
+      index = parent;
+  }
+  tx_heap[index] = *entry;
+}
+
+/**
+ * Removes the highest priority entry from the heap. Assumes it is not empty.
+ */
+static void TX_Heap_Pop(CAN_Std_TX_Entry *entry) {
+  *entry = tx_heap[0];
+
+  CAN_Std_TX_Entry last = tx_heap[--tx_heap_size];
+  uint16_t index = 0;
+
+  // sift down
+  while (1) {
+      uint16_t child = 2 * index + 1;
+      if (child >= tx_heap_size) {
+          break;
+      }
+      if (child + 1 < tx_heap_size && TX_Entry_Before(&tx_heap[child + 1], &tx_heap[child])) {
+          child++;
+      }
+      if (!TX_Entry_Before(&tx_heap[child], &last)) {
+          break;
+      }
+      tx_heap[index] = tx_heap[child];
+      index = child;
+  }
+  tx_heap[index] = last;
+}
+
+/**
+ * Moves queued frames into free hardware mailboxes, highest priority first.
+ * Must be called with interrupts masked.
+ */
+static void TX_Refill_Mailboxes(void) {
+  CAN_TxHeaderTypeDef header = { .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA };
+  uint32_t mailbox;
+
+  while (tx_heap_size > 0 && HAL_CAN_GetTxMailboxesFreeLevel(hcan_tx) > 0) {
+      header.StdId = tx_heap[0].id;
+      header.DLC   = tx_heap[0].dlc;
+      if (HAL_CAN_AddTxMessage(hcan_tx, &header, tx_heap[0].data, &mailbox) != HAL_OK) {
+          return;
+      }
+
+      // CAN_TX_MAILBOXx is a bit mask, convert it to an index
+      uint8_t index = 31 - __CLZ(mailbox);
+      TX_Heap_Pop(&tx_mailboxes[index]);
+      tx_mailbox_busy |= 1 << index;
+  }
+}
+
+/**
+ * If the highest priority queued frame is blocked by a lower priority frame
+ * in a mailbox, aborts the lowest priority mailbox. The aborted frame is
+ * requeued from CAN_Std_TX_Mailbox_Callback.
+ * Must be called with interrupts masked.
+ */
+static void TX_Preempt_Mailbox(void) {
+  // only one abort at a time, and only if the frame can be requeued
+  if (tx_heap_size == 0 || tx_heap_size >= CAN_STD_TX_QUEUE_SIZE || tx_mailbox_aborting != 0) {
+      return;
+  }
+
+  // find the lowest priority frame currently in a mailbox
+  int8_t victim = -1;
+  for (uint8_t index = 0; index < CAN_STD_NUM_MAILBOXES; index++) {
+      if ((tx_mailbox_busy & (1 << index)) == 0) {
+          return;  // a mailbox is free, nothing to preempt
+      }
+      if (victim < 0 || TX_Entry_Before(&tx_mailboxes[victim], &tx_mailboxes[index])) {
+          victim = index;
+      }
+  }
 
+  if (TX_Entry_Before(&tx_heap[0], &tx_mailboxes[victim])) {
+      tx_mailbox_aborting |= 1 << victim;
+      tx_stats.preempted++;
+      HAL_CAN_AbortTxRequest(hcan_tx, 1 << victim);
+  }
+}
 
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
@@ -8,7 +8,49 @@
  */
 
 #include "buttons.h"
+#include "can_stats.h"
+#include "can_std.h"
 
  void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
    Button_EXTI_Callback(GPIO_Pin);
  }
+
+#ifdef HAL_CAN_MODULE_ENABLED
+ void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_RX_FIFO_Callback(hcan, CAN_RX_FIFO0);
+ }
+
+ void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_RX_FIFO_Callback(hcan, CAN_RX_FIFO1);
+ }
+
+ void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_TX_Mailbox_Callback(hcan, 0, 1);
+ }
+
+ void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_TX_Mailbox_Callback(hcan, 1, 1);
+ }
+
+ void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_TX_Mailbox_Callback(hcan, 2, 1);
+ }
+
+ void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_TX_Mailbox_Callback(hcan, 0, 0);
+ }
+
+ void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_TX_Mailbox_Callback(hcan, 1, 0);
+ }
+
+ void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef *hcan) {
+   CAN_Std_TX_Mailbox_Callback(hcan, 2, 0);
+ }
+
+ void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) {
+   // before CAN_Std_Error_Callback, which resets the error code
+   CAN_Stats_Error_Callback(hcan);
+   CAN_Std_Error_Callback(hcan);
+ }
+#endif // #ifdef HAL_CAN_MODULE_ENABLED
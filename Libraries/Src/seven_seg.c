@@ -8,15 +8,15 @@
  */
 
 #include "seven_seg.h"
-#include <math.h>
 
 #define ASCII_MAX  128
 #define ASCII_SKIP 32
 
 /* Private functions */
-static char hex_to_char(uint8_t hex);
-static HAL_StatusTypeDef Seven_Seg_Write_Integer_DP(Seven_Seg *seven_seg, int8_t val, uint8_t left_dp, uint8_t right_dp);
-static HAL_StatusTypeDef Seven_Seg_Write_Hexes(Seven_Seg *seven_seg, uint8_t left_val, uint8_t right_val, uint8_t left_dp, uint8_t right_dp);
+static void Seven_Seg_Render_Integer_DP(int8_t val, uint8_t left_dp, uint8_t right_dp, uint8_t data[2]);
+static void Seven_Seg_Render_Glyphs(const uint8_t glyphs[2], uint8_t left_dp, uint8_t right_dp, uint8_t data[2]);
+static int32_t Seven_Seg_Round_Scale(int32_t value, int8_t shift);
+static int32_t Seven_Seg_Round_Float(float val);
 
 // table borrowed from
 // https://github.com/dmadison/LED-Segment-ASCII/blob/master/7-Segment/7-Segment-ASCII_BIN.txt
@@ -216,8 +216,90 @@ static const uint8_t RIGHT_ASCII[ASCII_MAX - ASCII_SKIP] = {
     0b01000000, /* ~ */
 };
 
+/*
+ * Digit glyphs, as in the ASCII tables above ('0'-'9', 'A', 'b', 'C', 'd',
+ * 'E', 'F' and '-'), named so the tables below can be built from them by
+ * the preprocessor.
+ */
+#define LEFT_GLYPH_0     0b11101101
+#define LEFT_GLYPH_1     0b00101000
+#define LEFT_GLYPH_2     0b11001110
+#define LEFT_GLYPH_3     0b01101110
+#define LEFT_GLYPH_4     0b00101011
+#define LEFT_GLYPH_5     0b01100111
+#define LEFT_GLYPH_6     0b11100111
+#define LEFT_GLYPH_7     0b00101100
+#define LEFT_GLYPH_8     0b11101111
+#define LEFT_GLYPH_9     0b01101111
+#define LEFT_GLYPH_A     0b10101111
+#define LEFT_GLYPH_B     0b11100011
+#define LEFT_GLYPH_C     0b11000101
+#define LEFT_GLYPH_D     0b11101010
+#define LEFT_GLYPH_E     0b11000111
+#define LEFT_GLYPH_F     0b10000111
+#define LEFT_GLYPH_MINUS 0b00000010
+
+#define RIGHT_GLYPH_0     0b11111010
+#define RIGHT_GLYPH_1     0b10000010
+#define RIGHT_GLYPH_2     0b11011100
+#define RIGHT_GLYPH_3     0b11001110
+#define RIGHT_GLYPH_4     0b10100110
+#define RIGHT_GLYPH_5     0b01101110
+#define RIGHT_GLYPH_6     0b01111110
+#define RIGHT_GLYPH_7     0b11000010
+#define RIGHT_GLYPH_8     0b11111110
+#define RIGHT_GLYPH_9     0b11101110
+#define RIGHT_GLYPH_A     0b11110110
+#define RIGHT_GLYPH_B     0b00111110
+#define RIGHT_GLYPH_C     0b01111000
+#define RIGHT_GLYPH_D     0b10011110
+#define RIGHT_GLYPH_E     0b01111100
+#define RIGHT_GLYPH_F     0b01110100
+#define RIGHT_GLYPH_MINUS 0b00000100
+
+// a pair of glyphs, in the order they are written to the shift register
+#define GLYPHS(left, right) { RIGHT_GLYPH_##right, LEFT_GLYPH_##left }
+
+#define DECIMAL_ROW(tens) \
+    GLYPHS(tens, 0), GLYPHS(tens, 1), GLYPHS(tens, 2), GLYPHS(tens, 3), GLYPHS(tens, 4), \
+    GLYPHS(tens, 5), GLYPHS(tens, 6), GLYPHS(tens, 7), GLYPHS(tens, 8), GLYPHS(tens, 9)
+
+#define HEX_ROW(high) \
+    DECIMAL_ROW(high), \
+    GLYPHS(high, A), GLYPHS(high, B), GLYPHS(high, C), GLYPHS(high, D), GLYPHS(high, E), GLYPHS(high, F)
+
+#define DECIMAL_MIN -9
+#define DECIMAL_MAX 99
+
+// -9 to 99, indexed by value - DECIMAL_MIN: "-9" to "-1", then "00" to "99"
+static const uint8_t DECIMAL_GLYPHS[DECIMAL_MAX - DECIMAL_MIN + 1][2] = {
+    GLYPHS(MINUS, 9), GLYPHS(MINUS, 8), GLYPHS(MINUS, 7), GLYPHS(MINUS, 6), GLYPHS(MINUS, 5),
+    GLYPHS(MINUS, 4), GLYPHS(MINUS, 3), GLYPHS(MINUS, 2), GLYPHS(MINUS, 1),
+    DECIMAL_ROW(0), DECIMAL_ROW(1), DECIMAL_ROW(2), DECIMAL_ROW(3), DECIMAL_ROW(4),
+    DECIMAL_ROW(5), DECIMAL_ROW(6), DECIMAL_ROW(7), DECIMAL_ROW(8), DECIMAL_ROW(9),
+};
+
+// 0x00 to 0xFF: "00" to "FF"
+static const uint8_t HEX_GLYPHS[256][2] = {
+    HEX_ROW(0), HEX_ROW(1), HEX_ROW(2), HEX_ROW(3), HEX_ROW(4), HEX_ROW(5), HEX_ROW(6), HEX_ROW(7),
+    HEX_ROW(8), HEX_ROW(9), HEX_ROW(A), HEX_ROW(B), HEX_ROW(C), HEX_ROW(D), HEX_ROW(E), HEX_ROW(F),
+};
+
+static const uint8_t OUT_OF_RANGE_GLYPHS[2] = GLYPHS(MINUS, MINUS);
+
+static const uint32_t POWERS_OF_TEN[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+static Seven_Seg seven_seg_pool[SEVEN_SEG_MAX_HANDLERS];
+static uint8_t num_seven_segs = 0;
+
 Seven_Seg *Seven_Seg_Init(Shift_Reg *shift_reg) {
-  Seven_Seg *seven_seg = malloc(sizeof(Seven_Seg));
+  if (shift_reg == NULL || num_seven_segs >= SEVEN_SEG_MAX_HANDLERS) {
+      return NULL;
+  }
+
+  Seven_Seg *seven_seg = &seven_seg_pool[num_seven_segs++];
   seven_seg->shift_reg = shift_reg;
   return seven_seg;
 }
@@ -227,71 +309,58 @@ HAL_StatusTypeDef Seven_Seg_Write_Raw(Seven_Seg *seven_seg, uint8_t left_raw, ui
   return Shift_Reg_Write(seven_seg->shift_reg, data, 2);
 }
 
-static char hex_to_char(uint8_t hex) {
-  hex &= 0x0F;
-  if (hex < 10) {
-      return hex + '0';
-  }
-
-  switch (hex) {
-    case 0x0A:
-      return 'A';
-    case 0x0B:
-      return 'b';
-    case 0x0C:
-      return 'C';
-    case 0x0D:
-      return 'd';
-    case 0x0E:
-      return 'E';
-    case 0x0F:
-      return 'F';
-    default:
-      return ' ';
-  }
+/**
+ * Renders a pair of glyphs from the tables, adding the decimal points
+ * without branching.
+ */
+static void Seven_Seg_Render_Glyphs(const uint8_t glyphs[2], uint8_t left_dp, uint8_t right_dp, uint8_t data[2]) {
+  data[0] = glyphs[0] | (SEVEN_SEG_RIGHT_DP & -(right_dp != 0));
+  data[1] = glyphs[1] | (SEVEN_SEG_LEFT_DP  & -(left_dp  != 0));
 }
 
-static HAL_StatusTypeDef Seven_Seg_Write_Hexes(Seven_Seg *seven_seg, uint8_t left_val, uint8_t right_val, uint8_t left_dp, uint8_t right_dp) {
-  char left = hex_to_char(left_val);
-  char right = hex_to_char(right_val);
-
-  char text[2] = { left, right };
-  return Seven_Seg_Write_Chars(seven_seg, text, left_dp, right_dp);
+void Seven_Seg_Render_Hex(uint8_t hex, uint8_t left_dp, uint8_t right_dp, uint8_t data[2]) {
+  Seven_Seg_Render_Glyphs(HEX_GLYPHS[hex], left_dp, right_dp, data);
 }
 
 HAL_StatusTypeDef Seven_Seg_Write_Hex(Seven_Seg *seven_seg, uint8_t hex, uint8_t left_dp, uint8_t right_dp) {
-  return Seven_Seg_Write_Hexes(seven_seg, hex >> 4, hex, left_dp, right_dp);
+  uint8_t data[2];
+  Seven_Seg_Render_Hex(hex, left_dp, right_dp, data);
+  return Shift_Reg_Write(seven_seg->shift_reg, data, 2);
 }
 
-static HAL_StatusTypeDef Seven_Seg_Write_Integer_DP(Seven_Seg *seven_seg, int8_t val, uint8_t left_dp, uint8_t right_dp) {
-  // if positive value, write the last two digits
-  if (val >= 0) {
-      return Seven_Seg_Write_Hexes(seven_seg, (val / 10) % 10, val % 10, left_dp, right_dp);
+static void Seven_Seg_Render_Integer_DP(int8_t val, uint8_t left_dp, uint8_t right_dp, uint8_t data[2]) {
+  // one unsigned compare covers both ends of the range
+  uint8_t index = (uint8_t)(val - DECIMAL_MIN);
+  if (index > DECIMAL_MAX - DECIMAL_MIN) {
+      Seven_Seg_Render_Glyphs(OUT_OF_RANGE_GLYPHS, left_dp, right_dp, data);
   }
-
-  // if negative value, write minus and the last digit
   else {
-      char text[2] = { '-', '0' + abs(val) % 10 };
-      return Seven_Seg_Write_Chars(seven_seg, text, left_dp, right_dp);
+      Seven_Seg_Render_Glyphs(DECIMAL_GLYPHS[index], left_dp, right_dp, data);
   }
 }
 
+void Seven_Seg_Render_Integer(int8_t val, uint8_t data[2]) {
+  Seven_Seg_Render_Integer_DP(val, 0, 0, data);
+}
+
 HAL_StatusTypeDef Seven_Seg_Write_Integer(Seven_Seg *seven_seg, int8_t val) {
-  return Seven_Seg_Write_Integer_DP(seven_seg, val, 0, 0);
+  uint8_t data[2];
+  Seven_Seg_Render_Integer(val, data);
+  return Shift_Reg_Write(seven_seg->shift_reg, data, 2);
 }
 
-HAL_StatusTypeDef Seven_Seg_Write_Chars(Seven_Seg *seven_seg, char text[2], uint8_t left_dp, uint8_t right_dp) {
+void Seven_Seg_Render_Chars(const char text[2], uint8_t left_dp, uint8_t right_dp, uint8_t data[2]) {
   uint8_t left_raw, right_raw;
 
-  // ensure char is within bounds of normal ASCII
+  // ensure char is within bounds of normal ASCII, otherwise blank
   if (text[0] < ASCII_SKIP || text[0] >= ASCII_MAX) {
-      left_raw = ' ';
+      left_raw = LEFT_ASCII[0];
   }
   else {
       left_raw = LEFT_ASCII[(uint8_t)text[0] - ASCII_SKIP];
   }
   if (text[1] < ASCII_SKIP || text[1] >= ASCII_MAX) {
-      right_raw = ' ';
+      right_raw = RIGHT_ASCII[0];
   }
   else {
       right_raw = RIGHT_ASCII[(uint8_t)text[1] - ASCII_SKIP];
@@ -305,26 +374,147 @@ HAL_StatusTypeDef Seven_Seg_Write_Chars(Seven_Seg *seven_seg, char text[2], uint
       right_raw |= SEVEN_SEG_RIGHT_DP;
   }
 
-  // write to display
-  return Seven_Seg_Write_Raw(seven_seg, left_raw, right_raw);
+  data[0] = right_raw;
+  data[1] = left_raw;
+}
+
+HAL_StatusTypeDef Seven_Seg_Write_Chars(Seven_Seg *seven_seg, char text[2], uint8_t left_dp, uint8_t right_dp) {
+  uint8_t data[2];
+  Seven_Seg_Render_Chars(text, left_dp, right_dp, data);
+  return Shift_Reg_Write(seven_seg->shift_reg, data, 2);
 }
 
 HAL_StatusTypeDef Seven_Seg_Write_Text(Seven_Seg *seven_seg, char text[2]) {
   return Seven_Seg_Write_Chars(seven_seg, text, 0, 0);
 }
 
-HAL_StatusTypeDef Seven_Seg_Write_Decimal(Seven_Seg *seven_seg, float val) {
-  // display to ones place
-  if ( ( 10.0 <= val && val < 100.0 ) || ( -10.0 < val && val <= 0 ) ) {
-      return Seven_Seg_Write_Integer_DP(seven_seg, (int8_t)val, 0, 1);
+/**
+ * Scales a value by 10^shift, rounding half away from zero.
+ *
+ * @param value  the value to scale
+ * @param shift  the power of ten, from -9 to 1
+ *
+ * @retval the scaled value, saturated to INT32_MIN/INT32_MAX
+ */
+static int32_t Seven_Seg_Round_Scale(int32_t value, int8_t shift) {
+  if (shift > 0) {
+      if (value > INT32_MAX / 10) {
+          return INT32_MAX;
+      }
+      if (value < INT32_MIN / 10) {
+          return INT32_MIN;
+      }
+      return value * 10;
   }
 
-  // display to tenths place
-  else if ( 0.0 <= val && val < 10.0 ) {
-      return Seven_Seg_Write_Integer_DP(seven_seg, (int8_t)(val * 10), 1, 0);
+  uint32_t divisor = POWERS_OF_TEN[-shift];
+  uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+  uint32_t quotient = magnitude / divisor;
+  if (magnitude - quotient * divisor >= divisor - divisor / 2) {
+      quotient++;
   }
+  return (value < 0) ? -(int32_t)quotient : (int32_t)quotient;
+}
 
-  else {
-      return Seven_Seg_Write_Text(seven_seg, "--");
+HAL_StatusTypeDef Seven_Seg_Render_Fixed(int32_t value, uint8_t decimals, uint8_t data[2]) {
+  if (decimals > SEVEN_SEG_MAX_DECIMALS) {
+      return HAL_ERROR;
+  }
+
+  // "d.d", or "-.d" below zero
+  int32_t tenths = Seven_Seg_Round_Scale(value, 1 - decimals);
+  if (tenths > DECIMAL_MIN - 1 && tenths <= DECIMAL_MAX) {
+      Seven_Seg_Render_Glyphs(DECIMAL_GLYPHS[tenths - DECIMAL_MIN], 1, 0, data);
+      return HAL_OK;
+  }
+
+  // "dd", or "-d" below zero
+  int32_t units = Seven_Seg_Round_Scale(value, -decimals);
+  if (units <= DECIMAL_MAX) {
+      Seven_Seg_Render_Integer_DP(units < DECIMAL_MIN ? INT8_MIN : units, 0, 0, data);
+      return HAL_OK;
+  }
+
+  // "d.d." for d.d thousand
+  int32_t hundreds = Seven_Seg_Round_Scale(value, -2 - decimals);
+  if (hundreds <= DECIMAL_MAX) {
+      Seven_Seg_Render_Glyphs(DECIMAL_GLYPHS[hundreds - DECIMAL_MIN], 1, 1, data);
+      return HAL_OK;
+  }
+
+  // "dd." for dd thousand
+  int32_t thousands = Seven_Seg_Round_Scale(value, -3 - decimals);
+  if (thousands <= DECIMAL_MAX) {
+      Seven_Seg_Render_Glyphs(DECIMAL_GLYPHS[thousands - DECIMAL_MIN], 0, 1, data);
+      return HAL_OK;
   }
+
+  Seven_Seg_Render_Glyphs(OUT_OF_RANGE_GLYPHS, 0, 0, data);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Seven_Seg_Write_Fixed(Seven_Seg *seven_seg, int32_t value, uint8_t decimals) {
+  uint8_t data[2];
+  HAL_StatusTypeDef status = Seven_Seg_Render_Fixed(value, decimals, data);
+  if (status != HAL_OK) {
+      return status;
+  }
+  return Shift_Reg_Write(seven_seg->shift_reg, data, 2);
+}
+
+/**
+ * Rounds a float to an integer, half away from zero. Adding 0.5 before
+ * truncating would round 0.49999997 up, so the fraction is compared instead
+ * (it is exact, as the float and its whole part are this close).
+ *
+ * @param val  the value, within the int32_t range
+ *
+ * @retval the rounded value
+ */
+static int32_t Seven_Seg_Round_Float(float val) {
+  int32_t whole = (int32_t)val;
+  float fraction = val - (float)whole;
+  if (fraction >= 0.5f) {
+      whole++;
+  }
+  else if (fraction <= -0.5f) {
+      whole--;
+  }
+  return whole;
+}
+
+void Seven_Seg_Render_Decimal(float val, uint8_t data[2]) {
+  // the bounds also catch NaN, which fails both compares
+  if (!(val > -10.0f && val < 100000.0f)) {
+      Seven_Seg_Render_Glyphs(OUT_OF_RANGE_GLYPHS, 0, 0, data);
+      return;
+  }
+
+  if (val < 100.0f) {
+      // "d.d", or "-.d" below zero, straight from the float
+      if (val > -1.0f && val < 10.0f) {
+          int32_t tenths = Seven_Seg_Round_Float(val * 10.0f);
+          if (tenths > DECIMAL_MIN - 1 && tenths <= DECIMAL_MAX) {
+              Seven_Seg_Render_Glyphs(DECIMAL_GLYPHS[tenths - DECIMAL_MIN], 1, 0, data);
+              return;
+          }
+      }
+
+      // "dd", or "-d" below zero
+      int32_t units = Seven_Seg_Round_Float(val);
+      if (units > DECIMAL_MIN - 1 && units <= DECIMAL_MAX) {
+          Seven_Seg_Render_Glyphs(DECIMAL_GLYPHS[units - DECIMAL_MIN], 0, 0, data);
+          return;
+      }
+  }
+
+  // hundreds and thousands, and the values which round out of "dd", as
+  // fixed point
+  Seven_Seg_Render_Fixed(Seven_Seg_Round_Float(val * 1000.0f), 3, data);
+}
+
+HAL_StatusTypeDef Seven_Seg_Write_Decimal(Seven_Seg *seven_seg, float val) {
+  uint8_t data[2];
+  Seven_Seg_Render_Decimal(val, data);
+  return Shift_Reg_Write(seven_seg->shift_reg, data, 2);
 }
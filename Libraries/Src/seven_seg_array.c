@@ -0,0 +1,177 @@
+/*
+ * seven_seg_array.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See seven_seg_array.h for usage and troubleshooting.
+ */
+
+#include "seven_seg_array.h"
+
+/* GLOBAL VARS */
+static Seven_Seg_Array array_pool[SEVEN_SEG_ARRAY_MAX_HANDLERS];
+static uint8_t num_arrays = 0;
+
+/* PRIVATE FUNCTIONS */
+static void Array_Render_Span(Seven_Seg_Array *array, uint8_t first_slot, uint8_t num_slots,
+                              const char *chars, const uint8_t *dps);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+Seven_Seg_Array *Seven_Seg_Array_Init(Shift_Reg_Frame *frame, const uint8_t *offsets, uint8_t num_slots) {
+  if (frame == NULL || num_arrays >= SEVEN_SEG_ARRAY_MAX_HANDLERS ||
+      num_slots == 0 || num_slots > SEVEN_SEG_ARRAY_MAX_SLOTS) {
+      return NULL;
+  }
+
+  uint8_t mask[SHIFT_REG_MAX_REGS] = { 0 };
+  for (uint8_t slot = 0; slot < num_slots; slot++) {
+      uint8_t offset = offsets[slot];
+      if (offset + 1 >= frame->num_regs || mask[offset] || mask[offset + 1]) {
+          return NULL;
+      }
+      mask[offset] = 0xFF;
+      mask[offset + 1] = 0xFF;
+  }
+
+  int8_t owner = Shift_Reg_Frame_Add_Owner(frame, mask);
+  if (owner < 0) {
+      return NULL;
+  }
+
+  Seven_Seg_Array *array = &array_pool[num_arrays++];
+  memset(array, 0, sizeof(Seven_Seg_Array));
+  array->frame     = frame;
+  array->owner     = owner;
+  array->num_slots = num_slots;
+  memcpy(array->offsets, offsets, num_slots);
+
+  Shift_Reg_Frame_Write_Owner(frame, owner, array->values);
+  return array;
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Write_Raw(Seven_Seg_Array *array, uint8_t slot, uint8_t left_raw, uint8_t right_raw) {
+  if (slot >= array->num_slots) {
+      return HAL_ERROR;
+  }
+  uint8_t *data = &array->values[array->offsets[slot]];
+  data[0] = right_raw;
+  data[1] = left_raw;
+  return Shift_Reg_Frame_Write_Owner(array->frame, array->owner, array->values);
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Write_Hex(Seven_Seg_Array *array, uint8_t slot, uint8_t hex, uint8_t left_dp, uint8_t right_dp) {
+  if (slot >= array->num_slots) {
+      return HAL_ERROR;
+  }
+  Seven_Seg_Render_Hex(hex, left_dp, right_dp, &array->values[array->offsets[slot]]);
+  return Shift_Reg_Frame_Write_Owner(array->frame, array->owner, array->values);
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Write_Integer(Seven_Seg_Array *array, uint8_t slot, int8_t val) {
+  if (slot >= array->num_slots) {
+      return HAL_ERROR;
+  }
+  Seven_Seg_Render_Integer(val, &array->values[array->offsets[slot]]);
+  return Shift_Reg_Frame_Write_Owner(array->frame, array->owner, array->values);
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Write_Fixed(Seven_Seg_Array *array, uint8_t slot, int32_t value, uint8_t decimals) {
+  if (slot >= array->num_slots ||
+      Seven_Seg_Render_Fixed(value, decimals, &array->values[array->offsets[slot]]) != HAL_OK) {
+      return HAL_ERROR;
+  }
+  return Shift_Reg_Frame_Write_Owner(array->frame, array->owner, array->values);
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Write_Text(Seven_Seg_Array *array, uint8_t first_slot, uint8_t num_slots, const char *text) {
+  if (num_slots == 0 || first_slot + num_slots > array->num_slots) {
+      return HAL_ERROR;
+  }
+
+  // each '.' is folded into the character before it
+  char chars[SEVEN_SEG_ARRAY_MAX_SLOTS * 2];
+  uint8_t dps[SEVEN_SEG_ARRAY_MAX_SLOTS * 2] = { 0 };
+  uint8_t width = num_slots * 2;
+  uint8_t length = 0;
+  for (const char *c = text; *c != '\0'; c++) {
+      if (*c == '.' && length > 0 && !dps[length - 1]) {
+          dps[length - 1] = 1;
+          continue;
+      }
+      if (length >= width) {
+          return HAL_ERROR;
+      }
+      chars[length++] = *c;
+  }
+  memset(&chars[length], ' ', width - length);
+
+  Array_Render_Span(array, first_slot, num_slots, chars, dps);
+  return Shift_Reg_Frame_Write_Owner(array->frame, array->owner, array->values);
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Write_Number(Seven_Seg_Array *array, uint8_t first_slot, uint8_t num_slots,
+                                               int32_t value, uint8_t decimals) {
+  if (num_slots == 0 || first_slot + num_slots > array->num_slots) {
+      return HAL_ERROR;
+  }
+
+  char chars[SEVEN_SEG_ARRAY_MAX_SLOTS * 2];
+  uint8_t dps[SEVEN_SEG_ARRAY_MAX_SLOTS * 2] = { 0 };
+  uint8_t width = num_slots * 2;
+  memset(chars, ' ', width);
+
+  // digits from the right, at least one before the decimal point
+  uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+  int8_t pos = width - 1;
+  uint8_t digits = 0;
+  while ((magnitude != 0 || digits <= decimals) && pos >= 0) {
+      chars[pos] = '0' + magnitude % 10;
+      if (digits == decimals && decimals > 0) {
+          dps[pos] = 1;
+      }
+      magnitude /= 10;
+      digits++;
+      pos--;
+  }
+
+  uint8_t overflow = (magnitude != 0 || digits <= decimals);
+  if (value < 0 && !overflow) {
+      if (pos < 0) {
+          overflow = 1;
+      }
+      else {
+          chars[pos] = '-';
+      }
+  }
+  if (overflow) {
+      memset(chars, '-', width);
+      memset(dps, 0, width);
+  }
+
+  Array_Render_Span(array, first_slot, num_slots, chars, dps);
+  return Shift_Reg_Frame_Write_Owner(array->frame, array->owner, array->values);
+}
+
+HAL_StatusTypeDef Seven_Seg_Array_Flush(Seven_Seg_Array *array) {
+  return Shift_Reg_Frame_Flush(array->frame);
+}
+
+/**
+ * Renders two characters and their decimal points per module into the
+ * array's bytes, over consecutive slots.
+ *
+ * @param array       the array handler
+ * @param first_slot  the leftmost module
+ * @param num_slots   the number of modules
+ * @param chars       num_slots * 2 characters, in reading order
+ * @param dps         num_slots * 2 decimal points, 1 for on
+ */
+static void Array_Render_Span(Seven_Seg_Array *array, uint8_t first_slot, uint8_t num_slots,
+                              const char *chars, const uint8_t *dps) {
+  for (uint8_t slot = 0; slot < num_slots; slot++) {
+      Seven_Seg_Render_Chars(&chars[slot * 2], dps[slot * 2], dps[slot * 2 + 1],
+                             &array->values[array->offsets[first_slot + slot]]);
+  }
+}
@@ -0,0 +1,199 @@
+/*
+ * seven_seg_marquee.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See seven_seg_marquee.h for usage and troubleshooting.
+ */
+
+#include "seven_seg_marquee.h"
+#include "util.h"
+
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+#define MARQUEE_TICK_HZ 10000
+
+/* GLOBAL VARS */
+static Seven_Seg_Marquee marquee_pool[SEVEN_SEG_MARQUEE_MAX_HANDLERS];
+static uint8_t num_marquees = 0;
+
+/* PRIVATE FUNCTIONS */
+static void Marquee_Select(Seven_Seg_Marquee *marquee);
+static void Marquee_Tick(TIM_HandleTypeDef *htim);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+Seven_Seg_Marquee *Seven_Seg_Marquee_Init(Seven_Seg *seven_seg, TIM_HandleTypeDef *htim) {
+  if (seven_seg == NULL || num_marquees >= SEVEN_SEG_MARQUEE_MAX_HANDLERS) {
+      return NULL;
+  }
+
+  htim->Init.Prescaler = Util_Get_Timer_Clock(htim->Instance) / MARQUEE_TICK_HZ - 1;
+  htim->Init.Period = MARQUEE_TICK_HZ - 1;
+  htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+  if (HAL_TIM_Base_Init(htim) != HAL_OK ||
+      HAL_TIM_RegisterCallback(htim, HAL_TIM_PERIOD_ELAPSED_CB_ID, Marquee_Tick) != HAL_OK) {
+      return NULL;
+  }
+
+  Seven_Seg_Marquee *marquee = &marquee_pool[num_marquees++];
+  memset(marquee, 0, sizeof(Seven_Seg_Marquee));
+  marquee->seven_seg = seven_seg;
+  marquee->htim      = htim;
+  marquee->active    = -1;
+
+  return marquee;
+}
+
+HAL_StatusTypeDef Seven_Seg_Marquee_Show(Seven_Seg_Marquee *marquee, uint8_t priority,
+                                         const char *text, uint16_t step_ms, uint8_t repeat) {
+  if (priority >= SEVEN_SEG_MARQUEE_PRIORITIES ||
+      step_ms == 0 || step_ms > SEVEN_SEG_MARQUEE_MAX_STEP_MS) {
+      return HAL_ERROR;
+  }
+
+  // the text between a blank at each end, with each '.' folded into the
+  // character before it
+  char chars[SEVEN_SEG_MARQUEE_MAX_LENGTH + 2];
+  uint8_t dps[SEVEN_SEG_MARQUEE_MAX_LENGTH + 2];
+  uint8_t length = 0;
+  chars[length] = ' ';
+  dps[length++] = 0;
+  for (const char *c = text; *c != '\0'; c++) {
+      if (*c == '.' && length > 1 && !dps[length - 1]) {
+          dps[length - 1] = 1;
+          continue;
+      }
+      if (length > SEVEN_SEG_MARQUEE_MAX_LENGTH) {
+          return HAL_ERROR;
+      }
+      chars[length] = *c;
+      dps[length++] = 0;
+  }
+  chars[length] = ' ';
+  dps[length++] = 0;
+
+  // render outside the critical section, so only the copy holds off the
+  // scrolling interrupt
+  uint8_t frames[SEVEN_SEG_MARQUEE_MAX_LENGTH + 1][2];
+  uint8_t num_frames = length - 1;
+  for (uint8_t frame = 0; frame < num_frames; frame++) {
+      Seven_Seg_Render_Chars(&chars[frame], dps[frame], dps[frame + 1], frames[frame]);
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  Seven_Seg_Message *message = &marquee->messages[priority];
+  memcpy(message->frames, frames, num_frames * 2);
+  message->num_frames = num_frames;
+  message->frame      = 0;
+  message->repeat     = repeat;
+  message->step_ms    = step_ms;
+
+  // replacing the message showing restarts it
+  if (marquee->active == priority) {
+      marquee->active = -1;
+  }
+  Marquee_Select(marquee);
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Seven_Seg_Marquee_Clear(Seven_Seg_Marquee *marquee, uint8_t priority) {
+  if (priority >= SEVEN_SEG_MARQUEE_PRIORITIES) {
+      return HAL_ERROR;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  marquee->messages[priority].num_frames = 0;
+  marquee->messages[priority].frame = 0;
+  Marquee_Select(marquee);
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+/**
+ * Shows the highest priority message, if it is not already showing, from
+ * the frame it is on. Blanks the display and stops the timer if there are
+ * none. Called with interrupts disabled.
+ *
+ * @param marquee  the marquee handler
+ */
+static void Marquee_Select(Seven_Seg_Marquee *marquee) {
+  int8_t priority = SEVEN_SEG_MARQUEE_PRIORITIES - 1;
+  while (priority >= 0 && marquee->messages[priority].num_frames == 0) {
+      priority--;
+  }
+  if (priority == marquee->active) {
+      return;
+  }
+  marquee->active = priority;
+
+  TIM_HandleTypeDef *htim = marquee->htim;
+  if (priority < 0) {
+      HAL_TIM_Base_Stop_IT(htim);
+      Seven_Seg_Write_Raw(marquee->seven_seg, 0, 0);
+      return;
+  }
+
+  // restart the step, so the frame is shown for all of it
+  Seven_Seg_Message *message = &marquee->messages[priority];
+  __HAL_TIM_SET_AUTORELOAD(htim, message->step_ms * (MARQUEE_TICK_HZ / 1000) - 1);
+  __HAL_TIM_SET_COUNTER(htim, 0);
+  Shift_Reg_Write(marquee->seven_seg->shift_reg, message->frames[message->frame], 2);
+
+  if (htim->State == HAL_TIM_STATE_READY) {
+      HAL_TIM_Base_Start_IT(htim);
+  }
+}
+
+/**
+ * Shows the next frame of the message showing, moving on to the next
+ * message once one which does not repeat ends. Called when the scroll
+ * timer elapses.
+ *
+ * @param htim the timer handler whose period elapsed
+ */
+static void Marquee_Tick(TIM_HandleTypeDef *htim) {
+  Seven_Seg_Marquee *marquee = NULL;
+  for (uint8_t index = 0; index < num_marquees; index++) {
+      if (marquee_pool[index].htim == htim) {
+          marquee = &marquee_pool[index];
+          break;
+      }
+  }
+  if (marquee == NULL) {
+      return;
+  }
+
+  // a higher priority interrupt may show or clear a message
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (marquee->active >= 0) {
+      Seven_Seg_Message *message = &marquee->messages[marquee->active];
+      uint8_t frame = message->frame + 1;
+      if (frame < message->num_frames) {
+          message->frame = frame;
+          Shift_Reg_Write(marquee->seven_seg->shift_reg, message->frames[frame], 2);
+      }
+      else if (message->repeat) {
+          message->frame = 0;
+          Shift_Reg_Write(marquee->seven_seg->shift_reg, message->frames[0], 2);
+      }
+      else {
+          message->num_frames = 0;
+          message->frame = 0;
+          Marquee_Select(marquee);
+      }
+  }
+  __set_PRIMASK(primask);
+}
+
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
@@ -8,27 +8,76 @@
  */
 
 #include "shift_reg.h"
+#include "util.h"
 #ifdef HAL_SPI_MODULE_ENABLED
   #include "stm32f4xx_hal.h"
   #include "stm32f4xx_hal_spi.h"
 #endif // End of HAL_SPI_MODULE_ENABLED check
 
-#define MAX_SHIFT_REGS 3
+/*
+ * Shifts out bit `bit` of `byte` with two (or three) BSRR stores: SHCP low
+ * and DATA together when they share a port, then SHCP high. The low phase
+ * (one store) covers the 74HC595 data setup time at up to 72 MHz.
+ */
+#define SHIFT_REG_GPIO_BIT(byte, bit)                                       \
+  do {                                                                      \
+      if (!shared_port) {                                                   \
+          shcp_port->BSRR = shcp_reset;                                     \
+      }                                                                     \
+      data_port->BSRR = data_bsrr[((byte) >> (bit)) & 1];                   \
+      shcp_port->BSRR = shcp_set;                                           \
+  } while (0)
 
 #ifdef HAL_SPI_MODULE_ENABLED
 #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
-static void Shift_Reg_SPI_Reset_NSS(SPI_HandleTypeDef *hspi);
+static Shift_Reg *Shift_Reg_SPI_Init(SPI_HandleTypeDef *hspi,
+                              GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
+                              Shift_Reg_Mode mode);
+static void Shift_Reg_SPI_TX_Complete(SPI_HandleTypeDef *hspi);
+static void Shift_Reg_Update_Inputs(Shift_Reg *shift_reg);
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+static void Shift_Reg_TIM_Latch_Done(TIM_HandleTypeDef *htim);
+#endif
 
-static SPI_HandleTypeDef* SPI_Handlers[MAX_SHIFT_REGS];
-static Shift_Reg* Shift_Regs[MAX_SHIFT_REGS];
-static uint8_t num_shift_regs = 0;
+static Shift_Reg_Bus bus_pool[SHIFT_REG_MAX_BUSES];
+static uint8_t num_buses = 0;
+static Shift_Reg_Bus *buses = NULL;
 #endif // #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
+static void Shift_Reg_Bus_Complete(Shift_Reg_Bus *bus);
+static HAL_StatusTypeDef Shift_Reg_Bus_Start_Next(Shift_Reg_Bus *bus);
 #endif // End of HAL_SPI_MODULE_ENABLED check
 
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+static void Shift_Reg_GPIO_IT_Tick(TIM_HandleTypeDef *htim);
+
+static Shift_Reg *gpio_it_shift_regs = NULL;
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+static HAL_StatusTypeDef Shift_Reg_Send_Pending(Shift_Reg *shift_reg);
+
+// handlers are never freed, so the pool is filled in order
+static Shift_Reg handler_pool[SHIFT_REG_MAX_HANDLERS];
+static uint8_t num_handlers = 0;
+
+/**
+ * @retval a cleared handler from the pool, or NULL if the pool is used up
+ */
+static Shift_Reg *Shift_Reg_Alloc(void) {
+  if (num_handlers >= SHIFT_REG_MAX_HANDLERS) {
+      return NULL;
+  }
+  Shift_Reg *shift_reg = &handler_pool[num_handlers++];
+  memset(shift_reg, 0, sizeof(Shift_Reg));
+  return shift_reg;
+}
+
 Shift_Reg *Shift_Reg_GPIO_Init(GPIO_TypeDef *shcp_port, uint16_t shcp_pin,
             GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
             GPIO_TypeDef *data_port, uint16_t data_pin) {
-  Shift_Reg *shift_reg = malloc(sizeof(Shift_Reg));
+  Shift_Reg *shift_reg = Shift_Reg_Alloc();
+  if (shift_reg == NULL) {
+      return NULL;
+  }
   shift_reg->Mode      = Shift_Reg_GPIO_Mode;
   shift_reg->SHCP_Port = shcp_port;
   shift_reg->SHCP_Pin  = shcp_pin;
@@ -37,39 +86,265 @@ Shift_Reg *Shift_Reg_GPIO_Init(GPIO_TypeDef *shcp_port, uint16_t shcp_pin,
   shift_reg->DATA_Port = data_port;
   shift_reg->DATA_Pin  = data_pin;
 
+  // precompute the BSRR words: the upper half resets a pin, the lower half sets it
+  shift_reg->SHCP_Set      = shcp_pin;
+  shift_reg->SHCP_Reset    = (uint32_t)shcp_pin << 16;
+  shift_reg->DATA_BSRR[0]  = (uint32_t)data_pin << 16;
+  shift_reg->DATA_BSRR[1]  = data_pin;
+  shift_reg->Shared_Port   = (shcp_port == data_port);
+  if (shift_reg->Shared_Port) {
+      // the DATA write also pulls SHCP low
+      shift_reg->DATA_BSRR[0] |= shift_reg->SHCP_Reset;
+      shift_reg->DATA_BSRR[1] |= shift_reg->SHCP_Reset;
+  }
+  shift_reg->half_bit_cycles = 0;
+
   shift_reg->remaining_bits = 0;
   shift_reg->remaining_bytes = 0;
   shift_reg->cur_byte = 0;
   shift_reg->send_data = NULL;
+  shift_reg->next = NULL;
+  shift_reg->tx_buffer_size = 0;
+  shift_reg->tx_index = 0;
+  shift_reg->pending_length = 0;
+  shift_reg->Write_Complete_Callback = NULL;
 
   return shift_reg;
 }
 
-#ifdef HAL_TIM_MODULE_ENABLED
-// TODO: make GPIO non-blocking mode
-#endif // #ifdef HAL_TIM_MODULE_ENABLED
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+Shift_Reg *Shift_Reg_GPIO_IT_Init(TIM_HandleTypeDef *htim, uint16_t bit_period_us,
+            GPIO_TypeDef *shcp_port, uint16_t shcp_pin,
+            GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
+            GPIO_TypeDef *data_port, uint16_t data_pin,
+            uint8_t num_regs) {
 
-#ifdef HAL_SPI_MODULE_ENABLED
+  if (num_handlers >= SHIFT_REG_MAX_HANDLERS || bit_period_us == 0 ||
+      num_regs == 0 || num_regs > SHIFT_REG_MAX_REGS) {
+      return NULL;
+  }
 
-// Hardware NSS disabled because it does not function properly
-/*
-Shift_Reg *Shift_Reg_SPI_HW_NSS_Init(SPI_HandleTypeDef *hspi) {
-  Shift_Reg *shift_reg = malloc(sizeof(Shift_Reg));
-  shift_reg->Mode      = Shift_Reg_SPI_HW_NSS_Mode;
-  shift_reg->hspi      = hspi;
+  // count at 1 MHz, overflow every bit
+  htim->Init.Prescaler = Util_Get_Timer_Clock(htim->Instance) / 1000000 - 1;
+  htim->Init.Period = bit_period_us - 1;
+  htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+  if (HAL_TIM_Base_Init(htim) != HAL_OK ||
+      HAL_TIM_RegisterCallback(htim, HAL_TIM_PERIOD_ELAPSED_CB_ID, Shift_Reg_GPIO_IT_Tick) != HAL_OK) {
+      return NULL;
+  }
+
+  Shift_Reg *shift_reg = Shift_Reg_GPIO_Init(shcp_port, shcp_pin, stcp_port, stcp_pin, data_port, data_pin);
+  if (shift_reg == NULL) {
+      return NULL;
+  }
+  shift_reg->Mode           = Shift_Reg_GPIO_IT_Mode;
+  shift_reg->htim           = htim;
+  shift_reg->tx_buffer_size = num_regs;
+
+  shift_reg->next           = gpio_it_shift_regs;
+  gpio_it_shift_regs        = shift_reg;
 
   return shift_reg;
 }
-*/
+
+/**
+ * Shifts out the next bit, or once every bit is out, latches the data,
+ * stops the timer and reports completion. Called when the timer elapses.
+ *
+ * @param htim the timer handler whose period elapsed
+ */
+static void Shift_Reg_GPIO_IT_Tick(TIM_HandleTypeDef *htim) {
+  Shift_Reg *shift_reg = gpio_it_shift_regs;
+  while (shift_reg != NULL && shift_reg->htim != htim) {
+      shift_reg = shift_reg->next;
+  }
+  if (shift_reg == NULL) {
+      return;
+  }
+
+  // move to the next byte
+  if (shift_reg->remaining_bits == 0) {
+      // every bit was shifted out on the previous tick, so latch them
+      if (shift_reg->remaining_bytes == 0) {
+          HAL_TIM_Base_Stop_IT(htim);
+          HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_SET);
+
+          if (shift_reg->Write_Complete_Callback != NULL) {
+              shift_reg->Write_Complete_Callback(shift_reg);
+          }
+          Shift_Reg_Send_Pending(shift_reg);
+          return;
+      }
+
+      shift_reg->cur_byte = *shift_reg->send_data;
+      ++shift_reg->send_data;
+      --shift_reg->remaining_bytes;
+      shift_reg->remaining_bits = 8;
+  }
+
+  // write the most significant bit to the register
+  GPIO_TypeDef *shcp_port = shift_reg->SHCP_Port;
+  GPIO_TypeDef *data_port = shift_reg->DATA_Port;
+  uint32_t shcp_set       = shift_reg->SHCP_Set;
+  uint32_t shcp_reset     = shift_reg->SHCP_Reset;
+  const uint32_t *data_bsrr = shift_reg->DATA_BSRR;
+  uint8_t shared_port     = shift_reg->Shared_Port;
+  SHIFT_REG_GPIO_BIT(shift_reg->cur_byte, 7);
+
+  // move to the next bit
+  shift_reg->cur_byte <<= 1;
+  --shift_reg->remaining_bits;
+}
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+void Shift_Reg_Register_Complete_Callback(Shift_Reg *shift_reg, void (*callback)(Shift_Reg *shift_reg)) {
+  shift_reg->Write_Complete_Callback = callback;
+}
+
+#ifdef HAL_SPI_MODULE_ENABLED
 
 #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
 Shift_Reg *Shift_Reg_SPI_SW_NSS_Init(SPI_HandleTypeDef *hspi,
                               GPIO_TypeDef *stcp_port, uint16_t stcp_pin) {
+  Shift_Reg *shift_reg = Shift_Reg_SPI_Init(hspi, stcp_port, stcp_pin, Shift_Reg_SPI_SW_NSS_Mode);
+  if (shift_reg != NULL) {
+      shift_reg->tx_buffer_size = SHIFT_REG_MAX_REGS;
+  }
+  return shift_reg;
+}
 
-  if (num_shift_regs >= MAX_SHIFT_REGS) {
+Shift_Reg *Shift_Reg_SPI_DMA_Init(SPI_HandleTypeDef *hspi,
+                              GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
+                              uint8_t num_regs) {
+  // the DMA stream must be linked to the SPI bus in the IOC file
+  if (hspi->hdmatx == NULL || num_regs == 0 || num_regs > SHIFT_REG_MAX_REGS) {
       return NULL;
   }
 
+  Shift_Reg *shift_reg = Shift_Reg_SPI_Init(hspi, stcp_port, stcp_pin, Shift_Reg_SPI_DMA_Mode);
+  if (shift_reg == NULL) {
+      return NULL;
+  }
+  shift_reg->tx_buffer_size = num_regs;
+
+  return shift_reg;
+}
+
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+Shift_Reg *Shift_Reg_SPI_TIM_Latch_Init(SPI_HandleTypeDef *hspi, TIM_HandleTypeDef *htim,
+                              uint32_t channel, uint8_t num_regs) {
+  // the timer counts SHCP through its ETR pin, so SCK must idle low and
+  // rise once per bit
+  if (num_handlers >= SHIFT_REG_MAX_HANDLERS || hspi->hdmatx == NULL ||
+      !IS_TIM_CLOCKSOURCE_ETRMODE2_INSTANCE(htim->Instance) ||
+      (hspi->Instance->CR1 & SPI_CR1_CPOL) != 0 ||
+      num_regs == 0 || num_regs > SHIFT_REG_MAX_REGS) {
+      return NULL;
+  }
+
+  // SPI bit rate = bus clock / 2^(BR + 1)
+  uint32_t pclk = ((uint32_t)hspi->Instance >= APB2PERIPH_BASE) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+  uint32_t bit_rate = pclk >> (((hspi->Instance->CR1 & SPI_CR1_BR) >> SPI_CR1_BR_Pos) + 1);
+  uint32_t timer_clock = Util_Get_Timer_Clock(htim->Instance);
+
+  // the counted ETR edges can be at most a quarter of the timer clock, so
+  // faster buses are divided by the ETR prescaler, counting every 2, 4 or 8
+  // bits; a byte is always a whole number of counts
+  uint8_t bits_per_count = 1;
+  while ((uint64_t)bit_rate > (uint64_t)timer_clock / 4 * bits_per_count) {
+      if (bits_per_count == 8) {
+          return NULL;
+      }
+      bits_per_count *= 2;
+  }
+
+  htim->Init.Prescaler = 0;
+  htim->Init.Period = 0xFFFF;
+  htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_PWM_Init(htim) != HAL_OK) {
+      return NULL;
+  }
+
+  TIM_ClockConfigTypeDef clock_config = {
+      .ClockSource = TIM_CLOCKSOURCE_ETRMODE2,
+      .ClockPolarity = TIM_CLOCKPOLARITY_NONINVERTED,
+      .ClockPrescaler = (bits_per_count == 1) ? TIM_CLOCKPRESCALER_DIV1 :
+                        (bits_per_count == 2) ? TIM_CLOCKPRESCALER_DIV2 :
+                        (bits_per_count == 4) ? TIM_CLOCKPRESCALER_DIV4 : TIM_CLOCKPRESCALER_DIV8,
+      .ClockFilter = 0,
+  };
+  if (HAL_TIM_ConfigClockSource(htim, &clock_config) != HAL_OK) {
+      return NULL;
+  }
+
+  // low until the compare value (the last SHCP edge), then high until the
+  // next write clears the counter
+  TIM_OC_InitTypeDef oc_config = {
+      .OCMode = TIM_OCMODE_PWM2,
+      .Pulse = 0xFFFF,
+      .OCPolarity = TIM_OCPOLARITY_HIGH,
+      .OCNPolarity = TIM_OCNPOLARITY_HIGH,
+      .OCFastMode = TIM_OCFAST_DISABLE,
+      .OCIdleState = TIM_OCIDLESTATE_RESET,
+      .OCNIdleState = TIM_OCNIDLESTATE_RESET,
+  };
+  if (HAL_TIM_PWM_ConfigChannel(htim, &oc_config, channel) != HAL_OK) {
+      return NULL;
+  }
+  // the update (and its flag) is only ever generated by software
+  htim->Instance->CR1 |= TIM_CR1_URS;
+  TIM_CCxChannelCmd(htim->Instance, channel, TIM_CCx_ENABLE);
+  if (IS_TIM_BREAK_INSTANCE(htim->Instance)) {
+      __HAL_TIM_MOE_ENABLE(htim);
+  }
+
+  // the compare match (the latch) sends the pending write, if there is one
+  if (HAL_TIM_RegisterCallback(htim, HAL_TIM_PWM_PULSE_FINISHED_CB_ID, Shift_Reg_TIM_Latch_Done) != HAL_OK) {
+      return NULL;
+  }
+
+  Shift_Reg *shift_reg = Shift_Reg_SPI_Init(hspi, NULL, 0, Shift_Reg_SPI_TIM_Latch_Mode);
+  if (shift_reg == NULL) {
+      return NULL;
+  }
+  shift_reg->htim                = htim;
+  shift_reg->latch_channel       = channel;
+  shift_reg->latch_bits_per_count = bits_per_count;
+  shift_reg->tx_buffer_size      = num_regs;
+
+  return shift_reg;
+}
+
+/**
+ * Completes the write once it is latched, freeing the bus. Called on the
+ * latch timer's compare match, whose interrupt is only enabled once the
+ * transfer is done.
+ *
+ * @param htim the timer handler whose channel matched
+ */
+static void Shift_Reg_TIM_Latch_Done(TIM_HandleTypeDef *htim) {
+  for (Shift_Reg_Bus *bus = buses; bus != NULL; bus = bus->next) {
+      Shift_Reg *shift_reg = bus->active;
+      if (shift_reg != NULL && shift_reg->Mode == Shift_Reg_SPI_TIM_Latch_Mode && shift_reg->htim == htim) {
+          // stop counting before the next transfer on the bus clocks SCK
+          __HAL_TIM_DISABLE_IT(htim, TIM_IT_CC1 << (shift_reg->latch_channel >> 2));
+          htim->Instance->CR1 &= ~TIM_CR1_CEN;
+          Shift_Reg_Bus_Complete(bus);
+          return;
+      }
+  }
+}
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+static Shift_Reg *Shift_Reg_SPI_Init(SPI_HandleTypeDef *hspi,
+                              GPIO_TypeDef *stcp_port, uint16_t stcp_pin,
+                              Shift_Reg_Mode mode) {
+
   // ensure that SPI settings are correct
   uint16_t should_be_unset = SPI_CR1_RXONLY | SPI_CR1_DFF | SPI_CR1_CPHA | SPI_CR1_LSBFIRST | SPI_CR1_CRCEN;
   uint16_t should_be_set   = SPI_CR1_MSTR | SPI_CR1_SSM;
@@ -78,70 +353,356 @@ Shift_Reg *Shift_Reg_SPI_SW_NSS_Init(SPI_HandleTypeDef *hspi,
       return NULL;
   }
 
-  Shift_Reg *shift_reg = malloc(sizeof(Shift_Reg));
-  shift_reg->Mode      = Shift_Reg_SPI_SW_NSS_Mode;
+  if (num_handlers >= SHIFT_REG_MAX_HANDLERS) {
+      return NULL;
+  }
+
+  // the first shift register on a bus creates its queue
+  Shift_Reg_Bus *bus = buses;
+  while (bus != NULL && bus->hspi != hspi) {
+      bus = bus->next;
+  }
+  if (bus == NULL) {
+      if (num_buses >= SHIFT_REG_MAX_BUSES) {
+          return NULL;
+      }
+
+      // called at the end of both interrupt and DMA transfers
+      if (HAL_SPI_RegisterCallback(hspi, HAL_SPI_TX_COMPLETE_CB_ID, Shift_Reg_SPI_TX_Complete) != HAL_OK) {
+          return NULL;
+      }
+
+      bus = &bus_pool[num_buses++];
+      memset(bus, 0, sizeof(Shift_Reg_Bus));
+      bus->hspi = hspi;
+      bus->next = buses;
+      buses     = bus;
+  }
+
+  Shift_Reg *shift_reg = Shift_Reg_Alloc();
+  shift_reg->Mode      = mode;
   shift_reg->hspi      = hspi;
   shift_reg->STCP_Port = stcp_port;
   shift_reg->STCP_Pin  = stcp_pin;
+  shift_reg->bus       = bus;
 
-  SPI_Handlers[num_shift_regs] = hspi;
-  Shift_Regs[num_shift_regs] = shift_reg;
-  ++num_shift_regs;
-
-  HAL_SPI_RegisterCallback(hspi, HAL_SPI_TX_COMPLETE_CB_ID, Shift_Reg_SPI_Reset_NSS);
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  shift_reg->next = bus->devices;
+  bus->devices    = shift_reg;
+  __set_PRIMASK(primask);
 
   return shift_reg;
 }
 
-static void Shift_Reg_SPI_Reset_NSS(SPI_HandleTypeDef *hspi) {
-  for (uint8_t index = 0; index < num_shift_regs; index++) {
-      if (SPI_Handlers[index] == hspi) {
-          Shift_Reg *shift_reg = Shift_Regs[index];
-          HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_RESET);
-          HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_SET);
+/**
+ * Latches the shift register whose transfer completed, and starts the
+ * next one waiting for the bus. Called at the end of every transfer.
+ *
+ * @param hspi the SPI handler whose transfer completed
+ */
+static void Shift_Reg_SPI_TX_Complete(SPI_HandleTypeDef *hspi) {
+  Shift_Reg_Bus *bus = buses;
+  while (bus != NULL && bus->hspi != hspi) {
+      bus = bus->next;
+  }
+  if (bus == NULL || bus->active == NULL) {
+      return;
+  }
+  Shift_Reg *shift_reg = bus->active;
+
+  // the timer latches SPI_TIM_Latch by itself, on the last SHCP edge; the
+  // bus is free once it has (if it already has, the interrupt is taken
+  // straight away)
+  if (shift_reg->Mode == Shift_Reg_SPI_TIM_Latch_Mode) {
+#if defined(HAL_TIM_MODULE_ENABLED)
+      __HAL_TIM_ENABLE_IT(shift_reg->htim, TIM_IT_CC1 << (shift_reg->latch_channel >> 2));
+#endif
+      return;
+  }
 
-          return;
+  HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_SET);
+
+  if (shift_reg->in_num_regs != 0) {
+      Shift_Reg_Update_Inputs(shift_reg);
+  }
+  Shift_Reg_Bus_Complete(bus);
+}
+
+/**
+ * Takes the inputs received in the last transfer, and reports any change.
+ */
+static void Shift_Reg_Update_Inputs(Shift_Reg *shift_reg) {
+  uint8_t changed[SHIFT_REG_MAX_REGS];
+  uint8_t any_changed = 0;
+
+  for (uint8_t index = 0; index < shift_reg->in_num_regs; index++) {
+      changed[index] = shift_reg->in_buffer[index] ^ shift_reg->in_states[index];
+      shift_reg->in_states[index] = shift_reg->in_buffer[index];
+      any_changed |= changed[index];
+  }
+
+  if (any_changed && shift_reg->Input_Change_Callback != NULL) {
+      shift_reg->Input_Change_Callback(shift_reg, changed);
+  }
+}
+
+HAL_StatusTypeDef Shift_Reg_SPI_DMA_Attach_Input(Shift_Reg *shift_reg,
+                              GPIO_TypeDef *pl_port, uint16_t pl_pin,
+                              uint8_t num_regs) {
+  if (shift_reg == NULL || shift_reg->Mode != Shift_Reg_SPI_DMA_Mode ||
+      num_regs == 0 || num_regs > SHIFT_REG_MAX_REGS) {
+      return HAL_ERROR;
+  }
+
+  // both directions on their own lines, with the received bytes moved by DMA
+  SPI_HandleTypeDef *hspi = shift_reg->hspi;
+  if (hspi->hdmarx == NULL || (hspi->Instance->CR1 & SPI_CR1_BIDIMODE) != 0) {
+      return HAL_ERROR;
+  }
+
+  // full duplex transfers end with their own callback
+  HAL_StatusTypeDef status = HAL_SPI_RegisterCallback(hspi, HAL_SPI_TX_RX_COMPLETE_CB_ID, Shift_Reg_SPI_TX_Complete);
+  if (status != HAL_OK) {
+      return status;
+  }
+
+  // high between transfers: the 74HC165s shift instead of loading
+  HAL_GPIO_WritePin(pl_port, pl_pin, GPIO_PIN_SET);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  shift_reg->PL_Port     = pl_port;
+  shift_reg->PL_Pin      = pl_pin;
+  shift_reg->in_num_regs = num_regs;
+  memset(shift_reg->in_states, 0, sizeof(shift_reg->in_states));
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Shift_Reg_Scan_Inputs(Shift_Reg *shift_reg) {
+  if (shift_reg == NULL || shift_reg->in_num_regs == 0) {
+      return HAL_ERROR;
+  }
+
+  HAL_StatusTypeDef status = HAL_OK;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  // a write already waiting reads the inputs as well
+  if (shift_reg->pending_length == 0) {
+      uint8_t length = shift_reg->tx_length;
+      if (length == 0) {
+          // nothing was written yet, and both buffers are still clear
+          length = (shift_reg->in_num_regs > shift_reg->tx_buffer_size) ?
+                   shift_reg->in_num_regs : shift_reg->tx_buffer_size;
+      }
+      else {
+          memcpy(shift_reg->tx_buffers[shift_reg->tx_index ^ 1],
+                 shift_reg->tx_buffers[shift_reg->tx_index], length);
       }
+      shift_reg->pending_length = length;
+      status = Shift_Reg_Send_Pending(shift_reg);
   }
+  __set_PRIMASK(primask);
+
+  return status;
+}
+
+HAL_StatusTypeDef Shift_Reg_Read_Inputs(Shift_Reg *shift_reg, uint8_t *states) {
+  if (shift_reg == NULL || shift_reg->in_num_regs == 0) {
+      return HAL_ERROR;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(states, shift_reg->in_states, shift_reg->in_num_regs);
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+void Shift_Reg_Register_Input_Callback(Shift_Reg *shift_reg,
+                              void (*callback)(Shift_Reg *shift_reg, const uint8_t *changed)) {
+  shift_reg->Input_Change_Callback = callback;
 }
 #endif // #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1)
 #endif // End of HAL_SPI_MODULE_ENABLED check
 
 
-static HAL_StatusTypeDef Shift_Reg_Write_Data_GPIO(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
-  GPIO_PinState msb;
-  uint8_t cur_byte;
+HAL_StatusTypeDef Shift_Reg_GPIO_Set_Max_Bit_Rate(Shift_Reg *shift_reg, uint32_t bit_rate_hz) {
+  if (shift_reg == NULL || shift_reg->Mode != Shift_Reg_GPIO_Mode) {
+      return HAL_ERROR;
+  }
+
+  if (bit_rate_hz == 0) {
+      shift_reg->half_bit_cycles = 0;
+      return HAL_OK;
+  }
+
+  // round up, so the cap is never exceeded
+  Util_Cycle_Counter_Init();
+  shift_reg->half_bit_cycles = (SystemCoreClock + 2 * bit_rate_hz - 1) / (2 * bit_rate_hz);
+  return HAL_OK;
+}
+
+/**
+ * Shifts out the data as fast as the GPIO allows, unrolled 8 bits at a time.
+ */
+static void Shift_Reg_Write_Data_GPIO_Fast(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
+  // locals, so the loop keeps everything in registers
+  GPIO_TypeDef *shcp_port = shift_reg->SHCP_Port;
+  GPIO_TypeDef *data_port = shift_reg->DATA_Port;
+  uint32_t shcp_set       = shift_reg->SHCP_Set;
+  uint32_t shcp_reset     = shift_reg->SHCP_Reset;
+  const uint32_t *data_bsrr = shift_reg->DATA_BSRR;
+  uint8_t shared_port     = shift_reg->Shared_Port;
 
-  // for each byte
   while (data_length > 0) {
-      // get the current byte
-      cur_byte = *data;
-
-      // for each bit
-      for (int i = 0; i < 8; i++) {
-          // get the current bit
-          if ((cur_byte & 0b10000000) > 0) {
-              msb = GPIO_PIN_SET;
-          }
-          else {
-              msb = GPIO_PIN_RESET;
+      uint8_t cur_byte = *data;
+
+      // most significant bit first
+      SHIFT_REG_GPIO_BIT(cur_byte, 7);
+      SHIFT_REG_GPIO_BIT(cur_byte, 6);
+      SHIFT_REG_GPIO_BIT(cur_byte, 5);
+      SHIFT_REG_GPIO_BIT(cur_byte, 4);
+      SHIFT_REG_GPIO_BIT(cur_byte, 3);
+      SHIFT_REG_GPIO_BIT(cur_byte, 2);
+      SHIFT_REG_GPIO_BIT(cur_byte, 1);
+      SHIFT_REG_GPIO_BIT(cur_byte, 0);
+
+      --data_length;
+      ++data;
+  }
+}
+
+/**
+ * Shifts out the data with each SHCP phase lasting at least half_bit_cycles.
+ */
+static void Shift_Reg_Write_Data_GPIO_Capped(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
+  GPIO_TypeDef *shcp_port = shift_reg->SHCP_Port;
+  GPIO_TypeDef *data_port = shift_reg->DATA_Port;
+  uint32_t half_bit_cycles = shift_reg->half_bit_cycles;
+  uint32_t edge = Util_Get_Cycles();
+
+  while (data_length > 0) {
+      uint8_t cur_byte = *data;
+
+      for (int8_t bit = 7; bit >= 0; bit--) {
+          // SHCP low with the data, then SHCP high, each after half a bit
+          while (Util_Get_Cycles() - edge < half_bit_cycles);
+          if (!shift_reg->Shared_Port) {
+              shcp_port->BSRR = shift_reg->SHCP_Reset;
           }
+          data_port->BSRR = shift_reg->DATA_BSRR[(cur_byte >> bit) & 1];
+          edge = Util_Get_Cycles();
+
+          while (Util_Get_Cycles() - edge < half_bit_cycles);
+          shcp_port->BSRR = shift_reg->SHCP_Set;
+          edge = Util_Get_Cycles();
+      }
+
+      --data_length;
+      ++data;
+  }
+
+  // hold SHCP high for the last bit before STCP rises
+  while (Util_Get_Cycles() - edge < half_bit_cycles);
+}
+
+static HAL_StatusTypeDef Shift_Reg_Write_Data_GPIO(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
+  if (shift_reg->half_bit_cycles == 0) {
+      Shift_Reg_Write_Data_GPIO_Fast(shift_reg, data, data_length);
+  }
+  else {
+      Shift_Reg_Write_Data_GPIO_Capped(shift_reg, data, data_length);
+  }
+  return HAL_OK;
+}
+
+#ifdef SHIFT_REG_GPIO_BENCHMARK
+/**
+ * Shifts out the data with HAL_GPIO_WritePin, three calls a bit, as GPIO
+ * mode did before the BSRR words. Kept only as the benchmark's baseline.
+ */
+static void Shift_Reg_Write_Data_GPIO_HAL(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
+  while (data_length > 0) {
+      uint8_t cur_byte = *data;
 
-          // write that bit to the register
+      for (uint8_t i = 0; i < 8; i++) {
+          GPIO_PinState msb = (cur_byte & 0x80) ? GPIO_PIN_SET : GPIO_PIN_RESET;
           HAL_GPIO_WritePin(shift_reg->SHCP_Port, shift_reg->SHCP_Pin, GPIO_PIN_RESET);
           HAL_GPIO_WritePin(shift_reg->DATA_Port, shift_reg->DATA_Pin, msb);
           HAL_GPIO_WritePin(shift_reg->SHCP_Port, shift_reg->SHCP_Pin, GPIO_PIN_SET);
-
-          // move to the next bit
           cur_byte <<= 1;
       }
 
-      // move to the next byte
       --data_length;
       ++data;
   }
+}
+
+/**
+ * @retval the cycles taken by one write of the data through the given path
+ */
+static uint32_t Shift_Reg_Time_GPIO(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length,
+                                    void (*write)(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length)) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t start = Util_Get_Cycles();
+  write(shift_reg, data, data_length);
+  uint32_t cycles = Util_Get_Cycles() - start;
+  __set_PRIMASK(primask);
+  return cycles;
+}
+
+/**
+ * @retval the bit rate, in bits/us, of the given bits in the given cycles
+ */
+static float Shift_Reg_Bits_Per_Us(uint32_t bits, uint32_t cycles) {
+  return (cycles == 0) ? 0.0f : (float)bits * (SystemCoreClock / 1000000U) / cycles;
+}
+
+HAL_StatusTypeDef Shift_Reg_GPIO_Benchmark(Shift_Reg *shift_reg, uint32_t capped_rate_hz,
+                                           Shift_Reg_GPIO_Benchmark_Result *result) {
+  if (shift_reg == NULL || shift_reg->Mode != Shift_Reg_GPIO_Mode || capped_rate_hz == 0) {
+      return HAL_ERROR;
+  }
+
+  // alternating bits, so DATA changes on every other bit
+  uint8_t data[SHIFT_REG_MAX_REGS];
+  memset(data, 0xCC, sizeof(data));
+  uint32_t saved_half_bit_cycles = shift_reg->half_bit_cycles;
+
+  // also starts the cycle counter
+  Shift_Reg_GPIO_Set_Max_Bit_Rate(shift_reg, capped_rate_hz);
+
+  result->bits          = 8 * sizeof(data);
+  result->hal_cycles    = Shift_Reg_Time_GPIO(shift_reg, data, sizeof(data), Shift_Reg_Write_Data_GPIO_HAL);
+  result->fast_cycles   = Shift_Reg_Time_GPIO(shift_reg, data, sizeof(data), Shift_Reg_Write_Data_GPIO_Fast);
+  result->capped_cycles = Shift_Reg_Time_GPIO(shift_reg, data, sizeof(data), Shift_Reg_Write_Data_GPIO_Capped);
+  shift_reg->half_bit_cycles = saved_half_bit_cycles;
+
+  result->hal_bits_per_us    = Shift_Reg_Bits_Per_Us(result->bits, result->hal_cycles);
+  result->fast_bits_per_us   = Shift_Reg_Bits_Per_Us(result->bits, result->fast_cycles);
+  result->capped_bits_per_us = Shift_Reg_Bits_Per_Us(result->bits, result->capped_cycles);
   return HAL_OK;
 }
+#endif // #ifdef SHIFT_REG_GPIO_BENCHMARK
+
+static HAL_StatusTypeDef Shift_Reg_Write_Data_GPIO_IT(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+  shift_reg->send_data       = data;
+  shift_reg->remaining_bytes = data_length;
+  shift_reg->remaining_bits  = 0;
+
+  __HAL_TIM_SET_COUNTER(shift_reg->htim, 0);
+  return HAL_TIM_Base_Start_IT(shift_reg->htim);
+#else
+  return HAL_ERROR;
+#endif
+}
 
 static HAL_StatusTypeDef Shift_Reg_Write_Data_SPI(Shift_Reg *shift_reg, uint8_t* data, uint8_t num_digits) {
 #ifdef HAL_SPI_MODULE_ENABLED
@@ -151,34 +712,197 @@ static HAL_StatusTypeDef Shift_Reg_Write_Data_SPI(Shift_Reg *shift_reg, uint8_t*
 #endif
 }
 
-HAL_StatusTypeDef Shift_Reg_Write(Shift_Reg *shift_reg, uint8_t* data, uint8_t num_digits) {
-  if (shift_reg == NULL) {
-      return HAL_ERROR;
+static HAL_StatusTypeDef Shift_Reg_Write_Data_SPI_DMA(Shift_Reg *shift_reg, uint8_t* data, uint8_t num_digits) {
+#ifdef HAL_SPI_MODULE_ENABLED
+  if (shift_reg->in_num_regs != 0) {
+      // load the inputs into the 74HC165s, then shift them out with the data
+      HAL_GPIO_WritePin(shift_reg->PL_Port, shift_reg->PL_Pin, GPIO_PIN_RESET);
+      HAL_GPIO_WritePin(shift_reg->PL_Port, shift_reg->PL_Pin, GPIO_PIN_SET);
+      return HAL_SPI_TransmitReceive_DMA(shift_reg->hspi, data, shift_reg->in_buffer, num_digits);
   }
+  return HAL_SPI_Transmit_DMA(shift_reg->hspi, data, num_digits);
+#else
+  return HAL_ERROR;
+#endif
+}
 
-  // manually turn off storage clock pin
-  if (shift_reg->Mode == Shift_Reg_GPIO_Mode ||
-      shift_reg->Mode == Shift_Reg_GPIO_IT_Mode ||
-      shift_reg->Mode == Shift_Reg_SPI_SW_NSS_Mode) {
-      HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_RESET);
+static HAL_StatusTypeDef Shift_Reg_Write_Data_SPI_TIM_Latch(Shift_Reg *shift_reg, uint8_t* data, uint8_t num_digits) {
+#if defined(HAL_SPI_MODULE_ENABLED) && defined(HAL_TIM_MODULE_ENABLED)
+  TIM_HandleTypeDef *htim = shift_reg->htim;
+
+  // rise on the count of the last SHCP edge, however the bytes are spaced
+  uint32_t latch = 8 * num_digits / shift_reg->latch_bits_per_count;
+  __HAL_TIM_SET_COMPARE(htim, shift_reg->latch_channel, latch);
+  htim->Instance->EGR = TIM_EGR_UG;   // load the compare value, clear the counter, and STCP with it
+  __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_CC1 << (shift_reg->latch_channel >> 2));
+
+  // count before the first edge (interrupts are disabled by
+  // Shift_Reg_Send_Pending's callers)
+  htim->Instance->CR1 |= TIM_CR1_CEN;
+  HAL_StatusTypeDef status = HAL_SPI_Transmit_DMA(shift_reg->hspi, data, num_digits);
+  if (status != HAL_OK) {
+      htim->Instance->CR1 &= ~TIM_CR1_CEN;
   }
+  return status;
+#else
+  return HAL_ERROR;
+#endif
+}
 
-  // send the data
-  HAL_StatusTypeDef status;
-  if (shift_reg->Mode == Shift_Reg_GPIO_Mode) {
-      status = Shift_Reg_Write_Data_GPIO(shift_reg, data, num_digits);
+#ifdef HAL_SPI_MODULE_ENABLED
+/**
+ * Starts the next queued write, if the bus is idle. Writes which fail to
+ * start are dropped, so they cannot stall the bus.
+ * Must be called with interrupts disabled, or from the completion interrupt.
+ *
+ * @retval the status of starting the write (HAL_OK if nothing was started)
+ */
+static HAL_StatusTypeDef Shift_Reg_Bus_Start_Next(Shift_Reg_Bus *bus) {
+  HAL_StatusTypeDef status = HAL_OK;
+
+  while (bus->active == NULL && bus->queue_head != NULL) {
+      Shift_Reg *shift_reg = bus->queue_head;
+      bus->queue_head = shift_reg->queue_next;
+      if (bus->queue_head == NULL) {
+          bus->queue_tail = NULL;
+      }
+      shift_reg->queue_next = NULL;
+      shift_reg->queued = 0;
+
+      // the pending buffer becomes the one being sent
+      uint8_t length = shift_reg->pending_length;
+      shift_reg->pending_length = 0;
+      shift_reg->tx_index ^= 1;
+      shift_reg->tx_length = length;
+      uint8_t *data = shift_reg->tx_buffers[shift_reg->tx_index];
+
+      // manually turn off storage clock pin
+      if (shift_reg->Mode != Shift_Reg_SPI_TIM_Latch_Mode) {
+          HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_RESET);
+      }
+
+      bus->active = shift_reg;
+      switch (shift_reg->Mode) {
+        case Shift_Reg_SPI_DMA_Mode:
+          status = Shift_Reg_Write_Data_SPI_DMA(shift_reg, data, length);
+          break;
+        case Shift_Reg_SPI_TIM_Latch_Mode:
+          status = Shift_Reg_Write_Data_SPI_TIM_Latch(shift_reg, data, length);
+          break;
+        default:
+          status = Shift_Reg_Write_Data_SPI(shift_reg, data, length);
+          break;
+      }
+      if (status != HAL_OK) {
+          bus->active = NULL;
+      }
   }
-  else {
-      status = Shift_Reg_Write_Data_SPI(shift_reg, data, num_digits);
+
+  return status;
+}
+
+/**
+ * Ends the write of the active shift register once it is latched, and
+ * starts the next one waiting for the bus.
+ */
+static void Shift_Reg_Bus_Complete(Shift_Reg_Bus *bus) {
+  Shift_Reg *shift_reg = bus->active;
+  bus->active = NULL;
+
+  if (shift_reg->Write_Complete_Callback != NULL) {
+      shift_reg->Write_Complete_Callback(shift_reg);
   }
-  if (status != HAL_OK) {
-      return status;
+  Shift_Reg_Bus_Start_Next(bus);
+}
+#endif // End of HAL_SPI_MODULE_ENABLED check
+
+/**
+ * Sends the pending write, if there is one and the previous write is done.
+ * SPI writes wait in their bus queue instead.
+ * Must be called with interrupts disabled, or from the completion interrupt.
+ *
+ * @retval the status of starting the write (HAL_OK if nothing was started)
+ */
+static HAL_StatusTypeDef Shift_Reg_Send_Pending(Shift_Reg *shift_reg) {
+  uint8_t length = shift_reg->pending_length;
+  if (length == 0) {
+      return HAL_OK;
+  }
+
+#ifdef HAL_SPI_MODULE_ENABLED
+  if (shift_reg->Mode != Shift_Reg_GPIO_IT_Mode) {
+      Shift_Reg_Bus *bus = shift_reg->bus;
+      if (!shift_reg->queued) {
+          shift_reg->queued = 1;
+          if (bus->queue_tail == NULL) {
+              bus->queue_head = shift_reg;
+          }
+          else {
+              bus->queue_tail->queue_next = shift_reg;
+          }
+          bus->queue_tail = shift_reg;
+      }
+      return Shift_Reg_Bus_Start_Next(bus);
+  }
+#endif
+
+#if defined(HAL_TIM_MODULE_ENABLED)
+  // the timer runs until the write is latched
+  if (shift_reg->htim->State != HAL_TIM_STATE_READY) {
+      return HAL_OK;
+  }
+#endif
+
+  // the pending buffer becomes the one being sent
+  shift_reg->pending_length = 0;
+  shift_reg->tx_index ^= 1;
+  uint8_t *data = shift_reg->tx_buffers[shift_reg->tx_index];
+
+  // manually turn off storage clock pin
+  HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_RESET);
+
+  return Shift_Reg_Write_Data_GPIO_IT(shift_reg, data, length);
+}
+
+HAL_StatusTypeDef Shift_Reg_Write(Shift_Reg *shift_reg, uint8_t* data, uint8_t num_digits) {
+  if (shift_reg == NULL) {
+      return HAL_ERROR;
   }
 
-  // manually turn on the storage clock pin
+  // blocking: send the data straight away
   if (shift_reg->Mode == Shift_Reg_GPIO_Mode) {
+      HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_RESET);
+      Shift_Reg_Write_Data_GPIO(shift_reg, data, num_digits);
       HAL_GPIO_WritePin(shift_reg->STCP_Port, shift_reg->STCP_Pin, GPIO_PIN_SET);
-   }
 
-  return HAL_OK;
+      if (shift_reg->Write_Complete_Callback != NULL) {
+          shift_reg->Write_Complete_Callback(shift_reg);
+      }
+      return HAL_OK;
+  }
+
+  if (num_digits > shift_reg->tx_buffer_size) {
+      return HAL_ERROR;
+  }
+
+  // non-blocking: replace the pending write (the one not being sent), and
+  // send it now if the bus is free, or else once the writes before it are done
+  uint8_t *buffer = shift_reg->tx_buffers[shift_reg->tx_index ^ 1];
+  uint8_t length = num_digits;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+#ifdef HAL_SPI_MODULE_ENABLED
+  // the inputs are shifted in as the data is shifted out, so lead the data
+  // with zeros until every input is in
+  if (shift_reg->in_num_regs > length) {
+      length = shift_reg->in_num_regs;
+      memset(buffer, 0, length - num_digits);
+  }
+#endif
+  memcpy(buffer + (length - num_digits), data, num_digits);
+  shift_reg->pending_length = length;
+  HAL_StatusTypeDef status = Shift_Reg_Send_Pending(shift_reg);
+  __set_PRIMASK(primask);
+
+  return status;
 }
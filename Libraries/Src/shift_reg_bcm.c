@@ -0,0 +1,154 @@
+/*
+ * shift_reg_bcm.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See shift_reg_bcm.h for usage and troubleshooting.
+ */
+
+#include "shift_reg_bcm.h"
+#include "util.h"
+
+#if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+
+/* GLOBAL VARS */
+static Shift_Reg_BCM bcm_pool[SHIFT_REG_BCM_MAX_HANDLERS];
+static uint8_t num_bcms = 0;
+
+/* PRIVATE FUNCTIONS */
+static void BCM_Tick(TIM_HandleTypeDef *htim);
+
+/* FUNCTION IMPLEMENTATIONS */
+
+Shift_Reg_BCM *Shift_Reg_BCM_Init(Shift_Reg *shift_reg, TIM_HandleTypeDef *htim,
+                                  uint8_t num_regs, uint8_t bits, uint16_t refresh_hz) {
+  if (shift_reg == NULL || num_bcms >= SHIFT_REG_BCM_MAX_HANDLERS ||
+      num_regs == 0 || num_regs > SHIFT_REG_MAX_REGS ||
+      bits == 0 || bits > SHIFT_REG_BCM_MAX_BITS || refresh_hz == 0) {
+      return NULL;
+  }
+
+  // a period is 2^bits - 1 units; prescale so the longest plane (2^(bits-1)
+  // units) fits in the 16 bit auto-reload
+  uint32_t units = (1UL << bits) - 1;
+  uint32_t unit_clocks = Util_Get_Timer_Clock(htim->Instance) / (refresh_hz * units);
+  uint32_t prescale = ((unit_clocks << (bits - 1)) >> 16) + 1;
+  uint32_t unit_ticks = unit_clocks / prescale;
+  if (unit_ticks == 0) {
+      return NULL;
+  }
+
+  htim->Init.Prescaler = prescale - 1;
+  htim->Init.Period = unit_ticks - 1;
+  htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  // each plane sets the length of the next one
+  htim->Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+
+  if (HAL_TIM_Base_Init(htim) != HAL_OK ||
+      HAL_TIM_RegisterCallback(htim, HAL_TIM_PERIOD_ELAPSED_CB_ID, BCM_Tick) != HAL_OK) {
+      return NULL;
+  }
+
+  Shift_Reg_BCM *bcm = &bcm_pool[num_bcms++];
+  memset(bcm, 0, sizeof(Shift_Reg_BCM));
+  bcm->shift_reg  = shift_reg;
+  bcm->htim       = htim;
+  bcm->num_regs   = num_regs;
+  bcm->bits       = bits;
+  bcm->unit_ticks = unit_ticks;
+
+  return bcm;
+}
+
+HAL_StatusTypeDef Shift_Reg_BCM_Start(Shift_Reg_BCM *bcm) {
+  TIM_HandleTypeDef *htim = bcm->htim;
+
+  // plane 0 is shown straight away, for one unit
+  bcm->plane = 0;
+  __HAL_TIM_SET_COUNTER(htim, 0);
+  __HAL_TIM_SET_AUTORELOAD(htim, bcm->unit_ticks - 1);
+  htim->Instance->EGR = TIM_EGR_UG;
+  __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+  __HAL_TIM_SET_AUTORELOAD(htim, (bcm->unit_ticks << (1 % bcm->bits)) - 1);
+
+  HAL_StatusTypeDef status = Shift_Reg_Write(bcm->shift_reg, bcm->planes[0], bcm->num_regs);
+  if (status != HAL_OK) {
+      return status;
+  }
+  return HAL_TIM_Base_Start_IT(htim);
+}
+
+HAL_StatusTypeDef Shift_Reg_BCM_Stop(Shift_Reg_BCM *bcm) {
+  return HAL_TIM_Base_Stop_IT(bcm->htim);
+}
+
+HAL_StatusTypeDef Shift_Reg_BCM_Set(Shift_Reg_BCM *bcm, uint16_t output, uint8_t level) {
+  uint16_t index = output / 8;
+  if (index >= bcm->num_regs || level >= (1U << bcm->bits)) {
+      return HAL_ERROR;
+  }
+  uint8_t mask = 1 << (output % 8);
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t plane = 0; plane < bcm->bits; plane++) {
+      if ((level >> plane) & 1) {
+          bcm->planes[plane][index] |= mask;
+      }
+      else {
+          bcm->planes[plane][index] &= ~mask;
+      }
+  }
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Shift_Reg_BCM_Set_All(Shift_Reg_BCM *bcm, uint8_t level) {
+  if (level >= (1U << bcm->bits)) {
+      return HAL_ERROR;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t plane = 0; plane < bcm->bits; plane++) {
+      memset(bcm->planes[plane], ((level >> plane) & 1) ? 0xFF : 0x00, bcm->num_regs);
+  }
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+/**
+ * Shows the next plane, and preloads the length of the one after it.
+ * Called when the refresh timer elapses, at the end of each plane.
+ *
+ * @param htim the timer handler whose period elapsed
+ */
+static void BCM_Tick(TIM_HandleTypeDef *htim) {
+  Shift_Reg_BCM *bcm = NULL;
+  for (uint8_t index = 0; index < num_bcms; index++) {
+      if (bcm_pool[index].htim == htim) {
+          bcm = &bcm_pool[index];
+          break;
+      }
+  }
+  if (bcm == NULL) {
+      return;
+  }
+
+  uint8_t plane = bcm->plane + 1;
+  if (plane >= bcm->bits) {
+      plane = 0;
+  }
+  bcm->plane = plane;
+  Shift_Reg_Write(bcm->shift_reg, bcm->planes[plane], bcm->num_regs);
+
+  // the current plane's length was preloaded on the previous update
+  uint8_t next = (plane + 1 < bcm->bits) ? plane + 1 : 0;
+  __HAL_TIM_SET_AUTORELOAD(htim, (bcm->unit_ticks << next) - 1);
+}
+
+#endif // #if defined(HAL_TIM_MODULE_ENABLED) && (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
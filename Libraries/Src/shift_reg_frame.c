@@ -0,0 +1,142 @@
+/*
+ * shift_reg_frame.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See shift_reg_frame.h for usage and troubleshooting.
+ */
+
+#include "shift_reg_frame.h"
+
+/* GLOBAL VARS */
+static Shift_Reg_Frame frame_pool[SHIFT_REG_FRAME_MAX_FRAMES];
+static uint8_t num_frames = 0;
+
+/* FUNCTION IMPLEMENTATIONS */
+
+Shift_Reg_Frame *Shift_Reg_Frame_Init(Shift_Reg *shift_reg, uint8_t num_regs) {
+  if (shift_reg == NULL || num_regs == 0 || num_regs > SHIFT_REG_MAX_REGS ||
+      num_frames >= SHIFT_REG_FRAME_MAX_FRAMES) {
+      return NULL;
+  }
+
+  Shift_Reg_Frame *frame = &frame_pool[num_frames++];
+  memset(frame, 0, sizeof(Shift_Reg_Frame));
+  frame->shift_reg = shift_reg;
+  frame->num_regs = num_regs;
+
+  // differs from the (all off) image, so the first flush writes it
+  memset(frame->latched, 0xFF, sizeof(frame->latched));
+  frame->dirty = 1;
+
+  return frame;
+}
+
+int8_t Shift_Reg_Frame_Add_Owner(Shift_Reg_Frame *frame, const uint8_t *mask) {
+  if (frame->num_owners >= SHIFT_REG_FRAME_MAX_OWNERS) {
+      return -1;
+  }
+
+  for (uint8_t index = 0; index < frame->num_regs; index++) {
+      if ((frame->owned[index] & mask[index]) != 0) {
+          return -1;
+      }
+  }
+
+  int8_t owner = frame->num_owners++;
+  for (uint8_t index = 0; index < frame->num_regs; index++) {
+      frame->owner_masks[owner][index] = mask[index];
+      frame->owned[index] |= mask[index];
+  }
+  return owner;
+}
+
+HAL_StatusTypeDef Shift_Reg_Frame_Write_Owner(Shift_Reg_Frame *frame, int8_t owner, const uint8_t *values) {
+  if (owner < 0 || owner >= frame->num_owners) {
+      return HAL_ERROR;
+  }
+  const uint8_t *mask = frame->owner_masks[owner];
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint8_t changed = 0;
+  for (uint8_t index = 0; index < frame->num_regs; index++) {
+      uint8_t byte = (frame->image[index] & ~mask[index]) | (values[index] & mask[index]);
+      changed |= byte ^ frame->image[index];
+      frame->image[index] = byte;
+  }
+  if (changed) {
+      frame->dirty = 1;
+  }
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Shift_Reg_Frame_Set_Bit(Shift_Reg_Frame *frame, uint16_t bit, uint8_t value) {
+  uint16_t index = bit / 8;
+  if (index >= frame->num_regs) {
+      return HAL_ERROR;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint8_t byte = frame->image[index];
+  if (value) {
+      byte |= 1 << (bit % 8);
+  }
+  else {
+      byte &= ~(1 << (bit % 8));
+  }
+  if (byte != frame->image[index]) {
+      frame->image[index] = byte;
+      frame->dirty = 1;
+  }
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Shift_Reg_Frame_Set_Byte(Shift_Reg_Frame *frame, uint8_t index, uint8_t value) {
+  if (index >= frame->num_regs) {
+      return HAL_ERROR;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (value != frame->image[index]) {
+      frame->image[index] = value;
+      frame->dirty = 1;
+  }
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef Shift_Reg_Frame_Flush(Shift_Reg_Frame *frame) {
+  // the flag only says the image was touched; it may have been set back
+  if (!frame->dirty) {
+      return HAL_OK;
+  }
+
+  uint8_t image[SHIFT_REG_MAX_REGS];
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(image, frame->image, frame->num_regs);
+  frame->dirty = 0;
+  __set_PRIMASK(primask);
+
+  if (memcmp(image, frame->latched, frame->num_regs) == 0) {
+      return HAL_OK;
+  }
+
+  HAL_StatusTypeDef status = Shift_Reg_Write(frame->shift_reg, image, frame->num_regs);
+  if (status != HAL_OK) {
+      frame->dirty = 1;
+      return status;
+  }
+  memcpy(frame->latched, image, frame->num_regs);
+
+  return HAL_OK;
+}
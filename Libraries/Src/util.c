@@ -5,4 +5,20 @@
  *      Author: David Melisso
  */
 
+#include "util.h"
+#include "stm32f4xx_hal.h"
 
+void Util_Cycle_Counter_Init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t Util_Get_Timer_Clock(TIM_TypeDef *instance) {
+  // TIM1 and TIM8-11 are on APB2, the rest on APB1
+  if ((uint32_t)instance >= APB2PERIPH_BASE) {
+      uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+      return ((RCC->CFGR & RCC_CFGR_PPRE2) == RCC_CFGR_PPRE2_DIV1) ? pclk : 2 * pclk;
+  }
+  uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+  return ((RCC->CFGR & RCC_CFGR_PPRE1) == RCC_CFGR_PPRE1_DIV1) ? pclk : 2 * pclk;
+}
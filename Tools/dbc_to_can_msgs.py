@@ -0,0 +1,374 @@
+#!/usr/bin/env python3
+"""
+dbc_to_can_msgs.py
+
+Generates the CAN message catalog (Libraries/Inc/can_msgs.h) from a DBC file.
+
+  Created on: May 20, 2024
+      Author: Caltech Racing
+
+The catalog only lists messages and signals. can_codec.h expands the ID,
+DLC and period constants, the pack/unpack codecs and the receive dispatch
+table (CAN_Codec_RX_Table) from it at compile time, so this is the only
+file that is generated.
+
+Checks, each of which fails the generation:
+  - every message ID lies inside one of the CAN_ID ranges in can_std.h
+    (a range starts at its CAN_ID value and spans 16 IDs, or up to the next
+    CAN_ID value if that is closer)
+  - no two messages share an ID or a name
+  - every signal is 1 to 32 bits, fits inside the message DLC, and does not
+    overlap another signal of the same message
+  - no multiplexed signals or extended IDs (the catalog does not support them)
+
+Usage:
+
+    # regenerate the catalog after editing the DBC
+    python3 Tools/dbc_to_can_msgs.py
+
+    # check the committed catalog is up to date with the DBC (exit 1 if not)
+    python3 Tools/dbc_to_can_msgs.py --check
+
+--check only compares against this script's own output, so it cannot catch
+a bug in the generator itself. make -C Tools/tests also generates from
+Tools/tests/fixtures/golden.dbc and compares against a header checked by
+hand (golden_msgs.h), then decodes payloads worked out by hand with it.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+DEFAULT_DBC = os.path.join(ROOT, "Tools", "can_msgs.dbc")
+DEFAULT_CAN_STD = os.path.join(ROOT, "Libraries", "Inc", "can_std.h")
+DEFAULT_OUTPUT = os.path.join(ROOT, "Libraries", "Inc", "can_msgs.h")
+
+# IDs in a node's range, unless the next CAN_ID is closer
+NODE_RANGE_SIZE = 0x10
+
+CYCLE_TIME_ATTRIBUTE = "GenMsgCycleTime"
+
+RE_MESSAGE = re.compile(r"^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)")
+RE_SIGNAL = re.compile(
+    r"^SG_\s+(\w+)\s*(\S*)\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*"
+    r"\(\s*([^,\s]+)\s*,\s*([^)\s]+)\s*\)")
+RE_CYCLE_TIME = re.compile(
+    r'^BA_\s+"' + CYCLE_TIME_ATTRIBUTE + r'"\s+BO_\s+(\d+)\s+(\d+)\s*;')
+RE_CAN_ID = re.compile(r"^\s*CAN_ID_(\w+)\s*=\s*(0x[0-9A-Fa-f]+|\d+)")
+
+
+class DBCError(Exception):
+    pass
+
+
+class Signal:
+    def __init__(self, name, start, length, big_endian, signed, scale, offset):
+        self.name = name
+        self.start = start
+        self.length = length
+        self.big_endian = big_endian
+        self.signed = signed
+        self.scale = scale
+        self.offset = offset
+
+    def c_type(self):
+        for bits in (8, 16, 32):
+            if self.length <= bits:
+                return ("int%d_t" if self.signed else "uint%d_t") % bits
+        raise DBCError("signal %s is longer than 32 bits" % self.name)
+
+    def bits(self):
+        """
+        Returns the payload bits (byte * 8 + bit) the signal occupies,
+        or None if it runs off the end of an 8-byte payload.
+        """
+        if not self.big_endian:
+            first = self.start
+        else:
+            # same as CAN_Codec_Shift: position of the LSB in the byte swapped word
+            first = (7 - self.start // 8) * 8 + self.start % 8 - (self.length - 1)
+        if first < 0 or first + self.length > 64:
+            return None
+        positions = range(first, first + self.length)
+        if not self.big_endian:
+            return set(positions)
+        return set((7 - p // 8) * 8 + p % 8 for p in positions)
+
+
+class Message:
+    def __init__(self, can_id, name, dlc, sender, line):
+        self.id = can_id
+        self.name = name
+        self.dlc = dlc
+        self.sender = sender
+        self.line = line
+        self.period = 0
+        self.signals = []
+
+
+def parse_dbc(path):
+    messages = []
+    by_id = {}
+    cycle_times = []
+
+    with open(path, encoding="latin-1") as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            where = "%s:%d" % (path, number)
+
+            if line.startswith("BO_ "):
+                match = RE_MESSAGE.match(line)
+                if not match:
+                    raise DBCError("%s: cannot parse message" % where)
+                raw_id, name, dlc, sender = match.groups()
+                raw_id = int(raw_id)
+                if raw_id & 0x80000000 or raw_id > 0x7FF:
+                    raise DBCError("%s: %s is not a standard ID message" % (where, name))
+                if int(dlc) > 8:
+                    raise DBCError("%s: %s DLC is over 8" % (where, name))
+                message = Message(raw_id, name, int(dlc), sender, where)
+                messages.append(message)
+                by_id.setdefault(raw_id, []).append(message)
+
+            elif line.startswith("SG_ "):
+                match = RE_SIGNAL.match(line)
+                if not match:
+                    raise DBCError("%s: cannot parse signal" % where)
+                if not messages:
+                    raise DBCError("%s: signal outside of a message" % where)
+                name, mux, start, length, order, sign, scale, offset = match.groups()
+                if mux:
+                    raise DBCError("%s: multiplexed signal %s is not supported" % (where, name))
+                messages[-1].signals.append(Signal(
+                    name, int(start), int(length), order == "0", sign == "-",
+                    float(scale), float(offset)))
+
+            elif line.startswith("BA_ "):
+                match = RE_CYCLE_TIME.match(line)
+                if match:
+                    cycle_times.append((int(match.group(1)), int(match.group(2)), where))
+
+    for raw_id, period, where in cycle_times:
+        if raw_id not in by_id:
+            raise DBCError("%s: cycle time for unknown message %d" % (where, raw_id))
+        for message in by_id[raw_id]:
+            message.period = period
+
+    return messages
+
+
+def parse_node_ranges(path):
+    """
+    Returns [(node, first, last)] for the CAN_ID enum in can_std.h.
+    """
+    bases = []
+    with open(path) as f:
+        for line in f:
+            match = RE_CAN_ID.match(line)
+            if match:
+                bases.append((int(match.group(2), 0), match.group(1)))
+    if not bases:
+        raise DBCError("%s: no CAN_ID values found" % path)
+
+    bases.sort()
+    ranges = []
+    for i, (base, node) in enumerate(bases):
+        end = bases[i + 1][0] if i + 1 < len(bases) else 0x800
+        ranges.append((node, base, min(end, base + NODE_RANGE_SIZE) - 1))
+    return ranges
+
+
+def check(messages, ranges):
+    errors = []
+
+    names = {}
+    ids = {}
+    for message in messages:
+        if message.name in names:
+            errors.append("%s: message name %s already used at %s"
+                          % (message.line, message.name, names[message.name].line))
+        names.setdefault(message.name, message)
+        if message.id in ids:
+            errors.append("%s: ID 0x%03X of %s collides with %s at %s"
+                          % (message.line, message.id, message.name,
+                             ids[message.id].name, ids[message.id].line))
+        ids.setdefault(message.id, message)
+
+        if not any(first <= message.id <= last for _, first, last in ranges):
+            errors.append("%s: ID 0x%03X of %s is outside every CAN_ID range"
+                          % (message.line, message.id, message.name))
+
+        used = set()
+        signal_names = set()
+        for signal in message.signals:
+            if signal.name in signal_names:
+                errors.append("%s: %s has two signals named %s"
+                              % (message.line, message.name, signal.name))
+            signal_names.add(signal.name)
+            if not 1 <= signal.length <= 32:
+                errors.append("%s: %s.%s must be 1 to 32 bits"
+                              % (message.line, message.name, signal.name))
+                continue
+            bits = signal.bits()
+            if bits is None or max(bits) >= message.dlc * 8:
+                errors.append("%s: %s.%s does not fit in %d bytes"
+                              % (message.line, message.name, signal.name, message.dlc))
+                continue
+            if bits & used:
+                errors.append("%s: %s.%s overlaps another signal"
+                              % (message.line, message.name, signal.name))
+            used |= bits
+
+    if errors:
+        raise DBCError("\n".join(errors))
+
+
+HEADER = """\
+/*
+ * can_msgs.h
+ *
+ * Caltech Racing CAN message catalog.
+ *
+ * Declares every message on the car network, and the signals packed into
+ * each one. Nothing here generates code by itself; see can_codec.h for the
+ * pack/unpack functions and receive dispatch table generated from these lists.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * GENERATED by Tools/dbc_to_can_msgs.py from {dbc}; do not edit.
+ *
+ * Adding a message:
+ *    1. Add the message to {dbc}, with an ID inside the range of
+ *       the sending node (see CAN_ID in can_std.h), and a GenMsgCycleTime
+ *    2. Run python3 Tools/dbc_to_can_msgs.py
+ *
+ * Signal columns:
+ *    start   - DBC start bit. For little endian (Intel) signals, the LSB.
+ *              For big endian (Motorola) signals, the MSB, numbered with
+ *              bit 7 as the MSB of byte 0 (DBC "sawtooth" numbering)
+ *    length  - number of bits, 1 to 32
+ *    order   - CAN_MSG_LE (Intel) or CAN_MSG_BE (Motorola)
+ *    type    - C type of the raw value; signed types are sign-extended
+ *    scale   - physical = raw * scale + offset
+ *    offset
+ */
+
+#ifndef INC_CAN_MSGS_H_
+#define INC_CAN_MSGS_H_
+
+#include "can_std.h"
+
+#define CAN_MSG_LE 0
+#define CAN_MSG_BE 1
+"""
+
+FOOTER = """
+#endif /* INC_CAN_MSGS_H_ */
+"""
+
+
+def c_float(value):
+    return repr(float(value)) + "f"
+
+
+def id_expression(can_id, ranges):
+    for node, first, last in ranges:
+        if first <= can_id <= last:
+            return "CAN_ID_%s + 0x%X" % (node, can_id - first)
+    return "0x%03X" % can_id
+
+
+def column(text, width):
+    """
+    Pads text to width, always leaving at least one space after it.
+    """
+    return text.ljust(width - 1) + " "
+
+
+def continued(lines):
+    """
+    Joins macro body lines with line continuations.
+    """
+    return " \\\n".join(lines)
+
+
+def generate(messages, ranges, dbc):
+    out = [HEADER.format(dbc=dbc)]
+
+    out.append("/*      name,             id,                   dlc, period (ms) */")
+    lines = ["#define CAN_MSG_LIST(MSG)"]
+    for message in messages:
+        lines.append("  MSG(%s%s%s%s" % (
+            column(message.name + ",", 20),
+            column(id_expression(message.id, ranges) + ",", 22),
+            column(str(message.dlc) + ",", 5),
+            (str(message.period) + ")").ljust(5)))
+    out.append(continued(lines).rstrip())
+    out.append("")
+
+    out.append("/*      message,          signal,             start, length, order,      "
+               "type,     scale,   offset */")
+    for message in messages:
+        lines = ["#define CAN_SIGNALS_%s(SIG, M)" % message.name]
+        for signal in message.signals:
+            lines.append("  SIG(M,%s%s%s%s%s%s%s%s" % (
+                " " * 18,
+                column(signal.name + ",", 20),
+                column(str(signal.start) + ",", 7),
+                column(str(signal.length) + ",", 8),
+                column("CAN_MSG_BE," if signal.big_endian else "CAN_MSG_LE,", 12),
+                column(signal.c_type() + ",", 10),
+                column(c_float(signal.scale) + ",", 9),
+                (c_float(signal.offset) + ")").ljust(7)))
+        out.append(continued(lines).rstrip())
+        out.append("")
+
+    out.append(FOOTER.lstrip("\n"))
+    return "\n".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate can_msgs.h from a DBC file.")
+    parser.add_argument("--dbc", default=DEFAULT_DBC, help="input DBC file")
+    parser.add_argument("--can-std", default=DEFAULT_CAN_STD,
+                        help="can_std.h, for the CAN_ID node ranges")
+    parser.add_argument("--output", default=DEFAULT_OUTPUT, help="generated header")
+    parser.add_argument("--check", action="store_true",
+                        help="only compare against the existing output, exit 1 if it differs")
+    args = parser.parse_args()
+
+    try:
+        messages = parse_dbc(args.dbc)
+        ranges = parse_node_ranges(args.can_std)
+        check(messages, ranges)
+    except (DBCError, OSError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    text = generate(messages, ranges, os.path.relpath(os.path.abspath(args.dbc), ROOT))
+
+    if args.check:
+        try:
+            with open(args.output) as f:
+                current = f.read()
+        except OSError:
+            current = None
+        if current != text:
+            print("%s is out of date with %s; run %s"
+                  % (args.output, args.dbc, os.path.relpath(__file__, ROOT)), file=sys.stderr)
+            return 1
+        return 0
+
+    with open(args.output, "w") as f:
+        f.write(text)
+    print("wrote %d messages, %d signals to %s"
+          % (len(messages), sum(len(m.signals) for m in messages), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,146 @@
+/*
+ * bench_can_codec.c
+ *
+ * Decode time per frame of the generated codecs (can_codec.h), against
+ * decoding the same frames from a runtime table of signal layouts.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * A stream of frames with random payloads, drawn from the whole catalog, is
+ * fully decoded (every signal of every frame) by:
+ *    generated   switch on the ID, then CAN_Msg_<M>_Unpack, every
+ *                layout a compile-time constant
+ *    runtime     the same shift and mask (CAN_Codec_Get), with the layout
+ *                read from a table at run time, as a generic DBC decoder does
+ *    bitwise     the bit-by-bit reference of host/can_ref.h
+ *
+ * Every decoder's results are summed, and the sums must agree.
+ */
+
+#include "can_codec.h"
+#include "can_ref.h"
+#include "host_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_FRAMES 4096
+#define NUM_PASSES 200
+#define NUM_RUNS   5
+
+typedef struct {
+  uint16_t id;
+  uint8_t data[8];
+} Frame;
+
+typedef struct {
+  uint8_t start, length, order, is_signed;
+} Layout;
+
+typedef struct {
+  uint16_t id;
+  uint8_t num_signals;
+  Layout signals[8];
+} Message_Layout;
+
+static Frame frames[NUM_FRAMES];
+
+#define BENCH_LAYOUT(msg, sig, start, length, order, type, scale, offset) \
+  { start, length, order, CAN_CODEC_IS_SIGNED(type) },
+#define BENCH_MESSAGE_LAYOUT(name, id, dlc, period) \
+  { id, sizeof((Layout[]){ CAN_SIGNALS_##name(BENCH_LAYOUT, name) }) / sizeof(Layout), \
+    { CAN_SIGNALS_##name(BENCH_LAYOUT, name) } },
+static const Message_Layout layouts[] = { CAN_MSG_LIST(BENCH_MESSAGE_LAYOUT) };
+
+#define NUM_MESSAGES (sizeof(layouts) / sizeof(layouts[0]))
+
+// ID to layout, as a dispatch table would index it
+static const Message_Layout *layout_by_id[2048];
+
+#define BENCH_SUM_FIELD(msg, sig, start, length, order, type, scale, offset) sum += (uint32_t)m.sig;
+#define BENCH_CASE(name, id, dlc, period)                 \
+  case (id): {                                            \
+    CAN_Msg_##name m;                                     \
+    CAN_Msg_##name##_Unpack(frame->data, &m);             \
+    CAN_SIGNALS_##name(BENCH_SUM_FIELD, name)             \
+    break;                                                \
+  }
+
+static __attribute__((noinline)) uint32_t Decode_Generated(const Frame *frame) {
+  uint32_t sum = 0;
+  switch (frame->id) {
+    CAN_MSG_LIST(BENCH_CASE)
+    default:
+      break;
+  }
+  return sum;
+}
+
+static __attribute__((noinline)) uint32_t Decode_Runtime(const Frame *frame) {
+  const Message_Layout *layout = layout_by_id[frame->id];
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < layout->num_signals; i++) {
+      const Layout *s = &layout->signals[i];
+      sum += CAN_Codec_Get(frame->data, s->start, s->length, s->order, s->is_signed);
+  }
+  return sum;
+}
+
+static __attribute__((noinline)) uint32_t Decode_Bitwise(const Frame *frame) {
+  const Message_Layout *layout = layout_by_id[frame->id];
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < layout->num_signals; i++) {
+      const Layout *s = &layout->signals[i];
+      sum += Ref_Get(frame->data, s->start, s->length, s->order == CAN_MSG_BE, s->is_signed);
+  }
+  return sum;
+}
+
+/**
+ * @retval the best time over NUM_RUNS, in ns per frame
+ */
+static double Bench(uint32_t (*decode)(const Frame *frame), uint32_t *sum) {
+  double best = 1e9;
+  for (uint32_t run = 0; run < NUM_RUNS; run++) {
+      uint32_t total = 0;
+      uint64_t start = Host_Time_NS();
+      for (uint32_t pass = 0; pass < NUM_PASSES; pass++) {
+          for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+              total += decode(&frames[i]);
+          }
+      }
+      double ns = (double)(Host_Time_NS() - start) / (NUM_PASSES * NUM_FRAMES);
+      best = (ns < best) ? ns : best;
+      *sum = total;
+  }
+  return best;
+}
+
+int main(void) {
+  srand(1);
+  for (uint32_t i = 0; i < NUM_MESSAGES; i++) {
+      layout_by_id[layouts[i].id] = &layouts[i];
+  }
+  for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+      frames[i].id = layouts[rand() % NUM_MESSAGES].id;
+      for (uint8_t byte = 0; byte < 8; byte++) {
+          frames[i].data[byte] = (uint8_t)rand();
+      }
+  }
+
+  uint32_t generated_sum, runtime_sum, bitwise_sum;
+  double generated = Bench(Decode_Generated, &generated_sum);
+  double runtime = Bench(Decode_Runtime, &runtime_sum);
+  double bitwise = Bench(Decode_Bitwise, &bitwise_sum);
+
+  printf("decode, %u messages, ns/frame:\n", (unsigned)NUM_MESSAGES);
+  printf("  generated %6.2f\n", generated);
+  printf("  runtime   %6.2f  (%.1fx)\n", runtime, runtime / generated);
+  printf("  bitwise   %6.2f  (%.1fx)\n", bitwise, bitwise / generated);
+
+  if (generated_sum != runtime_sum || generated_sum != bitwise_sum) {
+      printf("decoders disagree: %08X %08X %08X\n", generated_sum, runtime_sum, bitwise_sum);
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * bench_can_dispatch.c
+ *
+ * Time per frame of the receive dispatch table (CAN_Codec_RX_Table), against
+ * reading the frames out of the ring and decoding them with a switch on the
+ * ID, as the CAN_Std_RX_Read loop in can_std.h does.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Every catalog message has a handler which sums its unpacked fields. The
+ * ring is filled through CAN_Std_RX_FIFO_Callback, untimed, then emptied by:
+ *    table   CAN_Std_RX_Dispatch: the filter match slot lookup, then
+ *            CAN_Codec_RX_<M> unpacks in place and calls the handler
+ *    read    CAN_Std_RX_Read copies the frames out, then a switch on the ID
+ *            unpacks and calls the same handler
+ *
+ * Both sums must agree.
+ *
+ * On an x86 host the table is roughly twice as slow (about 21-30 ns against
+ * 9-12 ns a frame). Reading out with CAN_Std_RX_Read and calling
+ * CAN_Codec_RX_<M> from a switch costs the same as the plain switch, so the
+ * unpack is not the difference. It is CAN_Std_RX_Dispatch releasing every
+ * slot on its own, two full fences a frame (a locked instruction each on x86),
+ * plus two calls through function pointers whose target changes with every
+ * frame, which the host's branch predictor misses. On the M4 a DMB is a few
+ * cycles and there is no indirect branch prediction to miss, so expect the
+ * gap on the car to be far smaller; measure it there with Util_Get_Cycles.
+ */
+
+#include "can_codec.h"
+#include "can_std.h"
+#include "host_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_FRAMES 4096
+#define BATCH      (CAN_STD_RX_RING_SIZE - 1)
+#define NUM_PASSES 50
+#define NUM_RUNS   5
+
+typedef struct {
+  uint16_t id;
+  uint32_t fifo;
+  uint32_t filter_match;
+  uint8_t data[8];
+  uint8_t dlc;
+} Frame;
+
+static Frame frames[NUM_FRAMES];
+static uint32_t sum;
+
+#define BENCH_SUM_FIELD(msg, sig, start, length, order, type, scale, offset) total += (uint32_t)m->sig;
+#define BENCH_HANDLER(name, id, dlc, period)                                     \
+  static void name##_Handler(const CAN_Msg_##name *m, void *context) {           \
+    uint32_t total = 0;                                                          \
+    CAN_SIGNALS_##name(BENCH_SUM_FIELD, name)                                    \
+    sum += total;                                                                \
+  }
+CAN_MSG_LIST(BENCH_HANDLER)
+
+#define BENCH_TABLE_ENTRY(name, id, dlc, period) .name = name##_Handler,
+static const CAN_Codec_RX_Table rx_table = { CAN_MSG_LIST(BENCH_TABLE_ENTRY) };
+
+#define BENCH_CASE(name, id, msg_dlc, period)             \
+  case (id): {                                            \
+    CAN_Msg_##name m;                                     \
+    if (frame->dlc >= (msg_dlc)) {                        \
+        CAN_Msg_##name##_Unpack(frame->data, &m);         \
+        name##_Handler(&m, NULL);                         \
+    }                                                     \
+    break;                                                \
+  }
+
+static void Empty_Table(uint16_t num_frames) {
+  CAN_Std_RX_Dispatch(num_frames);
+}
+
+static void Empty_Read(uint16_t num_frames) {
+  CAN_Std_Frame batch[BATCH];
+  uint16_t count = CAN_Std_RX_Read(batch, num_frames);
+  for (uint16_t i = 0; i < count; i++) {
+      const CAN_Std_Frame *frame = &batch[i];
+      switch (frame->id) {
+        CAN_MSG_LIST(BENCH_CASE)
+        default:
+          break;
+      }
+  }
+}
+
+/**
+ * @retval the best time over NUM_RUNS, in ns per frame
+ */
+static double Bench(void (*empty)(uint16_t num_frames), uint32_t *total) {
+  static CAN_HandleTypeDef hcan;
+  double best = 1e9;
+
+  for (uint32_t run = 0; run < NUM_RUNS; run++) {
+      uint64_t elapsed = 0;
+      sum = 0;
+      for (uint32_t pass = 0; pass < NUM_PASSES; pass++) {
+          for (uint32_t first = 0; first + BATCH <= NUM_FRAMES; first += BATCH) {
+              for (uint32_t i = first; i < first + BATCH; i++) {
+                  Host_CAN_RX_Push(frames[i].fifo, frames[i].id, frames[i].filter_match,
+                                   frames[i].data, frames[i].dlc);
+                  CAN_Std_RX_FIFO_Callback(&hcan, frames[i].fifo);
+              }
+              uint64_t start = Host_Time_NS();
+              empty(BATCH);
+              elapsed += Host_Time_NS() - start;
+          }
+      }
+      double ns = (double)elapsed / (NUM_PASSES * (NUM_FRAMES / BATCH) * BATCH);
+      best = (ns < best) ? ns : best;
+      *total = sum;
+  }
+  return best;
+}
+
+/**
+ * @retval the FilterMatchIndex the hardware reports for the ID
+ */
+static uint32_t Filter_Match(uint16_t id, uint32_t *fifo) {
+  uint8_t num_banks;
+  const CAN_Filter_Bank *banks = CAN_Filter_Get_Banks(&num_banks);
+
+  for (uint8_t bank = 0; bank < num_banks; bank++) {
+      uint8_t count = (banks[bank].mode == CAN_Filter_List_Mode) ? 4 : 2;
+      for (uint8_t element = 0; element < count; element++) {
+          const CAN_Filter_Element *e = &banks[bank].elements[element];
+          if (((id ^ e->id) & e->mask) == 0) {
+              *fifo = (banks[bank].fifo == 0) ? CAN_RX_FIFO0 : CAN_RX_FIFO1;
+              return banks[bank].first_match_index + element;
+          }
+      }
+  }
+  return 0;
+}
+
+#define BENCH_MESSAGE(name, id, dlc, period) { id, dlc },
+
+int main(void) {
+  static CAN_HandleTypeDef hcan;
+  static const struct { uint16_t id; uint8_t dlc; } messages[] = { CAN_MSG_LIST(BENCH_MESSAGE) };
+  const uint32_t num_messages = sizeof(messages) / sizeof(messages[0]);
+
+  if (CAN_Codec_RX_Register(&rx_table) != HAL_OK || CAN_Std_RX_Init(&hcan) != HAL_OK) {
+      printf("init failed\n");
+      return 1;
+  }
+
+  srand(1);
+  for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+      uint32_t index = rand() % num_messages;
+      frames[i].id = messages[index].id;
+      frames[i].dlc = messages[index].dlc;
+      frames[i].filter_match = Filter_Match(frames[i].id, &frames[i].fifo);
+      for (uint8_t byte = 0; byte < 8; byte++) {
+          frames[i].data[byte] = (byte < frames[i].dlc) ? (uint8_t)rand() : 0;
+      }
+  }
+
+  uint32_t table_sum, read_sum;
+  double table = Bench(Empty_Table, &table_sum);
+  double read = Bench(Empty_Read, &read_sum);
+
+  printf("receive, %u messages, ns/frame:\n", (unsigned)num_messages);
+  printf("  table %6.2f\n", table);
+  printf("  read  %6.2f  (%.2fx)\n", read, read / table);
+
+  if (table_sum != read_sum) {
+      printf("paths disagree: %08X %08X\n", table_sum, read_sum);
+      return 1;
+  }
+  return 0;
+}
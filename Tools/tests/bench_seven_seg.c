@@ -0,0 +1,232 @@
+/*
+ * bench_seven_seg.c
+ *
+ * Render time per value of the seven segment glyph tables (seven_seg.c),
+ * against the character path they replaced.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Random values are rendered into the two shift register bytes by:
+ *    table   Seven_Seg_Render_Hex / Seven_Seg_Render_Integer: one load from
+ *            the glyph tables, the decimal points added with a mask
+ *    chars   as Write_Hex and Write_Integer did before the tables: digits
+ *            to characters (hex_to_char, or / and % by 10), then the ASCII
+ *            tables through Seven_Seg_Render_Chars
+ *
+ * Both paths must render every value identically. Integers are drawn from
+ * -9 to 99, the range both display the same way.
+ *
+ * On an x86 host the tables are about 1.5x faster (8 against 12 ns a value),
+ * and most of the 8 ns is the call and the loop. The M4 has no branch
+ * predictor to hide the character path's branches, so expect a larger gap
+ * there; measure it with Util_Get_Cycles.
+ *
+ * Floats are rendered by:
+ *    float   Seven_Seg_Render_Decimal: tenths or units rounded straight from
+ *            the float, to the glyph table
+ *    fixed   as Write_Decimal did before it: thousandths, then
+ *            Seven_Seg_Render_Fixed
+ * for values from -9.4 to 99 (small), and from 100 to 99,000 (large), which
+ * both paths send through Seven_Seg_Render_Fixed. Values that the paths
+ * round differently (a value just below a boundary whose thousandths round
+ * onto it) are counted, not failed; test_seven_seg_fixed checks both.
+ *
+ * On an x86 host the float path takes 3.3 against 5.2 ns for small values,
+ * about 1.6x faster, and 1 ns more (19 against 18 ns) for large ones, the
+ * compares it makes before falling through to the fixed path. Small values
+ * are what the car shows; measure both on the M4 with Util_Get_Cycles.
+ */
+
+#include "seven_seg.h"
+#include "host_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_VALUES 4096
+#define NUM_PASSES 2000
+#define NUM_RUNS   5
+
+typedef enum {
+  Path_Table,
+  Path_Chars,
+  NUM_PATHS,
+} Path;
+
+static const char *path_names[NUM_PATHS] = { "table", "chars" };
+
+static uint8_t hexes[NUM_VALUES];
+static int8_t integers[NUM_VALUES];
+static uint8_t dps[NUM_VALUES];
+static float floats[2][NUM_VALUES];   // small, then large
+static uint8_t float_data[NUM_PATHS][NUM_VALUES][2];
+
+// hex_to_char, as it was
+static char Hex_To_Char(uint8_t hex) {
+  hex &= 0x0F;
+  if (hex < 10) {
+      return hex + '0';
+  }
+
+  switch (hex) {
+    case 0x0A:
+      return 'A';
+    case 0x0B:
+      return 'b';
+    case 0x0C:
+      return 'C';
+    case 0x0D:
+      return 'd';
+    case 0x0E:
+      return 'E';
+    default:
+      return 'F';
+  }
+}
+
+__attribute__((noinline))
+static void Chars_Render_Hex(uint8_t hex, uint8_t left_dp, uint8_t right_dp, uint8_t data[2]) {
+  char text[2] = { Hex_To_Char(hex >> 4), Hex_To_Char(hex) };
+  Seven_Seg_Render_Chars(text, left_dp, right_dp, data);
+}
+
+__attribute__((noinline))
+static void Chars_Render_Integer(int8_t val, uint8_t data[2]) {
+  char text[2];
+  if (val >= 0) {
+      text[0] = '0' + (val / 10) % 10;
+      text[1] = '0' + val % 10;
+  }
+  else {
+      text[0] = '-';
+      text[1] = '0' + (-val) % 10;
+  }
+  Seven_Seg_Render_Chars(text, 0, 0, data);
+}
+
+/**
+ * @retval the sum of every byte rendered, to compare the paths and to keep
+ *         the work from being optimized away
+ */
+static uint32_t Render_All(Path path, uint8_t integer) {
+  uint32_t sum = 0;
+  uint8_t data[2];
+  for (uint32_t i = 0; i < NUM_VALUES; i++) {
+      if (integer) {
+          if (path == Path_Table) {
+              Seven_Seg_Render_Integer(integers[i], data);
+          }
+          else {
+              Chars_Render_Integer(integers[i], data);
+          }
+      }
+      else {
+          if (path == Path_Table) {
+              Seven_Seg_Render_Hex(hexes[i], dps[i] & 1, dps[i] >> 1, data);
+          }
+          else {
+              Chars_Render_Hex(hexes[i], dps[i] & 1, dps[i] >> 1, data);
+          }
+      }
+      sum = sum * 31 + (data[0] | data[1] << 8);
+  }
+  return sum;
+}
+
+// Write_Decimal, as it was
+__attribute__((noinline))
+static void Fixed_Render_Decimal(float val, uint8_t data[2]) {
+  int32_t thousandths = (int32_t)(val * 1000.0f + (val < 0 ? -0.5f : 0.5f));
+  Seven_Seg_Render_Fixed(thousandths, 3, data);
+}
+
+/**
+ * Renders every float of one range into float_data[path].
+ */
+static void Render_Floats(Path path, uint8_t large) {
+  for (uint32_t i = 0; i < NUM_VALUES; i++) {
+      if (path == Path_Table) {
+          Seven_Seg_Render_Decimal(floats[large][i], float_data[path][i]);
+      }
+      else {
+          Fixed_Render_Decimal(floats[large][i], float_data[path][i]);
+      }
+  }
+}
+
+/**
+ * @retval the best time over NUM_RUNS, in ns per value
+ */
+static double Bench(Path path, uint8_t integer, uint32_t *sum) {
+  double best = 1e9;
+  for (uint32_t run = 0; run < NUM_RUNS; run++) {
+      uint64_t start = Host_Time_NS();
+      for (uint32_t pass = 0; pass < NUM_PASSES; pass++) {
+          *sum = Render_All(path, integer);
+      }
+      double ns = (double)(Host_Time_NS() - start) / ((double)NUM_PASSES * NUM_VALUES);
+      best = (ns < best) ? ns : best;
+  }
+  return best;
+}
+
+static double Bench_Floats(Path path, uint8_t large) {
+  double best = 1e9;
+  for (uint32_t run = 0; run < NUM_RUNS; run++) {
+      uint64_t start = Host_Time_NS();
+      for (uint32_t pass = 0; pass < NUM_PASSES; pass++) {
+          Render_Floats(path, large);
+      }
+      double ns = (double)(Host_Time_NS() - start) / ((double)NUM_PASSES * NUM_VALUES);
+      best = (ns < best) ? ns : best;
+  }
+  return best;
+}
+
+int main(void) {
+  uint8_t failed = 0;
+
+  srand(1);
+  for (uint32_t i = 0; i < NUM_VALUES; i++) {
+      hexes[i] = rand();
+      integers[i] = rand() % 109 - 9;
+      dps[i] = rand() % 4;
+      floats[0][i] = (float)(rand() % 10841 - 940) / 100.0f;
+      floats[1][i] = (float)(rand() % 9890 + 10) * 10.0f + (float)rand() / RAND_MAX;
+  }
+
+  printf("render, ns/value:\n");
+  printf("  %-8s %8s %8s\n", "", "table", "chars");
+  for (uint8_t integer = 0; integer < 2; integer++) {
+      double ns[NUM_PATHS];
+      uint32_t sums[NUM_PATHS];
+      for (Path path = Path_Table; path < NUM_PATHS; path++) {
+          ns[path] = Bench(path, integer, &sums[path]);
+      }
+      printf("  %-8s %8.2f %8.2f  (%.2fx)\n", integer ? "integer" : "hex",
+             ns[Path_Table], ns[Path_Chars], ns[Path_Chars] / ns[Path_Table]);
+      if (sums[Path_Table] != sums[Path_Chars]) {
+          printf("  %s: %s and %s render differently\n", integer ? "integer" : "hex",
+                 path_names[Path_Table], path_names[Path_Chars]);
+          failed = 1;
+      }
+  }
+
+  printf("decimal, ns/value:\n");
+  printf("  %-8s %8s %8s\n", "", "float", "fixed");
+  for (uint8_t large = 0; large < 2; large++) {
+      double ns[NUM_PATHS];
+      for (Path path = Path_Table; path < NUM_PATHS; path++) {
+          ns[path] = Bench_Floats(path, large);
+      }
+      uint32_t differ = 0;
+      for (uint32_t i = 0; i < NUM_VALUES; i++) {
+          differ += (float_data[Path_Table][i][0] != float_data[Path_Chars][i][0] ||
+                     float_data[Path_Table][i][1] != float_data[Path_Chars][i][1]);
+      }
+      printf("  %-8s %8.2f %8.2f  (%.2fx, %u of %u rounded differently)\n", large ? "large" : "small",
+             ns[Path_Table], ns[Path_Chars], ns[Path_Chars] / ns[Path_Table], differ, NUM_VALUES);
+  }
+
+  return failed;
+}
@@ -0,0 +1,181 @@
+/*
+ * bench_util_ring.c
+ *
+ * Throughput of the SPSC ring buffers of util.h, per item, for the single,
+ * batch and in-place functions.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Items are the size of a CAN_Std_Frame, in a ring of CAN_STD_RX_RING_SIZE.
+ *    same thread  push then pop, one context: the cost of the functions
+ *                 themselves, as on the M4, where the interrupt and the main
+ *                 loop never run at the same time
+ *    threads      a producer thread against a consumer thread: adds the
+ *                 cost of moving the indices and slots between cores, which
+ *                 batching amortizes
+ *
+ * On the host, __DMB is a full fence (a locked instruction on x86), which
+ * costs far more than a DMB on the M4, so the same thread numbers are an
+ * upper bound on the relative cost of the barriers.
+ */
+
+#include "util.h"
+#include "host_hal.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+typedef struct {
+  uint32_t id;
+  uint8_t info[4];
+  uint16_t timestamp;
+  uint8_t data[8];
+} Item;
+
+UTIL_RING_DECLARE(Bench_Ring, Item, 64)
+
+#define NUM_ITEMS 4000000U
+#define BATCH     8
+#define NUM_RUNS  3
+
+typedef enum {
+  Mode_Single,
+  Mode_Batch,
+  Mode_In_Place,
+  NUM_MODES,
+} Mode;
+
+static const char *mode_names[NUM_MODES] = { "single", "batch 8", "in place" };
+
+static Bench_Ring ring;
+static Mode mode;
+
+static uint32_t Produce(uint32_t seq) {
+  Item items[BATCH];
+  switch (mode) {
+    case Mode_Single:
+      items[0].id = seq;
+      return Bench_Ring_Push(&ring, &items[0]);
+    case Mode_Batch:
+      for (uint32_t i = 0; i < BATCH; i++) {
+          items[i].id = seq + i;
+      }
+      return Bench_Ring_Push_Batch(&ring, items, BATCH);
+    default: {
+      Item *slot = Bench_Ring_Reserve(&ring);
+      if (slot == NULL) {
+          return 0;
+      }
+      slot->id = seq;
+      Bench_Ring_Commit(&ring);
+      return 1;
+    }
+  }
+}
+
+static uint32_t Consume(uint32_t *sum) {
+  Item items[BATCH];
+  switch (mode) {
+    case Mode_Single:
+      if (!Bench_Ring_Pop(&ring, &items[0])) {
+          return 0;
+      }
+      *sum += items[0].id;
+      return 1;
+    case Mode_Batch: {
+      uint32_t n = Bench_Ring_Pop_Batch(&ring, items, BATCH);
+      for (uint32_t i = 0; i < n; i++) {
+          *sum += items[i].id;
+      }
+      return n;
+    }
+    default: {
+      const Item *slot = Bench_Ring_Peek(&ring);
+      if (slot == NULL) {
+          return 0;
+      }
+      *sum += slot->id;
+      Bench_Ring_Release(&ring);
+      return 1;
+    }
+  }
+}
+
+static void *Producer(void *arg) {
+  uint32_t seq = 0;
+  while (seq < NUM_ITEMS) {
+      uint32_t n = Produce(seq);
+      if (n == 0) {
+          sched_yield();
+      }
+      seq += n;
+  }
+  return NULL;
+}
+
+/**
+ * @retval ns per item, the best of NUM_RUNS
+ */
+static double Bench_Same_Thread(uint32_t *sum) {
+  double best = 1e9;
+  for (uint32_t run = 0; run < NUM_RUNS; run++) {
+      Bench_Ring_Reset(&ring);
+      *sum = 0;
+      uint64_t start = Host_Time_NS();
+      for (uint32_t seq = 0; seq < NUM_ITEMS;) {
+          uint32_t n = Produce(seq);
+          for (uint32_t popped = 0; popped < n;) {
+              popped += Consume(sum);
+          }
+          seq += n;
+      }
+      double ns = (double)(Host_Time_NS() - start) / NUM_ITEMS;
+      best = (ns < best) ? ns : best;
+  }
+  return best;
+}
+
+static double Bench_Threads(uint32_t *sum) {
+  double best = 1e9;
+  for (uint32_t run = 0; run < NUM_RUNS; run++) {
+      pthread_t producer;
+      Bench_Ring_Reset(&ring);
+      *sum = 0;
+      uint64_t start = Host_Time_NS();
+      pthread_create(&producer, NULL, Producer, NULL);
+      for (uint32_t count = 0; count < NUM_ITEMS;) {
+          uint32_t n = Consume(sum);
+          if (n == 0) {
+              sched_yield();
+          }
+          count += n;
+      }
+      pthread_join(producer, NULL);
+      double ns = (double)(Host_Time_NS() - start) / NUM_ITEMS;
+      best = (ns < best) ? ns : best;
+  }
+  return best;
+}
+
+int main(void) {
+  // every item is counted exactly once: the sum of 0 .. NUM_ITEMS - 1
+  const uint32_t expected = (uint32_t)((uint64_t)NUM_ITEMS * (NUM_ITEMS - 1) / 2);
+  uint8_t failed = 0;
+
+  printf("ring of 64 x %u bytes, ns/item:\n", (unsigned)sizeof(Item));
+  printf("  %-9s %12s %9s\n", "", "same thread", "threads");
+  for (mode = Mode_Single; mode < NUM_MODES; mode++) {
+      uint32_t same_sum, threads_sum;
+      double same = Bench_Same_Thread(&same_sum);
+      double threads = Bench_Threads(&threads_sum);
+      printf("  %-9s %12.2f %9.2f\n", mode_names[mode], same, threads);
+      failed |= (same_sum != expected || threads_sum != expected);
+  }
+
+  if (failed) {
+      printf("items lost or repeated\n");
+      return 1;
+  }
+  return 0;
+}
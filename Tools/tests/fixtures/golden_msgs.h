@@ -0,0 +1,65 @@
+/*
+ * can_msgs.h
+ *
+ * Caltech Racing CAN message catalog.
+ *
+ * Declares every message on the car network, and the signals packed into
+ * each one. Nothing here generates code by itself; see can_codec.h for the
+ * pack/unpack functions and receive dispatch table generated from these lists.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * GENERATED by Tools/dbc_to_can_msgs.py from Tools/tests/fixtures/golden.dbc; do not edit.
+ *
+ * Adding a message:
+ *    1. Add the message to Tools/tests/fixtures/golden.dbc, with an ID inside the range of
+ *       the sending node (see CAN_ID in can_std.h), and a GenMsgCycleTime
+ *    2. Run python3 Tools/dbc_to_can_msgs.py
+ *
+ * Signal columns:
+ *    start   - DBC start bit. For little endian (Intel) signals, the LSB.
+ *              For big endian (Motorola) signals, the MSB, numbered with
+ *              bit 7 as the MSB of byte 0 (DBC "sawtooth" numbering)
+ *    length  - number of bits, 1 to 32
+ *    order   - CAN_MSG_LE (Intel) or CAN_MSG_BE (Motorola)
+ *    type    - C type of the raw value; signed types are sign-extended
+ *    scale   - physical = raw * scale + offset
+ *    offset
+ */
+
+#ifndef INC_CAN_MSGS_H_
+#define INC_CAN_MSGS_H_
+
+#include "can_std.h"
+
+#define CAN_MSG_LE 0
+#define CAN_MSG_BE 1
+
+/*      name,             id,                   dlc, period (ms) */
+#define CAN_MSG_LIST(MSG) \
+  MSG(Golden_Fault,       CAN_ID_HIGH_PRIO + 0x3, 1,   5)    \
+  MSG(Golden_Intel,       CAN_ID_AMS + 0x5,     8,   100)  \
+  MSG(Golden_Motorola,    CAN_ID_STEER + 0x2,   6,   20)   \
+  MSG(Golden_Debug,       CAN_ID_LOW_PRIO + 0x0, 8,   0)
+
+/*      message,          signal,             start, length, order,      type,     scale,   offset */
+#define CAN_SIGNALS_Golden_Fault(SIG, M) \
+  SIG(M,                  Code,               0,     7,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)   \
+  SIG(M,                  Latched,            7,     1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#define CAN_SIGNALS_Golden_Intel(SIG, M) \
+  SIG(M,                  Offset_Temp,        0,     8,      CAN_MSG_LE, uint8_t,  0.5f,    -40.0f) \
+  SIG(M,                  Unaligned,          12,    12,     CAN_MSG_LE, int16_t,  0.25f,   0.0f)   \
+  SIG(M,                  Flag,               24,    1,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)   \
+  SIG(M,                  Wide,               32,    32,     CAN_MSG_LE, int32_t,  1e-05f,  0.0f)
+
+#define CAN_SIGNALS_Golden_Motorola(SIG, M) \
+  SIG(M,                  Nibble_Span,        3,     12,     CAN_MSG_BE, uint16_t, 1.0f,    0.0f)   \
+  SIG(M,                  Signed_Ten,         21,    10,     CAN_MSG_BE, int16_t,  0.1f,    5.0f)   \
+  SIG(M,                  Byte_Pair,          39,    16,     CAN_MSG_BE, uint16_t, 0.01f,   0.0f)
+
+#define CAN_SIGNALS_Golden_Debug(SIG, M) \
+  SIG(M,                  Counter,            56,    8,      CAN_MSG_LE, uint8_t,  1.0f,    0.0f)
+
+#endif /* INC_CAN_MSGS_H_ */
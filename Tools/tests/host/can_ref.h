@@ -0,0 +1,80 @@
+/*
+ * can_ref.h
+ *
+ * A bit-by-bit reference for DBC signal layouts, to check the codecs of
+ * can_codec.h against. Deliberately slow and literal: it walks the signal
+ * one bit at a time, exactly as the DBC format describes it, and shares
+ * nothing with CAN_Codec_Shift.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Payload bit b is bit (b % 8) of byte (b / 8).
+ *    - Intel (little endian): start is the LSB, and the signal runs up
+ *      through increasing bit numbers
+ *    - Motorola (big endian): start is the MSB; each next bit is the one
+ *      below it in the same byte, or bit 7 of the next byte after bit 0
+ */
+
+#ifndef TOOLS_TESTS_CAN_REF_H_
+#define TOOLS_TESTS_CAN_REF_H_
+
+#include <stdint.h>
+
+/**
+ * @retval the payload bit holding bit i (0 = LSB) of the signal
+ */
+static inline uint32_t Ref_Bit_Position(uint32_t start, uint32_t length, uint32_t big_endian, uint32_t i) {
+  if (!big_endian) {
+      return start + i;
+  }
+  // walk from the MSB (i = length - 1) down to bit i
+  uint32_t position = start;
+  for (uint32_t bit = length - 1; bit > i; bit--) {
+      position = (position % 8 == 0) ? position + 15 : position - 1;
+  }
+  return position;
+}
+
+/**
+ * @retval 1 if the signal lies inside an 8-byte payload
+ */
+static inline uint8_t Ref_Fits(uint32_t start, uint32_t length, uint32_t big_endian) {
+  if (!big_endian) {
+      return start + length <= 64;
+  }
+  uint32_t position = start;
+  for (uint32_t bit = 1; bit < length; bit++) {
+      position = (position % 8 == 0) ? position + 15 : position - 1;
+      if (position >= 64) {
+          return 0;
+      }
+  }
+  return 1;
+}
+
+/**
+ * @retval the raw value, sign-extended to 32 bits if is_signed
+ */
+static inline uint32_t Ref_Get(const uint8_t *data, uint32_t start, uint32_t length, uint32_t big_endian,
+                               uint32_t is_signed) {
+  uint32_t raw = 0;
+  for (uint32_t i = 0; i < length; i++) {
+      uint32_t position = Ref_Bit_Position(start, length, big_endian, i);
+      raw |= (uint32_t)((data[position / 8] >> (position % 8)) & 1) << i;
+  }
+  if (is_signed && length < 32 && (raw >> (length - 1)) & 1) {
+      raw |= ~0U << length;
+  }
+  return raw;
+}
+
+static inline void Ref_Set(uint8_t *data, uint32_t start, uint32_t length, uint32_t big_endian, uint32_t raw) {
+  for (uint32_t i = 0; i < length; i++) {
+      uint32_t position = Ref_Bit_Position(start, length, big_endian, i);
+      data[position / 8] &= (uint8_t)~(1U << (position % 8));
+      data[position / 8] |= (uint8_t)(((raw >> i) & 1) << (position % 8));
+  }
+}
+
+#endif /* TOOLS_TESTS_CAN_REF_H_ */
@@ -0,0 +1,43 @@
+/*
+ * check.h
+ *
+ * Assertions for the host tests in Tools/tests. A failed CHECK prints where
+ * and why, and the test carries on, so one run shows every failure.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Usage:
+ *
+ *      CHECK(value == 3, "value is %d", value);
+ *
+ *      // ...
+ *
+ *      return CHECK_DONE();  // from main, 1 if anything failed
+ */
+
+#ifndef TOOLS_TESTS_CHECK_H_
+#define TOOLS_TESTS_CHECK_H_
+
+#include <stdio.h>
+
+static unsigned check_count;
+static unsigned check_failures;
+
+#define CHECK(condition, ...)                                         \
+  do {                                                                \
+    check_count++;                                                    \
+    if (!(condition)) {                                               \
+        check_failures++;                                             \
+        printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #condition);   \
+        printf(__VA_ARGS__);                                          \
+        printf("\n");                                                 \
+    }                                                                 \
+  } while (0)
+
+#define CHECK_DONE()                                                  \
+  (printf("%s: %u checks, %u failed\n", __FILE__, check_count,        \
+          check_failures),                                            \
+   check_failures != 0)
+
+#endif /* TOOLS_TESTS_CHECK_H_ */
@@ -0,0 +1,111 @@
+/*
+ * host.h
+ *
+ * Builds the libraries for the PC running the tests and benchmarks in
+ * Tools/tests. Force-included (gcc -include host.h) before every source.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * The CMSIS intrinsics in cmsis_gcc.h are ARM assembly, so this defines its
+ * include guard and provides host versions instead:
+ *    - interrupts are never masked, and PRIMASK always reads 0; tests which
+ *      run an "interrupt" on another thread rely on the libraries' lock-free
+ *      paths, exactly like the target
+ *    - __DMB, __DSB and __ISB are full fences, at least as strong as on the M4
+ *
+ * The peripherals the libraries access directly (DWT, CoreDebug, RCC,
+ * SYSCFG, EXTI, and the GPIO ports, which buttons.c matches against
+ * SYSCFG's EXTI lines by address) are redirected to ordinary structs, so
+ * e.g. a test sets host_dwt.CYCCNT to control Util_Get_Cycles. Other
+ * peripherals are reached through handles, whose Instance a test points at
+ * its own register struct.
+ */
+
+#ifndef TOOLS_TESTS_HOST_H_
+#define TOOLS_TESTS_HOST_H_
+
+#include <stdint.h>
+
+#define __CMSIS_GCC_H
+
+#ifndef __has_builtin
+#define __has_builtin(x) (0)
+#endif
+
+#define __ASM                       __asm
+#define __INLINE                    inline
+#define __STATIC_INLINE             static inline
+#define __STATIC_FORCEINLINE        __attribute__((always_inline)) static inline
+#define __NO_RETURN                 __attribute__((__noreturn__))
+#define __USED                      __attribute__((used))
+#define __WEAK                      __attribute__((weak))
+#define __PACKED                    __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT             struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION              union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)                __attribute__((aligned(x)))
+#define __RESTRICT                  __restrict
+#define __COMPILER_BARRIER()        __asm volatile("" ::: "memory")
+
+#define __NOP()                     __asm volatile("nop")
+#define __WFI()                     __COMPILER_BARRIER()
+#define __WFE()                     __COMPILER_BARRIER()
+#define __SEV()                     __COMPILER_BARRIER()
+#define __BKPT(value)               __builtin_trap()
+
+__STATIC_FORCEINLINE void __DMB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+__STATIC_FORCEINLINE void __DSB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+__STATIC_FORCEINLINE void __ISB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t value)   { return __builtin_bswap32(value); }
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t value) { return (value >> 8 & 0x00FF00FFU) | (value << 8 & 0xFF00FF00U); }
+__STATIC_FORCEINLINE int16_t __REVSH(int16_t value)   { return (int16_t)__builtin_bswap16((uint16_t)value); }
+__STATIC_FORCEINLINE uint8_t __CLZ(uint32_t value)    { return (value == 0U) ? 32U : (uint8_t)__builtin_clz(value); }
+
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t value) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < 32; i++) {
+      result = (result << 1) | ((value >> i) & 1U);
+  }
+  return result;
+}
+
+__STATIC_FORCEINLINE void __enable_irq(void)  { __COMPILER_BARRIER(); }
+__STATIC_FORCEINLINE void __disable_irq(void) { __COMPILER_BARRIER(); }
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void) { return 0; }
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t priMask) { (void)priMask; __COMPILER_BARRIER(); }
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void) { return 0; }
+
+#include "stm32f4xx.h"
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern RCC_TypeDef host_rcc;
+extern SYSCFG_TypeDef host_syscfg;
+extern EXTI_TypeDef host_exti;
+extern GPIO_TypeDef host_gpio[8];   // GPIOA to GPIOH, in GPIO_GET_INDEX order
+
+#undef DWT
+#undef CoreDebug
+#define DWT       (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#undef RCC
+#define RCC       (&host_rcc)
+#undef SYSCFG
+#undef EXTI
+#define SYSCFG    (&host_syscfg)
+#define EXTI      (&host_exti)
+#undef GPIOA
+#undef GPIOB
+#undef GPIOC
+#undef GPIOD
+#undef GPIOE
+#undef GPIOH
+#define GPIOA     (&host_gpio[0])
+#define GPIOB     (&host_gpio[1])
+#define GPIOC     (&host_gpio[2])
+#define GPIOD     (&host_gpio[3])
+#define GPIOE     (&host_gpio[4])
+#define GPIOH     (&host_gpio[7])
+
+#endif /* TOOLS_TESTS_HOST_H_ */
@@ -0,0 +1,286 @@
+/*
+ * host_hal.c
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * See host_hal.h for the behavior of each model.
+ */
+
+#include "host_hal.h"
+#include <string.h>
+#include <time.h>
+
+#define HOST_WEAK __attribute__((weak))
+
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+RCC_TypeDef host_rcc;   // APB prescalers of 1, so the timer clocks are the PCLKs
+SYSCFG_TypeDef host_syscfg;
+EXTI_TypeDef host_exti;
+GPIO_TypeDef host_gpio[8];
+uint32_t SystemCoreClock = 72000000;
+
+uint32_t host_tick;
+
+CAN_FilterTypeDef host_can_filters[HOST_CAN_NUM_FILTER_BANKS];
+Host_CAN_TX_Frame host_can_tx_log[HOST_CAN_TX_LOG_SIZE];
+uint32_t host_can_tx_count;
+uint32_t host_can_tx_busy;
+
+Host_GPIO_Write host_gpio_log[HOST_GPIO_LOG_SIZE];
+uint32_t host_gpio_count;
+
+Host_SPI host_spi;
+
+static Host_CAN_RX_Frame can_rx_fifos[2][HOST_CAN_RX_FIFO_SIZE];
+static uint32_t can_rx_levels[2];
+
+void Host_HAL_Reset(void) {
+  memset(host_can_filters, 0, sizeof(host_can_filters));
+  memset(can_rx_levels, 0, sizeof(can_rx_levels));
+  host_can_tx_count = 0;
+  host_can_tx_busy = 0;
+  host_gpio_count = 0;
+  memset(&host_spi, 0, sizeof(host_spi));
+}
+
+uint64_t Host_Time_NS(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* HAL */
+
+HOST_WEAK uint32_t HAL_GetTick(void) {
+  return host_tick;
+}
+
+HOST_WEAK uint32_t HAL_RCC_GetPCLK1Freq(void) {
+  return SystemCoreClock / 2;
+}
+
+HOST_WEAK uint32_t HAL_RCC_GetPCLK2Freq(void) {
+  return SystemCoreClock;
+}
+
+/* GPIO */
+
+HOST_WEAK void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+  if (PinState == GPIO_PIN_SET) {
+      GPIOx->ODR |= GPIO_Pin;
+  }
+  else {
+      GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+
+  if (host_gpio_count < HOST_GPIO_LOG_SIZE) {
+      host_gpio_log[host_gpio_count] = (Host_GPIO_Write){ GPIOx, GPIO_Pin, PinState };
+  }
+  host_gpio_count++;
+}
+
+HOST_WEAK GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/* TIM */
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) {
+  htim->State = HAL_TIM_STATE_READY;
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim) {
+  htim->State = HAL_TIM_STATE_BUSY;
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim) {
+  htim->State = HAL_TIM_STATE_READY;
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim) {
+  htim->State = HAL_TIM_STATE_READY;
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, const TIM_OC_InitTypeDef *sConfig,
+                                                      uint32_t Channel) {
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim,
+                                                      const TIM_ClockConfigTypeDef *sClockSourceConfig) {
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_TIM_RegisterCallback(TIM_HandleTypeDef *htim, HAL_TIM_CallbackIDTypeDef CallbackID,
+                                                     pTIM_CallbackTypeDef pCallback) {
+  switch (CallbackID) {
+    case HAL_TIM_PERIOD_ELAPSED_CB_ID:
+      htim->PeriodElapsedCallback = pCallback;
+      return HAL_OK;
+    case HAL_TIM_PWM_PULSE_FINISHED_CB_ID:
+      htim->PWM_PulseFinishedCallback = pCallback;
+      return HAL_OK;
+    default:
+      return HAL_ERROR;
+  }
+}
+
+HOST_WEAK void TIM_CCxChannelCmd(TIM_TypeDef *TIMx, uint32_t Channel, uint32_t ChannelState) {
+}
+
+/* SPI */
+
+static HAL_StatusTypeDef Host_SPI_Start(SPI_HandleTypeDef *hspi, const uint8_t *pTxData, uint8_t *pRxData,
+                                        uint16_t Size, HAL_SPI_StateTypeDef state) {
+  if (hspi->State != HAL_SPI_STATE_READY) {
+      return HAL_BUSY;
+  }
+  if (Size > HOST_SPI_MAX_BYTES) {
+      return HAL_ERROR;
+  }
+  memcpy(host_spi.tx, pTxData, Size);
+  if (pRxData != NULL) {
+      memcpy(pRxData, host_spi.rx, Size);
+  }
+  host_spi.size = Size;
+  host_spi.transfers++;
+  hspi->State = state;
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size) {
+  return Host_SPI_Start(hspi, pData, NULL, Size, HAL_SPI_STATE_BUSY_TX);
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size) {
+  return Host_SPI_Start(hspi, pData, NULL, Size, HAL_SPI_STATE_BUSY_TX);
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData,
+                                                        uint16_t Size) {
+  return Host_SPI_Start(hspi, pTxData, pRxData, Size, HAL_SPI_STATE_BUSY_TX_RX);
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_SPI_RegisterCallback(SPI_HandleTypeDef *hspi, HAL_SPI_CallbackIDTypeDef CallbackID,
+                                                     pSPI_CallbackTypeDef pCallback) {
+  switch (CallbackID) {
+    case HAL_SPI_TX_COMPLETE_CB_ID:
+      hspi->TxCpltCallback = pCallback;
+      return HAL_OK;
+    case HAL_SPI_TX_RX_COMPLETE_CB_ID:
+      hspi->TxRxCpltCallback = pCallback;
+      return HAL_OK;
+    default:
+      return HAL_ERROR;
+  }
+}
+
+void Host_SPI_Complete(SPI_HandleTypeDef *hspi) {
+  HAL_SPI_StateTypeDef state = hspi->State;
+
+  hspi->State = HAL_SPI_STATE_READY;
+  if (state == HAL_SPI_STATE_BUSY_TX && hspi->TxCpltCallback != NULL) {
+      hspi->TxCpltCallback(hspi);
+  }
+  else if (state == HAL_SPI_STATE_BUSY_TX_RX && hspi->TxRxCpltCallback != NULL) {
+      hspi->TxRxCpltCallback(hspi);
+  }
+}
+
+/* CAN */
+
+HOST_WEAK HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *sFilterConfig) {
+  if (sFilterConfig->FilterBank >= HOST_CAN_NUM_FILTER_BANKS) {
+      return HAL_ERROR;
+  }
+  host_can_filters[sFilterConfig->FilterBank] = *sFilterConfig;
+  return HAL_OK;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs) {
+  return HAL_OK;
+}
+
+uint8_t Host_CAN_RX_Push(uint32_t fifo, uint32_t id, uint32_t filter_match, const uint8_t *data, uint8_t dlc) {
+  if (can_rx_levels[fifo] == HOST_CAN_RX_FIFO_SIZE) {
+      return 0;
+  }
+
+  Host_CAN_RX_Frame *frame = &can_rx_fifos[fifo][can_rx_levels[fifo]++];
+  frame->header = (CAN_RxHeaderTypeDef){
+      .StdId            = id,
+      .IDE              = CAN_ID_STD,
+      .RTR              = CAN_RTR_DATA,
+      .DLC              = dlc,
+      .FilterMatchIndex = filter_match,
+  };
+  memset(frame->data, 0, sizeof(frame->data));
+  memcpy(frame->data, data, dlc);
+  return 1;
+}
+
+HOST_WEAK uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t RxFifo) {
+  return can_rx_levels[RxFifo];
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo,
+                                                 CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]) {
+  if (can_rx_levels[RxFifo] == 0) {
+      return HAL_ERROR;
+  }
+
+  Host_CAN_RX_Frame *fifo = can_rx_fifos[RxFifo];
+  *pHeader = fifo[0].header;
+  memcpy(aData, fifo[0].data, 8);
+  can_rx_levels[RxFifo]--;
+  memmove(&fifo[0], &fifo[1], can_rx_levels[RxFifo] * sizeof(fifo[0]));
+  return HAL_OK;
+}
+
+HOST_WEAK uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef *hcan) {
+  return 3 - __builtin_popcount(host_can_tx_busy);
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, const CAN_TxHeaderTypeDef *pHeader,
+                                                 const uint8_t aData[], uint32_t *pTxMailbox) {
+  for (uint32_t mailbox = 0; mailbox < 3; mailbox++) {
+      uint32_t bit = CAN_TX_MAILBOX0 << mailbox;
+      if ((host_can_tx_busy & bit) == 0) {
+          host_can_tx_busy |= bit;
+          *pTxMailbox = bit;
+
+          if (host_can_tx_count < HOST_CAN_TX_LOG_SIZE) {
+              Host_CAN_TX_Frame *frame = &host_can_tx_log[host_can_tx_count];
+              frame->header = *pHeader;
+              frame->mailbox = bit;
+              memcpy(frame->data, aData, pHeader->DLC);
+          }
+          host_can_tx_count++;
+          return HAL_OK;
+      }
+  }
+  return HAL_ERROR;
+}
+
+void Host_CAN_TX_Complete(uint32_t mailboxes) {
+  host_can_tx_busy &= ~mailboxes;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes) {
+  return HAL_OK;
+}
+
+HOST_WEAK uint32_t HAL_CAN_GetError(const CAN_HandleTypeDef *hcan) {
+  return hcan->ErrorCode;
+}
+
+HOST_WEAK HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan) {
+  hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+  return HAL_OK;
+}
@@ -0,0 +1,112 @@
+/*
+ * host_hal.h
+ *
+ * Minimal models of the HAL peripherals the libraries use, for the host
+ * tests and benchmarks in Tools/tests.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Every HAL function the libraries call is defined in host_hal.c, weak, so
+ * a test can replace any of them with its own. The defaults:
+ *    - TIM: Base_Start_IT/Stop_IT set the handle State, RegisterCallback
+ *      stores the callback in the handle; a test "interrupts" by calling
+ *      e.g. htim->PeriodElapsedCallback(htim)
+ *    - SPI: a transfer records its bytes in host_spi and leaves the handle
+ *      busy until Host_SPI_Complete, which calls the registered callback
+ *    - GPIO: WritePin sets the pin in the port's ODR and logs the write
+ *    - CAN: ConfigFilter stores the bank in host_can_filters, the receive
+ *      FIFOs are filled with Host_CAN_RX_Push, and AddTxMessage logs the
+ *      frame and takes a mailbox until Host_CAN_TX_Complete
+ */
+
+#ifndef TOOLS_TESTS_HOST_HAL_H_
+#define TOOLS_TESTS_HOST_HAL_H_
+
+#include "stm32f4xx_hal.h"
+
+/* Definitions */
+
+#define HOST_CAN_NUM_FILTER_BANKS 28
+#define HOST_CAN_RX_FIFO_SIZE     3
+#define HOST_CAN_TX_LOG_SIZE      256
+#define HOST_GPIO_LOG_SIZE        4096
+#define HOST_SPI_MAX_BYTES        64
+
+typedef struct {
+  CAN_RxHeaderTypeDef header;
+  uint8_t data[8];
+} Host_CAN_RX_Frame;
+
+typedef struct {
+  CAN_TxHeaderTypeDef header;
+  uint8_t data[8];
+  uint32_t mailbox;
+} Host_CAN_TX_Frame;
+
+typedef struct {
+  GPIO_TypeDef *port;
+  uint16_t pin;
+  GPIO_PinState state;
+} Host_GPIO_Write;
+
+typedef struct {
+  uint8_t tx[HOST_SPI_MAX_BYTES];   // bytes of the last transfer
+  uint8_t rx[HOST_SPI_MAX_BYTES];   // bytes shifted in by full-duplex transfers
+  uint16_t size;
+  uint32_t transfers;               // transfers started
+} Host_SPI;
+
+extern uint32_t host_tick;          // HAL_GetTick, in ms
+
+extern CAN_FilterTypeDef host_can_filters[HOST_CAN_NUM_FILTER_BANKS];
+extern Host_CAN_TX_Frame host_can_tx_log[HOST_CAN_TX_LOG_SIZE];
+extern uint32_t host_can_tx_count;  // frames added, may exceed the log size
+extern uint32_t host_can_tx_busy;   // mask of occupied mailboxes
+
+extern Host_GPIO_Write host_gpio_log[HOST_GPIO_LOG_SIZE];
+extern uint32_t host_gpio_count;    // writes logged, may exceed the log size
+
+extern Host_SPI host_spi;
+
+/* Functions */
+
+/**
+ * Queues a received frame in a CAN receive FIFO.
+ *
+ * @param fifo          CAN_RX_FIFO0 or CAN_RX_FIFO1
+ * @param id            the standard identifier
+ * @param filter_match  the FilterMatchIndex to report
+ * @param data          the payload
+ * @param dlc           the number of bytes in data
+ *
+ * @retval 1 if queued, 0 if the FIFO is full
+ */
+uint8_t Host_CAN_RX_Push(uint32_t fifo, uint32_t id, uint32_t filter_match, const uint8_t *data, uint8_t dlc);
+
+/**
+ * Frees the given mailboxes, as if their frames were sent.
+ *
+ * @param mailboxes  a mask of CAN_TX_MAILBOX0..2
+ */
+void Host_CAN_TX_Complete(uint32_t mailboxes);
+
+/**
+ * Finishes the SPI transfer in flight, and calls the registered TX (or
+ * TX/RX) complete callback.
+ *
+ * @param hspi  the SPI handler
+ */
+void Host_SPI_Complete(SPI_HandleTypeDef *hspi);
+
+/**
+ * Clears the GPIO and SPI logs, the CAN TX log and FIFOs, and the filters.
+ */
+void Host_HAL_Reset(void);
+
+/**
+ * @retval a monotonic time, in ns, for benchmarks
+ */
+uint64_t Host_Time_NS(void);
+
+#endif /* TOOLS_TESTS_HOST_HAL_H_ */
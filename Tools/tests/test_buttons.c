@@ -0,0 +1,223 @@
+/*
+ * test_buttons.c
+ *
+ * Checks the debouncing of buttons.h on the simulated timer and GPIO: each
+ * EXTI button integrates on its own over the shared tick, so a clean press
+ * is reported after exactly its debounce time while a neighbour chatters,
+ * a glitch shorter than the debounce time is never reported, and pins
+ * which are not EXTI lines of their port are refused. The same for a
+ * polled button port, whose vertical counters only change the pins in its
+ * mask.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * The buttons are active low on GPIOE (host.h redirects it, with SYSCFG
+ * and EXTI). Each ms, the test sets the pins, calling Button_EXTI_Callback
+ * for every edge of an EXTI pin as HAL_GPIO_EXTI_Callback would, then ticks
+ * the timer if it is running. The button port is GPIOD, with no EXTI.
+ */
+
+#include "buttons.h"
+#include "check.h"
+#include "host_hal.h"
+
+#define PIN_A        GPIO_PIN_0
+#define PIN_B        GPIO_PIN_1
+#define PIN_UNMASKED GPIO_PIN_2
+#define PIN_OTHER    GPIO_PIN_3     // an EXTI line, but of another port
+#define DEBOUNCE_MS  20
+#define PORT_PINS    0x00FF
+#define SCAN_MS      5
+
+typedef struct {
+  uint32_t calls;
+  uint32_t time;                    // ms of the last call
+  GPIO_PinState state;              // state of the last call
+} Calls;
+
+static TIM_TypeDef tim;
+static TIM_HandleTypeDef htim = { .Instance = &tim };
+static uint32_t now;                // ms since the start
+static Calls calls_a, calls_b;
+
+static uint32_t port_calls;
+static uint16_t port_changed, port_state;
+static uint32_t port_time;
+
+static void Button_A_Handler(GPIO_PinState state) {
+  calls_a = (Calls){ calls_a.calls + 1, now, state };
+}
+
+static void Button_B_Handler(GPIO_PinState state) {
+  calls_b = (Calls){ calls_b.calls + 1, now, state };
+}
+
+static void Port_Handler(uint16_t changed, uint16_t state) {
+  port_calls++;
+  port_changed = changed;
+  port_state = state;
+  port_time = now;
+}
+
+/**
+ * Sets an input pin, and calls Button_EXTI_Callback if it is an EXTI line
+ * and its level changed.
+ */
+static void Set_Pin(uint16_t pin, uint8_t high) {
+  uint32_t idr = high ? (GPIOE->IDR | pin) : (GPIOE->IDR & ~(uint32_t)pin);
+  uint8_t edge = (idr != GPIOE->IDR);
+  GPIOE->IDR = idr;
+  if (edge && (EXTI->IMR & pin) != 0) {
+      Button_EXTI_Callback(pin);
+  }
+}
+
+// one ms: the timer elapses, if it is running
+static void Tick(void) {
+  now++;
+  if (htim.State == HAL_TIM_STATE_BUSY) {
+      htim.PeriodElapsedCallback(&htim);
+  }
+}
+
+static void Run(uint32_t ms) {
+  while (ms-- > 0) {
+      Tick();
+  }
+}
+
+int main(void) {
+  // PE0 to PE3 routed to EXTI, but PE3's line is given to port A; PE2's
+  // line is masked
+  SYSCFG->EXTICR[0] = (4 << 0) | (4 << 4) | (4 << 8) | (0 << 12);
+  EXTI->IMR = PIN_A | PIN_B | PIN_OTHER;
+  GPIOE->IDR = PIN_A | PIN_B | PIN_UNMASKED | PIN_OTHER;
+
+  CHECK(Init_Button_Begin(&htim, DEBOUNCE_MS) == HAL_OK, "begin");
+  Button *a = Init_Button(GPIOE, PIN_A, GPIO_PIN_SET, Button_A_Handler);
+  Button *b = Init_Button(GPIOE, PIN_B, GPIO_PIN_SET, Button_B_Handler);
+  CHECK(a != NULL && b != NULL, "init");
+  CHECK(Init_Button(GPIOE, PIN_UNMASKED, GPIO_PIN_SET, Button_A_Handler) == NULL, "masked EXTI line accepted");
+  CHECK(Init_Button(GPIOE, PIN_OTHER, GPIO_PIN_SET, Button_A_Handler) == NULL, "EXTI line of port A accepted");
+  CHECK(Init_Button_Finish() == HAL_OK, "finish");
+  CHECK(htim.State == HAL_TIM_STATE_READY, "timer running with nothing settling");
+
+  // an edge on a pin which is not a button starts nothing
+  Set_Pin(PIN_UNMASKED, 0);
+  CHECK(Button_EXTI_Callback(PIN_UNMASKED) == HAL_OK, "unmasked pin");
+  Run(2 * DEBOUNCE_MS);
+  CHECK(htim.State == HAL_TIM_STATE_READY && calls_a.calls == 0 && calls_b.calls == 0,
+        "unmasked pin started the timer");
+
+  // A is pressed cleanly as B starts to chatter, an edge every 2 ms for
+  // 60 ms, ending pressed: A is reported after exactly its debounce time,
+  // B not until it has been pressed for long enough
+  uint32_t pressed = now;
+  Set_Pin(PIN_A, 0);
+  for (uint32_t ms = 0; ms < 60; ms++) {
+      if (ms % 2 == 0) {
+          Set_Pin(PIN_B, ms % 4 == 0);
+      }
+      Tick();
+  }
+  CHECK(calls_a.calls == 1 && calls_a.state == GPIO_PIN_RESET, "A: %u calls", (unsigned)calls_a.calls);
+  CHECK(calls_a.time - pressed == DEBOUNCE_MS, "A reported after %u ms, expected %u",
+        (unsigned)(calls_a.time - pressed), DEBOUNCE_MS);
+  CHECK(calls_b.calls == 0, "chattering B reported");
+
+  uint32_t settled = now;
+  Run(2 * DEBOUNCE_MS);
+  CHECK(calls_b.calls == 1 && calls_b.state == GPIO_PIN_RESET, "B: %u calls", (unsigned)calls_b.calls);
+  CHECK(calls_b.time - settled <= DEBOUNCE_MS, "B reported %u ms after it settled",
+        (unsigned)(calls_b.time - settled));
+  CHECK(htim.State == HAL_TIM_STATE_READY, "timer running after both settled");
+
+  // released, then an 8 ms glitch: the integrator decays, the timer stops,
+  // and the glitch is never reported
+  Set_Pin(PIN_A, 1);
+  Run(2 * DEBOUNCE_MS);
+  CHECK(calls_a.calls == 2 && calls_a.state == GPIO_PIN_SET, "A release: %u calls", (unsigned)calls_a.calls);
+
+  Set_Pin(PIN_A, 0);
+  Run(8);
+  Set_Pin(PIN_A, 1);
+  Run(2 * DEBOUNCE_MS);
+  CHECK(calls_a.calls == 2, "8 ms glitch reported");
+  CHECK(a->integrator == 0 && !a->settling, "A integrator %u after the glitch", a->integrator);
+  CHECK(htim.State == HAL_TIM_STATE_READY, "timer running after the glitch");
+
+  // a glitch which is released before the integrator decays adds up with
+  // the next one, as long as they are within the debounce time together
+  Set_Pin(PIN_A, 0);
+  Run(DEBOUNCE_MS / 2 + 1);
+  Set_Pin(PIN_A, 1);
+  Run(1);
+  Set_Pin(PIN_A, 0);
+  Run(DEBOUNCE_MS);
+  CHECK(calls_a.calls == 3 && calls_a.state == GPIO_PIN_RESET, "A after a bounce: %u calls",
+        (unsigned)calls_a.calls);
+
+  // a longer debounce time only delays its own button
+  CHECK(Button_Set_Debounce(b, 0) == HAL_ERROR, "0 ms debounce");
+  CHECK(Button_Set_Debounce(b, 3 * DEBOUNCE_MS) == HAL_OK, "set debounce");
+  Run(2 * DEBOUNCE_MS);
+  pressed = now;
+  Set_Pin(PIN_A, 1);
+  Set_Pin(PIN_B, 1);
+  Run(4 * DEBOUNCE_MS);
+  CHECK(calls_a.calls == 4 && calls_a.time - pressed == DEBOUNCE_MS, "A released after %u ms",
+        (unsigned)(calls_a.time - pressed));
+  CHECK(calls_b.calls == 2 && calls_b.time - pressed == 3 * DEBOUNCE_MS, "B released after %u ms",
+        (unsigned)(calls_b.time - pressed));
+
+  // a port of polled switches on GPIOD, whose upper byte is not in the mask
+  // and toggles every ms; the timer runs all the time from then on
+  GPIOD->IDR = 0xFFFF;
+  Button_Port *port = Init_Button_Port(GPIOD, PORT_PINS, SCAN_MS, Port_Handler);
+  CHECK(port != NULL && port->state == PORT_PINS, "port init");
+  CHECK(Init_Button_Port(GPIOD, 0, SCAN_MS, Port_Handler) == NULL, "empty port");
+  CHECK(Init_Button_Finish() == HAL_OK && htim.State == HAL_TIM_STATE_BUSY, "port scan not started");
+  uint32_t start = now;
+
+  // pin 0 is pressed cleanly just after a scan, as pin 1 chatters, changing
+  // before every scan: pin 0 changes on the fourth scan, pin 1 never
+  Run(SCAN_MS);
+  pressed = now;
+  GPIOD->IDR &= ~GPIO_PIN_0;
+  for (uint32_t ms = 0; ms < 12 * SCAN_MS; ms++) {
+      if (ms % SCAN_MS == 0) {
+          GPIOD->IDR ^= GPIO_PIN_1;
+      }
+      GPIOD->IDR ^= ~PORT_PINS & 0xFFFF;
+      Tick();
+  }
+  CHECK((pressed - start) % SCAN_MS == 0, "press not aligned to a scan");
+  CHECK(port_calls == 1 && port_changed == GPIO_PIN_0, "port: %u calls, changed 0x%04X",
+        (unsigned)port_calls, port_changed);
+  CHECK(port_time - pressed == 4 * SCAN_MS, "pin 0 reported after %u ms, expected %u",
+        (unsigned)(port_time - pressed), 4 * SCAN_MS);
+  CHECK(port_state == (PORT_PINS & ~GPIO_PIN_0), "port state 0x%04X", port_state);
+
+  // an 8 ms glitch on pin 2, from 1 ms before a scan, is seen by two scans
+  // of the four needed
+  Run(SCAN_MS - 1);
+  GPIOD->IDR &= ~GPIO_PIN_2;
+  Run(8);
+  GPIOD->IDR |= GPIO_PIN_2;
+  Run(8 * SCAN_MS);
+  CHECK(port_calls == 1, "8 ms glitch reported: changed 0x%04X", port_changed);
+
+  // released, and reported with only pins of the mask in the state
+  GPIOD->IDR |= GPIO_PIN_0;
+  for (uint32_t ms = 0; ms < 8 * SCAN_MS; ms++) {
+      GPIOD->IDR ^= ~PORT_PINS & 0xFFFF;
+      Tick();
+  }
+  CHECK(port_calls == 2 && port_changed == GPIO_PIN_0 && port_state == PORT_PINS,
+        "release: %u calls, changed 0x%04X, state 0x%04X", (unsigned)port_calls, port_changed, port_state);
+  CHECK((port->state & ~PORT_PINS) == 0 && (port->count0 | port->count1) == 0,
+        "unmasked pins counted: state 0x%04X, counts 0x%04X 0x%04X", port->state, port->count0, port->count1);
+
+  return CHECK_DONE();
+}
@@ -0,0 +1,196 @@
+/*
+ * test_can_codec.c
+ *
+ * Checks the codecs generated by can_codec.h against the bit-by-bit DBC
+ * reference in host/can_ref.h.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ *    - CAN_Codec_Get/Set for every byte order, start bit and length which
+ *      fits a payload, signed and unsigned, on random payloads
+ *    - every catalog signal's raw and physical accessors, and that a setter
+ *      leaves every other bit of the payload alone
+ *    - whole-message Pack/Unpack round trips
+ *    - a few payloads worked out by hand
+ */
+
+#include "can_codec.h"
+#include "can_ref.h"
+#include "check.h"
+#include <math.h>
+#include <stdlib.h>
+
+typedef struct {
+  const char *name;
+  uint32_t start, length, order, is_signed;
+  float scale, offset;
+  uint32_t (*get_raw)(const uint8_t *data);
+  void (*set_raw)(uint8_t *data, uint32_t raw);
+  float (*get)(const uint8_t *data);
+  void (*set)(uint8_t *data, float value);
+} Signal;
+
+// wrap each signal's accessors in functions of one signature
+#define TEST_ACCESSORS(msg, sig, start, length, order, type, scale, offset)                                         \
+  static uint32_t Get_Raw_##msg##_##sig(const uint8_t *d) { return (uint32_t)CAN_Msg_##msg##_Get_##sig##_Raw(d); } \
+  static void Set_Raw_##msg##_##sig(uint8_t *d, uint32_t raw) { CAN_Msg_##msg##_Set_##sig##_Raw(d, (type)raw); }  \
+  static float Get_##msg##_##sig(const uint8_t *d) { return CAN_Msg_##msg##_Get_##sig(d); }                       \
+  static void Set_##msg##_##sig(uint8_t *d, float value) { CAN_Msg_##msg##_Set_##sig(d, value); }
+#define TEST_MESSAGE_ACCESSORS(name, id, dlc, period) CAN_SIGNALS_##name(TEST_ACCESSORS, name)
+CAN_MSG_LIST(TEST_MESSAGE_ACCESSORS)
+
+#define TEST_SIGNAL(msg, sig, start, length, order, type, scale, offset)                     \
+  { #msg "." #sig, start, length, order, CAN_CODEC_IS_SIGNED(type), scale, offset,         \
+    Get_Raw_##msg##_##sig, Set_Raw_##msg##_##sig, Get_##msg##_##sig, Set_##msg##_##sig },
+#define TEST_MESSAGE_SIGNALS(name, id, dlc, period) CAN_SIGNALS_##name(TEST_SIGNAL, name)
+static const Signal signals[] = { CAN_MSG_LIST(TEST_MESSAGE_SIGNALS) };
+
+#define NUM_SIGNALS (sizeof(signals) / sizeof(signals[0]))
+
+static void Random_Payload(uint8_t *data) {
+  for (uint8_t i = 0; i < 8; i++) {
+      data[i] = (uint8_t)rand();
+  }
+}
+
+static uint32_t Random_Raw(uint32_t length) {
+  uint32_t raw = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ ((uint32_t)rand() << 31);
+  return (length < 32) ? raw & ((1U << length) - 1) : raw;
+}
+
+static uint32_t Sign_Extend(uint32_t raw, uint32_t length, uint32_t is_signed) {
+  if (is_signed && length < 32 && (raw >> (length - 1)) & 1) {
+      return raw | (~0U << length);
+  }
+  return raw;
+}
+
+static void Test_Generic(void) {
+  uint32_t layouts = 0;
+
+  for (uint32_t order = CAN_MSG_LE; order <= CAN_MSG_BE; order++) {
+      for (uint32_t start = 0; start < 64; start++) {
+          for (uint32_t length = 1; length <= 32; length++) {
+              if (!Ref_Fits(start, length, order == CAN_MSG_BE)) {
+                  continue;
+              }
+              layouts++;
+              for (uint32_t trial = 0; trial < 64; trial++) {
+                  uint8_t data[8], expected[8];
+                  Random_Payload(data);
+
+                  for (uint32_t is_signed = 0; is_signed <= 1; is_signed++) {
+                      uint32_t got = CAN_Codec_Get(data, start, length, order, is_signed);
+                      uint32_t want = Ref_Get(data, start, length, order == CAN_MSG_BE, is_signed);
+                      CHECK(got == want, "get order %u start %u length %u signed %u: 0x%08X, expected 0x%08X",
+                            order, start, length, is_signed, got, want);
+                  }
+
+                  uint32_t raw = Random_Raw(length);
+                  memcpy(expected, data, 8);
+                  Ref_Set(expected, start, length, order == CAN_MSG_BE, raw);
+                  CAN_Codec_Set(data, start, length, order, raw);
+                  CHECK(memcmp(data, expected, 8) == 0, "set order %u start %u length %u raw 0x%X",
+                        order, start, length, raw);
+              }
+          }
+      }
+  }
+  printf("generic accessors: %u layouts\n", layouts);
+}
+
+static void Test_Catalog_Signals(void) {
+  for (uint32_t index = 0; index < NUM_SIGNALS; index++) {
+      const Signal *s = &signals[index];
+      uint32_t big_endian = (s->order == CAN_MSG_BE);
+
+      for (uint32_t trial = 0; trial < 10000; trial++) {
+          uint8_t data[8], expected[8];
+          Random_Payload(data);
+
+          uint32_t want = Ref_Get(data, s->start, s->length, big_endian, s->is_signed);
+          CHECK(s->get_raw(data) == want, "%s get raw", s->name);
+
+          float physical = (s->is_signed ? (float)(int32_t)want : (float)want) * s->scale + s->offset;
+          CHECK(s->get(data) == physical, "%s get %f, expected %f", s->name, s->get(data), physical);
+
+          // raw setter only touches its own bits
+          uint32_t raw = Random_Raw(s->length);
+          memcpy(expected, data, 8);
+          Ref_Set(expected, s->start, s->length, big_endian, raw);
+          s->set_raw(data, raw);
+          CHECK(memcmp(data, expected, 8) == 0, "%s set raw 0x%X", s->name, raw);
+
+          // physical setter rounds back to the same raw value
+          float value = (s->is_signed ? (float)(int32_t)Sign_Extend(raw, s->length, 1) : (float)raw) * s->scale
+                        + s->offset;
+          Random_Payload(data);
+          s->set(data, value);
+          CHECK(s->get_raw(data) == Sign_Extend(raw, s->length, s->is_signed),
+                "%s set %f gives raw 0x%X, expected 0x%X", s->name, value, s->get_raw(data), raw);
+      }
+  }
+  printf("catalog signals: %u\n", (unsigned)NUM_SIGNALS);
+}
+
+#define TEST_RANDOM_FIELD(msg, sig, start, length, order, type, scale, offset) \
+  m.sig = (type)Random_Raw(length);
+#define TEST_COMPARE_FIELD(msg, sig, start, length, order, type, scale, offset) \
+  CHECK(n.sig == (type)Sign_Extend((uint32_t)m.sig, length, CAN_CODEC_IS_SIGNED(type)), #msg "." #sig);
+#define TEST_PACK_UNPACK(name, id, dlc, period)                                         \
+  for (uint32_t trial = 0; trial < 1000; trial++) {                                     \
+    CAN_Msg_##name m, n;                                                                \
+    uint8_t data[8];                                                                    \
+    CAN_SIGNALS_##name(TEST_RANDOM_FIELD, name)                                         \
+    Random_Payload(data);                                                               \
+    CAN_Msg_##name##_Pack(data, &m);                                                    \
+    CAN_Msg_##name##_Unpack(data, &n);                                                  \
+    CAN_SIGNALS_##name(TEST_COMPARE_FIELD, name)                                        \
+    for (uint8_t byte = dlc; byte < 8; byte++) {                                        \
+        CHECK(data[byte] == 0, #name " pack leaves byte %d set", byte);                 \
+    }                                                                                   \
+  }
+
+static void Test_Pack_Unpack(void) {
+  CAN_MSG_LIST(TEST_PACK_UNPACK)
+}
+
+static void Test_Hand_Checked(void) {
+  // little endian, signed: 0xFB2E = -1234 rpm; 100 - 40 = 60 degC
+  uint8_t motor[8] = { 0x2E, 0xFB, 0x0A, 0x00, 0xA0, 0x0F, 0x64 };
+  CHECK(CAN_Msg_Motor_Status_Get_Motor_Speed_Raw(motor) == -1234, "Motor_Speed");
+  CHECK(fabsf(CAN_Msg_Motor_Status_Get_Motor_Torque(motor) - 1.0f) < 1e-6f, "Motor_Torque");
+  CHECK(fabsf(CAN_Msg_Motor_Status_Get_DC_Bus_Voltage(motor) - 400.0f) < 1e-3f, "DC_Bus_Voltage");
+  CHECK(CAN_Msg_Motor_Status_Get_Motor_Temp(motor) == 60.0f, "Motor_Temp");
+
+  // big endian: the MSB is in the first byte
+  uint8_t tach[8] = { 0x12, 0x34, 0x00, 0x01, 0xFF, 0xFF, 0x80, 0x00 };
+  CHECK(CAN_Msg_Tach_Speeds_Get_Wheel_Speed_FL_Raw(tach) == 0x1234, "Wheel_Speed_FL");
+  CHECK(CAN_Msg_Tach_Speeds_Get_Wheel_Speed_FR_Raw(tach) == 0x0001, "Wheel_Speed_FR");
+  CHECK(CAN_Msg_Tach_Speeds_Get_Wheel_Speed_RL_Raw(tach) == 0xFFFF, "Wheel_Speed_RL");
+  CHECK(CAN_Msg_Tach_Speeds_Get_Wheel_Speed_RR_Raw(tach) == 0x8000, "Wheel_Speed_RR");
+
+  // big endian, signed: 0xFF85 = -123 = -12.3 deg
+  uint8_t steer[8] = { 0 };
+  CAN_Msg_Steer_Angle_Set_Angle(steer, -12.3f);
+  CAN_Msg_Steer_Angle_Set_Rate_Raw(steer, -2);
+  CHECK(steer[0] == 0xFF && steer[1] == 0x85, "Angle bytes %02X %02X", steer[0], steer[1]);
+  CHECK(steer[2] == 0xFF && steer[3] == 0xFE, "Rate bytes %02X %02X", steer[2], steer[3]);
+
+  // a 10-bit signal leaves the top of its second byte alone
+  uint8_t pedal[8] = { 0, 0xFC };
+  CAN_Msg_Pedal_Status_Set_Throttle_Raw(pedal, 0x3FF);
+  CHECK(pedal[0] == 0xFF && pedal[1] == 0xFF, "Throttle bytes %02X %02X", pedal[0], pedal[1]);
+  CAN_Msg_Pedal_Status_Set_Throttle_Raw(pedal, 0x001);
+  CHECK(pedal[0] == 0x01 && pedal[1] == 0xFC, "Throttle bytes %02X %02X", pedal[0], pedal[1]);
+}
+
+int main(void) {
+  srand(1);
+  Test_Generic();
+  Test_Catalog_Signals();
+  Test_Pack_Unpack();
+  Test_Hand_Checked();
+  return CHECK_DONE();
+}
@@ -0,0 +1,132 @@
+/*
+ * test_can_dispatch.c
+ *
+ * Checks the receive dispatch table of can_codec.h through the whole receive
+ * path of can_std.h: CAN_Codec_RX_Register, the filters it subscribes,
+ * CAN_Std_RX_FIFO_Callback filling the ring from the host CAN FIFOs, and
+ * CAN_Std_RX_Dispatch calling each message's handler with the unpacked frame.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ */
+
+#include "can_codec.h"
+#include "can_std.h"
+#include "check.h"
+#include "host_hal.h"
+
+typedef struct {
+  uint32_t motor_calls, pedal_calls, steer_calls;
+  CAN_Msg_Motor_Status motor;
+  CAN_Msg_Pedal_Status pedal;
+  CAN_Msg_Steer_Angle steer;
+} Received;
+
+static Received received;
+
+// the handler got what Unpack gives
+#define TEST_COMPARE_FIELD(msg, sig, start, length, order, type, scale, offset) \
+  CHECK(received.msg.sig == msg##_msg.sig, #msg "." #sig " %d, expected %d", \
+        (int)received.msg.sig, (int)msg##_msg.sig);
+
+static void Motor_Status_Handler(const CAN_Msg_Motor_Status *msg, void *context) {
+  Received *r = (Received *)context;
+  r->motor_calls++;
+  r->motor = *msg;
+}
+
+static void Pedal_Status_Handler(const CAN_Msg_Pedal_Status *msg, void *context) {
+  Received *r = (Received *)context;
+  r->pedal_calls++;
+  r->pedal = *msg;
+}
+
+static void Steer_Angle_Handler(const CAN_Msg_Steer_Angle *msg, void *context) {
+  Received *r = (Received *)context;
+  r->steer_calls++;
+  r->steer = *msg;
+}
+
+static const CAN_Codec_RX_Table rx_table = {
+  .Motor_Status = Motor_Status_Handler,
+  .Pedal_Status = Pedal_Status_Handler,
+  .Steer_Angle  = Steer_Angle_Handler,
+  .context      = &received,
+};
+
+/**
+ * Receives a frame as the hardware would: into the FIFO of its filter, with
+ * the FilterMatchIndex of the element which matches it.
+ */
+static void Receive(uint16_t id, const uint8_t *data, uint8_t dlc) {
+  static CAN_HandleTypeDef hcan;
+  uint8_t num_banks;
+  const CAN_Filter_Bank *banks = CAN_Filter_Get_Banks(&num_banks);
+
+  for (uint8_t bank = 0; bank < num_banks; bank++) {
+      uint8_t count = (banks[bank].mode == CAN_Filter_List_Mode) ? 4 : 2;
+      for (uint8_t element = 0; element < count; element++) {
+          const CAN_Filter_Element *e = &banks[bank].elements[element];
+          if (((id ^ e->id) & e->mask) != 0) {
+              continue;
+          }
+          uint32_t fifo = (banks[bank].fifo == 0) ? CAN_RX_FIFO0 : CAN_RX_FIFO1;
+          Host_CAN_RX_Push(fifo, id, banks[bank].first_match_index + element, data, dlc);
+          CAN_Std_RX_FIFO_Callback(&hcan, fifo);
+          return;
+      }
+  }
+}
+
+int main(void) {
+  static CAN_HandleTypeDef hcan;
+
+  CHECK(CAN_Codec_RX_Register(&rx_table) == HAL_OK, "register");
+  CHECK(CAN_Std_RX_Init(&hcan) == HAL_OK, "init");
+
+  // only the messages with a handler are subscribed
+  uint8_t fifo;
+  CHECK(CAN_Filter_Accepts(CAN_MSG_Motor_Status, &fifo), "Motor_Status filtered out");
+  CHECK(CAN_Filter_Accepts(CAN_MSG_Steer_Angle, &fifo), "Steer_Angle filtered out");
+  CHECK(!CAN_Filter_Accepts(CAN_MSG_Dash_Status, &fifo), "Dash_Status subscribed");
+  CHECK(!CAN_Filter_Accepts(CAN_MSG_AMS_Status, &fifo), "AMS_Status subscribed");
+
+  // the same payloads as test_can_codec.c
+  const uint8_t motor[8] = { 0x2E, 0xFB, 0x0A, 0x00, 0xA0, 0x0F, 0x64 };
+  const uint8_t steer[8] = { 0xFF, 0x85, 0xFF, 0xFE };
+  const uint8_t pedal[8] = { 0xFF, 0xFF, 0x00, 0x00, 0x00 };
+
+  Receive(CAN_MSG_Motor_Status, motor, CAN_MSG_Motor_Status_DLC);
+  Receive(CAN_MSG_Steer_Angle, steer, CAN_MSG_Steer_Angle_DLC);
+  Receive(CAN_MSG_Pedal_Status, pedal, CAN_MSG_Pedal_Status_DLC);
+  // a short frame is dispatched, but never reaches the handler
+  Receive(CAN_MSG_Motor_Status, motor, CAN_MSG_Motor_Status_DLC - 1);
+
+  CHECK(CAN_Std_RX_Dispatch(8) == 4, "dispatched");
+  CHECK(received.motor_calls == 1, "Motor_Status handled %u times", received.motor_calls);
+  CHECK(received.steer_calls == 1, "Steer_Angle handled %u times", received.steer_calls);
+  CHECK(received.pedal_calls == 1, "Pedal_Status handled %u times", received.pedal_calls);
+
+  CAN_Msg_Motor_Status motor_msg;
+  CAN_Msg_Steer_Angle steer_msg;
+  CAN_Msg_Pedal_Status pedal_msg;
+  CAN_Msg_Motor_Status_Unpack(motor, &motor_msg);
+  CAN_Msg_Steer_Angle_Unpack(steer, &steer_msg);
+  CAN_Msg_Pedal_Status_Unpack(pedal, &pedal_msg);
+  CAN_SIGNALS_Motor_Status(TEST_COMPARE_FIELD, motor)
+  CAN_SIGNALS_Steer_Angle(TEST_COMPARE_FIELD, steer)
+  CAN_SIGNALS_Pedal_Status(TEST_COMPARE_FIELD, pedal)
+  CHECK(received.motor.Motor_Speed == -1234, "Motor_Speed %d", received.motor.Motor_Speed);
+  CHECK(received.steer.Angle == -123, "Angle %d", received.steer.Angle);
+  CHECK(received.pedal.Throttle == 0x3FF, "Throttle 0x%X", received.pedal.Throttle);
+
+  CAN_Std_RX_Stats stats;
+  CAN_Std_RX_Get_Stats(&stats);
+  CHECK(stats.received == 4 && stats.unhandled == 0, "received %u, unhandled %u",
+        (unsigned)stats.received, (unsigned)stats.unhandled);
+
+  // a message can only have one handler
+  CHECK(CAN_Codec_RX_Register(&rx_table) == HAL_ERROR, "registered twice");
+
+  return CHECK_DONE();
+}
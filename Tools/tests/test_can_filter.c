@@ -0,0 +1,243 @@
+/*
+ * test_can_filter.c
+ *
+ * Checks the filter bank allocator (can_filter.h) against a model of the
+ * bxCAN filters, evaluated from the register values CAN_Filter_Apply hands
+ * to HAL_CAN_ConfigFilter.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * For every scenario, each of the 2048 standard IDs is run through the
+ * model, which checks that:
+ *    - every subscribed ID is accepted, into FIFO0 below
+ *      CAN_FILTER_FIFO1_FIRST_ID and FIFO1 from it
+ *    - CAN_Filter_Accepts agrees with the model on every ID
+ *    - the FilterMatchIndex the hardware would report names an element of
+ *      the allocated banks which matches the ID (what CAN_Std_RX_Dispatch
+ *      relies on)
+ *    - CAN_Filter_Get_Report counts exactly the IDs the model accepts
+ *    - exact subscriptions which fit the banks never false-accept
+ */
+
+#include "can_filter.h"
+#include "check.h"
+#include "host_hal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_IDS 2048
+
+typedef struct {
+  uint8_t accepted;
+  uint8_t fifo;
+  uint8_t match_index;
+} Hardware_Match;
+
+static uint8_t subscribed[NUM_IDS];
+
+/**
+ * Filters an ID as the bxCAN does: in 16-bit scale every bank holds four
+ * (list) or two (mask) filters, numbered per FIFO in bank order. When several
+ * match, a list filter wins over a mask filter, then the lowest number.
+ */
+static Hardware_Match Hardware_Filter(uint16_t id) {
+  Hardware_Match match = { 0 };
+  uint8_t next_index[2] = { 0, 0 };
+  uint8_t best_is_list = 0;
+  uint16_t frame = (uint16_t)(id << 5);   // STDID[10:0], RTR = 0, IDE = 0, EXID[17:15] = 0
+
+  for (uint8_t bank = 0; bank < HOST_CAN_NUM_FILTER_BANKS; bank++) {
+      const CAN_FilterTypeDef *filter = &host_can_filters[bank];
+      if (filter->FilterActivation != CAN_FILTER_ENABLE) {
+          continue;
+      }
+      uint8_t fifo = (filter->FilterFIFOAssignment == CAN_FILTER_FIFO0) ? 0 : 1;
+      uint8_t is_list = (filter->FilterMode == CAN_FILTERMODE_IDLIST);
+
+      uint16_t ids[4], masks[4];
+      uint8_t count;
+      if (is_list) {
+          ids[0] = filter->FilterIdLow;
+          ids[1] = filter->FilterMaskIdLow;
+          ids[2] = filter->FilterIdHigh;
+          ids[3] = filter->FilterMaskIdHigh;
+          masks[0] = masks[1] = masks[2] = masks[3] = 0xFFFF;
+          count = 4;
+      }
+      else {
+          ids[0] = filter->FilterIdLow;
+          masks[0] = filter->FilterMaskIdLow;
+          ids[1] = filter->FilterIdHigh;
+          masks[1] = filter->FilterMaskIdHigh;
+          count = 2;
+      }
+
+      for (uint8_t index = 0; index < count; index++) {
+          uint8_t number = next_index[fifo]++;
+          if (((frame ^ ids[index]) & masks[index]) != 0) {
+              continue;
+          }
+          uint8_t is_better = !match.accepted || (is_list && !best_is_list);
+          if (is_better) {
+              match = (Hardware_Match){ 1, fifo, number };
+              best_is_list = is_list;
+          }
+      }
+  }
+  return match;
+}
+
+/**
+ * @retval 1 if the allocated bank element the hardware would report matches the ID
+ */
+static uint8_t Match_Index_Names_ID(uint16_t id, const Hardware_Match *match) {
+  uint8_t num_banks;
+  const CAN_Filter_Bank *banks = CAN_Filter_Get_Banks(&num_banks);
+
+  for (uint8_t bank = 0; bank < num_banks; bank++) {
+      uint8_t count = (banks[bank].mode == CAN_Filter_List_Mode) ? 4 : 2;
+      if (banks[bank].fifo != match->fifo ||
+          match->match_index < banks[bank].first_match_index ||
+          match->match_index >= banks[bank].first_match_index + count) {
+          continue;
+      }
+      const CAN_Filter_Element *element = &banks[bank].elements[match->match_index - banks[bank].first_match_index];
+      return ((id ^ element->id) & element->mask) == 0;
+  }
+  return 0;
+}
+
+static void Subscribe(uint16_t id) {
+  subscribed[id] = 1;
+  CAN_Filter_Subscribe(id);
+}
+
+static void Subscribe_Range(uint16_t first, uint16_t last) {
+  memset(&subscribed[first], 1, last - first + 1);
+  CAN_Filter_Subscribe_Range(first, last);
+}
+
+static void Begin(void) {
+  CAN_Filter_Reset();
+  Host_HAL_Reset();
+  memset(subscribed, 0, sizeof(subscribed));
+}
+
+/**
+ * Applies the subscriptions and checks every ID against the model.
+ *
+ * @param name         printed with the report
+ * @param accept_all   1 if nothing is subscribed
+ * @param exact        1 if no false accepts are allowed
+ */
+static void Check_Scenario(const char *name, uint8_t accept_all, uint8_t exact) {
+  static CAN_HandleTypeDef hcan;
+
+  CHECK(CAN_Filter_Apply(&hcan) == HAL_OK, "%s: apply failed", name);
+
+  uint16_t num_subscribed = 0, num_accepted = 0, num_false = 0;
+  for (uint16_t id = 0; id < NUM_IDS; id++) {
+      Hardware_Match match = Hardware_Filter(id);
+      uint8_t fifo = 0xFF;
+      uint8_t accepts = CAN_Filter_Accepts(id, &fifo);
+
+      num_subscribed += subscribed[id];
+      num_accepted += match.accepted;
+      num_false += match.accepted && !subscribed[id];
+
+      CHECK(accepts == match.accepted, "%s: 0x%03X accepts %d, hardware %d", name, id, accepts, match.accepted);
+      if (subscribed[id] || accept_all) {
+          uint8_t expected_fifo = (accept_all || id < CAN_FILTER_FIFO1_FIRST_ID) ? 0 : 1;
+          CHECK(match.accepted, "%s: subscribed 0x%03X is rejected", name, id);
+          CHECK(match.fifo == expected_fifo, "%s: 0x%03X into FIFO%d", name, id, match.fifo);
+      }
+      if (match.accepted) {
+          CHECK(fifo == match.fifo, "%s: 0x%03X FIFO%d, hardware FIFO%d", name, id, fifo, match.fifo);
+          CHECK(Match_Index_Names_ID(id, &match), "%s: 0x%03X match index %d names another element",
+                name, id, match.match_index);
+      }
+  }
+
+  CAN_Filter_Report report;
+  CAN_Filter_Get_Report(&report);
+  CHECK(report.subscribed_ids == num_subscribed, "%s: report subscribed %d, expected %d",
+        name, report.subscribed_ids, num_subscribed);
+  CHECK(report.accepted_ids == num_accepted, "%s: report accepted %d, hardware %d",
+        name, report.accepted_ids, num_accepted);
+  CHECK(report.false_accepts == num_false, "%s: report false accepts %d, hardware %d",
+        name, report.false_accepts, num_false);
+  CHECK(report.banks_used <= CAN_FILTER_NUM_BANKS, "%s: %d banks", name, report.banks_used);
+  CHECK(host_can_filters[CAN_FILTER_NUM_BANKS].FilterActivation != CAN_FILTER_ENABLE,
+        "%s: CAN2 bank configured", name);
+  if (exact) {
+      CHECK(num_false == 0, "%s: %d false accepts", name, num_false);
+  }
+
+  printf("%-12s subscribed %4d  accepted %4d  false %4d (%3d.%d%%)  banks %2d  merges %3d\n",
+         name, report.subscribed_ids, report.accepted_ids, report.false_accepts,
+         report.false_accept_permille / 10, report.false_accept_permille % 10,
+         report.banks_used, report.merges);
+}
+
+int main(void) {
+  Begin();
+  Check_Scenario("empty", 1, 0);
+
+  // the catalog IDs, plus the AMS range
+  Begin();
+  Subscribe_Range(0x010, 0x01F);
+  Subscribe(0x030);
+  Subscribe(0x031);
+  Subscribe(0x050);
+  Subscribe(0x400);
+  Subscribe(0x410);
+  Check_Scenario("catalog", 0, 1);
+
+  // a range over the FIFO boundary, and unaligned ranges
+  Begin();
+  Subscribe_Range(0x3FE, 0x401);
+  Subscribe_Range(0x123, 0x17D);
+  Subscribe_Range(0x5FF, 0x600);
+  Check_Scenario("ranges", 0, 1);
+
+  // 108 isolated IDs fill all 27 banks as lists, with nothing merged
+  Begin();
+  for (uint16_t i = 0; i < 56; i++) {
+      Subscribe(1 + 3 * i);
+  }
+  for (uint16_t i = 0; i < 52; i++) {
+      Subscribe(CAN_FILTER_FIFO1_FIRST_ID + 1 + 3 * i);
+  }
+  Check_Scenario("108 exact", 0, 1);
+
+  // one more than fits forces a merge
+  Subscribe(0x7F0);
+  Check_Scenario("109 exact", 0, 0);
+
+  // scattered IDs, up to far more than fit
+  srand(1);
+  for (uint16_t round = 0; round < 20; round++) {
+      Begin();
+      uint16_t num_ids = 50 + rand() % 150;
+      for (uint16_t i = 0; i < num_ids; i++) {
+          Subscribe(rand() % NUM_IDS);
+      }
+      char name[16];
+      snprintf(name, sizeof(name), "random %d", num_ids);
+      Check_Scenario(name, 0, 0);
+  }
+
+  Begin();
+  Subscribe_Range(0, NUM_IDS - 1);
+  Check_Scenario("all", 0, 1);
+
+  // more blocks than CAN_FILTER_MAX_ELEMENTS in one FIFO is refused
+  Begin();
+  for (uint16_t i = 0; i <= CAN_FILTER_MAX_ELEMENTS; i++) {
+      Subscribe(2 * i);
+  }
+  CHECK(CAN_Filter_Allocate() == HAL_ERROR, "%d blocks allocated", CAN_FILTER_MAX_ELEMENTS + 1);
+
+  return CHECK_DONE();
+}
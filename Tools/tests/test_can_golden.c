@@ -0,0 +1,98 @@
+/*
+ * test_can_golden.c
+ *
+ * Checks the generator end to end: the catalog Tools/dbc_to_can_msgs.py
+ * writes for fixtures/golden.dbc must equal fixtures/golden_msgs.h, which is
+ * written by hand (the Makefile diffs the two), and the codecs can_codec.h
+ * expands from it must decode payloads worked out by hand.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Built against the generated header, so a generator bug shows up either
+ * in the diff or here, even where --check on the car catalog passes.
+ */
+
+#include "can_codec.h"
+#include "check.h"
+#include <math.h>
+
+static void Test_Constants(void) {
+  CHECK(CAN_MSG_Golden_Fault == 0x003, "Golden_Fault ID 0x%03X", CAN_MSG_Golden_Fault);
+  CHECK(CAN_MSG_Golden_Intel == 0x015, "Golden_Intel ID 0x%03X", CAN_MSG_Golden_Intel);
+  CHECK(CAN_MSG_Golden_Motorola == 0x412, "Golden_Motorola ID 0x%03X", CAN_MSG_Golden_Motorola);
+  CHECK(CAN_MSG_Golden_Debug == 0x7FF, "Golden_Debug ID 0x%03X", CAN_MSG_Golden_Debug);
+
+  CHECK(CAN_MSG_Golden_Fault_DLC == 1 && CAN_MSG_Golden_Motorola_DLC == 6, "DLC");
+  CHECK(CAN_MSG_Golden_Fault_PERIOD == 5 && CAN_MSG_Golden_Intel_PERIOD == 100 &&
+        CAN_MSG_Golden_Motorola_PERIOD == 20, "period");
+  CHECK(CAN_MSG_Golden_Debug_PERIOD == 0, "no cycle time gives period %d", CAN_MSG_Golden_Debug_PERIOD);
+}
+
+static void Test_Intel(void) {
+  // 7 + 1 bits sharing one byte: 0xA5 = 1 0100101
+  uint8_t fault[8] = { 0xA5 };
+  CHECK(CAN_Msg_Golden_Fault_Get_Code_Raw(fault) == 0x25, "Code");
+  CHECK(CAN_Msg_Golden_Fault_Get_Latched_Raw(fault) == 1, "Latched");
+
+  // 0xC8 = 200 * 0.5 - 40 = 60 degC
+  // Unaligned, bits 12..23: 0xFF in byte 2, 0xD in the top of byte 1 = 0xFFD = -3 = -0.75 A
+  // Flag is bit 0 of byte 3, clear among set bits
+  // Wide: 0xFFFE7960 = -100000 = -1.0
+  uint8_t intel[8] = { 0xC8, 0xD7, 0xFF, 0xFE, 0x60, 0x79, 0xFE, 0xFF };
+  CHECK(CAN_Msg_Golden_Intel_Get_Offset_Temp(intel) == 60.0f, "Offset_Temp %f", CAN_Msg_Golden_Intel_Get_Offset_Temp(intel));
+  CHECK(CAN_Msg_Golden_Intel_Get_Unaligned_Raw(intel) == -3, "Unaligned raw %d",
+        CAN_Msg_Golden_Intel_Get_Unaligned_Raw(intel));
+  CHECK(CAN_Msg_Golden_Intel_Get_Unaligned(intel) == -0.75f, "Unaligned");
+  CHECK(CAN_Msg_Golden_Intel_Get_Flag_Raw(intel) == 0, "Flag");
+  CHECK(CAN_Msg_Golden_Intel_Get_Wide_Raw(intel) == -100000, "Wide raw");
+  CHECK(fabsf(CAN_Msg_Golden_Intel_Get_Wide(intel) + 1.0f) < 1e-6f, "Wide");
+
+  // packing leaves the junk out
+  CAN_Msg_Golden_Intel m = { .Offset_Temp = 200, .Unaligned = -3, .Flag = 1, .Wide = -100000 };
+  uint8_t packed[8] = { 0 };
+  const uint8_t expected[8] = { 0xC8, 0xD0, 0xFF, 0x01, 0x60, 0x79, 0xFE, 0xFF };
+  CAN_Msg_Golden_Intel_Pack(packed, &m);
+  CHECK(memcmp(packed, expected, 8) == 0, "Golden_Intel pack %02X %02X %02X %02X",
+        packed[0], packed[1], packed[2], packed[3]);
+}
+
+static void Test_Motorola(void) {
+  // Nibble_Span, MSB at bit 3: the low nibble of byte 0, then byte 1 = 0xABC
+  // Signed_Ten, MSB at bit 21: bits 5..0 of byte 2 = 111001, bits 7..4 of byte 3 = 1100
+  //   = 0x39C = -100 = -100 * 0.1 + 5 = -5 deg
+  // Byte_Pair, MSB at bit 39: byte 4 then byte 5 = 0x1234 = 46.60 bar
+  uint8_t motorola[8] = { 0x5A, 0xBC, 0xF9, 0xC3, 0x12, 0x34 };
+  CHECK(CAN_Msg_Golden_Motorola_Get_Nibble_Span_Raw(motorola) == 0xABC, "Nibble_Span 0x%X",
+        CAN_Msg_Golden_Motorola_Get_Nibble_Span_Raw(motorola));
+  CHECK(CAN_Msg_Golden_Motorola_Get_Signed_Ten_Raw(motorola) == -100, "Signed_Ten raw %d",
+        CAN_Msg_Golden_Motorola_Get_Signed_Ten_Raw(motorola));
+  CHECK(fabsf(CAN_Msg_Golden_Motorola_Get_Signed_Ten(motorola) + 5.0f) < 1e-5f, "Signed_Ten");
+  CHECK(CAN_Msg_Golden_Motorola_Get_Byte_Pair_Raw(motorola) == 0x1234, "Byte_Pair");
+  CHECK(fabsf(CAN_Msg_Golden_Motorola_Get_Byte_Pair(motorola) - 46.6f) < 1e-4f, "Byte_Pair");
+
+  CAN_Msg_Golden_Motorola m = { .Nibble_Span = 0xABC, .Signed_Ten = -100, .Byte_Pair = 0x1234 };
+  uint8_t packed[8] = { 0 };
+  const uint8_t expected[8] = { 0x0A, 0xBC, 0x39, 0xC0, 0x12, 0x34, 0x00, 0x00 };
+  CAN_Msg_Golden_Motorola_Pack(packed, &m);
+  CHECK(memcmp(packed, expected, 8) == 0, "Golden_Motorola pack %02X %02X %02X %02X",
+        packed[0], packed[1], packed[2], packed[3]);
+
+  // physical setter: 12.3 deg = (12.3 - 5) / 0.1 = 73 = 0x049
+  uint8_t data[8] = { 0 };
+  CAN_Msg_Golden_Motorola_Set_Signed_Ten(data, 12.3f);
+  CHECK(data[2] == 0x04 && data[3] == 0x90, "Signed_Ten bytes %02X %02X", data[2], data[3]);
+}
+
+static void Test_Last_Byte(void) {
+  uint8_t debug[8] = { 0, 0, 0, 0, 0, 0, 0, 0x9C };
+  CHECK(CAN_Msg_Golden_Debug_Get_Counter_Raw(debug) == 0x9C, "Counter");
+}
+
+int main(void) {
+  Test_Constants();
+  Test_Intel();
+  Test_Motorola();
+  Test_Last_Byte();
+  return CHECK_DONE();
+}
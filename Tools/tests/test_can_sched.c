@@ -0,0 +1,167 @@
+/*
+ * test_can_sched.c
+ *
+ * Checks the cyclic transmit scheduler of can_sched.h: that the phase
+ * offsets CAN_Sched_Start assigns spread the messages over the hyperperiod,
+ * and that the jitter is measured between transmissions, from the simulated
+ * timer and the completed host CAN mailboxes.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ */
+
+#include "can_sched.h"
+#include "can_std.h"
+#include "check.h"
+#include "host_hal.h"
+#include <string.h>
+
+#define TEST_CYCLES_PER_TICK (SystemCoreClock / 1000 * CAN_SCHED_TICK_MS)
+#define TEST_CYCLES_PER_US   (SystemCoreClock / 1000000)
+
+static CAN_HandleTypeDef hcan;
+static TIM_TypeDef tim;
+static TIM_HandleTypeDef htim = { .Instance = &tim };
+
+static uint8_t Send_Producer(uint8_t *data, void *context) {
+  return 1;
+}
+
+// skips the periods listed in context, counted from 1 and ended by 0
+static uint8_t Skip_Producer(uint8_t *data, void *context) {
+  static uint32_t calls;
+  const uint32_t *skip = (const uint32_t *)context;
+  calls++;
+  for (; *skip != 0; skip++) {
+      if (*skip == calls) {
+          return 0;
+      }
+  }
+  return 1;
+}
+
+/**
+ * Registers the given periods (ms), starts the scheduler, and checks that the
+ * busiest tick of the hyperperiod holds peak messages.
+ */
+static void Check_Spread(const char *name, const uint16_t *periods, uint8_t count, uint8_t peak) {
+  static CAN_Sched_Message *registered[CAN_SCHED_MAX_MESSAGES];
+  static uint8_t load[CAN_SCHED_MAX_HYPERPERIOD];
+
+  CAN_Sched_Init(&htim);
+  uint32_t hyperperiod = 1;
+  for (uint8_t index = 0; index < count; index++) {
+      registered[index] = CAN_Sched_Register(0x100 + index, 8, periods[index], Send_Producer, NULL);
+      CHECK(registered[index] != NULL, "%s: register %u", name, index);
+      uint32_t a = hyperperiod, b = periods[index];
+      while (b != 0) {
+          uint32_t t = a % b;
+          a = b;
+          b = t;
+      }
+      hyperperiod = hyperperiod / a * periods[index];
+  }
+  CHECK(hyperperiod <= CAN_SCHED_MAX_HYPERPERIOD, "%s: hyperperiod %u", name, (unsigned)hyperperiod);
+  CHECK(CAN_Sched_Start() == HAL_OK, "%s: start", name);
+  CAN_Sched_Stop();
+
+  memset(load, 0, sizeof(load));
+  for (uint8_t index = 0; index < count; index++) {
+      CAN_Sched_Stats stats;
+      CAN_Sched_Get_Stats(registered[index], &stats);
+      CHECK(stats.offset < periods[index], "%s: offset %u of period %u",
+            name, stats.offset, periods[index]);
+      for (uint32_t tick = stats.offset; tick < hyperperiod; tick += periods[index]) {
+          load[tick]++;
+      }
+  }
+
+  uint8_t busiest = 0;
+  for (uint32_t tick = 0; tick < hyperperiod; tick++) {
+      if (load[tick] > busiest) {
+          busiest = load[tick];
+      }
+  }
+  CHECK(busiest == peak, "%s: busiest tick has %u messages, expected %u", name, busiest, peak);
+}
+
+/**
+ * Runs the scheduler for the given number of ticks. Every frame it queues
+ * completes delay[n] us after the tick which queued it, n counting the
+ * frames from 0 (the last delay repeats).
+ */
+static void Run(uint32_t ticks, const uint32_t *delays, uint32_t num_delays) {
+  uint32_t frames = 0;
+  for (uint32_t tick = 1; tick <= ticks; tick++) {
+      uint32_t start = tick * TEST_CYCLES_PER_TICK;
+      host_dwt.CYCCNT = start;
+      uint32_t count = host_can_tx_count;
+      htim.PeriodElapsedCallback(&htim);
+
+      for (; count < host_can_tx_count; count++, frames++) {
+          uint32_t delay = delays[(frames < num_delays) ? frames : num_delays - 1];
+          uint32_t mailbox = host_can_tx_log[count].mailbox;
+          host_dwt.CYCCNT = start + delay * TEST_CYCLES_PER_US;
+          Host_CAN_TX_Complete(mailbox);
+          CAN_Std_TX_Mailbox_Callback(&hcan, 31 - __CLZ(mailbox), 1);
+      }
+  }
+}
+
+int main(void) {
+  CHECK(CAN_Std_TX_Init(&hcan) == HAL_OK, "TX init");
+
+  // the offsets: equal periods take a tick each, mixed periods fill the gaps
+  // of the shorter ones, and an overloaded period is spread evenly
+  const uint16_t ten[10] = { 10, 10, 10, 10, 10, 10, 10, 10, 10, 10 };
+  Check_Spread("10 x 10 ms", ten, 10, 1);
+  const uint16_t mixed[12] = { 100, 20, 10, 100, 20, 10, 100, 20, 10, 100, 20, 10 };
+  Check_Spread("4 x 10, 20 and 100 ms", mixed, 12, 1);
+  const uint16_t crowded[25] = { 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+                                 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10 };
+  Check_Spread("25 x 10 ms", crowded, 25, 3);
+  // coprime periods meet on some tick whatever their offsets
+  const uint16_t coprime[3] = { 2, 3, 5 };
+  Check_Spread("2, 3 and 5 ms", coprime, 3, 3);
+
+  CAN_Sched_Stats stats;
+
+  // a frame held in the queue 250 us longer than the others is seen twice,
+  // late then early, and the timer interrupt never was late
+  Host_HAL_Reset();
+  CAN_Sched_Init(&htim);
+  CAN_Sched_Message *message = CAN_Sched_Register(0x123, 8, 10, Send_Producer, NULL);
+  CAN_Sched_Start();
+  const uint32_t held[] = { 100, 100, 100, 350, 100 };
+  Run(100, held, 5);
+  CAN_Sched_Stop();
+  CAN_Sched_Get_Stats(message, &stats);
+  CHECK(stats.sent == 10, "sent %u", (unsigned)stats.sent);
+  CHECK(stats.max_jitter == 250, "jitter %u us, expected 250", (unsigned)stats.max_jitter);
+
+  // a constant delay is no jitter
+  Host_HAL_Reset();
+  CAN_Sched_Init(&htim);
+  message = CAN_Sched_Register(0x123, 8, 10, Send_Producer, NULL);
+  CAN_Sched_Start();
+  const uint32_t constant[] = { 400 };
+  Run(100, constant, 1);
+  CAN_Sched_Stop();
+  CAN_Sched_Get_Stats(message, &stats);
+  CHECK(stats.max_jitter == 0, "constant delay: jitter %u us", (unsigned)stats.max_jitter);
+
+  // the 20 ms across a skipped period is not a period late
+  Host_HAL_Reset();
+  CAN_Sched_Init(&htim);
+  static const uint32_t skip[] = { 3, 7, 8, 0 };
+  message = CAN_Sched_Register(0x123, 8, 10, Skip_Producer, (void *)skip);
+  CAN_Sched_Start();
+  Run(100, constant, 1);
+  CAN_Sched_Stop();
+  CAN_Sched_Get_Stats(message, &stats);
+  CHECK(stats.sent == 7 && stats.skipped == 3, "sent %u, skipped %u",
+        (unsigned)stats.sent, (unsigned)stats.skipped);
+  CHECK(stats.max_jitter == 0, "skipped periods: jitter %u us", (unsigned)stats.max_jitter);
+
+  return CHECK_DONE();
+}
@@ -0,0 +1,307 @@
+/*
+ * test_seven_seg_fixed.c
+ *
+ * Checks Seven_Seg_Render_Fixed against an independent int64 reference,
+ * over every value within +/-2,000,000 and random values over the whole
+ * int32 range, for every number of decimals. Then checks the float path,
+ * Seven_Seg_Render_Decimal, around every rounding boundary and at random.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * The rendered bytes are decoded back to text ("1.2.", "-.5", "--") with
+ * glyphs taken from Seven_Seg_Render_Chars, and compared with the text the
+ * reference formats. The reference rounds each format from the exact value
+ * in 64 bits, (2|v| + d) / 2d, so it shares no code with the library's
+ * overflow checks and power of ten table.
+ *
+ * A float is rounded from its exact value, in double. The library rounds
+ * float products (val * 10.0f), which can themselves round onto a boundary,
+ * and rounds values of 100 or more to thousandths before the display's
+ * digits, so a result which differs from the exact one must equal the
+ * result for those steps; such cases are counted and printed.
+ */
+
+#include "seven_seg.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define SPAN        2000000
+#define NUM_RANDOM  1000000
+
+static uint8_t left_glyphs[11], right_glyphs[11];   // '0'-'9', then '-'
+
+static void Load_Glyphs(void) {
+  const char *chars = "0123456789-";
+  for (uint8_t i = 0; i < 11; i++) {
+      uint8_t data[2];
+      char text[2] = { chars[i], chars[i] };
+      Seven_Seg_Render_Chars(text, 0, 0, data);
+      right_glyphs[i] = data[0];
+      left_glyphs[i] = data[1];
+  }
+}
+
+static char Decode_Glyph(const uint8_t glyphs[11], uint8_t glyph) {
+  for (uint8_t i = 0; i < 11; i++) {
+      if (glyphs[i] == glyph) {
+          return "0123456789-"[i];
+      }
+  }
+  return '?';
+}
+
+/**
+ * Decodes two rendered bytes to text, a '.' following each lit point.
+ */
+static void Decode(const uint8_t data[2], char *text) {
+  *text++ = Decode_Glyph(left_glyphs, data[1] & ~SEVEN_SEG_LEFT_DP);
+  if (data[1] & SEVEN_SEG_LEFT_DP) {
+      *text++ = '.';
+  }
+  *text++ = Decode_Glyph(right_glyphs, data[0] & ~SEVEN_SEG_RIGHT_DP);
+  if (data[0] & SEVEN_SEG_RIGHT_DP) {
+      *text++ = '.';
+  }
+  *text = '\0';
+}
+
+/**
+ * @retval value * 10^shift, rounded half away from zero
+ */
+static int64_t Ref_Scale(int64_t value, int shift) {
+  int64_t scale = 1;
+  for (int i = 0; i < abs(shift); i++) {
+      scale *= 10;
+  }
+  if (shift >= 0) {
+      return value * scale;
+  }
+  int64_t magnitude = llabs(value);
+  int64_t rounded = (2 * magnitude + scale) / (2 * scale);
+  return (value < 0) ? -rounded : rounded;
+}
+
+/**
+ * Formats value / 10^decimals as the display should show it.
+ */
+static void Ref_Fixed(int64_t value, int decimals, char *text) {
+  int64_t tenths = Ref_Scale(value, 1 - decimals);
+  if (tenths >= 0 && tenths < 100) {
+      sprintf(text, "%d.%d", (int)(tenths / 10), (int)(tenths % 10));
+      return;
+  }
+  if (tenths < 0 && tenths > -10) {
+      sprintf(text, "-.%d", (int)-tenths);
+      return;
+  }
+
+  int64_t units = Ref_Scale(value, -decimals);
+  if (units < 0) {
+      if (units > -10) {
+          sprintf(text, "-%d", (int)-units);
+      }
+      else {
+          strcpy(text, "--");
+      }
+      return;
+  }
+  if (units < 100) {
+      sprintf(text, "%02d", (int)units);
+      return;
+  }
+
+  int64_t hundreds = Ref_Scale(value, -2 - decimals);
+  if (hundreds < 100) {
+      sprintf(text, "%d.%d.", (int)(hundreds / 10), (int)(hundreds % 10));
+      return;
+  }
+
+  int64_t thousands = Ref_Scale(value, -3 - decimals);
+  if (thousands < 100) {
+      sprintf(text, "%02d.", (int)thousands);
+      return;
+  }
+  strcpy(text, "--");
+}
+
+/**
+ * @retval 1 if the value renders as the reference formats it
+ */
+static uint8_t Fixed_OK(int32_t value, uint8_t decimals) {
+  uint8_t data[2];
+  char got[8], expected[8];
+
+  if (Seven_Seg_Render_Fixed(value, decimals, data) != HAL_OK) {
+      return 0;
+  }
+  Decode(data, got);
+  Ref_Fixed(value, decimals, expected);
+  if (strcmp(got, expected) != 0) {
+      printf("  %d, %u decimals: \"%s\", expected \"%s\"\n", value, decimals, got, expected);
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @retval value rounded half away from zero (exact for these doubles, which
+ *         are floats times a power of ten)
+ */
+static int64_t Ref_Round(double value) {
+  return (value < 0) ? -(int64_t)floor(-value + 0.5) : (int64_t)floor(value + 0.5);
+}
+
+/**
+ * Formats a float as the display should show it, rounding its exact value,
+ * or if exact is 0, rounding as the library does.
+ */
+static void Ref_Decimal(float val, uint8_t exact, char *text) {
+  double tenths_value = exact ? (double)val * 10 : (double)(val * 10.0f);
+  double thousandths_value = exact ? (double)val * 1000 : (double)(val * 1000.0f);
+
+  if (val > -1.0f && val < 10.0f) {
+      int64_t tenths = Ref_Round(tenths_value);
+      if (tenths >= -9 && tenths <= 99) {
+          Ref_Fixed(tenths, 1, text);
+          return;
+      }
+  }
+  if (val > -10.0f && val < 100.0f) {
+      int64_t units = Ref_Round(val);
+      if (units >= -9 && units <= 99) {
+          Ref_Fixed(units, 0, text);
+          return;
+      }
+  }
+  if (!(val > -10.0f && val < 100000.0f)) {
+      strcpy(text, "--");
+      return;
+  }
+  Ref_Fixed(Ref_Round(thousandths_value), 3, text);
+}
+
+static uint32_t product_rounded;   // results which differ from rounding the exact value
+
+/**
+ * @retval 1 if the float renders as the reference formats it
+ */
+static uint8_t Decimal_OK(float val) {
+  uint8_t data[2];
+  char got[8], exact[8], product[8];
+
+  Seven_Seg_Render_Decimal(val, data);
+  Decode(data, got);
+  Ref_Decimal(val, 1, exact);
+  if (strcmp(got, exact) == 0) {
+      return 1;
+  }
+  Ref_Decimal(val, 0, product);
+  if (strcmp(got, product) == 0) {
+      product_rounded++;
+      return 1;
+  }
+  printf("  %.9g: \"%s\", expected \"%s\"\n", val, got, exact);
+  return 0;
+}
+
+static void Test_Examples(void) {
+  // the examples of seven_seg.h, in thousandths
+  static const struct { int32_t value; const char *text; } examples[] = {
+      { 3460, "3.5" }, { 59500, "60" }, { 1234000, "1.2." }, { 56789000, "57." },
+      { -500, "-.5" }, { -5000, "-5" }, { -9500, "--" }, { 99499000, "99." },
+      { 99500000, "--" }, { 0, "0.0" }, { -49, "0.0" }, { -50, "-.1" },
+  };
+  for (uint32_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+      uint8_t data[2];
+      char text[8];
+      Seven_Seg_Render_Fixed(examples[i].value, 3, data);
+      Decode(data, text);
+      CHECK(strcmp(text, examples[i].text) == 0, "%d thousandths: \"%s\", expected \"%s\"",
+            examples[i].value, text, examples[i].text);
+  }
+
+  // too many decimals is an error, and leaves the bytes alone
+  uint8_t data[2] = { 0x12, 0x34 };
+  CHECK(Seven_Seg_Render_Fixed(1, SEVEN_SEG_MAX_DECIMALS + 1, data) == HAL_ERROR &&
+        data[0] == 0x12 && data[1] == 0x34, "decimals out of range");
+}
+
+static void Test_Range(void) {
+  for (uint8_t decimals = 0; decimals <= SEVEN_SEG_MAX_DECIMALS; decimals++) {
+      uint32_t errors = 0;
+      for (int32_t value = -SPAN; value <= SPAN; value++) {
+          errors += !Fixed_OK(value, decimals);
+          if (errors > 10) {
+              break;
+          }
+      }
+
+      srand(decimals);
+      errors += !Fixed_OK(INT32_MIN, decimals) + !Fixed_OK(INT32_MAX, decimals);
+      for (uint32_t i = 0; i < NUM_RANDOM && errors <= 10; i++) {
+          int32_t value = (int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand() << 1 ^ (uint32_t)rand());
+          errors += !Fixed_OK(value, decimals);
+      }
+      CHECK(errors == 0, "%u decimals: %u values rendered wrong", decimals, errors);
+  }
+}
+
+static void Test_Decimal(void) {
+  // the examples of seven_seg.h, and the ends of the ranges
+  static const struct { float val; const char *text; } examples[] = {
+      { 3.5f, "3.5" }, { 59.0f, "59" }, { -5.0f, "-5" }, { 3.46f, "3.5" }, { 59.5f, "60" },
+      { 1234.0f, "1.2." }, { 56789.0f, "57." }, { -0.5f, "-.5" }, { -9.5f, "--" },
+      { 99499.0f, "99." }, { 99500.0f, "--" }, { 0.0f, "0.0" }, { -0.04f, "0.0" },
+      { 9.94f, "9.9" }, { 9.96f, "10" }, { -0.96f, "-1" }, { 0.049999997f, "0.0" },
+      { NAN, "--" }, { INFINITY, "--" }, { -INFINITY, "--" },
+  };
+  for (uint32_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+      uint8_t data[2];
+      char text[8];
+      Seven_Seg_Render_Decimal(examples[i].val, data);
+      Decode(data, text);
+      CHECK(strcmp(text, examples[i].text) == 0, "%.9g: \"%s\", expected \"%s\"",
+            examples[i].val, text, examples[i].text);
+  }
+
+  // every float within 64 steps of each rounding boundary: the tenths and
+  // units below 100, and the hundreds and thousands above
+  uint32_t errors = 0;
+  for (int32_t half = -199; half <= 2201; half += 2) {
+      double boundaries[4] = { half / 20.0, half / 2.0, half * 50.0, half * 500.0 };
+      for (uint8_t b = 0; b < 4; b++) {
+          if (boundaries[b] < -11 || boundaries[b] > 110000) {
+              continue;
+          }
+          float val = (float)boundaries[b];
+          for (uint8_t step = 0; step < 64; step++) {
+              val = nextafterf(val, -INFINITY);
+          }
+          for (uint8_t step = 0; step < 128 && errors <= 10; step++) {
+              errors += !Decimal_OK(val);
+              val = nextafterf(val, INFINITY);
+          }
+      }
+  }
+
+  // random values across and beyond the range
+  srand(7);
+  for (uint32_t i = 0; i < NUM_RANDOM && errors <= 10; i++) {
+      float val = (float)rand() / RAND_MAX * 110020.0f - 20.0f;
+      errors += !Decimal_OK((i % 2) ? val : val / 1000.0f);
+  }
+  CHECK(errors == 0, "%u floats rendered wrong", errors);
+  printf("decimal: %u results differ from rounding the exact value\n", product_rounded);
+}
+
+int main(void) {
+  Load_Glyphs();
+  Test_Examples();
+  Test_Range();
+  Test_Decimal();
+  return CHECK_DONE();
+}
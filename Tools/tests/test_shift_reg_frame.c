@@ -0,0 +1,200 @@
+/*
+ * test_shift_reg_frame.c
+ *
+ * Checks the frame buffer of shift_reg_frame.h: that Shift_Reg_Frame_Flush
+ * writes the image exactly when it differs from the last write, that owners
+ * only change their own outputs, and that a failed write is retried.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * Shift_Reg_Write is replaced by a stub which records each write, so the
+ * test sees exactly what the frame sends, and can make a write fail. After
+ * the fixed cases, random setter calls are checked against a model image.
+ */
+
+#include "shift_reg_frame.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_REGS 4
+
+static uint32_t writes;
+static uint8_t written[SHIFT_REG_MAX_REGS];
+static uint8_t written_length;
+static HAL_StatusTypeDef write_status = HAL_OK;
+
+HAL_StatusTypeDef Shift_Reg_Write(Shift_Reg *shift_reg, uint8_t* data, uint8_t data_length) {
+  if (write_status != HAL_OK) {
+      return write_status;
+  }
+  writes++;
+  memcpy(written, data, data_length);
+  written_length = data_length;
+  return HAL_OK;
+}
+
+/**
+ * @retval 1 if the last write was exactly the given bytes
+ */
+static uint8_t Written(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
+  const uint8_t expected[NUM_REGS] = { b0, b1, b2, b3 };
+  return written_length == NUM_REGS && memcmp(written, expected, NUM_REGS) == 0;
+}
+
+static void Test_Flush(Shift_Reg_Frame *frame) {
+  // the first flush writes every output off, even untouched
+  CHECK(Shift_Reg_Frame_Flush(frame) == HAL_OK && writes == 1, "first flush: %u writes", writes);
+  CHECK(Written(0, 0, 0, 0), "first flush data");
+  CHECK(Shift_Reg_Frame_Flush(frame) == HAL_OK && writes == 1, "clean flush wrote");
+
+  // output n is bit n % 8 of byte n / 8
+  CHECK(Shift_Reg_Frame_Set_Bit(frame, 0, 1) == HAL_OK, "set bit 0");
+  CHECK(Shift_Reg_Frame_Set_Bit(frame, 13, 1) == HAL_OK, "set bit 13");
+  CHECK(Shift_Reg_Frame_Set_Bit(frame, 31, 1) == HAL_OK, "set bit 31");
+  Shift_Reg_Frame_Flush(frame);
+  CHECK(writes == 2 && Written(0x01, 0x20, 0x00, 0x80), "set bits: %u writes, %02X %02X %02X %02X",
+        writes, written[0], written[1], written[2], written[3]);
+
+  // setting an output to what it already is leaves the frame clean
+  Shift_Reg_Frame_Set_Bit(frame, 13, 1);
+  Shift_Reg_Frame_Set_Byte(frame, 2, 0x00);
+  CHECK(!frame->dirty, "unchanged outputs made the frame dirty");
+
+  // changed, then changed back before the flush: nothing to write
+  Shift_Reg_Frame_Set_Bit(frame, 5, 1);
+  Shift_Reg_Frame_Set_Bit(frame, 5, 0);
+  CHECK(frame->dirty, "changed output left the frame clean");
+  Shift_Reg_Frame_Flush(frame);
+  CHECK(writes == 2 && !frame->dirty, "reverted change wrote");
+
+  Shift_Reg_Frame_Set_Byte(frame, 2, 0x5A);
+  Shift_Reg_Frame_Flush(frame);
+  CHECK(writes == 3 && Written(0x01, 0x20, 0x5A, 0x80), "set byte");
+
+  // outside the cascade
+  CHECK(Shift_Reg_Frame_Set_Bit(frame, 8 * NUM_REGS, 1) == HAL_ERROR, "bit outside the cascade");
+  CHECK(Shift_Reg_Frame_Set_Byte(frame, NUM_REGS, 0xFF) == HAL_ERROR, "byte outside the cascade");
+  // 2048 / 8 is 256, which would wrap to register 0 in a byte
+  CHECK(Shift_Reg_Frame_Set_Bit(frame, 2048, 1) == HAL_ERROR, "bit 2048");
+  CHECK(Shift_Reg_Frame_Set_Bit(frame, 2048 + 8 + 7, 1) == HAL_ERROR, "bit 2063");
+  CHECK(!frame->dirty && frame->image[0] == 0x01 && frame->image[1] == 0x20,
+        "out of range bit changed the image");
+
+  // a failed write keeps the frame dirty, and the next flush retries it
+  Shift_Reg_Frame_Set_Byte(frame, 0, 0xF0);
+  write_status = HAL_ERROR;
+  CHECK(Shift_Reg_Frame_Flush(frame) == HAL_ERROR, "failed write not reported");
+  CHECK(frame->dirty && writes == 3, "failed write: dirty %u, %u writes", frame->dirty, writes);
+  write_status = HAL_OK;
+  CHECK(Shift_Reg_Frame_Flush(frame) == HAL_OK && writes == 4, "retry: %u writes", writes);
+  CHECK(Written(0xF0, 0x20, 0x5A, 0x80), "retried data");
+}
+
+static void Test_Owners(Shift_Reg_Frame *frame) {
+  const uint8_t lights_mask[NUM_REGS]   = { 0xFF, 0x00, 0x00, 0x00 };
+  const uint8_t warnings_mask[NUM_REGS] = { 0x00, 0x0F, 0x00, 0x81 };
+  const uint8_t overlap_mask[NUM_REGS]  = { 0x00, 0x18, 0x00, 0x00 };
+
+  int8_t lights = Shift_Reg_Frame_Add_Owner(frame, lights_mask);
+  int8_t warnings = Shift_Reg_Frame_Add_Owner(frame, warnings_mask);
+  CHECK(lights == 0 && warnings == 1, "owners %d %d", lights, warnings);
+  CHECK(Shift_Reg_Frame_Add_Owner(frame, overlap_mask) == -1, "overlapping owner added");
+
+  Shift_Reg_Frame_Flush(frame);
+  uint32_t start = writes;
+
+  // every bit of values is given, but only the owner's are used
+  const uint8_t all_on[NUM_REGS] = { 0xFF, 0xFF, 0xFF, 0xFF };
+  const uint8_t all_off[NUM_REGS] = { 0 };
+  CHECK(Shift_Reg_Frame_Write_Owner(frame, warnings, all_on) == HAL_OK, "write warnings");
+  Shift_Reg_Frame_Flush(frame);
+  CHECK(writes == start + 1 && Written(0x00, 0x0F, 0x00, 0x81), "warnings on: %02X %02X %02X %02X",
+        written[0], written[1], written[2], written[3]);
+
+  Shift_Reg_Frame_Write_Owner(frame, lights, all_on);
+  Shift_Reg_Frame_Write_Owner(frame, warnings, all_off);
+  Shift_Reg_Frame_Flush(frame);
+  CHECK(writes == start + 2 && Written(0xFF, 0x00, 0x00, 0x00), "lights on, warnings off");
+
+  // the same values again
+  Shift_Reg_Frame_Write_Owner(frame, lights, all_on);
+  Shift_Reg_Frame_Write_Owner(frame, warnings, all_off);
+  CHECK(!frame->dirty, "repeated owner values made the frame dirty");
+
+  CHECK(Shift_Reg_Frame_Write_Owner(frame, 2, all_on) == HAL_ERROR, "unknown owner");
+  CHECK(Shift_Reg_Frame_Write_Owner(frame, -1, all_on) == HAL_ERROR, "owner -1");
+
+  // up to SHIFT_REG_FRAME_MAX_OWNERS
+  uint8_t num_owners = 2;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+      uint8_t mask[NUM_REGS] = { 0x00, 0x00, (uint8_t)(1 << bit), 0x00 };
+      num_owners += (Shift_Reg_Frame_Add_Owner(frame, mask) >= 0);
+  }
+  CHECK(num_owners == SHIFT_REG_FRAME_MAX_OWNERS, "%u owners", num_owners);
+}
+
+static void Test_Random(Shift_Reg_Frame *frame) {
+  uint8_t model[NUM_REGS], last[NUM_REGS];
+  uint32_t errors = 0, expected_writes = 0;
+
+  // start with every output off, written
+  for (uint8_t index = 0; index < NUM_REGS; index++) {
+      Shift_Reg_Frame_Set_Byte(frame, index, 0);
+  }
+  Shift_Reg_Frame_Flush(frame);
+  memset(model, 0, NUM_REGS);
+  memset(last, 0, NUM_REGS);
+  writes = 0;
+
+  srand(1);
+  for (uint32_t step = 0; step < 100000; step++) {
+      uint8_t index = rand() % NUM_REGS;
+      if (rand() % 2) {
+          uint16_t bit = rand() % (8 * NUM_REGS);
+          uint8_t value = rand() % 2;
+          Shift_Reg_Frame_Set_Bit(frame, bit, value);
+          model[bit / 8] = value ? (model[bit / 8] | 1 << (bit % 8)) : (model[bit / 8] & ~(1 << (bit % 8)));
+      }
+      else {
+          // few distinct values, so bytes are often set to what they are
+          uint8_t value = rand() % 4;
+          Shift_Reg_Frame_Set_Byte(frame, index, value);
+          model[index] = value;
+      }
+
+      if (rand() % 4 == 0) {
+          Shift_Reg_Frame_Flush(frame);
+          if (memcmp(model, last, NUM_REGS) != 0) {
+              expected_writes++;
+              memcpy(last, model, NUM_REGS);
+          }
+          errors += (memcmp(written, model, NUM_REGS) != 0);
+      }
+  }
+  CHECK(errors == 0, "%u flushes wrote other than the image", errors);
+  CHECK(writes == expected_writes, "%u writes, expected %u", writes, expected_writes);
+}
+
+int main(void) {
+  static Shift_Reg shift_reg;
+
+  CHECK(Shift_Reg_Frame_Init(NULL, NUM_REGS) == NULL, "init without a shift register");
+  CHECK(Shift_Reg_Frame_Init(&shift_reg, 0) == NULL, "init with no registers");
+  CHECK(Shift_Reg_Frame_Init(&shift_reg, SHIFT_REG_MAX_REGS + 1) == NULL, "init too long");
+
+  Shift_Reg_Frame *frame = Shift_Reg_Frame_Init(&shift_reg, NUM_REGS);
+  Shift_Reg_Frame *owned = Shift_Reg_Frame_Init(&shift_reg, NUM_REGS);
+  CHECK(frame != NULL && owned != NULL, "init");
+  CHECK(Shift_Reg_Frame_Init(&shift_reg, NUM_REGS) == NULL, "more than SHIFT_REG_FRAME_MAX_FRAMES");
+  if (frame == NULL || owned == NULL) {
+      return CHECK_DONE();
+  }
+
+  Test_Flush(frame);
+  Test_Owners(owned);
+  Test_Random(frame);
+
+  return CHECK_DONE();
+}
@@ -0,0 +1,201 @@
+/*
+ * test_shift_reg_gpio_it.c
+ *
+ * Checks the waveform of the GPIO_IT shift register mode: one bit per timer
+ * tick, most significant first, STCP latched one tick after the last bit,
+ * and the double buffer of Shift_Reg_Write while a write is being sent.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * SHCP, STCP and DATA are on ports of their own, ordinary structs, and each
+ * tick is a call of the callback Shift_Reg_GPIO_IT_Init registered with the
+ * timer. Before a tick the BSRRs are cleared, so afterwards they hold the
+ * last word stored: SHCP_Set if the tick clocked a bit in, and the bit's
+ * DATA word. The stores within one tick cannot be told apart this way; the
+ * shared port test checks instead that the one DATA store pulls SHCP low.
+ */
+
+#include "shift_reg.h"
+#include "check.h"
+#include "host_hal.h"
+#include <string.h>
+
+#define SHCP_PIN GPIO_PIN_3
+#define STCP_PIN GPIO_PIN_4
+#define DATA_PIN GPIO_PIN_5
+#define NUM_REGS 4
+
+typedef struct {
+  uint32_t ticks;       // ticks until the latch
+  uint32_t num_bits;    // bits clocked in
+  uint8_t bytes[2 * NUM_REGS];
+  uint8_t stcp_high;    // STCP went high before the last bit was clocked in
+  uint8_t bad_data;     // a clocked bit had no valid DATA word
+} Waveform;
+
+static GPIO_TypeDef shcp_port, stcp_port, data_port;
+static TIM_TypeDef tim;
+static TIM_HandleTypeDef htim;
+
+static uint32_t completions;
+static uint8_t stcp_at_completion;
+
+static void Write_Complete(Shift_Reg *shift_reg) {
+  completions++;
+  stcp_at_completion = (stcp_port.ODR & STCP_PIN) != 0;
+}
+
+/**
+ * Ticks the timer until a write is latched (or the timer stops), decoding
+ * the bits clocked in.
+ *
+ * @param max_ticks  ticks after which to give up, if the timer never stops
+ */
+static void Run(Waveform *wave, uint32_t max_ticks) {
+  uint32_t start_completions = completions;
+  memset(wave, 0, sizeof(Waveform));
+  while (htim.State == HAL_TIM_STATE_BUSY && completions == start_completions &&
+         wave->ticks < max_ticks) {
+      shcp_port.BSRR = 0;
+      data_port.BSRR = 0;
+      htim.PeriodElapsedCallback(&htim);
+      wave->ticks++;
+
+      if (shcp_port.BSRR != SHCP_PIN) {
+          continue;
+      }
+      wave->stcp_high |= (stcp_port.ODR & STCP_PIN) != 0;
+      uint8_t bit = (data_port.BSRR == DATA_PIN);
+      wave->bad_data |= (data_port.BSRR != DATA_PIN && data_port.BSRR != (uint32_t)DATA_PIN << 16);
+      if (wave->num_bits < 8 * sizeof(wave->bytes)) {
+          wave->bytes[wave->num_bits / 8] |= bit << (7 - wave->num_bits % 8);
+      }
+      wave->num_bits++;
+  }
+}
+
+static void Test_Waveform(Shift_Reg *shift_reg) {
+  uint8_t data[3] = { 0xA5, 0x3C, 0x81 };
+  Waveform wave;
+
+  // the timer counts at 1 MHz, and elapses once a bit
+  CHECK(htim.Init.Prescaler == 71 && htim.Init.Period == 9, "prescaler %u, period %u",
+        (unsigned)htim.Init.Prescaler, (unsigned)htim.Init.Period);
+
+  stcp_port.ODR = STCP_PIN;
+  CHECK(Shift_Reg_Write(shift_reg, data, 3) == HAL_OK, "write");
+  CHECK(htim.State == HAL_TIM_STATE_BUSY, "timer not started");
+  CHECK((stcp_port.ODR & STCP_PIN) == 0, "STCP not pulled low before the first bit");
+  data[0] = 0;   // the data was copied, so the caller may reuse its array
+
+  // every bit on its own tick, then a tick to latch them
+  Run(&wave, 100);
+  CHECK(wave.ticks == 3 * 8 + 1, "%u ticks", wave.ticks);
+  CHECK(wave.num_bits == 3 * 8, "%u bits", wave.num_bits);
+  CHECK(!wave.bad_data, "bit without a DATA word");
+  CHECK(wave.bytes[0] == 0xA5 && wave.bytes[1] == 0x3C && wave.bytes[2] == 0x81,
+        "shifted out %02X %02X %02X", wave.bytes[0], wave.bytes[1], wave.bytes[2]);
+  CHECK(!wave.stcp_high, "STCP high before the last bit");
+  CHECK((stcp_port.ODR & STCP_PIN) != 0, "STCP not latched");
+  CHECK(completions == 1 && stcp_at_completion, "completed %u times, STCP %u",
+        completions, stcp_at_completion);
+
+  // too many bytes for the cascade
+  uint8_t large[NUM_REGS + 1] = { 0 };
+  CHECK(Shift_Reg_Write(shift_reg, large, NUM_REGS + 1) == HAL_ERROR, "oversized write");
+  CHECK(htim.State == HAL_TIM_STATE_READY, "oversized write started");
+}
+
+static void Test_Double_Buffer(Shift_Reg *shift_reg) {
+  uint8_t first[2] = { 0x12, 0x34 };
+  uint8_t second[1] = { 0xFF };
+  uint8_t third[2] = { 0xC3, 0x5A };
+  Waveform wave;
+
+  completions = 0;
+  CHECK(Shift_Reg_Write(shift_reg, first, 2) == HAL_OK, "first write");
+  for (uint8_t i = 0; i < 5; i++) {
+      htim.PeriodElapsedCallback(&htim);
+  }
+
+  // while the first is being sent, each write replaces the pending one
+  CHECK(Shift_Reg_Write(shift_reg, second, 1) == HAL_OK, "second write");
+  CHECK(Shift_Reg_Write(shift_reg, third, 2) == HAL_OK, "third write");
+  CHECK(shift_reg->pending_length == 2, "pending %u bytes", shift_reg->pending_length);
+  memset(third, 0, sizeof(third));
+
+  // the rest of the first write, then its latch starts the third
+  Run(&wave, 100);
+  CHECK(wave.ticks == 2 * 8 - 5 + 1, "first write: %u more ticks", wave.ticks);
+  CHECK(completions == 1, "first write completed %u times", completions);
+  CHECK(htim.State == HAL_TIM_STATE_BUSY, "third write not started on the latch");
+  CHECK((stcp_port.ODR & STCP_PIN) == 0, "STCP not pulled low for the third write");
+
+  Run(&wave, 100);
+  CHECK(wave.ticks == 2 * 8 + 1 && wave.num_bits == 2 * 8, "third write: %u ticks, %u bits",
+        wave.ticks, wave.num_bits);
+  CHECK(wave.bytes[0] == 0xC3 && wave.bytes[1] == 0x5A, "shifted out %02X %02X",
+        wave.bytes[0], wave.bytes[1]);
+  CHECK(!wave.stcp_high, "STCP high before the last bit");
+  CHECK(completions == 2, "completed %u times", completions);
+  CHECK(shift_reg->pending_length == 0 && htim.State == HAL_TIM_STATE_READY, "still sending");
+
+  // a tick of another timer is not this shift register's
+  static TIM_HandleTypeDef other;
+  shcp_port.BSRR = 0;
+  htim.PeriodElapsedCallback(&other);
+  CHECK(shcp_port.BSRR == 0 && completions == 2, "ticked by another timer");
+}
+
+static void Test_Shared_Port(void) {
+  static TIM_TypeDef shared_tim;
+  static TIM_HandleTypeDef shared_htim = { .Instance = &shared_tim };
+  static GPIO_TypeDef port;
+
+  Shift_Reg *shift_reg = Shift_Reg_GPIO_IT_Init(&shared_htim, 10, &port, SHCP_PIN, &stcp_port, STCP_PIN,
+                                                &port, DATA_PIN, 1);
+  CHECK(shift_reg != NULL, "shared port init");
+  if (shift_reg == NULL) {
+      return;
+  }
+
+  // SHCP goes low in the same store as DATA, and high in the next
+  uint32_t shcp_reset = (uint32_t)SHCP_PIN << 16;
+  CHECK(shift_reg->Shared_Port, "port not shared");
+  CHECK(shift_reg->DATA_BSRR[0] == (((uint32_t)DATA_PIN << 16) | shcp_reset) &&
+        shift_reg->DATA_BSRR[1] == (DATA_PIN | shcp_reset),
+        "DATA words %08X %08X", shift_reg->DATA_BSRR[0], shift_reg->DATA_BSRR[1]);
+
+  uint8_t data = 0x96;
+  uint32_t ticks = 0, clocked = 0;
+  Shift_Reg_Write(shift_reg, &data, 1);
+  while (shared_htim.State == HAL_TIM_STATE_BUSY && ticks < 100) {
+      port.BSRR = 0;
+      shared_htim.PeriodElapsedCallback(&shared_htim);
+      clocked += (port.BSRR == SHCP_PIN);
+      ticks++;
+  }
+  CHECK(ticks == 9 && clocked == 8, "%u ticks, %u bits", ticks, clocked);
+}
+
+int main(void) {
+  // APB1 at half the core clock, as on the car, so every timer counts at
+  // 72 MHz whichever bus the address of tim happens to fall on
+  host_rcc.CFGR = RCC_CFGR_PPRE1_DIV2;
+  htim.Instance = &tim;
+  Shift_Reg *shift_reg = Shift_Reg_GPIO_IT_Init(&htim, 10, &shcp_port, SHCP_PIN, &stcp_port, STCP_PIN,
+                                                &data_port, DATA_PIN, NUM_REGS);
+  CHECK(shift_reg != NULL, "init");
+  if (shift_reg == NULL) {
+      return CHECK_DONE();
+  }
+  CHECK(htim.PeriodElapsedCallback != NULL, "no tick callback registered");
+  Shift_Reg_Register_Complete_Callback(shift_reg, Write_Complete);
+
+  Test_Waveform(shift_reg);
+  Test_Double_Buffer(shift_reg);
+  Test_Shared_Port();
+
+  return CHECK_DONE();
+}
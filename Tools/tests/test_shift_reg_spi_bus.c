@@ -0,0 +1,126 @@
+/*
+ * test_shift_reg_spi_bus.c
+ *
+ * Checks two SPI_DMA shift registers sharing one SPI bus: each transfer
+ * latches the STCP of its own shift register, queued transfers start from
+ * the transfer complete interrupt of the one before, back to back, and
+ * writes to a shift register which is already queued replace its data
+ * ("latest wins") without queueing it again.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * The two STCP pins are on ports of their own, ordinary structs, so a
+ * shift register is latched when its port's ODR goes high. Transfers are
+ * completed with Host_SPI_Complete, as the DMA would.
+ */
+
+#include "shift_reg.h"
+#include "check.h"
+#include "host_hal.h"
+#include <string.h>
+
+#define STCP_PIN GPIO_PIN_4
+#define NUM_REGS 2
+
+static SPI_TypeDef spi = { .CR1 = SPI_CR1_MSTR | SPI_CR1_SSM };
+static DMA_HandleTypeDef hdma_spi_tx;
+static SPI_HandleTypeDef hspi = { .Instance = &spi, .hdmatx = &hdma_spi_tx, .State = HAL_SPI_STATE_READY };
+static GPIO_TypeDef stcp_a, stcp_b;
+
+static Shift_Reg *shift_reg_a, *shift_reg_b;
+
+// the shift registers latched, in order
+static Shift_Reg *completions[16];
+static uint32_t num_completions;
+
+static void Write_Complete(Shift_Reg *shift_reg) {
+  if (num_completions < 16) {
+      completions[num_completions] = shift_reg;
+  }
+  num_completions++;
+}
+
+static uint8_t High(GPIO_TypeDef *port) {
+  return (port->ODR & STCP_PIN) != 0;
+}
+
+// the transfer in flight is of these bytes
+static uint8_t Sending(uint8_t first, uint8_t second) {
+  return host_spi.size == NUM_REGS && host_spi.tx[0] == first && host_spi.tx[1] == second;
+}
+
+int main(void) {
+  shift_reg_a = Shift_Reg_SPI_DMA_Init(&hspi, &stcp_a, STCP_PIN, NUM_REGS);
+  shift_reg_b = Shift_Reg_SPI_DMA_Init(&hspi, &stcp_b, STCP_PIN, NUM_REGS);
+  CHECK(shift_reg_a != NULL && shift_reg_b != NULL, "init");
+  Shift_Reg_Register_Complete_Callback(shift_reg_a, Write_Complete);
+  Shift_Reg_Register_Complete_Callback(shift_reg_b, Write_Complete);
+  stcp_a.ODR = STCP_PIN;
+  stcp_b.ODR = STCP_PIN;
+
+  // an idle bus starts the write straight away, with only its own STCP low
+  uint8_t a1[NUM_REGS] = { 0xA1, 0xA1 };
+  CHECK(Shift_Reg_Write(shift_reg_a, a1, NUM_REGS) == HAL_OK, "write A");
+  CHECK(host_spi.transfers == 1 && Sending(0xA1, 0xA1), "A not started");
+  CHECK(!High(&stcp_a) && High(&stcp_b), "STCP A %u, B %u", High(&stcp_a), High(&stcp_b));
+
+  // while A is sent, B waits, then A again behind it; B's later writes
+  // replace its data in the queue
+  uint8_t b1[NUM_REGS] = { 0xB1, 0xB1 };
+  uint8_t a2[NUM_REGS] = { 0xA2, 0xA2 };
+  uint8_t b2[NUM_REGS] = { 0xB2, 0xB2 };
+  uint8_t b3[NUM_REGS] = { 0xB3, 0xB3 };
+  CHECK(Shift_Reg_Write(shift_reg_b, b1, NUM_REGS) == HAL_OK, "write B");
+  CHECK(Shift_Reg_Write(shift_reg_a, a2, NUM_REGS) == HAL_OK, "write A again");
+  CHECK(Shift_Reg_Write(shift_reg_b, b2, NUM_REGS) == HAL_OK, "write B again");
+  b1[0] = b2[0] = 0;  // copied, so the arrays may be reused straight away
+  CHECK(Shift_Reg_Write(shift_reg_b, b3, NUM_REGS) == HAL_OK, "write B a third time");
+  CHECK(host_spi.transfers == 1 && Sending(0xA1, 0xA1), "busy bus started a transfer");
+  CHECK(num_completions == 0 && High(&stcp_b), "B touched while queued");
+
+  // A's interrupt latches A, then starts B's latest write, leaving A high
+  Host_SPI_Complete(&hspi);
+  CHECK(num_completions == 1 && completions[0] == shift_reg_a, "A not latched first");
+  CHECK(host_spi.transfers == 2 && Sending(0xB3, 0xB3), "B's latest write not started");
+  CHECK(High(&stcp_a) && !High(&stcp_b), "STCP A %u, B %u", High(&stcp_a), High(&stcp_b));
+
+  // B's interrupt latches B, then starts A's second write
+  Host_SPI_Complete(&hspi);
+  CHECK(num_completions == 2 && completions[1] == shift_reg_b, "B not latched second");
+  CHECK(host_spi.transfers == 3 && Sending(0xA2, 0xA2), "A's second write not started");
+  CHECK(!High(&stcp_a) && High(&stcp_b), "STCP A %u, B %u", High(&stcp_a), High(&stcp_b));
+
+  // the last one leaves the bus idle, with both latched
+  Host_SPI_Complete(&hspi);
+  CHECK(num_completions == 3 && completions[2] == shift_reg_a, "A not latched last");
+  CHECK(host_spi.transfers == 3 && hspi.State == HAL_SPI_STATE_READY, "bus not idle");
+  CHECK(High(&stcp_a) && High(&stcp_b), "STCP A %u, B %u", High(&stcp_a), High(&stcp_b));
+
+  // every STCP rise is of the shift register whose transfer just completed:
+  // the log holds low (start), then high (latch) for A, B, A
+  GPIO_TypeDef *expected[3] = { &stcp_a, &stcp_b, &stcp_a };
+  uint32_t transfer = 0;
+  for (uint32_t index = 0; index < host_gpio_count && index < HOST_GPIO_LOG_SIZE; index++) {
+      Host_GPIO_Write *write = &host_gpio_log[index];
+      if (write->state == GPIO_PIN_SET) {
+          CHECK(transfer < 3 && write->port == expected[transfer], "transfer %u latched the wrong STCP",
+                (unsigned)transfer);
+          transfer++;
+      }
+  }
+  CHECK(transfer == 3, "%u latches", (unsigned)transfer);
+
+  // a write to the shift register being sent is queued behind it, even
+  // with the bus otherwise idle
+  Host_HAL_Reset();
+  CHECK(Shift_Reg_Write(shift_reg_b, b1, NUM_REGS) == HAL_OK, "write B");
+  CHECK(Shift_Reg_Write(shift_reg_b, b2, NUM_REGS) == HAL_OK, "write B again");
+  CHECK(host_spi.transfers == 1 && Sending(0x00, 0xB1), "B not started");
+  Host_SPI_Complete(&hspi);
+  CHECK(host_spi.transfers == 2 && Sending(0x00, 0xB2), "B's second write not started");
+  Host_SPI_Complete(&hspi);
+  CHECK(num_completions == 5 && hspi.State == HAL_SPI_STATE_READY, "B not latched twice");
+
+  return CHECK_DONE();
+}
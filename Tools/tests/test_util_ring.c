@@ -0,0 +1,181 @@
+/*
+ * test_util_ring.c
+ *
+ * Checks the SPSC ring buffers of util.h (UTIL_RING_DECLARE): every function
+ * at the full, empty and wrap-around edges, then a producer thread against
+ * a consumer thread.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ *
+ * The threads stand in for an interrupt and the main loop. Each side mixes
+ * single, batch and in-place operations, on a small ring so it is full or
+ * empty most of the time, and the consumer checks that every item arrives
+ * exactly once, in order, and whole (a torn item fails its check word).
+ * x86 orders stores more strongly than the M4, so this cannot prove every
+ * __DMB is needed; it does catch index arithmetic and publication bugs.
+ */
+
+#include "util.h"
+#include "check.h"
+#include <pthread.h>
+#include <sched.h>
+
+typedef struct {
+  uint32_t seq;
+  uint32_t check;   // ~seq
+  uint32_t pad[2];  // wider than one store, so tearing shows
+} Item;
+
+UTIL_RING_DECLARE(Test_Ring, Item, 8)
+UTIL_RING_DECLARE(Stress_Ring, Item, 16)
+
+#define NUM_ITEMS 2000000U
+
+static Stress_Ring stress;
+
+static Item Make_Item(uint32_t seq) {
+  return (Item){ seq, ~seq, { seq, seq } };
+}
+
+static uint8_t Item_OK(const Item *item, uint32_t seq) {
+  return item->seq == seq && item->check == ~seq && item->pad[0] == seq && item->pad[1] == seq;
+}
+
+static void Test_Edges(void) {
+  static Test_Ring ring;
+  Item items[12], out[12];
+  for (uint32_t i = 0; i < 12; i++) {
+      items[i] = Make_Item(i);
+  }
+
+  // empty
+  CHECK(Test_Ring_Count(&ring) == 0 && Test_Ring_Free(&ring) == 8, "empty count/free");
+  CHECK(Test_Ring_Peek(&ring) == NULL, "peek on empty");
+  CHECK(Test_Ring_Pop(&ring, &out[0]) == 0, "pop on empty");
+  CHECK(Test_Ring_Pop_Batch(&ring, out, 4) == 0, "pop batch on empty");
+
+  // all size slots are usable
+  for (uint32_t i = 0; i < 8; i++) {
+      CHECK(Test_Ring_Push(&ring, &items[i]), "push %u", i);
+  }
+  CHECK(Test_Ring_Count(&ring) == 8 && Test_Ring_Free(&ring) == 0, "full count/free");
+  CHECK(Test_Ring_Push(&ring, &items[8]) == 0, "push on full");
+  CHECK(Test_Ring_Reserve(&ring) == NULL, "reserve on full");
+  CHECK(Test_Ring_Push_Batch(&ring, items, 4) == 0, "push batch on full");
+
+  // pop part, then a batch which wraps around the end of the buffer
+  CHECK(Test_Ring_Pop_Batch(&ring, out, 5) == 5, "pop batch 5");
+  for (uint32_t i = 0; i < 5; i++) {
+      CHECK(Item_OK(&out[i], i), "pop batch item %u", i);
+  }
+  CHECK(Test_Ring_Push_Batch(&ring, &items[8], 4) == 4, "wrapping push batch");
+  CHECK(Test_Ring_Push_Batch(&ring, items, 4) == 1, "push batch limited to the free slots");
+
+  // in place, across the wrap
+  Item *slot = Test_Ring_Peek(&ring);
+  CHECK(slot != NULL && Item_OK(slot, 5), "peek");
+  Test_Ring_Release(&ring);
+  CHECK(Test_Ring_Pop_Batch(&ring, out, 12) == 7, "wrapping pop batch");
+  for (uint32_t i = 0; i < 6; i++) {
+      CHECK(Item_OK(&out[i], 6 + i), "wrapping pop batch item %u", i);
+  }
+  CHECK(Item_OK(&out[6], 0), "last item");
+
+  slot = Test_Ring_Reserve(&ring);
+  CHECK(slot != NULL, "reserve");
+  *slot = items[3];
+  CHECK(Test_Ring_Count(&ring) == 0, "reserved slot visible before commit");
+  Test_Ring_Commit(&ring);
+  CHECK(Test_Ring_Pop(&ring, &out[0]) && Item_OK(&out[0], 3), "pop committed");
+
+  // the indices run freely, far past the size
+  for (uint32_t i = 0; i < 1000; i++) {
+      Test_Ring_Push(&ring, &items[i % 12]);
+      Test_Ring_Pop(&ring, &out[0]);
+  }
+  CHECK(Test_Ring_Count(&ring) == 0, "count after many laps");
+
+  Test_Ring_Push(&ring, &items[0]);
+  Test_Ring_Reset(&ring);
+  CHECK(Test_Ring_Count(&ring) == 0 && Test_Ring_Free(&ring) == 8, "reset");
+}
+
+static void *Producer(void *arg) {
+  uint32_t seq = 0;
+  Item batch[7];
+
+  while (seq < NUM_ITEMS) {
+      uint32_t pushed = 0;
+      switch (seq % 3) {
+        case 0: {
+          Item item = Make_Item(seq);
+          pushed = Stress_Ring_Push(&stress, &item);
+          break;
+        }
+        case 1: {
+          uint32_t n = 0;
+          for (; n < 7 && seq + n < NUM_ITEMS; n++) {
+              batch[n] = Make_Item(seq + n);
+          }
+          pushed = Stress_Ring_Push_Batch(&stress, batch, n);
+          break;
+        }
+        default: {
+          Item *slot = Stress_Ring_Reserve(&stress);
+          if (slot != NULL) {
+              *slot = Make_Item(seq);
+              Stress_Ring_Commit(&stress);
+              pushed = 1;
+          }
+          break;
+        }
+      }
+      if (pushed == 0) {
+          sched_yield();
+      }
+      seq += pushed;
+  }
+  return NULL;
+}
+
+static void Test_Threads(void) {
+  pthread_t producer;
+  uint32_t expected = 0, errors = 0;
+  Item batch[5];
+
+  pthread_create(&producer, NULL, Producer, NULL);
+
+  while (expected < NUM_ITEMS) {
+      uint32_t popped = 0;
+      if (expected % 2) {
+          const Item *slot = Stress_Ring_Peek(&stress);
+          if (slot != NULL) {
+              errors += !Item_OK(slot, expected);
+              Stress_Ring_Release(&stress);
+              popped = 1;
+          }
+      }
+      else {
+          popped = Stress_Ring_Pop_Batch(&stress, batch, 5);
+          for (uint32_t i = 0; i < popped; i++) {
+              errors += !Item_OK(&batch[i], expected + i);
+          }
+      }
+      if (popped == 0) {
+          sched_yield();
+      }
+      expected += popped;
+  }
+
+  pthread_join(producer, NULL);
+  CHECK(errors == 0, "%u items lost, repeated, reordered or torn", errors);
+  CHECK(Stress_Ring_Count(&stress) == 0, "%u items left over", Stress_Ring_Count(&stress));
+  printf("threads: %u items\n", NUM_ITEMS);
+}
+
+int main(void) {
+  Test_Edges();
+  Test_Threads();
+  return CHECK_DONE();
+}
@@ -0,0 +1,81 @@
+/*
+ * test_util_ring_cpp.cpp
+ *
+ * Checks util.h from C++: that it compiles there (UTIL_RING_DECLARE included,
+ * inside its extern "C"), and that Util_Ring behaves as the C ring does at
+ * the full, empty and wrap-around edges.
+ *
+ *  Created on: May 20, 2024
+ *      Author: Caltech Racing
+ */
+
+#include "util.h"
+#include "check.h"
+
+struct Item {
+  uint32_t seq;
+  uint32_t check;
+};
+
+// the C ring, declared from C++
+UTIL_RING_DECLARE(Item_Ring, Item, 4)
+
+static Item Make_Item(uint32_t seq) {
+  return Item{ seq, ~seq };
+}
+
+static void Test_Template(void) {
+  static Util_Ring<Item, 8> ring;
+  Item items[12], out[12];
+  for (uint32_t i = 0; i < 12; i++) {
+      items[i] = Make_Item(i);
+  }
+
+  CHECK(ring.Count() == 0 && ring.Free() == 8, "empty count/free");
+  CHECK(ring.Peek() == nullptr, "peek on empty");
+  CHECK(!ring.Pop(out[0]), "pop on empty");
+
+  for (uint32_t i = 0; i < 8; i++) {
+      CHECK(ring.Push(items[i]), "push %u", i);
+  }
+  CHECK(!ring.Push(items[8]) && ring.Reserve() == nullptr, "push on full");
+
+  CHECK(ring.Pop_Batch(out, 5) == 5 && out[4].seq == 4, "pop batch");
+  CHECK(ring.Push_Batch(&items[8], 4) == 4, "wrapping push batch");
+  CHECK(ring.Push_Batch(items, 4) == 1, "push batch limited to the free slots");
+
+  Item *slot = ring.Peek();
+  CHECK(slot != nullptr && slot->seq == 5, "peek");
+  ring.Release();
+  CHECK(ring.Pop_Batch(out, 12) == 7, "wrapping pop batch");
+  for (uint32_t i = 0; i < 6; i++) {
+      CHECK(out[i].seq == 6 + i && out[i].check == ~(6 + i), "wrapping pop batch item %u", i);
+  }
+  CHECK(out[6].seq == 0, "last item");
+
+  slot = ring.Reserve();
+  *slot = items[3];
+  ring.Commit();
+  CHECK(ring.Pop(out[0]) && out[0].seq == 3, "reserve/commit");
+
+  ring.Push(items[0]);
+  ring.Reset();
+  CHECK(ring.Count() == 0, "reset");
+}
+
+static void Test_Macro(void) {
+  static Item_Ring ring;
+  Item item = Make_Item(7), out;
+
+  for (uint32_t i = 0; i < 4; i++) {
+      CHECK(Item_Ring_Push(&ring, &item), "push %u", i);
+  }
+  CHECK(!Item_Ring_Push(&ring, &item), "push on full");
+  CHECK(Item_Ring_Pop(&ring, &out) && out.seq == 7, "pop");
+}
+
+int main(void) {
+  Test_Template();
+  Test_Macro();
+  return CHECK_DONE();
+}